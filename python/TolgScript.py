@@ -2,6 +2,7 @@ import sys
 import os
 import numpy as np
 import random
+import tolg
 from importlib.machinery import SourceFileLoader
 
 # Config file 
@@ -147,68 +148,69 @@ def reaper_pitch_analysis():
 
               
                
-def glott_vocoder_analysis():
-    wavscp = conf.datadir + '/scp/wav.scp'
-    with open(wavscp,'r') as wavfiles:
+def write_batch_scp(wavscp, batch_scp):
+    # keep only existing files, the vocoder fails on missing ones
+    with open(wavscp,'r') as wavfiles, open(batch_scp,'w') as batchfiles:
         for file in wavfiles:
             wavfile = file.rstrip()
             if os.path.isfile(wavfile):
-                # define file paths
-                bname = os.path.splitext(os.path.basename(wavfile))[0]
-                f0file = os.path.join(conf.datadir, 'f0', bname + '.f0')
-                gcifile = conf.datadir + '/gci/' + bname + '.GCI'
-                # create temporary analysis config for file 
-                config_user = 'config_user.cfg'
-                conf_file = open(config_user,'w')
-                if conf.do_sptk_pitch_analysis or conf.do_reaper_pitch_analysis:
-                    conf_file.write('USE_EXTERNAL_F0 = true;\n')
-                    conf_file.write('EXTERNAL_F0_FILENAME = \"' + f0file + '\";\n' )
-                else:
-                    conf_file.write('USE_EXTERNAL_F0 = false;\n')
-                if conf.use_external_gci:
-                    conf_file.write('USE_EXTERNAL_GCI = true;\n')
-                    conf_file.write('EXTERNAL_GCI_FILENAME = \"' + gcifile + '\";\n' )
-                conf_file.write('SAMPLING_FREQUENCY = ' + str(conf.sampling_frequency) +';\n')
-                conf_file.write('WARPING_LAMBDA_VT = '+ str(conf.warping_lambda) +';\n')
-                conf_file.write('DATA_DIRECTORY = \"' + conf.datadir + '\";\n')
-                conf_file.write('SAVE_TO_DATADIR_ROOT = false;\n')
-                # force the use of float file format
-                conf_file.write('DATA_TYPE = \"FLOAT\";\n')
-                conf_file.close()
-                # run analysis program
-                cmd = f"export LD_LIBRARY_PATH={os.environ['LD_LIBRARY_PATH']};"
-                cmd += conf.Analysis + ' ' + wavfile + ' ' + conf.config_default + ' ' + config_user
-                # cmd += conf.Analysis + ' ' + wavfile + ' ' + conf.config_default
-
-                os.system(cmd)
-                # remove temporary config
-                os.remove(config_user)
+                batchfiles.write(wavfile + '\n')
+
+def glott_vocoder_analysis():
+    wavscp = conf.datadir + '/scp/wav.scp'
+    batch_scp = 'wav_batch.scp'
+    write_batch_scp(wavscp, batch_scp)
+    # external F0 and GCI paths, "%s" is replaced by the file basename
+    f0file = os.path.join(conf.datadir, 'f0', '%s.f0')
+    gcifile = conf.datadir + '/gci/%s.GCI'
+    # analysis config shared by all files
+    config_user = 'config_user.cfg'
+    conf_file = open(config_user,'w')
+    if conf.do_sptk_pitch_analysis or conf.do_reaper_pitch_analysis:
+        conf_file.write('USE_EXTERNAL_F0 = true;\n')
+        conf_file.write('EXTERNAL_F0_FILENAME = \"' + f0file + '\";\n' )
+    else:
+        conf_file.write('USE_EXTERNAL_F0 = false;\n')
+    if conf.use_external_gci:
+        conf_file.write('USE_EXTERNAL_GCI = true;\n')
+        conf_file.write('EXTERNAL_GCI_FILENAME = \"' + gcifile + '\";\n' )
+    conf_file.write('SAMPLING_FREQUENCY = ' + str(conf.sampling_frequency) +';\n')
+    conf_file.write('WARPING_LAMBDA_VT = '+ str(conf.warping_lambda) +';\n')
+    conf_file.write('DATA_DIRECTORY = \"' + conf.datadir + '\";\n')
+    conf_file.write('SAVE_TO_DATADIR_ROOT = false;\n')
+    # force the use of float file format
+    conf_file.write('DATA_TYPE = \"FLOAT\";\n')
+    conf_file.close()
+    # run analysis program once for the whole list
+    cmd = f"export LD_LIBRARY_PATH={os.environ['LD_LIBRARY_PATH']};"
+    cmd += conf.Analysis + ' --scp ' + batch_scp + ' ' + conf.config_default + ' ' + config_user
+    os.system(cmd)
+    # remove temporary files
+    os.remove(config_user)
+    os.remove(batch_scp)
 
 def glott_vocoder_synthesis():
     wavscp = conf.datadir + '/scp/wav.scp'
-    with open(wavscp,'r') as wavfiles:
-        for f in wavfiles:
-            wavfile = f.rstrip()
-            if os.path.isfile(wavfile):
-                bname = os.path.splitext(os.path.basename(wavfile))[0]
-                f0file = conf.datadir + '/f0/' + bname + '.f0'
-                config_user = 'config_user.cfg'
-                conf_file = open(config_user,'w');
-                conf_file.write('SAMPLING_FREQUENCY = ' + str(conf.sampling_frequency) +';\n')
-                conf_file.write('WARPING_LAMBDA_VT = '+ str(conf.warping_lambda) +';\n')
-                conf_file.write('DATA_DIRECTORY = \"' + conf.datadir + '\";\n')
-                conf_file.write('DATA_TYPE = \"FLOAT\";\n')
-                conf_file.write('SAVE_TO_DATADIR_ROOT = false;\n')
-
-                if conf.use_dnn_generated_excitation:
-                    conf_file.write('EXCITATION_METHOD = \"DNN_GENERATED\";\n')   
-                conf_file.write('DNN_WEIGHT_PATH = \"' + conf.weights_data_dir + '/' + conf.dnn_name + '\";\n')
-                
-                conf_file.close()
-                cmd = f"export LD_LIBRARY_PATH={os.environ['LD_LIBRARY_PATH']};"
-                cmd += conf.Synthesis + ' ' + wavfile + ' ' + conf.config_default + ' ' + config_user
-                #print cmd
-                os.system(cmd)
+    batch_scp = 'wav_batch.scp'
+    write_batch_scp(wavscp, batch_scp)
+    config_user = 'config_user.cfg'
+    conf_file = open(config_user,'w');
+    conf_file.write('SAMPLING_FREQUENCY = ' + str(conf.sampling_frequency) +';\n')
+    conf_file.write('WARPING_LAMBDA_VT = '+ str(conf.warping_lambda) +';\n')
+    conf_file.write('DATA_DIRECTORY = \"' + conf.datadir + '\";\n')
+    conf_file.write('DATA_TYPE = \"FLOAT\";\n')
+    conf_file.write('SAVE_TO_DATADIR_ROOT = false;\n')
+
+    if conf.use_dnn_generated_excitation:
+        conf_file.write('EXCITATION_METHOD = \"DNN_GENERATED\";\n')
+    conf_file.write('DNN_WEIGHT_PATH = \"' + conf.weights_data_dir + '/' + conf.dnn_name + '\";\n')
+
+    conf_file.close()
+    cmd = f"export LD_LIBRARY_PATH={os.environ['LD_LIBRARY_PATH']};"
+    cmd += conf.Synthesis + ' --scp ' + batch_scp + ' ' + conf.config_default + ' ' + config_user
+    os.system(cmd)
+    os.remove(config_user)
+    os.remove(batch_scp)
 
 def package_data():
     # read and shuffle wav filelist
@@ -321,8 +323,12 @@ def package_data():
             for (ftype, ext, dim) in zip(conf.outputs, conf.output_exts, conf.output_dims):
                 if dim > 0:
                     feat_file = conf.datadir + '/' + ftype + '/' + bname + ext
-                    feat = np.fromfile(feat_file, dtype=np.float32, count=-1, sep='')
-                    feat = np.reshape(feat, (-1, dim))
+                    if ftype == 'pls':
+                        # plain or encoded (PULSE_ENCODING)
+                        feat = tolg.read_pulses(feat_file, dim)
+                    else:
+                        feat = np.fromfile(feat_file, dtype=np.float32, count=-1, sep='')
+                        feat = np.reshape(feat, (-1, dim))
 
                     if feat.shape[0] > output_data.shape[0]:
                         print("Error reading " + feat_file)
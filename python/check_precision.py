@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+# Quality report of the float32 synthesis filtering (COMPUTE_PRECISION =
+# "FLOAT") against the double path on the demo corpus.
+#
+# Synthesises each utterance of the demo data with src/Synthesis, once with
+# COMPUTE_PRECISION = "DOUBLE" and once with "FLOAT", to float32 wav files
+# (WAV_FORMAT = "FLOAT", so that 16-bit rounding does not hide the
+# differences), and prints for each utterance and for the whole corpus the
+# max abs difference, the RMS difference, the SNR of the float output
+# against the double output and the log-spectral distance (512-point Hann
+# frames, hop 256). The check fails if the corpus SNR is below --min-snr.
+#
+# usage (from the repository root, or `make check-precision` in src/):
+#   check_precision.py [--synthesis src/Synthesis]
+#       [--config dnn_demo/config_dnn_demo.cfg] [--datadir dnn_demo/data]
+#       [--basenames slt_arctic_a0001 ...]
+#       [--dnn-weights nndata/weights/dnn_demo_slt/dnn_demo_slt]
+#       [--excitation DNN_GENERATED] [--min-snr 60] [--keep]
+
+import argparse
+import os
+import shutil
+import sys
+import tempfile
+
+import numpy as np
+
+from check_streaming import INPUT_FEATURES, input_basenames, missing_features, synthesize
+
+LSD_FRAME = 512
+LSD_HOP = 256
+
+
+def log_spectral_distance(x, ref):
+    # Mean over frames of the RMS difference of the log power spectra (dB),
+    # frames more than 60 dB below the loudest one are skipped
+    if len(ref) < LSD_FRAME:
+        return 0.0
+    window = np.hanning(LSD_FRAME)
+    starts = range(0, len(ref) - LSD_FRAME + 1, LSD_HOP)
+    spec_x = np.array([np.abs(np.fft.rfft(window * x[i:i + LSD_FRAME])) ** 2 for i in starts])
+    spec_ref = np.array([np.abs(np.fft.rfft(window * ref[i:i + LSD_FRAME])) ** 2 for i in starts])
+    energy = np.sum(spec_ref, axis=1)
+    keep = energy > np.max(energy) * 1e-6
+    floor = np.max(spec_ref) * 1e-12
+    diff = 10.0 * np.log10(spec_x[keep] + floor) - 10.0 * np.log10(spec_ref[keep] + floor)
+    return float(np.mean(np.sqrt(np.mean(diff ** 2, axis=1))))
+
+
+def snr_db(signal_energy, error_energy):
+    if error_energy == 0.0:
+        return float('inf')
+    return 10.0 * np.log10(signal_energy / error_energy)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compare float32 and double synthesis filtering')
+    parser.add_argument('--synthesis', default='src/Synthesis')
+    parser.add_argument('--config', default='dnn_demo/config_dnn_demo.cfg')
+    parser.add_argument('--datadir', default='dnn_demo/data')
+    parser.add_argument('--basenames', nargs='+',
+                        help='utterances (default: all with features in --datadir)')
+    parser.add_argument('--dnn-weights', default='nndata/weights/dnn_demo_slt/dnn_demo_slt')
+    parser.add_argument('--excitation', default='DNN_GENERATED')
+    parser.add_argument('--min-snr', type=float, default=60.0,
+                        help='minimum corpus SNR in dB')
+    parser.add_argument('--keep', action='store_true',
+                        help='keep the configurations and wav files')
+    args = parser.parse_args()
+    args.excitation_method = args.excitation
+
+    workdir = tempfile.mkdtemp(prefix='tolg_precision_')
+    failures = 0
+    signal_energy = 0.0
+    error_energy = 0.0
+    max_diff = 0.0
+    lsd = []
+    try:
+        basenames = args.basenames or input_basenames(args.datadir)
+        if not basenames:
+            raise IOError('no utterances with %s features in %s'
+                          % (', '.join(INPUT_FEATURES), args.datadir))
+        missing = [f for basename in basenames for f in missing_features(args.datadir, basename)]
+        if missing:
+            raise IOError('missing feature files (run Analysis first): %s' % ' '.join(missing))
+        print('%-20s %12s %12s %9s %9s' % ('utterance', 'max abs', 'rms', 'snr dB', 'lsd dB'))
+        for basename in basenames:
+            args.basename = basename
+            ref, fs = synthesize(args, workdir, basename + '_double',
+                                 {'COMPUTE_PRECISION': '"DOUBLE"'})
+            out, fs_float = synthesize(args, workdir, basename + '_float',
+                                       {'COMPUTE_PRECISION': '"FLOAT"'})
+            if fs_float != fs or len(out) != len(ref):
+                print('FAIL %s: %d samples at %d Hz, double %d at %d Hz'
+                      % (basename, len(out), fs_float, len(ref), fs))
+                failures += 1
+                continue
+            err = out - ref
+            utt_max = float(np.max(np.abs(err))) if len(err) else 0.0
+            utt_lsd = log_spectral_distance(out, ref)
+            print('%-20s %12.3g %12.3g %9.1f %9.4f'
+                  % (basename, utt_max,
+                     np.sqrt(np.mean(err ** 2)) if len(err) else 0.0,
+                     snr_db(np.sum(ref ** 2), np.sum(err ** 2)), utt_lsd))
+            signal_energy += np.sum(ref ** 2)
+            error_energy += np.sum(err ** 2)
+            max_diff = max(max_diff, utt_max)
+            lsd.append(utt_lsd)
+        corpus_snr = snr_db(signal_energy, error_energy)
+        print('%-20s %12.3g %12s %9.1f %9.4f'
+              % ('corpus', max_diff, '', corpus_snr, np.mean(lsd) if lsd else 0.0))
+        if corpus_snr < args.min_snr:
+            print('FAIL corpus SNR %.1f dB is below %.1f dB' % (corpus_snr, args.min_snr))
+            failures += 1
+    except (RuntimeError, IOError) as err:
+        print('Error: %s' % err)
+        failures += 1
+    finally:
+        if args.keep:
+            print('outputs kept in %s' % workdir)
+        else:
+            shutil.rmtree(workdir, ignore_errors=True)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+# Check of the streaming synthesis (STREAMING_SYNTHESIS) against the
+# whole-utterance synthesis.
+#
+# Synthesises one utterance of the demo data (by default the first one in
+# --datadir that has every feature stream the synthesis reads: f0, gain,
+# lsf, slsf and hnr) with src/Synthesis, once offline and once streamed for
+# each STREAM_BLOCK_FRAMES, writes float32 wav files (WAV_FORMAT = "FLOAT",
+# so that 16-bit rounding does not hide or cause differences) and compares
+# the samples. The streaming synthesis is
+# meant to give the same signal; only the summation order of the overlap-add
+# may differ, so the check fails if any sample differs by more than
+# --tolerance (default 1e-5, about -100 dBFS) or if the lengths differ.
+#
+# usage (from the repository root, or `make check-streaming` in src/):
+#   check_streaming.py [--synthesis src/Synthesis]
+#       [--config dnn_demo/config_dnn_demo.cfg] [--datadir dnn_demo/data]
+#       [--basename slt_arctic_a0001]
+#       [--dnn-weights nndata/weights/dnn_demo_slt/dnn_demo_slt]
+#       [--excitation DNN_GENERATED] [--block-frames 1 8]
+#       [--tolerance 1e-5] [--keep]
+
+import argparse
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+import numpy as np
+
+# Feature streams read by the synthesis with the demo configuration, each
+# in datadir/<name>/<basename>.<name>
+INPUT_FEATURES = ('f0', 'gain', 'lsf', 'slsf', 'hnr')
+
+
+def read_wav(fname):
+    # RIFF reader for the PCM16 and float32 files written by the vocoder
+    with open(fname, 'rb') as f:
+        data = f.read()
+    if data[0:4] != b'RIFF' or data[8:12] != b'WAVE':
+        raise IOError('%s: not a wav file' % fname)
+    pos = 12
+    fmt = None
+    while pos + 8 <= len(data):
+        chunk_id = data[pos:pos + 4]
+        size = struct.unpack('<I', data[pos + 4:pos + 8])[0]
+        body = data[pos + 8:pos + 8 + size]
+        if chunk_id == b'fmt ':
+            fmt = struct.unpack('<HHIIHH', body[:16])
+        elif chunk_id == b'data':
+            if fmt is None:
+                raise IOError('%s: data before fmt chunk' % fname)
+            tag, channels, fs, _, _, bits = fmt
+            if tag == 3 and bits == 32:
+                return np.frombuffer(body, dtype='<f4').astype(np.float64), fs
+            if tag == 1 and bits == 16:
+                return np.frombuffer(body, dtype='<i2') / 32768.0, fs
+            raise IOError('%s: unsupported sample format' % fname)
+        pos += 8 + size + (size & 1)
+    raise IOError('%s: no data chunk' % fname)
+
+
+def missing_features(datadir, basename):
+    # INPUT_FEATURES files of basename that are not in datadir
+    files = [os.path.join(datadir, feature, basename + '.' + feature)
+             for feature in INPUT_FEATURES]
+    return [f for f in files if not os.path.isfile(f)]
+
+
+def input_basenames(datadir):
+    # Utterances of datadir that have all the INPUT_FEATURES
+    f0dir = os.path.join(datadir, 'f0')
+    if not os.path.isdir(f0dir):
+        return []
+    names = sorted(os.path.splitext(f)[0] for f in os.listdir(f0dir) if f.endswith('.f0'))
+    return [name for name in names if not missing_features(datadir, name)]
+
+
+def synthesize(args, workdir, name, settings):
+    outdir = os.path.join(workdir, name)
+    os.makedirs(outdir)
+    config_user = os.path.join(workdir, name + '.cfg')
+    settings = dict(settings)
+    settings.update({
+        'DATA_DIRECTORY': '"%s"' % os.path.abspath(args.datadir),
+        'SAVE_TO_DATADIR_ROOT': 'false',
+        'DNN_WEIGHT_PATH': '"%s"' % os.path.abspath(args.dnn_weights),
+        'EXCITATION_METHOD': '"%s"' % args.excitation_method,
+        'WAV_FORMAT': '"FLOAT"',
+        'DIR_SYN': '"%s"' % outdir,
+        'NUM_THREADS': '1',
+    })
+    with open(config_user, 'w') as f:
+        for key in sorted(settings):
+            f.write('%s = %s;\n' % (key, settings[key]))
+    # Synthesis takes only the basename from this path; the wav file itself
+    # is not read (USE_ORIGINAL_EXCITATION is off in the demo configuration)
+    wavfile = os.path.join(os.path.abspath(args.datadir), args.basename + '.wav')
+    cmd = [args.synthesis, wavfile, os.path.abspath(args.config), config_user]
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    if result.returncode != 0:
+        sys.stdout.write(result.stdout.decode(errors='replace'))
+        raise RuntimeError('%s failed' % ' '.join(cmd))
+    return read_wav(os.path.join(outdir, args.basename + '.syn.wav'))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compare streamed and whole-utterance synthesis')
+    parser.add_argument('--synthesis', default='src/Synthesis')
+    parser.add_argument('--config', default='dnn_demo/config_dnn_demo.cfg')
+    parser.add_argument('--datadir', default='dnn_demo/data')
+    parser.add_argument('--basename',
+                        help='utterance (default: the first with features in --datadir)')
+    parser.add_argument('--dnn-weights', default='nndata/weights/dnn_demo_slt/dnn_demo_slt')
+    parser.add_argument('--excitation', nargs='+', default=['DNN_GENERATED'])
+    parser.add_argument('--block-frames', type=int, nargs='+', default=[1, 8])
+    parser.add_argument('--tolerance', type=float, default=1e-5)
+    parser.add_argument('--keep', action='store_true',
+                        help='keep the configurations and wav files')
+    args = parser.parse_args()
+
+    if args.basename is None:
+        basenames = input_basenames(args.datadir)
+        if not basenames:
+            print('Error: no utterances with %s features in %s'
+                  % (', '.join(INPUT_FEATURES), args.datadir))
+            return 1
+        args.basename = basenames[0]
+    missing = missing_features(args.datadir, args.basename)
+    if missing:
+        print('Error: missing feature files (run Analysis first): %s' % ' '.join(missing))
+        return 1
+
+    workdir = tempfile.mkdtemp(prefix='tolg_streaming_')
+    failures = 0
+    try:
+        for method in args.excitation:
+            args.excitation_method = method
+            offline, fs = synthesize(args, workdir, method + '_offline',
+                                     {'STREAMING_SYNTHESIS': 'false'})
+            for block in args.block_frames:
+                streamed, fs_streamed = synthesize(
+                    args, workdir, '%s_block%d' % (method, block),
+                    {'STREAMING_SYNTHESIS': 'true', 'STREAM_BLOCK_FRAMES': str(block)})
+                if fs_streamed != fs or len(streamed) != len(offline):
+                    print('FAIL %s, %d frames per block: %d samples at %d Hz, offline %d at %d Hz'
+                          % (method, block, len(streamed), fs_streamed, len(offline), fs))
+                    failures += 1
+                    continue
+                max_diff = np.max(np.abs(streamed - offline)) if len(offline) > 0 else 0.0
+                ok = max_diff <= args.tolerance
+                print('%s %s, %d frames per block: max abs difference %.3g (tolerance %.3g)'
+                      % ('ok  ' if ok else 'FAIL', method, block, max_diff, args.tolerance))
+                if not ok:
+                    failures += 1
+    except (RuntimeError, IOError) as err:
+        print('Error: %s' % err)
+        failures += 1
+    finally:
+        if args.keep:
+            print('outputs kept in %s' % workdir)
+        else:
+            shutil.rmtree(workdir, ignore_errors=True)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
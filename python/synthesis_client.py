@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+# Test client for src/SynthesisServer.
+#
+# Sends the FLOAT features of one utterance (f0, gain, rd, lsf, slsf, hnr)
+# and writes the returned PCM to a wav file. With --requests and
+# --concurrency it repeats the request from several connections and prints
+# the server latency statistics.
+#
+# usage:
+#   synthesis_client.py SOCKET DATADIR BASENAME OUT.wav
+#       [--lsf-order 30] [--slsf-order 10] [--hnr-order 5]
+#       [--requests 1] [--concurrency 1] [--stats]
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+import wave
+
+import numpy as np
+
+# see src/glott/SynthesisProtocol.h
+MAGIC = 0x544F4C47
+VERSION = 1
+REQUEST_SYNTHESIZE = 1
+REQUEST_STATS = 2
+STATUS_NAMES = {0: 'OK', 1: 'BAD_REQUEST', 2: 'FAILED', 3: 'BUSY'}
+REQUEST_HEADER = struct.Struct('=IHHIIII')
+REPLY_HEADER = struct.Struct('=IHHII')
+
+
+def recv_exact(sock, n):
+    buf = bytearray()
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise IOError('connection closed by server')
+        buf.extend(chunk)
+    return bytes(buf)
+
+
+def recv_reply(sock):
+    magic, version, status, fs, n_bytes = REPLY_HEADER.unpack(
+        recv_exact(sock, REPLY_HEADER.size))
+    if magic != MAGIC or version != VERSION:
+        raise IOError('invalid reply from server')
+    return status, fs, recv_exact(sock, n_bytes)
+
+
+def read_feature(datadir, feature, basename, order):
+    fname = os.path.join(datadir, feature, basename + '.' + feature)
+    data = np.fromfile(fname, dtype=np.float32)
+    if order > 1:
+        data = data.reshape(-1, order)
+    return data
+
+
+def load_features(args):
+    f0 = read_feature(args.datadir, 'f0', args.basename, 1)
+    feats = [f0,
+             read_feature(args.datadir, 'gain', args.basename, 1),
+             read_feature(args.datadir, 'rd', args.basename, 1),
+             read_feature(args.datadir, 'lsf', args.basename, args.lsf_order)]
+    if args.slsf_order > 0:
+        feats.append(read_feature(args.datadir, 'slsf', args.basename, args.slsf_order))
+    if args.hnr_order > 0:
+        feats.append(read_feature(args.datadir, 'hnr', args.basename, args.hnr_order))
+    n_frames = len(f0)
+    for feat in feats:
+        if feat.shape[0] != n_frames:
+            sys.exit('Error: number of frames in feature files do not match')
+    header = REQUEST_HEADER.pack(MAGIC, VERSION, REQUEST_SYNTHESIZE, n_frames,
+                                 args.lsf_order, args.slsf_order, args.hnr_order)
+    payload = b''.join(np.ascontiguousarray(f, dtype=np.float32).tobytes() for f in feats)
+    return header + payload
+
+
+def synthesize(sock_path, request):
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(sock_path)
+        sock.sendall(request)
+        return recv_reply(sock)
+
+
+def query_stats(sock_path):
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(sock_path)
+        sock.sendall(REQUEST_HEADER.pack(MAGIC, VERSION, REQUEST_STATS, 0, 0, 0, 0))
+        status, fs, payload = recv_reply(sock)
+        return payload.decode()
+
+
+def write_wav(fname, pcm, fs):
+    with wave.open(fname, 'wb') as wav:
+        wav.setnchannels(1)
+        wav.setsampwidth(2)
+        wav.setframerate(fs)
+        wav.writeframes(pcm)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SynthesisServer test client')
+    parser.add_argument('socket')
+    parser.add_argument('datadir')
+    parser.add_argument('basename')
+    parser.add_argument('output')
+    parser.add_argument('--lsf-order', type=int, default=30)
+    parser.add_argument('--slsf-order', type=int, default=10)
+    parser.add_argument('--hnr-order', type=int, default=5)
+    parser.add_argument('--requests', type=int, default=1)
+    parser.add_argument('--concurrency', type=int, default=1)
+    parser.add_argument('--stats', action='store_true')
+    args = parser.parse_args()
+
+    request = load_features(args)
+    latencies = []
+    failures = []
+    lock = threading.Lock()
+    counter = iter(range(args.requests))
+
+    def run():
+        while True:
+            with lock:
+                if next(counter, None) is None:
+                    return
+            start = time.time()
+            try:
+                status, fs, payload = synthesize(args.socket, request)
+            except IOError as err:
+                status, fs, payload = -1, 0, str(err).encode()
+            elapsed = time.time() - start
+            with lock:
+                latencies.append(elapsed)
+                if status != 0:
+                    failures.append((STATUS_NAMES.get(status, status), payload.decode(errors='replace')))
+                elif not os.path.exists(args.output):
+                    write_wav(args.output, payload, fs)
+
+    if os.path.exists(args.output):
+        os.remove(args.output)
+    threads = [threading.Thread(target=run) for _ in range(max(args.concurrency, 1))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    lat = np.sort(np.array(latencies)) * 1000.0
+    print('requests %d, failed %d' % (len(lat), len(failures)))
+    if len(lat) > 0:
+        print('client latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f' % (
+            np.percentile(lat, 50), np.percentile(lat, 90), np.percentile(lat, 99), lat[-1]))
+    for name, message in failures[:10]:
+        print('  %s: %s' % (name, message))
+    if args.stats:
+        print(query_stats(args.socket), end='')
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
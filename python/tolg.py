@@ -0,0 +1,227 @@
+# Python binding of libtolg (src/glott/tolg.h).
+#
+# Analysis and synthesis in-process, without temporary config or feature
+# files. Features are returned as numpy arrays that point to the buffers
+# of the library (no copy); the buffers are released when the last array
+# of an analysis result is gone.
+#
+# usage:
+#   import tolg
+#   vocoder = tolg.Tolg('config_default_16k.cfg', 'config_user.cfg')
+#   feats = vocoder.analyze(pcm)          # dict: f0, gain, rd, lsf, slsf, hnr (, pls)
+#   pcm_out = vocoder.synthesize(feats)
+#   pls = tolg.read_pulses('utt.pls', 400)   # plain or encoded (PULSE_ENCODING)
+#
+# The library is looked up from $TOLG_LIBRARY, then next to the sources
+# (src/libtolg.so), then from the system library path.
+
+import ctypes
+import ctypes.util
+import os
+
+import numpy as np
+
+API_VERSION = 1
+
+_float_p = ctypes.POINTER(ctypes.c_float)
+
+
+class _Features(ctypes.Structure):
+    _fields_ = [('number_of_frames', ctypes.c_size_t),
+                ('lsf_order', ctypes.c_size_t),
+                ('slsf_order', ctypes.c_size_t),
+                ('hnr_order', ctypes.c_size_t),
+                ('pls_length', ctypes.c_size_t),
+                ('f0', _float_p),
+                ('gain', _float_p),
+                ('rd', _float_p),
+                ('lsf', _float_p),
+                ('slsf', _float_p),
+                ('hnr', _float_p),
+                ('pls', _float_p)]
+
+
+# feature name -> order field (None for one value per frame)
+_FEATURES = [('f0', None), ('gain', None), ('rd', None), ('lsf', 'lsf_order'),
+             ('slsf', 'slsf_order'), ('hnr', 'hnr_order'), ('pls', 'pls_length')]
+
+
+def _load_library():
+    candidates = []
+    if os.environ.get('TOLG_LIBRARY'):
+        candidates.append(os.environ['TOLG_LIBRARY'])
+    candidates.append(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                   '..', 'src', 'libtolg.so'))
+    found = ctypes.util.find_library('tolg')
+    if found:
+        candidates.append(found)
+    for path in candidates:
+        if os.path.exists(path) or path == found:
+            lib = ctypes.CDLL(path)
+            break
+    else:
+        raise OSError('libtolg.so not found, set TOLG_LIBRARY')
+
+    lib.tolg_api_version.restype = ctypes.c_int
+    lib.tolg_params_load.restype = ctypes.c_void_p
+    lib.tolg_params_load.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+    lib.tolg_params_free.argtypes = [ctypes.c_void_p]
+    lib.tolg_params_fs.restype = ctypes.c_int
+    lib.tolg_params_fs.argtypes = [ctypes.c_void_p]
+    lib.tolg_analyze.restype = ctypes.c_int
+    lib.tolg_analyze.argtypes = [_float_p, ctypes.c_size_t, ctypes.c_void_p,
+                                 ctypes.POINTER(_Features)]
+    lib.tolg_features_free.argtypes = [ctypes.POINTER(_Features)]
+    lib.tolg_synthesize.restype = ctypes.c_int
+    lib.tolg_synthesize.argtypes = [ctypes.POINTER(_Features), ctypes.c_void_p,
+                                    ctypes.POINTER(_float_p), ctypes.POINTER(ctypes.c_size_t)]
+    lib.tolg_pcm_free.argtypes = [_float_p]
+    lib.tolg_decode_pulses.restype = ctypes.c_int
+    lib.tolg_decode_pulses.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_size_t,
+                                       ctypes.POINTER(_float_p), ctypes.POINTER(ctypes.c_size_t)]
+    lib.tolg_last_error.restype = ctypes.c_char_p
+    if lib.tolg_api_version() != API_VERSION:
+        raise OSError('libtolg API version %d, expected %d' % (lib.tolg_api_version(), API_VERSION))
+    return lib
+
+
+_lib = None
+
+
+def _library():
+    global _lib
+    if _lib is None:
+        _lib = _load_library()
+    return _lib
+
+
+class _Owner(object):
+    """Releases library buffers when the last array using them is gone."""
+
+    def __init__(self, release, *args):
+        self._release = release
+        self._args = args
+
+    def __del__(self):
+        self._release(*self._args)
+
+
+def _wrap(ptr, shape, owner):
+    """numpy view of a float32 buffer of the library"""
+    n = int(np.prod(shape))
+    buf = (ctypes.c_float * n).from_address(ctypes.addressof(ptr.contents))
+    buf._owner = owner
+    return np.frombuffer(buf, dtype=np.float32).reshape(shape)
+
+
+def _as_float32(x):
+    return np.ascontiguousarray(x, dtype=np.float32)
+
+
+class TolgError(RuntimeError):
+    pass
+
+
+class Tolg(object):
+
+    def __init__(self, default_config, user_config=None):
+        self._lib = _library()
+        self._params = self._lib.tolg_params_load(
+            default_config.encode(), user_config.encode() if user_config else None)
+        if not self._params:
+            raise TolgError(self._error())
+        self.fs = self._lib.tolg_params_fs(self._params)
+
+    def __del__(self):
+        if getattr(self, '_params', None):
+            self._lib.tolg_params_free(self._params)
+            self._params = None
+
+    def _error(self):
+        return self._lib.tolg_last_error().decode(errors='replace')
+
+    def analyze(self, pcm):
+        """Features of pcm (float in [-1, 1] at self.fs) as a dict of
+        float32 arrays, n_frames x order."""
+        pcm = _as_float32(pcm)
+        feats = _Features()
+        if self._lib.tolg_analyze(pcm.ctypes.data_as(_float_p), pcm.size, self._params,
+                                  ctypes.byref(feats)) != 0:
+            raise TolgError(self._error())
+        owner = _Owner(self._lib.tolg_features_free, ctypes.byref(feats))
+        owner.features = feats
+        n = feats.number_of_frames
+        result = {}
+        for name, order_field in _FEATURES:
+            ptr = getattr(feats, name)
+            if not ptr:
+                continue
+            shape = (n,) if order_field is None else (n, getattr(feats, order_field))
+            result[name] = _wrap(ptr, shape, owner)
+        return result
+
+    def synthesize(self, features):
+        """Signal (float32, not re-scaled) from a dict of features as
+        returned by analyze(). C-contiguous float32 arrays are passed
+        without copying."""
+        feats = _Features()
+        keep = []
+        f0 = _as_float32(features['f0']).reshape(-1)
+        feats.number_of_frames = f0.shape[0]
+        for name, order_field in _FEATURES:
+            if name not in features or features[name] is None:
+                continue
+            values = _as_float32(features[name])
+            if values.shape[0] != feats.number_of_frames:
+                raise ValueError('number of frames of %s does not match f0' % name)
+            keep.append(values)
+            setattr(feats, name, values.ctypes.data_as(_float_p))
+            if order_field is not None:
+                setattr(feats, order_field, values.size // feats.number_of_frames)
+        pcm = _float_p()
+        n_samples = ctypes.c_size_t()
+        if self._lib.tolg_synthesize(ctypes.byref(feats), self._params,
+                                     ctypes.byref(pcm), ctypes.byref(n_samples)) != 0:
+            raise TolgError(self._error())
+        owner = _Owner(self._lib.tolg_pcm_free, pcm)
+        return _wrap(pcm, (n_samples.value,), owner)
+
+
+# Encoded pulse files (src/glott/PulseCodec.h)
+_PULSE_MAGIC = b'TOLGPLS1'
+_PULSE_HEADER = np.dtype([('magic', 'S8'), ('encoding', '<u4'), ('order', '<u4'),
+                          ('frames', '<u8'), ('bytes', '<u8')])
+_PULSES_FLOAT16 = 1
+
+
+def read_pulses(filename, pls_length, dtype=np.float32):
+    """Pulses of a .pls file as n_frames x pls_length. Plain files are
+    read as float32 (DATA_TYPE = "FLOAT", or dtype); FLOAT16 files are
+    decoded with numpy, RICE files with libtolg."""
+    data = np.fromfile(filename, dtype=np.uint8)
+    if data[:len(_PULSE_MAGIC)].tobytes() != _PULSE_MAGIC:
+        return data.view(dtype).reshape(-1, pls_length)
+
+    blocks = []
+    position = 0
+    while position < data.size:
+        header = data[position:position + _PULSE_HEADER.itemsize].view(_PULSE_HEADER)[0]
+        if header['magic'] != _PULSE_MAGIC or header['order'] != pls_length:
+            break
+        if header['encoding'] != _PULSES_FLOAT16:
+            break
+        begin = position + _PULSE_HEADER.itemsize
+        end = begin + int(header['bytes'])
+        blocks.append(data[begin:end].view('<f2').astype(np.float32).reshape(-1, pls_length))
+        position = end
+    else:
+        return np.concatenate(blocks) if len(blocks) > 1 else blocks[0]
+
+    lib = _library()
+    pulses = _float_p()
+    n_frames = ctypes.c_size_t()
+    buf = data.tobytes()
+    if lib.tolg_decode_pulses(buf, len(buf), pls_length, ctypes.byref(pulses),
+                              ctypes.byref(n_frames)) != 0:
+        raise TolgError('%s: %s' % (filename, lib.tolg_last_error().decode(errors='replace')))
+    return _wrap(pulses, (n_frames.value, pls_length), _Owner(lib.tolg_pcm_free, pulses))
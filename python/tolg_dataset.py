@@ -0,0 +1,98 @@
+# Training dataset written by batch Analysis (DATASET_DIRECTORY).
+#
+# The shards are .npy files mapped copy-on-write (mmap_mode='c'), so
+# nothing is read until a frame is used, and torch.from_numpy() of a shard
+# or of a frame shares the mapped pages (no copy, the files are never
+# written).
+#
+# usage:
+#   import tolg_dataset
+#   data = tolg_dataset.TolgDataset('/path/to/dataset')
+#   x, y = data[0]                      # input and output of the first frame
+#   x = data.normalize(x)               # scaled to [0.1, 0.9] as in the DNN
+#
+#   loader = torch.utils.data.DataLoader(data.torch_dataset(), batch_size=256,
+#                                        shuffle=True)
+
+import bisect
+import json
+import os
+
+import numpy as np
+
+
+class TolgDataset(object):
+
+    def __init__(self, directory):
+        self.directory = directory
+        with open(os.path.join(directory, 'dataset.json'), 'r') as fid:
+            self.layout = json.load(fid)
+        if self.layout['version'] != 1:
+            raise ValueError('unsupported dataset version %d' % self.layout['version'])
+        self.input_dim = self.layout['input_dim']
+        self.output_dim = self.layout['output_dim']
+
+        self.inputs = []
+        self.outputs = []
+        self.frames = []
+        self.offsets = [0]
+        for shard in self.layout['shards']:
+            base = os.path.join(directory, shard['name'])
+            self.inputs.append(np.load(base + '.input.npy', mmap_mode='c'))
+            self.outputs.append(np.load(base + '.output.npy', mmap_mode='c'))
+            self.frames.append(np.load(base + '.frames.npy', mmap_mode='c'))
+            self.offsets.append(self.offsets[-1] + shard['frames'])
+
+        minmax = np.fromfile(os.path.join(directory, self.layout['min_max']), dtype=np.float32)
+        self.input_min = minmax[:self.input_dim]
+        self.input_max = minmax[self.input_dim:]
+        self.range_low, self.range_high = self.layout['input_range']
+
+    def __len__(self):
+        return self.offsets[-1]
+
+    def _locate(self, index):
+        if index < 0:
+            index += len(self)
+        if index < 0 or index >= len(self):
+            raise IndexError('frame %d out of range' % index)
+        shard = bisect.bisect_right(self.offsets, index) - 1
+        return shard, index - self.offsets[shard]
+
+    def __getitem__(self, index):
+        shard, row = self._locate(index)
+        return self.inputs[shard][row], self.outputs[shard][row]
+
+    def frame_info(self, index):
+        """ (utterance index in the file list, frame number) of a frame """
+        shard, row = self._locate(index)
+        return tuple(int(v) for v in self.frames[shard][row])
+
+    def normalize(self, x):
+        """ Input scaling of the excitation DNN (dnnMinMax) """
+        scale = np.maximum(self.input_max - self.input_min, np.finfo(np.float32).tiny)
+        return self.range_low + (self.range_high - self.range_low) * (x - self.input_min) / scale
+
+    def torch_dataset(self, normalize=True):
+        import torch
+
+        parent = self
+
+        class _TorchDataset(torch.utils.data.Dataset):
+            def __len__(self):
+                return len(parent)
+
+            def __getitem__(self, index):
+                x, y = parent[index]
+                if normalize:
+                    x = parent.normalize(x).astype(np.float32)
+                return torch.from_numpy(x), torch.from_numpy(y)
+
+        return _TorchDataset()
+
+    def shard_tensors(self, shard):
+        """ Input, output and frame index of a whole shard as tensors on the
+        mapped memory (inputs not normalised) """
+        import torch
+        return (torch.from_numpy(self.inputs[shard]), torch.from_numpy(self.outputs[shard]),
+                torch.from_numpy(self.frames[shard]))
@@ -57,10 +57,17 @@
 #include "Filters.h"
 #include "FileIo.h"
 #include "ReadConfig.h"
+#include "FixedOrderKernels.h"
+#include "FrameScheduler.h"
 #include "SpFunctions.h"
 #include "AnalysisFunctions.h"
+#include "AnalysisPipeline.h"
 
 #include "Utils.h"
+#include "BatchProcessing.h"
+#include "DatasetWriter.h"
+#include "OutputWriter.h"
+#include "AnalysisCache.h"
 
 
 #include <gslwrap/random_generator.h>
@@ -76,6 +83,7 @@
 #include <gsl/gsl_vector_int.h>
 #include <gsl/gsl_filter.h>
 
+#include <functional>
 #include <memory>
 #include <unistd.h>
 #include <stdio.h>
@@ -85,494 +93,509 @@
 #include "./reaper/core/file_resource.h"
 #include "./reaper/core/track.h"
 #include "./reaper/epoch_tracker/epoch_tracker.h"
-#include "./reaper/wave/wave.h"
-
-
-//void Rd2R(double Rd, double EE, double F0, double& Ra, double& Rk, double& Rg) {
-//    Ra = (-1 + (4.8 * Rd)) / 100;
-//    Rk = (22.4 + (11.8 * Rd)) / 100;
-//    double EI = (M_PI * Rk * EE) / 2;
-//    double UP = (Rd * EE) / (10 * F0);
-//    Rg = EI / (F0 * UP * M_PI);
-//}
-// Function to generate synthetic source signal
-gsl::vector integrat(const gsl::vector& x, double Fs) {
-    int length = x.size();
-    gsl::vector y(length);
-
-    double Ts = 1.0 / Fs;
-    y[0] = Ts * x[0];
-
-    for (int n = 1; n < length; ++n) {
-        y[n] = (Ts * x[n]) + y[n - 1];
-    }
 
-    return y;
-}
 
+/* Samples and frames of one block of chunked analysis. The whole block is
+ * analysed and only its core is kept; the overlap on both sides gives the
+ * frame-wise estimators their context. */
+struct AnalysisBlock {
+    size_t begin;              // first sample of the block in the recording
+    size_t length;             // samples in the block
+    size_t first_frame;        // recording frame at the block start
+    size_t core_begin;         // core frames core_begin ... core_end-1
+    size_t core_end;
+    size_t core_sample_begin;  // core samples core_sample_begin ... core_sample_end-1
+    size_t core_sample_end;
+};
+
+/**
+ * Function GetAnalysisBlocks
+ *
+ * Split a recording of signal_length samples into blocks of
+ * ANALYSIS_CHUNK_SECONDS of core frames and ANALYSIS_CHUNK_OVERLAP_SECONDS
+ * of overlap. Blocks start on a frame boundary, so the frames of a block are
+ * frames of the recording.
+ */
+static std::vector<AnalysisBlock> GetAnalysisBlocks(const Param &params,
+                                                    const size_t &signal_length) {
+    const size_t shift = params.frame_shift;
+    const size_t n_frames = (signal_length + shift - 1) / shift;
+    const size_t core_frames = GSL_MAX(1, (size_t)rint(params.analysis_chunk_seconds*params.fs/(double)shift));
+    const size_t overlap = (size_t)ceil(params.analysis_chunk_overlap_seconds*params.fs/(double)shift);
+
+    std::vector<AnalysisBlock> blocks;
+    for (size_t c0 = 0; c0 < n_frames; c0 += core_frames) {
+        AnalysisBlock block;
+        block.core_begin = c0;
+        block.core_end = GSL_MIN(n_frames, c0 + core_frames);
+        block.first_frame = (c0 > overlap) ? c0 - overlap : 0;
+        block.begin = block.first_frame*shift;
+        block.length = GSL_MIN(signal_length, (block.core_end + overlap)*shift) - block.begin;
+        block.core_sample_begin = block.core_begin*shift;
+        block.core_sample_end = (block.core_end == n_frames) ? signal_length : block.core_end*shift;
+        blocks.push_back(block);
+    }
+    return blocks;
+}
 
+static gsl::vector VectorRange(const gsl::vector &v, const size_t &begin, const size_t &end) {
+    gsl::vector range(end - begin);
+    for (size_t i = begin; i < end; i++)
+        range(i - begin) = v(i);
+    return range;
+}
 
-gsl::vector contains_nan(const gsl::vector &x) {
-    gsl::vector x_logic;
-    x_logic.resize(x.size());
-    for (int32_t i = 0; i < x.size(); ++i) {
-        if (std::isnan(x[i])) {
-            x_logic[i] = 1;
-        }else{
-            x_logic[i] = 0;
-        }
-    }
-    return x_logic;
+static gsl::matrix ColumnRange(const gsl::matrix &m, const size_t &begin, const size_t &end) {
+    gsl::matrix range(m.size1(), end - begin);
+    for (size_t j = begin; j < end; j++)
+        for (size_t i = 0; i < m.size1(); i++)
+            range(i, j - begin) = m(i, j);
+    return range;
 }
 
-bool any_wrap(const gsl::vector &x) {
-    for (int32_t i = 0; i < x.size(); ++i) {
-        if (x[i] == 1) {
-            return true;
-        }
-    }
-    return false;
+static gsl::vector VectorElements(const gsl::vector &v, const std::vector<size_t> &elements) {
+    gsl::vector selected;
+    selected.resize(elements.size());
+    for (size_t i = 0; i < elements.size(); i++)
+        selected(i) = v(elements[i]);
+    return selected;
 }
 
-// Hanning window function
-
-gsl::vector generateSyntheticSignal(const gsl::vector& glot, const gsl::vector& GCI, const gsl::vector& F0,
-                                    const gsl::vector& Ra, const gsl::vector& Rk,
-                                    gsl::vector& Rg, const gsl::vector& EE,
-                                    double fs, double F0min, double F0max, int maxCnt) {
-    int length = GCI.size();
-    gsl::vector sig(glot.size());
-    gsl::vector start(length);
-    gsl::vector finish(length);
-    gsl::vector UP(length);
-
-    for (int n = 0; n < length; ++n) {
-        if (F0[n] > F0min && F0[n] < F0max) {
-            gsl::vector pulse;
-            lf_cont(F0[n], fs, Ra[n], Rk[n], Rg[n], EE[n], pulse);
-
-            gsl::vector pulse_int = integrat(pulse, fs);
-            UP[n] = pulse_int.max();
-            int cnt = 1;
-
-            gsl::vector pulse_logic;
-            pulse_logic = contains_nan(pulse);
-
-            while (any_wrap(pulse_logic) && cnt < maxCnt) {
-                Rg[n] += 0.01; // Modify the copy of Rg
-                lf_cont(F0[n], fs, Ra[n], Rk[n], Rg[n], EE[n], pulse);
-                cnt++;
-            }
-
-            if (cnt == maxCnt) {
-                pulse.resize(pulse.size());
-                pulse.set_zero();
-            }
-
-            double minVal = pulse[0];
-            size_t idx = 0;
-
-            for (size_t i = 1; i < pulse.size(); ++i) {
-                if (pulse[i] < minVal) {
-                    minVal = pulse[i];
-                    idx = i;
-                }
-            }
-
-            for (int i = 0; i < pulse.size(); i++) {
-                pulse[i] *= hammingWindow(i, pulse.size());
-            }
-
-            start[n] = GCI[n] - idx - 1;
-            finish[n] = start[n] + pulse.size() - 1;
-            if (start[n] > 0 && finish[n] < sig.size()) {
-                sig.subvector(start[n], finish[n] - start[n] + 1) += pulse;
-            }
-        }
-    }
+/**
+ * Function KeepBlockCore
+ *
+ * Reduce the analysis of a block to its core: the frame-wise features of
+ * the core frames, the signals of the core samples and the GCIs and REAPER
+ * F0 values in the core samples, with GCIs as sample indices of the whole
+ * recording.
+ */
+static void KeepBlockCore(const AnalysisBlock &block, const Param &params, AnalysisData *data) {
+    const size_t n_frames = (block.length + params.frame_shift - 1) / params.frame_shift;
+    const size_t f_begin = block.core_begin - block.first_frame;
+    const size_t f_end = block.core_end - block.first_frame;
+    const size_t s_begin = block.core_sample_begin - block.begin;
+    const size_t s_end = block.core_sample_end - block.begin;
+
+    auto keep_frames = [&](gsl::vector *v) {
+        if (v->is_set() && v->size() == n_frames)
+            *v = VectorRange(*v, f_begin, f_end);
+    };
+    auto keep_frame_columns = [&](gsl::matrix *m) {
+        if (m->is_set() && m->size2() == n_frames)
+            *m = ColumnRange(*m, f_begin, f_end);
+    };
+    auto keep_samples = [&](gsl::vector *v) {
+        if (v->is_set() && v->size() == block.length)
+            *v = VectorRange(*v, s_begin, s_end);
+    };
+    auto in_core = [&](const double &sample) {
+        return sample >= s_begin && sample < s_end;
+    };
+
+    keep_frames(&data->fundf);
+    keep_frames(&data->frame_energy);
+    keep_frames(&data->Rd_opt);
+    keep_frame_columns(&data->lsf_vocal_tract);
+    keep_frame_columns(&data->lsf_glot);
+    keep_frame_columns(&data->hnr_glot);
+    keep_frame_columns(&data->excitation_pulses);
+    keep_samples(&data->source_signal);
+    keep_samples(&data->signal);
+
+    std::vector<int> gci;
+    for (size_t i = 0; i < data->gci_inds.size(); i++)
+        if (in_core(data->gci_inds(i)))
+            gci.push_back(data->gci_inds(i) + (int)block.begin);
+    data->gci_inds.resize(gci.size());
+    for (size_t i = 0; i < gci.size(); i++)
+        data->gci_inds(i) = gci[i];
+
+    /* EE, Ra, Rk and Rg are given at the REAPER GCIs */
+    const size_t n_gci_reaper = data->GCI_Reaper_gsl.size();
+    std::vector<size_t> kept;
+    for (size_t i = 0; i < n_gci_reaper; i++)
+        if (in_core(data->GCI_Reaper_gsl(i)))
+            kept.push_back(i);
+    data->GCI_Reaper_gsl = VectorElements(data->GCI_Reaper_gsl, kept);
+    for (size_t i = 0; i < kept.size(); i++)
+        data->GCI_Reaper_gsl(i) += block.begin;
+    gsl::vector *gci_values[] = {&data->EE, &data->Ra, &data->Rk, &data->Rg};
+    for (gsl::vector *v : gci_values)
+        if (v->is_set() && v->size() == n_gci_reaper)
+            *v = VectorElements(*v, kept);
+
+    kept.clear();
+    for (size_t i = 0; i < data->F0_Reaper_times.size(); i++)
+        if (in_core(data->F0_Reaper_times(i)*params.fs))
+            kept.push_back(i);
+    data->F0_Reaper_gsl = VectorElements(data->F0_Reaper_gsl, kept);
+    data->F0_Reaper_times = VectorElements(data->F0_Reaper_times, kept);
+}
 
-    return sig;
+/* Largest difference of the chunked analysis to the whole-file analysis */
+struct ChunkReport {
+    ChunkReport() : f0(0.0), gain(0.0), rd(0.0), lsf(0.0), slsf(0.0), hnr(0.0), pls(0.0),
+                    gci_chunked(0), gci_whole(0) {}
+    double f0, gain, rd, lsf, slsf, hnr, pls;
+    size_t gci_chunked;
+    size_t gci_whole;
+};
+
+static double MaxAbsDiff(const gsl::vector &v, const gsl::vector &reference, const size_t &offset) {
+    double diff = 0.0;
+    if (!v.is_set() || !reference.is_set() || offset + v.size() > reference.size())
+        return diff;
+    for (size_t i = 0; i < v.size(); i++)
+        diff = GSL_MAX(diff, fabs(v(i) - reference(offset + i)));
+    return diff;
 }
 
+static double MaxAbsDiff(const gsl::matrix &m, const gsl::matrix &reference, const size_t &offset) {
+    double diff = 0.0;
+    if (!m.is_set() || !reference.is_set() || m.size1() != reference.size1()
+        || offset + m.size2() > reference.size2())
+        return diff;
+    for (size_t j = 0; j < m.size2(); j++)
+        for (size_t i = 0; i < m.size1(); i++)
+            diff = GSL_MAX(diff, fabs(m(i, j) - reference(i, offset + j)));
+    return diff;
+}
 
-Track* MakeEpochOutput(EpochTracker &et, float unvoiced_pm_interval) {
-    std::vector<float> times;
-    std::vector<int16_t> voicing;
-    et.GetFilledEpochs(unvoiced_pm_interval, &times, &voicing);
-    Track* pm_track = new Track;
-    pm_track->resize(times.size());
-    for (int32_t i = 0; i < times.size(); ++i) {
-        pm_track->t(i) = times[i];
-        pm_track->set_v(i, voicing[i]);
-    }
-    return pm_track;
+static void CompareBlock(const AnalysisBlock &block, const AnalysisData &reference,
+                         const AnalysisData &data, ChunkReport *report) {
+    const size_t offset = block.core_begin;
+    report->f0 = GSL_MAX(report->f0, MaxAbsDiff(data.fundf, reference.fundf, offset));
+    report->gain = GSL_MAX(report->gain, MaxAbsDiff(data.frame_energy, reference.frame_energy, offset));
+    report->rd = GSL_MAX(report->rd, MaxAbsDiff(data.Rd_opt, reference.Rd_opt, offset));
+    report->lsf = GSL_MAX(report->lsf, MaxAbsDiff(data.lsf_vocal_tract, reference.lsf_vocal_tract, offset));
+    report->slsf = GSL_MAX(report->slsf, MaxAbsDiff(data.lsf_glot, reference.lsf_glot, offset));
+    report->hnr = GSL_MAX(report->hnr, MaxAbsDiff(data.hnr_glot, reference.hnr_glot, offset));
+    report->pls = GSL_MAX(report->pls, MaxAbsDiff(data.excitation_pulses, reference.excitation_pulses, offset));
+    report->gci_chunked += data.GCI_Reaper_gsl.size();
 }
 
-Track* MakeF0Output(EpochTracker &et, float resample_interval, Track** cor) {
-    std::vector<float> f0;
-    std::vector<float> corr;
-    if (!et.ResampleAndReturnResults(resample_interval, &f0, &corr)) {
-        return NULL;
+/**
+ * Function AnalyseFileChunked
+ *
+ * Analyse a long recording in overlapping blocks (ANALYSIS_CHUNK_SECONDS)
+ * and append the features of each block to the output files, so that the
+ * memory use does not grow with the length of the recording.
+ *
+ * Steps that see the whole signal in AnalyseFile (F0 post-processing,
+ * REAPER tracking, Rd interpolation, high-pass filter start-up) see one
+ * block at a time, so the features can differ slightly from whole-file
+ * analysis near block boundaries; ANALYSIS_CHUNK_REPORT measures this.
+ * With a writer, the blocks are written in order by the writer thread.
+ */
+static int AnalyseFileChunked(const char *wav_filename, Param params, OutputWriter *writer) {
+
+    if (params.use_external_f0 || params.use_external_gci) {
+        std::cerr << "Error: ANALYSIS_CHUNK_SECONDS cannot be used with external F0 or GCI files" << std::endl;
+        return EXIT_FAILURE;
     }
-
-    Track* f0_track = new Track;
-    Track* cor_track = new Track;
-    f0_track->resize(f0.size());
-    cor_track->resize(corr.size());
-    for (int32_t i = 0; i < f0.size(); ++i) {
-        float t = resample_interval * i;
-        f0_track->t(i) = t;
-        cor_track->t(i) = t;
-        f0_track->set_v(i, (f0[i] > 0.0) ? true : false);
-        cor_track->set_v(i, (f0[i] > 0.0) ? true : false);
-        f0_track->a(i) = (f0[i] > 0.0) ? f0[i] : -1.0;
-        cor_track->a(i) = corr[i];
+    if (params.analysis_chunk_overlap_seconds < 0.0) {
+        std::cerr << "Error: ANALYSIS_CHUNK_OVERLAP_SECONDS must not be negative" << std::endl;
+        return EXIT_FAILURE;
     }
-    *cor = cor_track;
-    return f0_track;
-}
 
-bool ComputeEpochsAndF0(EpochTracker &et, float unvoiced_pulse_interval,
-                        float external_frame_interval,
-                        Track** pm, Track** f0, Track** corr) {
-    if (!et.ComputeFeatures()) {
-        return false;
+    size_t signal_length;
+    if (GetWavFileLength(wav_filename, params.fs, &signal_length) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    if (signal_length == 0) {
+        std::cerr << "Error: " << wav_filename << " is empty" << std::endl;
+        return EXIT_FAILURE;
     }
-    bool tr_result = et.TrackEpochs();
-    et.WriteDiagnostics("");  // Try to save them here, even after tracking failure.
-    if (!tr_result) {
-        fprintf(stderr, "Problems in TrackEpochs");
-        return false;
+    FilePathBasename(wav_filename, &(params.file_path), &(params.file_basename));
+    params.signal_length = signal_length;
+    params.number_of_frames = (int)ceil((double)signal_length/(double)params.frame_shift);
+
+    /* Reference: whole-file analysis in memory, without output files */
+    AnalysisData reference;
+    ChunkReport report;
+    if (params.analysis_chunk_report) {
+        Param whole_params = params;
+        whole_params.analysis_chunk_seconds = 0.0;
+        if (ReadWavFile(wav_filename, &(reference.signal), &whole_params,
+                        &(reference.signal_pcm16)) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+        SignalOutput discard = [](const std::string &, const std::string &, const gsl::vector &) {
+            return EXIT_SUCCESS;
+        };
+        SignalPolarity polarity;
+        if (AnalyseSignal(whole_params, discard, &reference, &polarity) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        reference.signal.release();
+        reference.source_signal.release();
+        report.gci_whole = reference.GCI_Reaper_gsl.size();
     }
 
-    // create pm and f0 objects, these need to be freed in calling client.
-    *pm = MakeEpochOutput(et, unvoiced_pulse_interval);
-    *f0 = MakeF0Output(et, external_frame_interval, corr);
-    return true;
-}
+    const std::vector<AnalysisBlock> blocks = GetAnalysisBlocks(params, signal_length);
+    std::cout << "Chunked analysis: " << blocks.size() << " blocks" << std::endl;
 
+    for (size_t b = 0; b < blocks.size(); b++) {
+        const AnalysisBlock &block = blocks[b];
+        const bool append = (b > 0);
+        std::cout << "Block " << b + 1 << "/" << blocks.size() << ": frames "
+                  << block.core_begin << " - " << block.core_end - 1 << std::endl;
 
+        Param block_params = params;
+        block_params.signal_length = block.length;
+        block_params.number_of_frames = (int)ceil((double)block.length/(double)params.frame_shift);
 
-void PrintTrack(const Track& track) {
-    for (int i = 0; i < track.num_frames(); ++i) {
-//        std::cout << "Time: " << track.t(i) << " ";
-//        std::cout << "Voicing: " << track.v(i) << std::endl;
-//        std::cout << "F0: " << track.a(i) << std::endl;
+        AnalysisData data;
+        if (ReadWavBlock(wav_filename, block.begin, block.length, &(data.signal),
+                         &(data.signal_pcm16)) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+        if (data.CheckMemoryBudget(block_params) == EXIT_FAILURE)
+            return EXIT_FAILURE;
 
-        if (track.v(i) == 1) {
-            double GCI_val = track.t(i) * 16000.0;
-            std::cout << GCI_val << std::endl;
-        }
+        const size_t core_offset = block.core_sample_begin - block.begin;
+        const size_t core_length = block.core_sample_end - block.core_sample_begin;
+        SignalOutput output_signal = [&](const std::string &default_dir,
+                                         const std::string &extension,
+                                         const gsl::vector &signal) {
+            const std::string filename = GetParamPath(default_dir, extension, params.dir_syn, params);
+            gsl::vector core = VectorRange(signal, core_offset, core_offset + core_length);
+            if (writer == NULL)
+                return AppendWavFile(filename, core, params.fs, params.wav_format, !append, false);
+            std::unique_ptr<OutputBatch> batch(new OutputBatch);
+            batch->AddAppendWav(filename, &core, params.fs, params.wav_format, !append);
+            writer->Submit(std::move(batch));
+            return EXIT_SUCCESS;
+        };
+
+        SignalPolarity polarity;
+        int result = AnalyseSignal(block_params, output_signal, &data, &polarity);
+        if (result != EXIT_SUCCESS)
+            return result;
+
+        /* Detect the polarity once and apply it to the rest of the recording */
+        if (params.signal_polarity == POLARITY_DETECT)
+            params.signal_polarity = polarity;
+
+        KeepBlockCore(block, block_params, &data);
+        if (params.analysis_chunk_report)
+            CompareBlock(block, reference, data, &report);
+
+        if (data.SaveData(params, append, writer) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+        data.ReportMemory(block_params, "saving features");
     }
-}
-
-
-
-int main(int argc, char *argv[]) {
 
-    if (CheckCommandLineAnalysis(argc) == EXIT_FAILURE) {
-        return EXIT_FAILURE;
+    if (params.analysis_chunk_report) {
+        std::cout << "Chunked analysis: max abs difference to whole-file analysis" << std::endl;
+        std::cout << "    f0   : " << report.f0 << std::endl;
+        std::cout << "    gain : " << report.gain << std::endl;
+        std::cout << "    rd   : " << report.rd << std::endl;
+        std::cout << "    lsf  : " << report.lsf << std::endl;
+        std::cout << "    slsf : " << report.slsf << std::endl;
+        std::cout << "    hnr  : " << report.hnr << std::endl;
+        if (params.extract_pulses_as_features)
+            std::cout << "    pls  : " << report.pls << std::endl;
+        std::cout << "    REAPER GCIs: " << report.gci_chunked << " (whole file "
+                  << report.gci_whole << ")" << std::endl;
     }
 
-    const char *wav_filename = argv[1];
-    const char *default_config_filename = argv[2];
-    const char *user_config_filename = argv[3];
-
-//
-//    const char *ratio = argv[4];
-
-
-    /* Declare configuration parameter struct */
-    Param params;
+    return EXIT_SUCCESS;
+}
 
-    /* Read configuration file */
-    if (ReadConfig(default_config_filename, true, &params) == EXIT_FAILURE)
-        return EXIT_FAILURE;
-    if (argc > 3) {
-        if (ReadConfig(user_config_filename, false, &params) == EXIT_FAILURE)
+/**
+ * Analyse one file with its own copy of the parameters
+ * (ReadWavFile sets the file-dependent fields). If utterance is given,
+ * the frames of the training dataset are also collected. With a writer
+ * (ASYNC_OUTPUT), the function returns when the files have been queued.
+ * With a cache (ANALYSIS_CACHE_DIRECTORY), a file whose outputs are up to
+ * date is skipped.
+ */
+static int AnalyseFile(const char *wav_filename, Param params, OutputWriter *writer,
+                       AnalysisCache *cache, DatasetUtterance *utterance = NULL) {
+
+    if (params.analysis_chunk_seconds > 0.0)
+        return AnalyseFileChunked(wav_filename, params, writer);
+
+    AnalysisKey key;
+    if (cache != NULL) {
+        FilePathBasename(wav_filename, &(params.file_path), &(params.file_basename));
+        if (GetAnalysisKey(wav_filename, params, &key) == EXIT_FAILURE)
             return EXIT_FAILURE;
+        if (utterance == NULL && cache->IsCurrent(params, key)) {
+            std::cout << "Analysis of " << wav_filename << " is up to date, skipped" << std::endl;
+            return EXIT_SUCCESS;
+        }
     }
 
     /* Read sound file and allocate data */
     AnalysisData data;
 
-    if(ReadWavFile(wav_filename, &(data.signal), &params) == EXIT_FAILURE)
+    /* One decode serves both the analysis and REAPER */
+    if(ReadWavFile(wav_filename, &(data.signal), &params, &(data.signal_pcm16)) == EXIT_FAILURE)
         return EXIT_FAILURE;
 
-    data.AllocateData(params);
-
-    /* High-pass filter signal to eliminate low frequency "rumble" */
-    HighPassFiltering(params, &(data.signal));
-
-    if(!params.use_external_f0 || !params.use_external_gci || (params.signal_polarity == POLARITY_DETECT))
-        GetIaifResidual(params, data.signal, (&data.source_signal_iaif));
-
-    /* Read or estimate signal polarity */
-    PolarityDetection(params, &(data.signal), &(data.source_signal_iaif));
-
-    /* Read or estimate fundamental frequency (F0)  */
-    if(GetF0(params, data.signal, data.source_signal_iaif, &(data.fundf)) == EXIT_FAILURE)
+    if(data.CheckMemoryBudget(params) == EXIT_FAILURE)
         return EXIT_FAILURE;
 
-    /* Read or estimate glottal closure instants (GCIs)*/
-    GetGci(params, data.signal, data.source_signal_iaif, data.fundf, &(data.gci_inds));
-
-    /* Estimate frame log-energy (Gain) */
-    GetGain(params, data.fundf, data.signal, &(data.frame_energy));
-
-    /* Spectral analysis for vocal tract transfer function*/
-    if(params.qmf_subband_analysis) {
-        SpectralAnalysisQmf(params, data, &(data.poly_vocal_tract));
-    } else {
-        SpectralAnalysis(params, data, &(data.poly_vocal_tract));
+    /* The pipeline keeps using these signals, so the writer gets a copy */
+    SignalOutput output_signal = [&params, writer](const std::string &default_dir,
+                                                   const std::string &extension,
+                                                   const gsl::vector &signal) {
+        const std::string filename = GetParamPath(default_dir, extension, params.dir_syn, params);
+        if (writer == NULL)
+            return WriteWavFile(filename, signal, params.fs, params.wav_format, false);
+        gsl::vector copy(signal);
+        std::unique_ptr<OutputBatch> batch(new OutputBatch);
+        batch->AddWav(filename, &copy, params.fs, params.wav_format);
+        writer->Submit(std::move(batch));
+        return EXIT_SUCCESS;
+    };
+
+    /* The first stage is skipped when its state was kept with the same key */
+    if (cache == NULL || !cache->use_stages()
+        || cache->ReadStage(params, key, &data) == EXIT_FAILURE) {
+        SignalPolarity polarity;
+        int result = AnalyseSignalFront(params, &data, &polarity);
+        if (result != EXIT_SUCCESS)
+            return result;
+        if (cache != NULL && cache->use_stages()
+            && cache->WriteStage(params, key, data) == EXIT_FAILURE)
+            return EXIT_FAILURE;
     }
+    int result = AnalyseSignalBack(params, output_signal, &data);
+    if (result != EXIT_SUCCESS)
+        return result;
 
-    /* Smooth vocal tract estimates in LSF domain */
-    Poly2Lsf(data.poly_vocal_tract, &data.lsf_vocal_tract);
-    MedianFilter(5, &data.lsf_vocal_tract);
-    MovingAverageFilter(3, &data.lsf_vocal_tract);
-    Lsf2Poly(data.lsf_vocal_tract, &data.poly_vocal_tract);
+    if (utterance != NULL)
+        GetDatasetFrames(params, data, utterance);
 
-    /* Perform glottal inverse filtering with the estimated VT AR polynomials */
-    InverseFilter(params, data, &(data.poly_glot), &(data.source_signal));
-
-    /* Re-estimate GCIs on the residual */
-    if(GetGci(params, data.signal, data.source_signal, data.fundf, &(data.gci_inds)) == EXIT_FAILURE)
+    /* Write analyzed features to files (the writer takes the buffers) */
+    if (data.SaveData(params, false, writer) == EXIT_FAILURE)
         return EXIT_FAILURE;
+    data.ReportMemory(params, "saving features");
+
+    /* The file is recorded in the cache once its outputs are written */
+    if (cache != NULL) {
+        const std::string filename(wav_filename);
+        if (writer == NULL)
+            return cache->Record(filename, params, key);
+        std::unique_ptr<OutputBatch> batch(new OutputBatch);
+        batch->Add([cache, writer, filename, params, key](const bool &) {
+            if (writer->failed())
+                return EXIT_SUCCESS;
+            return cache->Record(filename, params, key);
+        });
+        writer->Submit(std::move(batch));
+    }
 
+    return EXIT_SUCCESS;
 
-    bool do_hilbert_transform = kDoHilbertTransform;
-    bool do_high_pass = kDoHighpass;
-    float external_frame_interval = kExternalFrameInterval;
-    float max_f0 = kMaxF0Search;
-    float min_f0 = kMinF0Search;
-    float inter_pulse = kUnvoicedPulseInterval;
-    float unvoiced_cost = kUnvoicedCost;
-    bool ascii = false;
-    std::string debug_output;
-
-    std::string filename(wav_filename);
 
+}
 
-    // Load input.
-    Wave wav;
-    if (!wav.Load(filename)) {
-        fprintf(stderr, "Failed to load waveform '%s'\n", filename.c_str());
-        return 1;
-    }
+int main(int argc, char *argv[]) {
 
-    EpochTracker et;
-    et.set_unvoiced_cost(unvoiced_cost);
-    int16_t* wave_datap = const_cast<int16_t *>(wav.data()->data());
-    int32_t n_samples = wav.num_samples();
-    float sample_rate = wav.sample_rate();
-    if (!et.Init(wave_datap, n_samples, sample_rate,
-                 min_f0, max_f0, do_high_pass, do_hilbert_transform)) {
-        return 1;
-    }
-    if (!debug_output.empty()) {
-        et.set_debug_name(debug_output);
-    }
-    // Compute f0 and pitchmarks.
-    Track *f0 = NULL;
-    Track *pm = NULL;
-    Track *corr = NULL;
-    if (!ComputeEpochsAndF0(et, inter_pulse, external_frame_interval, &pm, &f0, &corr)) {
-        fprintf(stderr, "Failed to compute epochs\n");
-        return 1;
+    /* Batch mode: Analysis --scp wav.scp config_default.cfg (config_user.cfg) */
+    const bool batch = IsBatchCommandLine(argc, argv);
+    if (batch) {
+        argc--;
+        argv++;
     }
 
-    // Print f0 track
-//    if (f0 != nullptr) {
-//        PrintTrack(*f0);
-//    } else {
-//        std::cerr << "F0 track is null" << std::endl;
-//    }
-
-    std::vector<double> F0_Reaper;
-    if (f0 != nullptr) {
-        const Track& track = *f0;
-        for (int i = 0; i < track.num_frames(); ++i) {
-            if (track.a(i) != -1) {
-                double F0_val = track.a(i) ;
-    //            if (track.a(i) == -1) {
-    //                F0_val = 0;
-    //            }
-    //                std::cout << F0_val << std::endl;
-                F0_Reaper.push_back(F0_val); // Insert GCI_val into GCI_Reaper vector
-            }
-        }
-    } else {
-        std::cerr << "F0 track is null" << std::endl;
+    if (CheckCommandLineAnalysis(argc) == EXIT_FAILURE) {
+        return EXIT_FAILURE;
     }
 
+    const char *wav_filename = argv[1];
+    const char *default_config_filename = argv[2];
+    const char *user_config_filename = argv[3];
 
-    // Convert F0_Reaper to gsl::vector
-    data.F0_Reaper_gsl.resize(F0_Reaper.size());
-    for (size_t i = 0; i < F0_Reaper.size(); ++i) {
-        data.F0_Reaper_gsl[i] = F0_Reaper[i];
-    }
-
+//
+//    const char *ratio = argv[4];
 
 
-    std::vector<double> GCI_Reaper;
-    if (pm != nullptr) {
-        const Track& track = *pm;
+    /* Declare configuration parameter struct */
+    Param params;
 
-        for (int i = 0; i < track.num_frames(); ++i) {
-//            std::cout << track.v(i) << std::endl;
-//            std::cout << track.t(i) << std::endl;
-            if (track.v(i) == 1) {
-                int GCI_val = track.t(i) * 16000;
-    //                std::cout << GCI_val << std::endl;
-                GCI_Reaper.push_back(GCI_val); // Insert GCI_val into GCI_Reaper vector
-            }
-        }
-    } else {
-        std::cerr << "GCI track is null" << std::endl;
+    /* Read configuration file */
+    if (ReadConfig(default_config_filename, true, &params) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    if (argc > 3) {
+        if (ReadConfig(user_config_filename, false, &params) == EXIT_FAILURE)
+            return EXIT_FAILURE;
     }
 
+    /* Select fixed-order kernels for the configured LP orders */
+    ConfigureFixedOrderKernels(params);
+    ConfigureScheduler(params.num_threads, params.pin_threads);
 
-    // Convert GCI_Reaper to gsl::vector
-    data.GCI_Reaper_gsl.resize(GCI_Reaper.size());
-    for (size_t i = 0; i < GCI_Reaper.size(); ++i) {
-        data.GCI_Reaper_gsl[i] = GCI_Reaper[i];
+    /* Output files are written by a writer thread while the analysis goes on */
+    OutputWriter output_writer;
+    OutputWriter *writer = NULL;
+    if (params.async_output) {
+        output_writer.Start((size_t)GSL_MAX(params.output_queue_mb, 1)*1024*1024, params.output_fsync);
+        writer = &output_writer;
     }
 
-
-    /* start to do the Rd param extraction */
-    GetRd(params, data.source_signal, data.GCI_Reaper_gsl, &(data.Rd_opt_temp), &(data.EE));
-
-    data.Rd_opt.resize(data.fundf.size());
-    InterpolateLinear(data.Rd_opt_temp, data.fundf.size(), &data.Rd_opt);
-
-//    std::cout << "********************* GCI params *********************" << data.Rd_opt_temp << std::endl;
-
-
-//    data.EE_aligned.resize(data.fundf.size());
-//    InterpolateLinear(data.EE, data.fundf.size(), &data.EE_aligned);
-
-
-
-
-    data.Ra.resize(data.Rd_opt_temp.size());
-    data.Rk.resize(data.Rd_opt_temp.size());
-    data.Rg.resize(data.Rd_opt_temp.size());
-
-    double Ra_cur;
-    double Rk_cur;
-    double Rg_cur;
-
-
-    for (size_t i = 0; i < data.Rd_opt_temp.size(); ++i) {
-        Rd2R(data.Rd_opt_temp(i), data.EE(i), data.F0_Reaper_gsl(i), Ra_cur, Rk_cur, Rg_cur);
-        data.Ra[i] = Ra_cur;
-        data.Rk[i] = Rk_cur;
-        data.Rg[i] = Rg_cur;
+    /* Files analysed before with the same input and settings are skipped */
+    AnalysisCache analysis_cache;
+    AnalysisCache *cache = NULL;
+    if (!params.analysis_cache_directory.empty()) {
+        if (analysis_cache.Open(params) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+        cache = &analysis_cache;
     }
 
-    data.LF_excitation_pulses = generateSyntheticSignal(data.source_signal, data.GCI_Reaper_gsl, data.F0_Reaper_gsl, data.Ra, data.Rk, data.Rg, data.EE, params.fs, params.f0_min, params.f0_max, 10);
-//    std::cout << data.LF_excitation_pulses << std::endl;
-
+    int result;
+    if (!batch) {
+        result = AnalyseFile(wav_filename, params, writer, cache);
+        if (output_writer.Finish() == EXIT_FAILURE)
+            result = EXIT_FAILURE;
+        if (analysis_cache.Close() == EXIT_FAILURE)
+            result = EXIT_FAILURE;
+        return result;
+    }
 
-    std::string out_fname;
-    out_fname = GetParamPath("lf_pulse/lf_glottal", ".lf_pulse.wav", params.dir_syn, params);
-//    std::cout << out_fname << std::endl;
-    if(WriteWavFile(out_fname, data.LF_excitation_pulses, params.fs) == EXIT_FAILURE)
+    std::vector<std::string> files;
+    if (ReadScpFile(wav_filename, &files) == EXIT_FAILURE)
         return EXIT_FAILURE;
 
-    data.excitation_signal = data.LF_excitation_pulses;
-
-    FilterExcitation(params, data, &(data.signal));
-    /* FFT based filtering includes spectral matching */
-    FftFilterExcitation(params, data, &(data.signal));
-    GenerateUnvoicedSignal(params, data, &(data.signal));
-
+    if (params.dataset_directory.empty()) {
+        result = RunBatch(files, params, [writer, cache](const std::string &file,
+                                                         const Param &file_params) {
+            return AnalyseFile(file.c_str(), file_params, writer, cache);
+        });
+        if (output_writer.Finish() == EXIT_FAILURE)
+            result = EXIT_FAILURE;
+        if (analysis_cache.Close() == EXIT_FAILURE)
+            result = EXIT_FAILURE;
+        return result;
+    }
 
-    out_fname = GetParamPath("lf_pulse/lf_syn", ".lf_syn.wav", params.dir_syn, params);
-    if(WriteWavFile(out_fname, data.signal, params.fs) == EXIT_FAILURE)
+    /* Training dataset of the whole list, written in list order */
+    DatasetWriter dataset;
+    if (dataset.Open(params) == EXIT_FAILURE)
         return EXIT_FAILURE;
-
-
-    /* Extract pitch synchronous (excitation) waveforms at each frame */
-
-    GetPulses(params, data.LF_excitation_pulses, data.GCI_Reaper_gsl, data.fundf, &(data.excitation_pulses));
-//    std::cout << "********************* cost params *********************" << data.excitation_pulses.size2() << std::endl;
-//    std::cout << "********************* cost params *********************" << data.fundf.size() << std::endl;
-
-
-    HnrAnalysis(params, data.source_signal, data.fundf, &(data.hnr_glot));
-
-    /* Convert vocal tract AR polynomials to LSF */
-    Poly2Lsf(data.poly_vocal_tract, &(data.lsf_vocal_tract));
-
-    /* Convert glottal source AR polynomials to LSF */
-    Poly2Lsf(data.poly_glot, &(data.lsf_glot));
-
-
-    if (params.rd_ratio != 1.0) {
-
-
-
-
-        for (std::size_t i = 0; i < data.Rd_opt_temp.size(); ++i) {
-            data.Rd_opt_temp[i] *= params.rd_ratio;
+    result = RunBatchIndexed(files, params, [&dataset, writer, cache](size_t index,
+                                                                      const std::string &file,
+                                                                      const Param &file_params) {
+        DatasetUtterance utterance;
+        int file_result;
+        try {
+            file_result = AnalyseFile(file.c_str(), file_params, writer, cache, &utterance);
+        } catch (...) {
+            /* The writer waits for every index */
+            dataset.Add(index, NULL);
+            throw;
         }
-
-        data.Ra.resize(data.Rd_opt_temp.size());
-        data.Rk.resize(data.Rd_opt_temp.size());
-        data.Rg.resize(data.Rd_opt_temp.size());
-
-        double Ra_cur;
-        double Rk_cur;
-        double Rg_cur;
-
-
-        for (size_t i = 0; i < data.Rd_opt_temp.size(); ++i) {
-            Rd2R(data.Rd_opt_temp(i), data.EE(i), data.F0_Reaper_gsl(i), Ra_cur, Rk_cur, Rg_cur);
-            data.Ra[i] = Ra_cur;
-            data.Rk[i] = Rk_cur;
-            data.Rg[i] = Rg_cur;
-        }
-
-        data.LF_excitation_pulses_tuned = generateSyntheticSignal(data.source_signal, data.GCI_Reaper_gsl, data.F0_Reaper_gsl, data.Ra, data.Rk, data.Rg, data.EE, params.fs, params.f0_min, params.f0_max, 10);
-//    std::cout << data.LF_excitation_pulses << std::endl;
-
-//        data.unvoiced.resize(data.source_signal.size());
-
-        std::string out_fname;
-        out_fname = GetParamPath("lf_pulse/lf_glottal_tuned", ".lf_pulse_tuned.wav", params.dir_syn, params);
-//    std::cout << out_fname << std::endl;
-        if(WriteWavFile(out_fname, data.LF_excitation_pulses_tuned, params.fs) == EXIT_FAILURE)
-            return EXIT_FAILURE;
-
-//    data.excitation_signal.size() = data.LF_excitation_pulses.size();
-        data.excitation_signal = data.LF_excitation_pulses_tuned;
-
-        FilterExcitation(params, data, &(data.signal));
-
-        /* FFT based filtering includes spectral matching */
-        FftFilterExcitation(params, data, &(data.signal));
-        GenerateUnvoicedSignal(params, data, &(data.signal));
-
-        out_fname = GetParamPath("lf_pulse/lf_syn_tuned", ".lf_syn_tuned.wav", params.dir_syn, params);
-//    std::cout << out_fname << std::endl;
-        if(WriteWavFile(out_fname, data.signal, params.fs) == EXIT_FAILURE)
-            return EXIT_FAILURE;
-    }
-
-
-
-
-//    std::cout << "********************* GCI params *********************" << GCI_Reaper << std::endl;
-
-    /* Write analyzed features to files */
-    data.SaveData(params);
-
-
-    return EXIT_SUCCESS;
-
-
+        if (dataset.Add(index, file_result == EXIT_SUCCESS ? &utterance : NULL) == EXIT_FAILURE)
+            file_result = EXIT_FAILURE;
+        return file_result;
+    });
+    if (dataset.Close() == EXIT_FAILURE)
+        result = EXIT_FAILURE;
+    if (output_writer.Finish() == EXIT_FAILURE)
+        result = EXIT_FAILURE;
+    if (analysis_cache.Close() == EXIT_FAILURE)
+        result = EXIT_FAILURE;
+    return result;
 }
 
 /***********/
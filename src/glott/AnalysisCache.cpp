@@ -0,0 +1,444 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "AnalysisCache.h"
+#include "FeatureContainer.h"
+#include "FileIo.h"
+#include "MappedFile.h"
+
+#define ANALYSIS_CACHE_MANIFEST "manifest.txt"
+
+/**
+ * Function Hash64
+ *
+ * 64-bit hash of a byte string, 8 bytes at a time (multiply and xor-shift
+ * per word). For detecting changed inputs, not for security.
+ */
+uint64_t Hash64(const void *data, const size_t &bytes, const uint64_t &seed) {
+   const uint8_t *ptr = static_cast<const uint8_t *>(data);
+   const uint64_t multiplier = 0x9e3779b97f4a7c15ULL;
+   uint64_t hash = seed ^ 0xcbf29ce484222325ULL;
+   size_t i;
+   for (i = 0; i + 8 <= bytes; i += 8) {
+      uint64_t word;
+      memcpy(&word, ptr + i, sizeof(word));
+      hash = (hash ^ word)*multiplier;
+      hash ^= hash >> 32;
+   }
+   for (; i < bytes; i++) {
+      hash = (hash ^ ptr[i])*multiplier;
+      hash ^= hash >> 32;
+   }
+   hash = (hash ^ (uint64_t)bytes)*multiplier;
+   return hash ^ (hash >> 29);
+}
+
+/* Key of a set of values, added one by one */
+class KeyHasher {
+ public:
+   explicit KeyHasher(const uint64_t &seed) : hash_(seed) {}
+
+   void Add(const void *data, const size_t &bytes) {hash_ = Hash64(data, bytes, hash_);}
+   void Add(const int &value) {Add(&value, sizeof(value));}
+   void Add(const bool &value) {Add((int)value);}
+   void Add(const double &value) {Add(&value, sizeof(value));}
+   void Add(const std::string &value) {
+      Add((int)value.size());
+      Add(value.data(), value.size());
+   }
+   int AddFile(const std::string &filename) {
+      MappedFile file;
+      if (file.Open(filename, 1) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+      Add(file.Values<uint8_t>(), file.bytes());
+      return EXIT_SUCCESS;
+   }
+
+   uint64_t hash() const {return hash_;}
+
+ private:
+   uint64_t hash_;
+};
+
+/**
+ * Function GetAnalysisOutputFiles
+ *
+ * Files written by the analysis of a file (SaveData and the LF pulse and
+ * LF synthesis signals).
+ */
+void GetAnalysisOutputFiles(const Param &params, std::vector<std::string> *files) {
+   files->clear();
+   if (params.feature_container) {
+      files->push_back(GetParamPath("feat", params.extension_container, params.dir_container, params));
+   } else {
+      if (params.extract_gain)
+         files->push_back(GetParamPath("gain", params.extension_gain, params.dir_gain, params));
+      if (params.extract_lsf_vt)
+         files->push_back(GetParamPath("lsf", params.extension_lsf, params.dir_lsf, params));
+      if (params.extract_lsf_glot)
+         files->push_back(GetParamPath("slsf", params.extension_lsfg, params.dir_lsfg, params));
+      if (params.extract_hnr)
+         files->push_back(GetParamPath("hnr", params.extension_hnr, params.dir_hnr, params));
+      if (params.extract_pulses_as_features)
+         files->push_back(GetParamPath("pls", params.extension_paf, params.dir_paf, params));
+      if (params.extract_f0)
+         files->push_back(GetParamPath("f0", params.extension_f0, params.dir_f0, params));
+      if (params.extract_rd) {
+         files->push_back(GetParamPath("rd", params.extension_rd, params.dir_exc, params));
+         files->push_back(GetParamPath("ee", params.extension_ee, params.dir_ee, params));
+         files->push_back(GetParamPath("ra", params.extension_ra, params.dir_ra, params));
+         files->push_back(GetParamPath("rk", params.extension_rk, params.dir_rk, params));
+         files->push_back(GetParamPath("rg", params.extension_rg, params.dir_rg, params));
+         files->push_back(GetParamPath("reaper_gci", params.extension_reaper_gci, params.dir_reaper_gci, params));
+         files->push_back(GetParamPath("reaper_f0", params.extension_reaper_f0, params.dir_reaper_f0, params));
+      }
+      if (params.extract_gci_signal)
+         files->push_back(GetParamPath("gci", params.extension_gci, params.dir_gci, params));
+   }
+   if (params.extract_glottal_excitation)
+      files->push_back(GetParamPath("src", params.extension_src, params.dir_exc, params));
+   if (params.extract_original_signal)
+      files->push_back(GetParamPath("exc", params.extension_wav, params.dir_exc, params));
+   files->push_back(GetParamPath("lf_pulse/lf_glottal", ".lf_pulse.wav", params.dir_syn, params));
+   files->push_back(GetParamPath("lf_pulse/lf_syn", ".lf_syn.wav", params.dir_syn, params));
+   if (params.rd_ratio != 1.0) {
+      files->push_back(GetParamPath("lf_pulse/lf_glottal_tuned", ".lf_pulse_tuned.wav", params.dir_syn, params));
+      files->push_back(GetParamPath("lf_pulse/lf_syn_tuned", ".lf_syn_tuned.wav", params.dir_syn, params));
+   }
+}
+
+/**
+ * Function GetAnalysisKey
+ *
+ * Keys of the analysis of wav_filename. Only the settings that change the
+ * analysis outputs are included: synthesis-only settings (postfilter,
+ * WSOLA, pitch scale, ...), thread counts and reports are not. Settings of
+ * the LF synthesis that the analysis runs for Rd are part of the second
+ * stage.
+ */
+int GetAnalysisKey(const std::string &wav_filename, const Param &params, AnalysisKey *key) {
+
+   KeyHasher front(ANALYSIS_CACHE_VERSION);
+   if (front.AddFile(wav_filename) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   const std::string *external_files[] = {
+      params.use_external_f0 ? &params.external_f0_filename : NULL,
+      params.use_external_gci ? &params.external_gci_filename : NULL,
+      params.use_external_lsf_vt ? &params.external_lsf_vt_filename : NULL};
+   for (const std::string *filename : external_files) {
+      front.Add(filename != NULL);
+      if (filename != NULL) {
+         if (front.AddFile(*filename) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+         front.Add((int)params.data_type);
+      }
+   }
+
+   /* F0, GCI, gain, spectral analysis, inverse filtering, REAPER */
+   front.Add(params.fs);
+   front.Add(params.frame_length);
+   front.Add(params.frame_length_long);
+   front.Add(params.frame_length_unvoiced);
+   front.Add(params.frame_shift);
+   front.Add(params.use_highpass_filtering);
+   front.Add((int)params.signal_polarity);
+   front.Add(params.f0_min);
+   front.Add(params.f0_max);
+   front.Add(params.voicing_threshold);
+   front.Add(params.zcr_threshold);
+   front.Add(params.relative_f0_threshold);
+   front.Add(params.max_pulse_len_diff);
+   front.Add((int)params.default_windowing_function);
+   front.Add(params.gif_pre_emphasis_coefficient);
+   front.Add(params.unvoiced_pre_emphasis_coefficient);
+   front.Add(params.lpc_order_vt);
+   front.Add(params.lpc_order_glot);
+   front.Add(params.lpc_order_glot_iaif);
+   front.Add(params.qmf_subband_analysis);
+   front.Add(params.lpc_order_vt_qmf1);
+   front.Add(params.lpc_order_vt_qmf2);
+   front.Add((int)params.lp_weighting_function);
+   front.Add(params.ame_duration_quotient);
+   front.Add(params.ame_position_quotient);
+   front.Add(params.use_iterative_gif);
+   front.Add(params.use_pitch_synchronous_analysis);
+   front.Add(params.warping_lambda_vt);
+   front.Add(params.use_fixed_order_kernels);
+   key->front = front.hash();
+
+   /* Rd, LF pulses and synthesis, pulses as features, HNR */
+   KeyHasher full(key->front);
+   full.Add(params.rd_ratio);
+   full.Add(params.paf_pulse_length);
+   full.Add((int)params.paf_analysis_window);
+   full.Add(params.use_paf_energy_normalization);
+   full.Add(params.extract_pulses_as_features);
+   full.Add(params.hnr_order);
+   full.Add((int)params.excitation_method);
+   full.Add(params.use_external_excitation);
+   full.Add(params.use_generic_envelope);
+   full.Add(params.use_spectral_matching);
+   full.Add(params.use_paf_unvoiced_synthesis);
+   full.Add(params.use_waveforms_directly);
+   full.Add(params.use_trajectory_smoothing);
+   full.Add(params.lsf_vt_smooth_len);
+   full.Add(params.lsf_glot_smooth_len);
+   full.Add(params.gain_smooth_len);
+   full.Add(params.hnr_smooth_len);
+   full.Add(params.filter_update_interval_vt);
+   full.Add(params.speed_scale);
+   full.Add(params.noise_gain_unvoiced);
+   full.Add(params.noise_gain_voiced);
+   full.Add(params.noise_low_freq_limit_voiced);
+   full.Add(params.random_seed);
+
+   /* Outputs */
+   std::vector<std::string> files;
+   GetAnalysisOutputFiles(params, &files);
+   for (const std::string &filename : files)
+      full.Add(filename);
+   full.Add((int)params.data_type);
+   full.Add((int)params.pulse_encoding);
+   full.Add((int)params.wav_format);
+   key->full = full.hash();
+
+   return EXIT_SUCCESS;
+}
+
+AnalysisCache::~AnalysisCache() {
+   Close();
+}
+
+int AnalysisCache::Open(const Param &params) {
+   if (params.analysis_chunk_seconds > 0.0) {
+      std::cerr << "Error: ANALYSIS_CACHE_DIRECTORY is not supported with ANALYSIS_CHUNK_SECONDS"
+                << std::endl;
+      return EXIT_FAILURE;
+   }
+   directory_ = params.analysis_cache_directory;
+   if (directory_.back() != '/')
+      directory_ += "/";
+   if (mkdir(directory_.c_str(), 0777) != 0 && errno != EEXIST) {
+      std::cerr << "Error: could not create directory " << directory_ << std::endl;
+      return EXIT_FAILURE;
+   }
+   use_stages_ = params.analysis_cache_stages;
+
+   /* Later lines replace earlier ones; lines of other versions are ignored */
+   const std::string filename = directory_ + ANALYSIS_CACHE_MANIFEST;
+   std::ifstream input(filename.c_str());
+   std::string line;
+   int version = 0;
+   while (std::getline(input, line)) {
+      if (line.compare(0, 1, "#") == 0) {
+         if (sscanf(line.c_str(), "# tolg analysis cache %d", &version) != 1)
+            version = 0;
+         continue;
+      }
+      const size_t tab1 = line.find('\t');
+      const size_t tab2 = (tab1 == std::string::npos) ? tab1 : line.find('\t', tab1 + 1);
+      const size_t tab3 = (tab2 == std::string::npos) ? tab2 : line.find('\t', tab2 + 1);
+      Entry entry;
+      if (version != ANALYSIS_CACHE_VERSION || tab3 == std::string::npos
+          || sscanf(line.c_str() + tab1 + 1, "%" SCNx64 "\t%" SCNx64,
+                    &entry.key.front, &entry.key.full) != 2)
+         continue;
+      entry.wav_filename = line.substr(tab3 + 1);
+      entries_[line.substr(0, tab1)] = entry;
+   }
+
+   manifest_ = fopen(filename.c_str(), "a");
+   if (manifest_ == NULL) {
+      std::cerr << "Error: could not open file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   fprintf(manifest_, "# tolg analysis cache %d\n", ANALYSIS_CACHE_VERSION);
+   fflush(manifest_);
+   std::cout << "Analysis cache: " << entries_.size() << " files in " << filename << std::endl;
+   return EXIT_SUCCESS;
+}
+
+std::string AnalysisCache::EntryLine(const std::string &name, const Entry &entry) {
+   char keys[64];
+   snprintf(keys, sizeof(keys), "%016" PRIx64 "\t%016" PRIx64, entry.key.front, entry.key.full);
+   return name + "\t" + keys + "\t" + entry.wav_filename + "\n";
+}
+
+int AnalysisCache::Close() {
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (manifest_ == NULL)
+      return EXIT_SUCCESS;
+   bool ok = fclose(manifest_) == 0;
+   manifest_ = NULL;
+
+   /* Compact: one line per file */
+   const std::string filename = directory_ + ANALYSIS_CACHE_MANIFEST;
+   const std::string tmp_filename = filename + ".tmp";
+   FILE *fid = fopen(tmp_filename.c_str(), "w");
+   ok = ok && fid != NULL;
+   if (fid != NULL) {
+      ok = fprintf(fid, "# tolg analysis cache %d\n", ANALYSIS_CACHE_VERSION) > 0 && ok;
+      for (const auto &entry : entries_)
+         ok = fputs(EntryLine(entry.first, entry.second).c_str(), fid) >= 0 && ok;
+      ok = fclose(fid) == 0 && ok;
+   }
+   if (!ok || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+      std::cerr << "Error: could not write file " << filename << std::endl;
+      remove(tmp_filename.c_str());
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+bool AnalysisCache::IsCurrent(const Param &params, const AnalysisKey &key) {
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto entry = entries_.find(params.file_basename);
+      if (entry == entries_.end() || entry->second.key.full != key.full)
+         return false;
+   }
+   std::vector<std::string> files;
+   GetAnalysisOutputFiles(params, &files);
+   struct stat info;
+   for (const std::string &filename : files)
+      if (stat(filename.c_str(), &info) != 0)
+         return false;
+   return true;
+}
+
+std::string AnalysisCache::StagePath(const Param &params) const {
+   return directory_ + params.file_basename + ".stage";
+}
+
+/* Front key as two 32-bit halves, exact in float64 */
+static void SetKeyVector(const uint64_t &key, gsl::vector *vector) {
+   *vector = gsl::vector(2);
+   (*vector)(0) = (double)(key >> 32);
+   (*vector)(1) = (double)(key & 0xffffffffULL);
+}
+
+static void ToVector(const gsl::vector_int &values, gsl::vector *vector) {
+   *vector = gsl::vector(values.size());
+   for (size_t i = 0; i < values.size(); i++)
+      (*vector)(i) = values(i);
+}
+
+/**
+ * Keep the state of the analysis after the first stage (AnalyseSignalFront)
+ * in float64, so that AnalyseSignalBack gives the same results from it.
+ * Files with empty results (no GCIs or REAPER epochs) are not kept.
+ */
+int AnalysisCache::WriteStage(const Param &params, const AnalysisKey &key, const AnalysisData &data) {
+   const gsl::vector *vectors[] = {&data.signal, &data.source_signal, &data.fundf, &data.frame_energy,
+                                   &data.F0_Reaper_gsl, &data.F0_Reaper_times, &data.GCI_Reaper_gsl};
+   for (const gsl::vector *vector : vectors)
+      if (!vector->is_set() || vector->size() == 0)
+         return EXIT_SUCCESS;
+   if (!data.gci_inds.is_set() || data.gci_inds.size() == 0)
+      return EXIT_SUCCESS;
+
+   gsl::vector front_key, gci;
+   SetKeyVector(key.front, &front_key);
+   ToVector(data.gci_inds, &gci);
+   FeatureContainerWriter stage;
+   stage.AddVector("front_key", front_key);
+   stage.AddVector("signal", data.signal);
+   stage.AddVector("source_signal", data.source_signal);
+   stage.AddVector("f0", data.fundf);
+   stage.AddVector("gain", data.frame_energy);
+   stage.AddVector("gci", gci);
+   stage.AddMatrix("poly_vt", data.poly_vocal_tract);
+   stage.AddMatrix("lsf", data.lsf_vocal_tract);
+   stage.AddMatrix("poly_glot", data.poly_glot);
+   stage.AddVector("reaper_f0", data.F0_Reaper_gsl);
+   stage.AddVector("reaper_f0_times", data.F0_Reaper_times);
+   stage.AddVector("reaper_gci", data.GCI_Reaper_gsl);
+   return stage.Write(StagePath(params), DOUBLE, false);
+}
+
+/**
+ * Restore the state after the first stage; data is allocated as by
+ * AnalyseSignalFront. Fails when there is no state for this front key.
+ */
+int AnalysisCache::ReadStage(const Param &params, const AnalysisKey &key, AnalysisData *data) {
+   const std::string filename = StagePath(params);
+   struct stat info;
+   if (stat(filename.c_str(), &info) != 0)
+      return EXIT_FAILURE;
+   FeatureContainer stage;
+   gsl::vector front_key, expected_key;
+   SetKeyVector(key.front, &expected_key);
+   if (stage.Open(filename) == EXIT_FAILURE || stage.FindStream("front_key") == NULL
+       || stage.ReadVector("front_key", &front_key) == EXIT_FAILURE
+       || front_key.size() != 2 || front_key(0) != expected_key(0) || front_key(1) != expected_key(1))
+      return EXIT_FAILURE;
+
+   data->AllocateData(params);
+   gsl::vector gci;
+   if (stage.ReadVector("signal", &(data->signal)) == EXIT_FAILURE
+       || stage.ReadVector("source_signal", &(data->source_signal)) == EXIT_FAILURE
+       || stage.ReadVector("f0", &(data->fundf)) == EXIT_FAILURE
+       || stage.ReadVector("gain", &(data->frame_energy)) == EXIT_FAILURE
+       || stage.ReadVector("gci", &gci) == EXIT_FAILURE
+       || stage.ReadMatrix("poly_vt", params.lpc_order_vt + 1, &(data->poly_vocal_tract)) == EXIT_FAILURE
+       || stage.ReadMatrix("lsf", params.lpc_order_vt, &(data->lsf_vocal_tract)) == EXIT_FAILURE
+       || stage.ReadMatrix("poly_glot", params.lpc_order_glot + 1, &(data->poly_glot)) == EXIT_FAILURE
+       || stage.ReadVector("reaper_f0", &(data->F0_Reaper_gsl)) == EXIT_FAILURE
+       || stage.ReadVector("reaper_f0_times", &(data->F0_Reaper_times)) == EXIT_FAILURE
+       || stage.ReadVector("reaper_gci", &(data->GCI_Reaper_gsl)) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (data->signal.size() != (size_t)params.signal_length
+       || data->fundf.size() != (size_t)params.number_of_frames)
+      return EXIT_FAILURE;
+   data->gci_inds = gsl::vector_int(gci.size());
+   for (size_t i = 0; i < gci.size(); i++)
+      data->gci_inds(i) = (int)gci(i);
+   std::vector<int16_t>().swap(data->signal_pcm16);
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Record the key of a file whose outputs have been written. Nothing is
+ * recorded if an output is missing.
+ */
+int AnalysisCache::Record(const std::string &wav_filename, const Param &params,
+                          const AnalysisKey &key) {
+   std::vector<std::string> files;
+   GetAnalysisOutputFiles(params, &files);
+   struct stat info;
+   for (const std::string &filename : files)
+      if (stat(filename.c_str(), &info) != 0)
+         return EXIT_FAILURE;
+
+   std::lock_guard<std::mutex> lock(mutex_);
+   Entry entry;
+   entry.key = key;
+   entry.wav_filename = wav_filename;
+   entries_[params.file_basename] = entry;
+   if (manifest_ == NULL)
+      return EXIT_FAILURE;
+   if (fputs(EntryLine(params.file_basename, entry).c_str(), manifest_) < 0 || fflush(manifest_) != 0) {
+      std::cerr << "Error: could not write file " << directory_ << ANALYSIS_CACHE_MANIFEST << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
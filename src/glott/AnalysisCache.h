@@ -0,0 +1,101 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_ANALYSISCACHE_H_
+#define SRC_GLOTT_ANALYSISCACHE_H_
+
+/*
+ * Incremental re-analysis (ANALYSIS_CACHE_DIRECTORY). Each analysed file
+ * gets two keys:
+ *   front  hash of the input audio (and external F0/GCI/LSF files) and of
+ *          the settings of the first analysis stage: F0, GCI, gain,
+ *          spectral analysis, inverse filtering and REAPER epochs
+ *   full   front key, the settings of the second stage (Rd, LF pulses and
+ *          synthesis, pulses as features, HNR) and the output files
+ * The keys of the files analysed so far are kept in a manifest. A file
+ * whose full key is in the manifest and whose outputs exist is skipped.
+ * With ANALYSIS_CACHE_STAGES, the state after the first stage is also
+ * kept (basename.stage, a float64 feature container that includes the
+ * front key), so that a file whose front key still matches only runs the
+ * second stage.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "definitions.h"
+
+#define ANALYSIS_CACHE_VERSION 1
+
+struct AnalysisKey {
+   uint64_t front;
+   uint64_t full;
+};
+
+uint64_t Hash64(const void *data, const size_t &bytes, const uint64_t &seed);
+
+/* params must have file_basename set (the outputs are named after it) */
+int GetAnalysisKey(const std::string &wav_filename, const Param &params, AnalysisKey *key);
+void GetAnalysisOutputFiles(const Param &params, std::vector<std::string> *files);
+
+/**
+ * Class AnalysisCache
+ *
+ * Manifest of analysed files in the cache directory (one line per file,
+ * appended as files are done; a later line replaces an earlier one) and
+ * the first-stage state files. Shared by the batch threads.
+ */
+class AnalysisCache {
+ public:
+   AnalysisCache() : manifest_(NULL), use_stages_(false) {}
+   ~AnalysisCache();
+
+   int Open(const Param &params);
+   /* Rewrite the manifest with one line per file */
+   int Close();
+
+   /* Outputs of the file exist and were written with this key */
+   bool IsCurrent(const Param &params, const AnalysisKey &key);
+   /* First-stage state of the file, if it was kept with this front key */
+   int ReadStage(const Param &params, const AnalysisKey &key, AnalysisData *data);
+   int WriteStage(const Param &params, const AnalysisKey &key, const AnalysisData &data);
+   /* Record the key once the outputs have been written */
+   int Record(const std::string &wav_filename, const Param &params, const AnalysisKey &key);
+
+   bool use_stages() const {return use_stages_;}
+
+ private:
+   struct Entry {
+      AnalysisKey key;
+      std::string wav_filename;
+   };
+
+   AnalysisCache(const AnalysisCache &);
+   AnalysisCache &operator=(const AnalysisCache &);
+
+   std::string StagePath(const Param &params) const;
+   static std::string EntryLine(const std::string &name, const Entry &entry);
+
+   std::mutex mutex_;
+   std::string directory_;
+   FILE *manifest_;
+   std::map<std::string, Entry> entries_;
+   bool use_stages_;
+};
+
+#endif /* SRC_GLOTT_ANALYSISCACHE_H_ */
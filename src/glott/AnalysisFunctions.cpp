@@ -26,6 +26,9 @@
 #include "Utils.h"
 #include "Filters.h"
 #include "QmfFunctions.h"
+#include "WindowCache.h"
+#include "FrameScheduler.h"
+#include "NoiseGenerator.h"
 
 
 
@@ -70,6 +73,18 @@ double hammingWindow(int i, int n) {
 
 int PolarityDetection(const Param &params, gsl::vector *signal,
                       gsl::vector *source_signal_iaif) {
+    SignalPolarity applied;
+    return PolarityDetection(params, signal, source_signal_iaif, &applied);
+}
+
+/**
+ * Same, also returning the polarity that was applied (POLARITY_DEFAULT or
+ * POLARITY_INVERT), so that it can be re-used for other parts of the
+ * same recording.
+ */
+int PolarityDetection(const Param &params, gsl::vector *signal,
+                      gsl::vector *source_signal_iaif, SignalPolarity *applied) {
+    *applied = POLARITY_DEFAULT;
     switch (params.signal_polarity) {
         case POLARITY_DEFAULT:
             return EXIT_SUCCESS;
@@ -78,6 +93,7 @@ int PolarityDetection(const Param &params, gsl::vector *signal,
             std::cout << " -- Inverting polarity (SIGNAL_POLARITY = \"INVERT\")"
                       << std::endl;
             (*signal) *= (double)-1.0;
+            *applied = POLARITY_INVERT;
             return EXIT_SUCCESS;
 
         case POLARITY_DETECT:
@@ -88,6 +104,7 @@ int PolarityDetection(const Param &params, gsl::vector *signal,
                           << std::endl;
                 (*signal) *= (double)-1.0;
                 (*source_signal_iaif) *= (double)-1.0;
+                *applied = POLARITY_INVERT;
             } else {
                 std::cout << "... Detected positive polarity." << std::endl;
             }
@@ -127,28 +144,30 @@ int GetF0(const Param &params, const gsl::vector &signal,
         }
     } else {
         *fundf = gsl::vector(params.number_of_frames);
-        gsl::vector signal_frame = gsl::vector(params.frame_length);
-        // gsl::vector glottal_frame = gsl::vector(2*params.frame_length); // Longer
-        // frame
-        gsl::vector glottal_frame =
-                gsl::vector(params.frame_length_long);  // Longer frame
-        int frame_index;
-        double ff;
         gsl::matrix fundf_candidates(params.number_of_frames,
                                      NUMBER_OF_F0_CANDIDATES);
-        gsl::vector candidates_vec(NUMBER_OF_F0_CANDIDATES);
-        for (frame_index = 0; frame_index < params.number_of_frames;
-             frame_index++) {
-            GetFrame(signal, frame_index, params.frame_shift, &signal_frame, NULL);
-            GetFrame(source_signal_iaif, frame_index, params.frame_shift,
-                     &glottal_frame, NULL);
-
-            FundamentalFrequency(params, glottal_frame, signal_frame, &ff,
-                                 &candidates_vec);
-            (*fundf)(frame_index) = ff;
-
-            fundf_candidates.set_row_vec(frame_index, candidates_vec);
-        }
+        ParallelFrames(params.num_threads, params.number_of_frames,
+                       [&](size_t begin, size_t end, size_t) {
+            gsl::vector signal_frame = gsl::vector(params.frame_length);
+            // gsl::vector glottal_frame = gsl::vector(2*params.frame_length); // Longer
+            // frame
+            gsl::vector glottal_frame =
+                    gsl::vector(params.frame_length_long);  // Longer frame
+            double ff;
+            gsl::vector candidates_vec(NUMBER_OF_F0_CANDIDATES);
+            size_t frame_index;
+            for (frame_index = begin; frame_index < end; frame_index++) {
+                GetFrame(signal, frame_index, params.frame_shift, &signal_frame, NULL);
+                GetFrame(source_signal_iaif, frame_index, params.frame_shift,
+                         &glottal_frame, NULL);
+
+                FundamentalFrequency(params, glottal_frame, signal_frame, &ff,
+                                     &candidates_vec);
+                (*fundf)(frame_index) = ff;
+
+                fundf_candidates.set_row_vec(frame_index, candidates_vec);
+            }
+        });
 
         /* Copy original F0 */
         gsl::vector fundf_orig(*fundf);
@@ -240,51 +259,52 @@ int GetGci(const Param &params, const gsl::vector &signal, const gsl::vector &so
 int GetGain(const Param &params, const gsl::vector &fundf,
             const gsl::vector &signal, gsl::vector *gain_ptr) {
     // double E_REF = 0.00001;
-    gsl::vector frame = gsl::vector(params.frame_length);
-    gsl::vector unvoiced_frame = gsl::vector(params.frame_length_unvoiced);
     gsl::vector gain = gsl::vector(params.number_of_frames);
-    ComplexVector frame_fft;
-    size_t NFFT = 4096;  // Long FFT
     double MIN_LOG_POWER = -100.0;
-    gsl::vector fft_mag(NFFT / 2 + 1);
     // int min_uv_frequency = rint((double)NFFT/(double)(params.fs)*000.0);
 
-    int frame_index;
-
-    frame.set_all(1.0);
-    ApplyWindowingFunction(params.default_windowing_function, &frame);
-    double frame_energy_compensation = sqrt(frame.size() / getSquareSum(frame));
-    double frame_energy;
-    bool frame_is_voiced;
-    for (frame_index = 0; frame_index < params.number_of_frames; frame_index++) {
-        frame_is_voiced = fundf(frame_index) > 0.0;
-        if (frame_is_voiced) {
-            GetFrame(signal, frame_index, params.frame_shift, &frame, NULL);
-            ApplyWindowingFunction(params.default_windowing_function, &frame);
-            frame_energy = getEnergy(frame);
-            if (frame_energy == 0.0) frame_energy = +DBL_MIN;
+    gsl::vector window(params.frame_length);
+    window.set_all(1.0);
+    ApplyWindowingFunction(params.default_windowing_function, &window);
+    const double frame_energy_compensation = sqrt(window.size() / getSquareSum(window));
+
+    ParallelFrames(params.num_threads, params.number_of_frames,
+                   [&](size_t begin, size_t end, size_t) {
+        gsl::vector frame = gsl::vector(params.frame_length);
+        gsl::vector unvoiced_frame = gsl::vector(params.frame_length_unvoiced);
+        double frame_energy;
+        bool frame_is_voiced;
+        size_t frame_index;
+        for (frame_index = begin; frame_index < end; frame_index++) {
+            frame_is_voiced = fundf(frame_index) > 0.0;
+            if (frame_is_voiced) {
+                GetFrame(signal, frame_index, params.frame_shift, &frame, NULL);
+                ApplyWindowingFunction(params.default_windowing_function, &frame);
+                frame_energy = getEnergy(frame);
+                if (frame_energy == 0.0) frame_energy = +DBL_MIN;
+
+                frame_energy *= frame_energy_compensation;  //(8.0/3.0);// Compensate
+                // windowing gain loss
+                gain(frame_index) = FrameEnergy2LogEnergy(frame_energy, frame.size());
 
-            frame_energy *= frame_energy_compensation;  //(8.0/3.0);// Compensate
-            // windowing gain loss
-            gain(frame_index) = FrameEnergy2LogEnergy(frame_energy, frame.size());
+            } else {
+                GetFrame(signal, frame_index, params.frame_shift, &unvoiced_frame, NULL);
+                ApplyWindowingFunction(params.default_windowing_function,
+                                       &unvoiced_frame);
+                frame_energy = getEnergy(unvoiced_frame);
 
-        } else {
-            GetFrame(signal, frame_index, params.frame_shift, &unvoiced_frame, NULL);
-            ApplyWindowingFunction(params.default_windowing_function,
-                                   &unvoiced_frame);
-            frame_energy = getEnergy(unvoiced_frame);
+                if (frame_energy == 0.0) frame_energy = +DBL_MIN;
 
-            if (frame_energy == 0.0) frame_energy = +DBL_MIN;
+                frame_energy *=
+                        frame_energy_compensation;  // Compensate windowing gain loss
+                gain(frame_index) =
+                        FrameEnergy2LogEnergy(frame_energy, unvoiced_frame.size());
+            }
 
-            frame_energy *=
-                    frame_energy_compensation;  // Compensate windowing gain loss
-            gain(frame_index) =
-                    FrameEnergy2LogEnergy(frame_energy, unvoiced_frame.size());
+            /* Clip gain at lower bound (prevent very low values for zero frames) */
+            if (gain(frame_index) < MIN_LOG_POWER) gain(frame_index) = MIN_LOG_POWER;
         }
-
-        /* Clip gain at lower bound (prevent very low values for zero frames) */
-        if (gain(frame_index) < MIN_LOG_POWER) gain(frame_index) = MIN_LOG_POWER;
-    }
+    });
     *gain_ptr = gain;
     return EXIT_SUCCESS;
 }
@@ -295,85 +315,86 @@ int GetGain(const Param &params, const gsl::vector &fundf,
  */
 int SpectralAnalysis(const Param &params, const AnalysisData &data,
                      gsl::matrix *poly_vocal_tract) {
-    gsl::vector frame(params.frame_length);
-    gsl::vector unvoiced_frame(params.frame_length_unvoiced, true);
-    gsl::vector pre_frame(params.lpc_order_vt * 2, true);
-    gsl::vector lp_weight(params.frame_length + params.lpc_order_vt * 3, true);
-    gsl::vector A(params.lpc_order_vt + 1, true);
-    gsl::vector G(params.lpc_order_glot_iaif, true);
-    gsl::vector B(1);
-    B(0) = 1.0;
-    // gsl::vector lip_radiation(2);lip_radiation(0) = 1.0; lip_radiation(1) =
-    // 0.99;
-    gsl::vector frame_pre_emph(params.frame_length);
-    gsl::vector frame_full;  // frame + preframe
-    gsl::vector residual(params.frame_length);
-
     if (params.use_external_lsf_vt == false) {
         std::cout << "Spectral analysis ...";
         /* Do analysis frame-wise */
-        size_t frame_index;
-        for (frame_index = 0; frame_index < (size_t)params.number_of_frames;
-             frame_index++) {
-            // GetPitchSynchFrame(data.signal, frame_index, params.frame_shift,
-            // &frame, &pre_frame);
-            /** Voiced analysis **/
-            if (data.fundf(frame_index) != 0) {
-                if (params.use_pitch_synchronous_analysis)
-                    GetPitchSynchFrame(params, data.signal, data.gci_inds, frame_index,
-                                       params.frame_shift, data.fundf(frame_index),
-                                       &frame, &pre_frame);
-                else
-                    GetFrame(data.signal, frame_index, params.frame_shift, &frame,
-                             &pre_frame);
-
-                /* Estimate Weighted Linear Prediction weight */
-                GetLpWeight(params, params.lp_weighting_function, data.gci_inds, frame,
-                            frame_index, &lp_weight);
-                /* Pre-emphasis and windowing */
-                Filter(std::vector<double>{1.0, -params.gif_pre_emphasis_coefficient},
-                       B, frame, &frame_pre_emph);
-                ApplyWindowingFunction(params.default_windowing_function,
-                                       &frame_pre_emph);
-                /* First-loop envelope */
-                ArAnalysis(params.lpc_order_vt, params.warping_lambda_vt,
-                           params.lp_weighting_function, lp_weight, frame_pre_emph, &A);
-                /* Second-loop envelope (if IAIF is used) */
-
-                if (params.use_iterative_gif) {
-                    ConcatenateFrames(pre_frame, frame, &frame_full);
-                    if (params.warping_lambda_vt != 0.0) {
-                        Filter(A, B, frame_full, &residual);
-                    } else {
-                        WFilter(A, B, frame_full, params.warping_lambda_vt, &residual);
-                    }
-                    ApplyWindowingFunction(params.default_windowing_function, &residual);
-                    ArAnalysis(params.lpc_order_glot_iaif, 0.0, NONE, lp_weight, residual,
-                               &G);
-                    Filter(G, B, frame, &frame_pre_emph);  // Iterated pre-emphasis
+        ParallelFrames(params.num_threads, params.number_of_frames,
+                       [&](size_t begin, size_t end, size_t) {
+            gsl::vector frame(params.frame_length);
+            gsl::vector unvoiced_frame(params.frame_length_unvoiced, true);
+            gsl::vector pre_frame(params.lpc_order_vt * 2, true);
+            gsl::vector lp_weight(params.frame_length + params.lpc_order_vt * 3, true);
+            gsl::vector A(params.lpc_order_vt + 1, true);
+            gsl::vector G(params.lpc_order_glot_iaif, true);
+            gsl::vector B(1);
+            B(0) = 1.0;
+            // gsl::vector lip_radiation(2);lip_radiation(0) = 1.0; lip_radiation(1) =
+            // 0.99;
+            gsl::vector frame_pre_emph(params.frame_length);
+            gsl::vector frame_full;  // frame + preframe
+            gsl::vector residual(params.frame_length);
+            size_t frame_index;
+            for (frame_index = begin; frame_index < end; frame_index++) {
+                // GetPitchSynchFrame(data.signal, frame_index, params.frame_shift,
+                // &frame, &pre_frame);
+                /** Voiced analysis **/
+                if (data.fundf(frame_index) != 0) {
+                    if (params.use_pitch_synchronous_analysis)
+                        GetPitchSynchFrame(params, data.signal, data.gci_inds, frame_index,
+                                           params.frame_shift, data.fundf(frame_index),
+                                           &frame, &pre_frame);
+                    else
+                        GetFrame(data.signal, frame_index, params.frame_shift, &frame,
+                                 &pre_frame);
+
+                    /* Estimate Weighted Linear Prediction weight */
+                    GetLpWeight(params, params.lp_weighting_function, data.gci_inds, frame,
+                                frame_index, &lp_weight);
+                    /* Pre-emphasis and windowing */
+                    Filter(std::vector<double>{1.0, -params.gif_pre_emphasis_coefficient},
+                           B, frame, &frame_pre_emph);
                     ApplyWindowingFunction(params.default_windowing_function,
                                            &frame_pre_emph);
+                    /* First-loop envelope */
                     ArAnalysis(params.lpc_order_vt, params.warping_lambda_vt,
-                               params.lp_weighting_function, lp_weight, frame_pre_emph,
-                               &A);
-                }
-                /** Unvoiced analysis **/
-            } else {
-                GetFrame(data.signal, frame_index, params.frame_shift, &unvoiced_frame,
-                         &pre_frame);
-                if (params.unvoiced_pre_emphasis_coefficient > 0.0) {
-                    Filter(
-                            std::vector<double>{
-                                    1.0, -1.0 * params.unvoiced_pre_emphasis_coefficient},
-                            std::vector<double>{1.0}, unvoiced_frame, &unvoiced_frame);
+                               params.lp_weighting_function, lp_weight, frame_pre_emph, &A);
+                    /* Second-loop envelope (if IAIF is used) */
+
+                    if (params.use_iterative_gif) {
+                        ConcatenateFrames(pre_frame, frame, &frame_full);
+                        if (params.warping_lambda_vt != 0.0) {
+                            Filter(A, B, frame_full, &residual);
+                        } else {
+                            WFilter(A, B, frame_full, params.warping_lambda_vt, &residual);
+                        }
+                        ApplyWindowingFunction(params.default_windowing_function, &residual);
+                        ArAnalysis(params.lpc_order_glot_iaif, 0.0, NONE, lp_weight, residual,
+                                   &G);
+                        Filter(G, B, frame, &frame_pre_emph);  // Iterated pre-emphasis
+                        ApplyWindowingFunction(params.default_windowing_function,
+                                               &frame_pre_emph);
+                        ArAnalysis(params.lpc_order_vt, params.warping_lambda_vt,
+                                   params.lp_weighting_function, lp_weight, frame_pre_emph,
+                                   &A);
+                    }
+                    /** Unvoiced analysis **/
+                } else {
+                    GetFrame(data.signal, frame_index, params.frame_shift, &unvoiced_frame,
+                             &pre_frame);
+                    if (params.unvoiced_pre_emphasis_coefficient > 0.0) {
+                        Filter(
+                                std::vector<double>{
+                                        1.0, -1.0 * params.unvoiced_pre_emphasis_coefficient},
+                                std::vector<double>{1.0}, unvoiced_frame, &unvoiced_frame);
+                    }
+                    ApplyWindowingFunction(params.default_windowing_function,
+                                           &unvoiced_frame);
+                    ArAnalysis(params.lpc_order_vt, params.warping_lambda_vt, NONE,
+                               lp_weight, unvoiced_frame, &A);
                 }
-                ApplyWindowingFunction(params.default_windowing_function,
-                                       &unvoiced_frame);
-                ArAnalysis(params.lpc_order_vt, params.warping_lambda_vt, NONE,
-                           lp_weight, unvoiced_frame, &A);
+                poly_vocal_tract->set_col_vec(frame_index, A);
             }
-            poly_vocal_tract->set_col_vec(frame_index, A);
-        }
+        });
     } else {
         std::cout << "Using external vocal tract LSFs ... ";
         /* Read external vocal tract filter LSFs*/
@@ -405,13 +426,6 @@ int SpectralAnalysis(const Param &params, const AnalysisData &data,
 
 int SpectralAnalysisQmf(const Param &params, const AnalysisData &data,
                         gsl::matrix *poly_vocal_tract) {
-    gsl::vector frame(params.frame_length);
-    gsl::vector frame_pre_emph(params.frame_length);
-    gsl::vector pre_frame(params.lpc_order_vt, true);
-    gsl::vector frame_qmf1(frame.size() / 2);  // Downsampled low-band frame
-    gsl::vector frame_qmf2(frame.size() / 2);  // Downsampled high-band frame
-    gsl::vector lp_weight_downsampled(frame_qmf1.size() +
-                                      params.lpc_order_vt_qmf1);
     gsl::vector B(1);
     B(0) = 1.0;
 
@@ -419,169 +433,190 @@ int SpectralAnalysisQmf(const Param &params, const AnalysisData &data,
             StdVector2GslVector(kCUTOFF05PI);  // Load hard-coded low-pass filter
     gsl::vector H1 = Qmf::GetMatchingFilter(H0);
 
-    gsl::vector lp_weight(params.frame_length + params.lpc_order_vt, true);
-    gsl::vector A(params.lpc_order_vt + 1, true);
-    gsl::vector A_qmf1(params.lpc_order_vt_qmf1 + 1, true);
-    gsl::vector A_qmf2(params.lpc_order_vt_qmf2 + 1, true);
-    // gsl::vector lsf_qmf1(params.lpc_order_vt_qmf1,true);
-    // gsl::vector lsf_qmf2(params.lpc_order_vt_qmf2,true);
-    // gsl::vector gain_qmf(params.number_of_frames);
-    double gain_qmf, e1, e2;
-
     gsl::vector lip_radiation(2);
     lip_radiation(0) = 1.0;
     lip_radiation(1) = -params.gif_pre_emphasis_coefficient;
 
-    // gsl::vector frame_full; // frame + preframe
-    // gsl::vector residual_full; // residual with preframe
-
     std::cout << "QMF sub-band-based spectral analysis ...";
 
-    size_t frame_index;
-    for (frame_index = 0; frame_index < (size_t)params.number_of_frames;
-         frame_index++) {
-        GetFrame(data.signal, frame_index, params.frame_shift, &frame, &pre_frame);
-
-        /** Voiced analysis (Low-band = QCP, High-band = LPC) **/
-        if (data.fundf(frame_index) != 0) {
-            /* Pre-emphasis */
-            Filter(lip_radiation, B, frame, &frame_pre_emph);
-            Qmf::GetSubBands(frame_pre_emph, H0, H1, &frame_qmf1, &frame_qmf2);
-            /* Gain differences between frame_qmf1 and frame_qmf2: */
-
-            e1 = getEnergy(frame_qmf1);
-            e2 = getEnergy(frame_qmf2);
-            if (e1 == 0.0) e1 += DBL_MIN;
-            if (e2 == 0.0) e2 += DBL_MIN;
-            gain_qmf = 20 * log10(e2 / e1);
-
-            /** Low-band analysis **/
-            GetLpWeight(params, params.lp_weighting_function, data.gci_inds, frame,
-                        frame_index, &lp_weight);
-            Qmf::Decimate(lp_weight, 2, &lp_weight_downsampled);
-
-            ApplyWindowingFunction(params.default_windowing_function, &frame_qmf1);
-            ArAnalysis(params.lpc_order_vt_qmf1, 0.0, params.lp_weighting_function,
-                       lp_weight_downsampled, frame_qmf1, &A_qmf1);
-
-            /** High-band analysis **/
-            // ApplyWindowingFunction(params.default_windowing_function,&frame_qmf2);
-            ArAnalysis(params.lpc_order_vt_qmf2, 0.0, NONE, lp_weight_downsampled,
-                       frame_qmf2, &A_qmf2);
-
-            Qmf::CombinePoly(A_qmf1, A_qmf2, gain_qmf, (int)frame_qmf1.size(), &A);
-            /** Unvoiced analysis (Low-band = LPC, High-band = LPC, no pre-emphasis)
-             * **/
-        } else {
-            // Qmf::GetSubBands(frame, H0, H1, &frame_qmf1, &frame_qmf2);
-
-            // e1 = getEnergy(frame_qmf1);
-            // e2 = getEnergy(frame_qmf2);
-            // if(e1 == 0.0)
-            //   e1 += DBL_MIN;
-            // if(e2 == 0.0)
-            //   e2 += DBL_MIN;
-            // gain_qmf = 20*log10(e2/e1);
-
-            /** Low-band analysis **/
-            // ApplyWindowingFunction(params.default_windowing_function,&frame_qmf1);
-            // ArAnalysis(params.lpc_order_vt_qmf1,0.0,NONE, lp_weight_downsampled,
-            // frame_qmf2, &A_qmf1);
-
-            /** High-band analysis **/
-            // ApplyWindowingFunction(params.default_windowing_function,&frame_qmf2);
-            // ArAnalysis(params.lpc_order_vt_qmf2,0.0,NONE, lp_weight_downsampled,
-            // frame_qmf2, &A_qmf2);
-            ApplyWindowingFunction(params.default_windowing_function, &frame);
-            ArAnalysis(params.lpc_order_vt, 0.0, NONE, lp_weight_downsampled, frame,
-                       &A);
-        }
+    ParallelFrames(params.num_threads, params.number_of_frames,
+                   [&](size_t begin, size_t end, size_t) {
+        gsl::vector frame(params.frame_length);
+        gsl::vector frame_pre_emph(params.frame_length);
+        gsl::vector pre_frame(params.lpc_order_vt, true);
+        gsl::vector frame_qmf1(frame.size() / 2);  // Downsampled low-band frame
+        gsl::vector frame_qmf2(frame.size() / 2);  // Downsampled high-band frame
+        gsl::vector lp_weight_downsampled(frame_qmf1.size() +
+                                          params.lpc_order_vt_qmf1);
+        gsl::vector lp_weight(params.frame_length + params.lpc_order_vt, true);
+        gsl::vector A(params.lpc_order_vt + 1, true);
+        gsl::vector A_qmf1(params.lpc_order_vt_qmf1 + 1, true);
+        gsl::vector A_qmf2(params.lpc_order_vt_qmf2 + 1, true);
+        // gsl::vector lsf_qmf1(params.lpc_order_vt_qmf1,true);
+        // gsl::vector lsf_qmf2(params.lpc_order_vt_qmf2,true);
+        // gsl::vector gain_qmf(params.number_of_frames);
+        double gain_qmf, e1, e2;
+
+        // gsl::vector frame_full; // frame + preframe
+        // gsl::vector residual_full; // residual with preframe
 
-        poly_vocal_tract->set_col_vec(frame_index, A);
-        // Poly2Lsf(A_qmf1,&lsf_qmf1);
-        // Poly2Lsf(A_qmf2,&lsf_qmf2);
-        // lsf_qmf1->set_col_vec(frame_index,lsf_qmf1);
-        // lsf_qmf2->set_col_vec(frame_index,lsf_qmf2);
-    }
-    return EXIT_SUCCESS;
-}
+        size_t frame_index;
+        for (frame_index = begin; frame_index < end; frame_index++) {
+            GetFrame(data.signal, frame_index, params.frame_shift, &frame, &pre_frame);
 
-int InverseFilter(const Param &params, const AnalysisData &data,
-                  gsl::matrix *poly_glot, gsl::vector *source_signal) {
-    size_t frame_index;
-    gsl::vector frame(params.frame_length, true);
-    gsl::vector pre_frame(2 * params.lpc_order_vt, true);
-    gsl::vector frame_full(frame.size() + pre_frame.size());  // Pre-frame + frame
-    gsl::vector frame_residual(params.frame_length);
-    gsl::vector a_glot(params.lpc_order_glot + 1);
-    gsl::vector b(1);
-    b(0) = 1.0;
+            /** Voiced analysis (Low-band = QCP, High-band = LPC) **/
+            if (data.fundf(frame_index) != 0) {
+                /* Pre-emphasis */
+                Filter(lip_radiation, B, frame, &frame_pre_emph);
+                Qmf::GetSubBands(frame_pre_emph, H0, H1, &frame_qmf1, &frame_qmf2);
+                /* Gain differences between frame_qmf1 and frame_qmf2: */
+
+                e1 = getEnergy(frame_qmf1);
+                e2 = getEnergy(frame_qmf2);
+                if (e1 == 0.0) e1 += DBL_MIN;
+                if (e2 == 0.0) e2 += DBL_MIN;
+                gain_qmf = 20 * log10(e2 / e1);
+
+                /** Low-band analysis **/
+                GetLpWeight(params, params.lp_weighting_function, data.gci_inds, frame,
+                            frame_index, &lp_weight);
+                Qmf::Decimate(lp_weight, 2, &lp_weight_downsampled);
 
-    // for linear frequency scale inverse filtering
-    gsl::vector a_lin(params.lpc_order_vt + 1);
-    gsl::vector a_lin_high_order(3 * params.lpc_order_vt +
-                                 1);  // arbitrary high order
-    size_t NFFT = 4096;
-    gsl::vector impulse(params.frame_length);
-    gsl::vector imp_response(params.frame_length);
-    gsl::vector pre_frame_high_order(3 * a_lin_high_order.size());
-    gsl::vector frame_full_high_order(frame.size() + pre_frame_high_order.size());
+                ApplyWindowingFunction(params.default_windowing_function, &frame_qmf1);
+                ArAnalysis(params.lpc_order_vt_qmf1, 0.0, params.lp_weighting_function,
+                           lp_weight_downsampled, frame_qmf1, &A_qmf1);
 
-    for (frame_index = 0; frame_index < (size_t)params.number_of_frames;
-         frame_index++) {
-        if (params.use_pitch_synchronous_analysis) {
-            GetPitchSynchFrame(params, data.signal, data.gci_inds, frame_index,
-                               params.frame_shift, data.fundf(frame_index), &frame,
-                               &pre_frame);
-            frame_residual.resize(frame.size());
-        } else {
-            GetFrame(data.signal, frame_index, params.frame_shift, &frame,
-                     &pre_frame);
-            GetFrame(data.signal, frame_index, params.frame_shift, &frame,
-                     &pre_frame_high_order);
-        }
+                /** High-band analysis **/
+                // ApplyWindowingFunction(params.default_windowing_function,&frame_qmf2);
+                ArAnalysis(params.lpc_order_vt_qmf2, 0.0, NONE, lp_weight_downsampled,
+                           frame_qmf2, &A_qmf2);
 
-        ConcatenateFrames(pre_frame, frame, &frame_full);
-        ConcatenateFrames(pre_frame_high_order, frame, &frame_full_high_order);
+                Qmf::CombinePoly(A_qmf1, A_qmf2, gain_qmf, (int)frame_qmf1.size(), &A);
+                /** Unvoiced analysis (Low-band = LPC, High-band = LPC, no pre-emphasis)
+                 * **/
+            } else {
+                // Qmf::GetSubBands(frame, H0, H1, &frame_qmf1, &frame_qmf2);
+
+                // e1 = getEnergy(frame_qmf1);
+                // e2 = getEnergy(frame_qmf2);
+                // if(e1 == 0.0)
+                //   e1 += DBL_MIN;
+                // if(e2 == 0.0)
+                //   e2 += DBL_MIN;
+                // gain_qmf = 20*log10(e2/e1);
+
+                /** Low-band analysis **/
+                // ApplyWindowingFunction(params.default_windowing_function,&frame_qmf1);
+                // ArAnalysis(params.lpc_order_vt_qmf1,0.0,NONE, lp_weight_downsampled,
+                // frame_qmf2, &A_qmf1);
+
+                /** High-band analysis **/
+                // ApplyWindowingFunction(params.default_windowing_function,&frame_qmf2);
+                // ArAnalysis(params.lpc_order_vt_qmf2,0.0,NONE, lp_weight_downsampled,
+                // frame_qmf2, &A_qmf2);
+                ApplyWindowingFunction(params.default_windowing_function, &frame);
+                ArAnalysis(params.lpc_order_vt, 0.0, NONE, lp_weight_downsampled, frame,
+                           &A);
+            }
 
-        if (params.warping_lambda_vt == 0.0) {
-            Filter(data.poly_vocal_tract.get_col_vec(frame_index), b, frame_full,
-                   &frame_residual);
-        } else {
-            gsl::vector a_warp(data.poly_vocal_tract.get_col_vec(frame_index));
-            // get warped filter linear frequency response via impulse response
-            imp_response.set_zero();
-            impulse.set_zero();
-            // give pre-frame (only affects phase, not filter fit)
-            impulse(a_lin_high_order.size()) = 1.0;
-            // get inverse filter impulse response
-            WFilter(a_warp, b, impulse, params.warping_lambda_vt, &imp_response);
-            // Do high-order LP fit on the inverse filter (FIR polynomial)
-            StabilizePoly(NFFT, imp_response, &a_lin_high_order);
-            // Linear filtering
-            Filter(a_lin_high_order, b, frame_full_high_order, &frame_residual);
+            poly_vocal_tract->set_col_vec(frame_index, A);
+            // Poly2Lsf(A_qmf1,&lsf_qmf1);
+            // Poly2Lsf(A_qmf2,&lsf_qmf2);
+            // lsf_qmf1->set_col_vec(frame_index,lsf_qmf1);
+            // lsf_qmf2->set_col_vec(frame_index,lsf_qmf2);
         }
+    });
+    return EXIT_SUCCESS;
+}
 
-        double ola_gain =
-                (double)params.frame_length / ((double)params.frame_shift * 2.0);
-        // Scale by frame energy, TODO: remove?
-        frame_residual *= LogEnergy2FrameEnergy(data.frame_energy(frame_index),
-                                                frame_residual.size()) /
-                          getEnergy(frame_residual) / ola_gain;
-        ApplyWindowingFunction(params.default_windowing_function, &frame_residual);
+int InverseFilter(const Param &params, const AnalysisData &data,
+                  gsl::matrix *poly_glot, gsl::vector *source_signal) {
+    /* Residual frames of each chunk, overlap-added in frame order */
+    std::vector<std::vector<gsl::vector> > chunk_residuals(GSL_MAX(params.num_threads, 1));
+
+    ParallelFramesOrdered(params.num_threads, params.number_of_frames,
+                          [&](size_t begin, size_t end, size_t slot) {
+        gsl::vector frame(params.frame_length, true);
+        gsl::vector pre_frame(2 * params.lpc_order_vt, true);
+        gsl::vector frame_full(frame.size() + pre_frame.size());  // Pre-frame + frame
+        gsl::vector frame_residual(params.frame_length);
+        gsl::vector a_glot(params.lpc_order_glot + 1);
+        gsl::vector b(1);
+        b(0) = 1.0;
+
+        // for linear frequency scale inverse filtering
+        gsl::vector a_lin(params.lpc_order_vt + 1);
+        gsl::vector a_lin_high_order(3 * params.lpc_order_vt +
+                                     1);  // arbitrary high order
+        size_t NFFT = 4096;
+        gsl::vector impulse(params.frame_length);
+        gsl::vector imp_response(params.frame_length);
+        gsl::vector pre_frame_high_order(3 * a_lin_high_order.size());
+        gsl::vector frame_full_high_order(frame.size() + pre_frame_high_order.size());
+
+        std::vector<gsl::vector> &residuals = chunk_residuals[slot];
+        residuals.resize(end - begin);
+        size_t frame_index;
+        for (frame_index = begin; frame_index < end; frame_index++) {
+            if (params.use_pitch_synchronous_analysis) {
+                GetPitchSynchFrame(params, data.signal, data.gci_inds, frame_index,
+                                   params.frame_shift, data.fundf(frame_index), &frame,
+                                   &pre_frame);
+                frame_residual.resize(frame.size());
+            } else {
+                GetFrame(data.signal, frame_index, params.frame_shift, &frame,
+                         &pre_frame);
+                GetFrame(data.signal, frame_index, params.frame_shift, &frame,
+                         &pre_frame_high_order);
+            }
 
-        LPC(frame_residual, params.lpc_order_glot, &a_glot);
-        size_t i;
-        for (i = 0; i < a_glot.size(); i++) {
-            if (gsl_isnan((a_glot)(i))) {
-                (a_glot)(i) = (0.0);
+            ConcatenateFrames(pre_frame, frame, &frame_full);
+            ConcatenateFrames(pre_frame_high_order, frame, &frame_full_high_order);
+
+            if (params.warping_lambda_vt == 0.0) {
+                Filter(data.poly_vocal_tract.get_col_vec(frame_index), b, frame_full,
+                       &frame_residual);
+            } else {
+                gsl::vector a_warp(data.poly_vocal_tract.get_col_vec(frame_index));
+                // get warped filter linear frequency response via impulse response
+                imp_response.set_zero();
+                impulse.set_zero();
+                // give pre-frame (only affects phase, not filter fit)
+                impulse(a_lin_high_order.size()) = 1.0;
+                // get inverse filter impulse response
+                WFilter(a_warp, b, impulse, params.warping_lambda_vt, &imp_response);
+                // Do high-order LP fit on the inverse filter (FIR polynomial)
+                StabilizePoly(NFFT, imp_response, &a_lin_high_order);
+                // Linear filtering
+                Filter(a_lin_high_order, b, frame_full_high_order, &frame_residual);
             }
-        }
-        poly_glot->set_col_vec(frame_index, a_glot);
 
-        OverlapAdd(frame_residual, frame_index * params.frame_shift,
-                   source_signal);  // center index = frame_index*params.frame_shift
-    }
+            double ola_gain =
+                    (double)params.frame_length / ((double)params.frame_shift * 2.0);
+            // Scale by frame energy, TODO: remove?
+            frame_residual *= LogEnergy2FrameEnergy(data.frame_energy(frame_index),
+                                                    frame_residual.size()) /
+                              getEnergy(frame_residual) / ola_gain;
+            ApplyWindowingFunction(params.default_windowing_function, &frame_residual);
+
+            LPC(frame_residual, params.lpc_order_glot, &a_glot);
+            size_t i;
+            for (i = 0; i < a_glot.size(); i++) {
+                if (gsl_isnan((a_glot)(i))) {
+                    (a_glot)(i) = (0.0);
+                }
+            }
+            poly_glot->set_col_vec(frame_index, a_glot);
+
+            residuals[frame_index - begin].copy(frame_residual);
+        }
+    }, [&](size_t begin, size_t end, size_t slot) {
+        size_t frame_index;
+        for (frame_index = begin; frame_index < end; frame_index++)
+            OverlapAdd(chunk_residuals[slot][frame_index - begin],
+                       frame_index * params.frame_shift,
+                       source_signal);  // center index = frame_index*params.frame_shift
+    });
 
     return EXIT_SUCCESS;
 }
@@ -707,91 +742,93 @@ void GetPulses(const Param &params, const gsl::vector &source_signal,
 
     std::cout << "Extracting excitation pulses ";
 
-    size_t frame_index;
-    for (frame_index = 0; frame_index < (size_t)params.number_of_frames;
-         frame_index++) {
-        size_t sample_index = frame_index * params.frame_shift;
-        int pulse_index = Find_nearest_pulse_index(sample_index, gci_inds,
-                                                   params, fundf(frame_index));
+    ParallelFrames(params.num_threads, params.number_of_frames,
+                   [&](size_t begin, size_t end, size_t) {
+        size_t frame_index;
+        for (frame_index = begin; frame_index < end; frame_index++) {
+            size_t sample_index = frame_index * params.frame_shift;
+            int pulse_index = Find_nearest_pulse_index(sample_index, gci_inds,
+                                                       params, fundf(frame_index));
 
-        gsl::vector paf_pulse(params.paf_pulse_length, true);
-        gsl::vector pulse;
+            gsl::vector paf_pulse(params.paf_pulse_length, true);
+            gsl::vector pulse;
 
-        int center_index;
-        /* Use frame center directly for unvoiced */
-        if (fundf(frame_index) == 0.0 || pulse_index == PULSE_NOT_FOUND) {
-            center_index = sample_index;
-        } else {
-            center_index = gci_inds(pulse_index);
-
-            /* Check that pulse center index is reasonably
-             * close to frame center index
-             */
-            int THRESH = 100 * params.frame_length;
-            if (abs(center_index - (int)sample_index) > THRESH) {
-                std::cerr
-                        << "Warning: no suitable pulse in range,"
-                        << "treating frame as unvoiced"
-                        << std::endl;
-                std::cerr
-                        << "Frame: " << frame_index
-                        << ", distance: " << abs(center_index - (int)sample_index)
-                        << std::endl;
+            int center_index;
+            /* Use frame center directly for unvoiced */
+            if (fundf(frame_index) == 0.0 || pulse_index == PULSE_NOT_FOUND) {
                 center_index = sample_index;
+            } else {
+                center_index = gci_inds(pulse_index);
+
+                /* Check that pulse center index is reasonably
+                 * close to frame center index
+                 */
+                int THRESH = 100 * params.frame_length;
+                if (abs(center_index - (int)sample_index) > THRESH) {
+                    std::cerr
+                            << "Warning: no suitable pulse in range,"
+                            << "treating frame as unvoiced"
+                            << std::endl;
+                    std::cerr
+                            << "Frame: " << frame_index
+                            << ", distance: " << abs(center_index - (int)sample_index)
+                            << std::endl;
+                    center_index = sample_index;
+                }
             }
-        }
 
-        int i;
-        size_t j;
+            int i;
+            size_t j;
 
-        /* No interpolation, window with selected window */
-        if (params.paf_analysis_window != RECT) {
-            /* Apply pitch-synchronous analysis window to pulse */
+            /* No interpolation, window with selected window */
+            if (params.paf_analysis_window != RECT) {
+                /* Apply pitch-synchronous analysis window to pulse */
 
-            size_t T;
-            if (fundf(frame_index) != 0.0) {
-                /* Voiced: use two pitch periods () */
-                T = round(2.0 * (double)params.fs / fundf(frame_index));
-                if (T > paf_pulse.size()) T = paf_pulse.size();
+                size_t T;
+                if (fundf(frame_index) != 0.0) {
+                    /* Voiced: use two pitch periods () */
+                    T = round(2.0 * (double)params.fs / fundf(frame_index));
+                    if (T > paf_pulse.size()) T = paf_pulse.size();
+                } else {
+                    /* Unvoiced: use all available space */
+                    T = paf_pulse.size();
+                }
+
+                pulse = gsl::vector(T);
+                for (j = 0; j < T; j++) {
+                    i = center_index - round(pulse.size() / 2.0) + j;
+                    if (i >= 0 && i < (int)source_signal.size())
+                        pulse(j) = source_signal(i);
+                }
+                ApplyWindowingFunction(params.paf_analysis_window, &pulse);
+
+                for (j = 0; j < pulse.size(); j++) {
+                    paf_pulse(
+                            (round(paf_pulse.size() / 2.0) - round(pulse.size() / 2.0)) + j) =
+                            pulse(j);
+                }
             } else {
-                /* Unvoiced: use all available space */
-                T = paf_pulse.size();
+                /* params.paf_analysis_window == RECT */
+                /* No windowing, just copy to paf_pulse */
+                for (j = 0; j < paf_pulse.size(); j++) {
+                    i = center_index - round(paf_pulse.size() / 2.0) + j;
+                    if (i >= 0 && i < (int)source_signal.size())
+                        paf_pulse(j) = source_signal(i);
+                }
             }
 
-            pulse = gsl::vector(T);
-            for (j = 0; j < T; j++) {
-                i = center_index - round(pulse.size() / 2.0) + j;
-                if (i >= 0 && i < (int)source_signal.size())
-                    pulse(j) = source_signal(i);
+            /* Normalize energy */
+            if (params.use_paf_energy_normalization) {
+                paf_pulse /= getEnergy(paf_pulse);
             }
-            ApplyWindowingFunction(params.paf_analysis_window, &pulse);
 
-            for (j = 0; j < pulse.size(); j++) {
-                paf_pulse(
-                        (round(paf_pulse.size() / 2.0) - round(pulse.size() / 2.0)) + j) =
-                        pulse(j);
-            }
-        } else {
-            /* params.paf_analysis_window == RECT */
-            /* No windowing, just copy to paf_pulse */
-            for (j = 0; j < paf_pulse.size(); j++) {
-                i = center_index - round(paf_pulse.size() / 2.0) + j;
-                if (i >= 0 && i < (int)source_signal.size())
-                    paf_pulse(j) = source_signal(i);
-            }
-        }
+            paf_pulse = replace_nan(paf_pulse);
 
-        /* Normalize energy */
-        if (params.use_paf_energy_normalization) {
-            paf_pulse /= getEnergy(paf_pulse);
+    //        std::cout << "********************* cost params *********************" << paf_pulse << std::endl;
+            /* Save to matrix */
+            pulses_mat->set_col_vec(frame_index, paf_pulse);
         }
-
-        paf_pulse = replace_nan(paf_pulse);
-
-//        std::cout << "********************* cost params *********************" << paf_pulse << std::endl;
-        /* Save to matrix */
-        pulses_mat->set_col_vec(frame_index, paf_pulse);
-    }
+    });
     std::cout << "done." << std::endl;
 }
 
@@ -822,54 +859,66 @@ void HighPassFiltering(const Param &params, gsl::vector *signal) {
 
 void GetIaifResidual(const Param &params, const gsl::vector &signal,
                      gsl::vector *residual) {
-    gsl::vector frame(params.frame_length, true);
-    gsl::vector frame_residual(params.frame_length, true);
-    gsl::vector frame_pre_emph(params.frame_length, true);
-    gsl::vector pre_frame(params.lpc_order_vt, true);
-    gsl::vector frame_full(params.lpc_order_vt + params.frame_length, true);
-    gsl::vector A(params.lpc_order_vt + 1, true);
-    gsl::vector B(1);
-    B(0) = 1.0;
-    gsl::vector G(params.lpc_order_glot_iaif + 1, true);
-    gsl::vector weight_fn;
-
     if (!residual->is_set()) *residual = gsl::vector(signal.size());
 
-    size_t frame_index;
-    for (frame_index = 0; frame_index < (size_t)params.number_of_frames;
-         frame_index++) {
-        GetFrame(signal, frame_index, params.frame_shift, &frame, &pre_frame);
+    /* Residual frames of each chunk, overlap-added in frame order */
+    std::vector<std::vector<gsl::vector> > chunk_residuals(GSL_MAX(params.num_threads, 1));
+
+    ParallelFramesOrdered(params.num_threads, params.number_of_frames,
+                          [&](size_t begin, size_t end, size_t slot) {
+        gsl::vector frame(params.frame_length, true);
+        gsl::vector frame_residual(params.frame_length, true);
+        gsl::vector frame_pre_emph(params.frame_length, true);
+        gsl::vector pre_frame(params.lpc_order_vt, true);
+        gsl::vector frame_full(params.lpc_order_vt + params.frame_length, true);
+        gsl::vector A(params.lpc_order_vt + 1, true);
+        gsl::vector B(1);
+        B(0) = 1.0;
+        gsl::vector G(params.lpc_order_glot_iaif + 1, true);
+        gsl::vector weight_fn;
+
+        std::vector<gsl::vector> &residuals = chunk_residuals[slot];
+        residuals.resize(end - begin);
+        size_t frame_index;
+        for (frame_index = begin; frame_index < end; frame_index++) {
+            GetFrame(signal, frame_index, params.frame_shift, &frame, &pre_frame);
 
-        /* Pre-emphasis and windowing */
-        Filter(std::vector<double>{1.0, -params.gif_pre_emphasis_coefficient}, B,
-               frame, &frame_pre_emph);
-        ApplyWindowingFunction(params.default_windowing_function, &frame_pre_emph);
+            /* Pre-emphasis and windowing */
+            Filter(std::vector<double>{1.0, -params.gif_pre_emphasis_coefficient}, B,
+                   frame, &frame_pre_emph);
+            ApplyWindowingFunction(params.default_windowing_function, &frame_pre_emph);
 
-        ArAnalysis(params.lpc_order_vt, 0.0, NONE, weight_fn, frame_pre_emph, &A);
-        ConcatenateFrames(pre_frame, frame, &frame_full);
+            ArAnalysis(params.lpc_order_vt, 0.0, NONE, weight_fn, frame_pre_emph, &A);
+            ConcatenateFrames(pre_frame, frame, &frame_full);
 
-        Filter(A, B, frame_full, &frame_residual);
+            Filter(A, B, frame_full, &frame_residual);
 
-        ApplyWindowingFunction(params.default_windowing_function, &frame_residual);
-        ArAnalysis(params.lpc_order_glot_iaif, 0.0, NONE, weight_fn, frame_residual,
-                   &G);
+            ApplyWindowingFunction(params.default_windowing_function, &frame_residual);
+            ArAnalysis(params.lpc_order_glot_iaif, 0.0, NONE, weight_fn, frame_residual,
+                       &G);
 
-        Filter(G, B, frame, &frame_pre_emph);  // Iterated pre-emphasis
-        ApplyWindowingFunction(params.default_windowing_function, &frame_pre_emph);
+            Filter(G, B, frame, &frame_pre_emph);  // Iterated pre-emphasis
+            ApplyWindowingFunction(params.default_windowing_function, &frame_pre_emph);
 
-        ArAnalysis(params.lpc_order_vt, 0.0, NONE, weight_fn, frame_pre_emph, &A);
+            ArAnalysis(params.lpc_order_vt, 0.0, NONE, weight_fn, frame_pre_emph, &A);
 
-        Filter(A, B, frame_full, &frame_residual);
+            Filter(A, B, frame_full, &frame_residual);
 
-        /* Set energy of residual equal to energy of frame */
-        double ola_gain =
-                (double)params.frame_length / ((double)params.frame_shift * 2.0);
-        frame_residual *= getEnergy(frame) / getEnergy(frame_residual) / ola_gain;
+            /* Set energy of residual equal to energy of frame */
+            double ola_gain =
+                    (double)params.frame_length / ((double)params.frame_shift * 2.0);
+            frame_residual *= getEnergy(frame) / getEnergy(frame_residual) / ola_gain;
 
-        ApplyWindowingFunction(HANN, &frame_residual);
+            ApplyWindowingFunction(HANN, &frame_residual);
 
-        OverlapAdd(frame_residual, frame_index * params.frame_shift, residual);
-    }
+            residuals[frame_index - begin].copy(frame_residual);
+        }
+    }, [&](size_t begin, size_t end, size_t slot) {
+        size_t frame_index;
+        for (frame_index = begin; frame_index < end; frame_index++)
+            OverlapAdd(chunk_residuals[slot][frame_index - begin],
+                       frame_index * params.frame_shift, residual);
+    });
 }
 
 void HnrAnalysis(const Param &params, const gsl::vector &source_signal,
@@ -878,65 +927,79 @@ void HnrAnalysis(const Param &params, const gsl::vector &source_signal,
 
     /* Variables */
     int hnr_channels = params.hnr_order;
-    gsl::vector frame(params.frame_length_long);
-    ComplexVector frame_fft;
     size_t NFFT = 4096;  // Long FFT
     double MIN_LOG_POWER = -60.0;
-    gsl::vector fft_mag(NFFT / 2 + 1);
-
-    gsl::vector_int harmonic_index;
-    gsl::vector hnr_values;
-
-    gsl::vector harmonic_values;  // experimental, ljuvela
-    gsl::vector upper_env_values;
-    gsl::vector lower_env_values;
-    gsl::vector fft_lower_env(NFFT / 2 + 1, true);
-    gsl::vector fft_upper_env(NFFT / 2 + 1);
 
     double kbd_alpha = 2.3;
     gsl::vector kbd_window =
-            getKaiserBesselDerivedWindow(frame.size(), kbd_alpha);
-
-    /* Linearly spaced frequency axis */
-    gsl::vector_int x_interp = LinspaceInt(0, 1, fft_mag.size() - 1);
+            getKaiserBesselDerivedWindow(params.frame_length_long, kbd_alpha);
 
-    gsl::vector hnr_interp(fft_mag.size());
+    /* Linear-scale HNR of each chunk. Linear2Erb accumulates into hnr_erb
+     * without clearing it, so the ERB conversion runs in frame order. */
+    std::vector<std::vector<gsl::vector> > chunk_hnr(GSL_MAX(params.num_threads, 1));
     gsl::vector hnr_erb(hnr_channels);
 
-    size_t frame_index, i;
-    double val;
-    for (frame_index = 0; frame_index < (size_t)params.number_of_frames;
-         frame_index++) {
-        GetFrame(source_signal, frame_index, params.frame_shift, &frame, NULL);
-        // ApplyWindowingFunction(params.default_windowing_function, &frame);
-        frame *= kbd_window;
-        FFTRadix2(frame, NFFT, &frame_fft);
-        fft_mag = frame_fft.getAbs();
-        for (i = 0; i < fft_mag.size(); i++) {
-            val =
-                    20 *
-                    log10(fft_mag(i));  // save to temp to prevent evaluation twice in max
-            fft_mag(i) = GSL_MAX(val, MIN_LOG_POWER);  // Min log-power = -60dB
-        }
+    ParallelFramesOrdered(params.num_threads, params.number_of_frames,
+                          [&](size_t begin, size_t end, size_t slot) {
+        gsl::vector frame(params.frame_length_long);
+        ComplexVector frame_fft;
+        gsl::vector fft_mag(NFFT / 2 + 1);
+
+        gsl::vector_int harmonic_index;
+        gsl::vector hnr_values;
+
+        gsl::vector harmonic_values;  // experimental, ljuvela
+        gsl::vector upper_env_values;
+        gsl::vector lower_env_values;
+        gsl::vector fft_lower_env(NFFT / 2 + 1, true);
+        gsl::vector fft_upper_env(NFFT / 2 + 1);
+
+        /* Linearly spaced frequency axis */
+        gsl::vector_int x_interp = LinspaceInt(0, 1, fft_mag.size() - 1);
+
+        gsl::vector hnr_interp(fft_mag.size());
+
+        std::vector<gsl::vector> &hnr_frames = chunk_hnr[slot];
+        hnr_frames.resize(end - begin);
+        size_t frame_index, i;
+        double val;
+        for (frame_index = begin; frame_index < end; frame_index++) {
+            GetFrame(source_signal, frame_index, params.frame_shift, &frame, NULL);
+            // ApplyWindowingFunction(params.default_windowing_function, &frame);
+            frame *= kbd_window;
+            FFTRadix2(frame, NFFT, &frame_fft);
+            fft_mag = frame_fft.getAbs();
+            for (i = 0; i < fft_mag.size(); i++) {
+                val =
+                        20 *
+                        log10(fft_mag(i));  // save to temp to prevent evaluation twice in max
+                fft_mag(i) = GSL_MAX(val, MIN_LOG_POWER);  // Min log-power = -60dB
+            }
 
-        if (fundf(frame_index) > 0) {
-            UpperLowerEnvelope(fft_mag, fundf(frame_index), params.fs, &fft_upper_env,
-                               &fft_lower_env);
-        } else {
-            /* Define the upper envelope as the maxima around pseudo-period of 100Hz
-             */
-            UpperLowerEnvelope(fft_mag, 100.0, params.fs, &fft_upper_env,
-                               &fft_lower_env);
-        }
+            if (fundf(frame_index) > 0) {
+                UpperLowerEnvelope(fft_mag, fundf(frame_index), params.fs, &fft_upper_env,
+                                   &fft_lower_env);
+            } else {
+                /* Define the upper envelope as the maxima around pseudo-period of 100Hz
+                 */
+                UpperLowerEnvelope(fft_mag, 100.0, params.fs, &fft_upper_env,
+                                   &fft_lower_env);
+            }
 
-        /* HNR as upper-lower envelope difference */
-        for (i = 0; i < hnr_interp.size(); i++)
-            hnr_interp(i) = fft_lower_env(i) - fft_upper_env(i);
+            /* HNR as upper-lower envelope difference */
+            for (i = 0; i < hnr_interp.size(); i++)
+                hnr_interp(i) = fft_lower_env(i) - fft_upper_env(i);
 
-        /* Convert to erb-bands */
-        Linear2Erb(hnr_interp, params.fs, &hnr_erb);
-        hnr_glott->set_col_vec(frame_index, hnr_erb);
-    }
+            hnr_frames[frame_index - begin].copy(hnr_interp);
+        }
+    }, [&](size_t begin, size_t end, size_t slot) {
+        size_t frame_index;
+        for (frame_index = begin; frame_index < end; frame_index++) {
+            /* Convert to erb-bands */
+            Linear2Erb(chunk_hnr[slot][frame_index - begin], params.fs, &hnr_erb);
+            hnr_glott->set_col_vec(frame_index, hnr_erb);
+        }
+    });
     std::cout << " done." << std::endl;
 }
 
@@ -976,7 +1039,10 @@ int GetPitchSynchFrame(const Param &params, const gsl::vector &signal,
         for (i = 0; i < (int)pre_frame->size(); i++) {
             ind = center_index - (int)frame->size() / 2 + i -
                   pre_frame->size();  // SPTK compatible, ljuvela
-            if (ind >= 0 && ind < (int)signal.size()) (*pre_frame)(i) = signal(ind);
+            if (ind >= 0 && ind < (int)signal.size())
+                (*pre_frame)(i) = signal(ind);
+            else
+                (*pre_frame)(i) = 0.0;
         }
     }
 
@@ -1683,9 +1749,7 @@ double GetRd(const Param &params, const gsl::vector &source_signal,
 
         // Applying Hanning window to lf_data.glot_seg,
         // glot_seg=glot(start:finish).*hanning(finish-start+1);
-        for (int i = 0; i < lf_data.glot_seg.size(); i++) {
-            lf_data.glot_seg[i] *= hanningWindow(i, lf_data.glot_seg.size());
-        }
+        ApplyWindowingFunction(HANNING, &lf_data.glot_seg);
 
         //  glot_seg_spec=20*log10(abs(fft(glot_seg)));
         ComplexVector glot_seg_spec;
@@ -1741,9 +1805,7 @@ double GetRd(const Param &params, const gsl::vector &source_signal,
 
             // LFgroup_win=LFgroup(:).*hanning(finish-start+1);
             int lfgroup_size = finish - start + 1;
-            for (int i = 0; i < lfgroup_size; i++) {
-                lf_data.LFgroup(i) *= hanningWindow(i, lfgroup_size);
-            }
+            ApplyWindow(*GetWindowTable(HANNING, lfgroup_size), &lf_data.LFgroup);
 
             // LFgroup_win=LFgroup(:);
             lf_data.LFgroup_win = lf_data.LFgroup;
@@ -2079,8 +2141,6 @@ void GenerateUnvoicedSignal(const Param &params, const SynthesisData &data,
 
     gsl::vector uv_signal((*signal).size(), true);
     gsl::vector noise_vec(params.frame_length_unvoiced);
-    gsl::random_generator rand_gen;
-    gsl::gaussian_random random_gauss_gen(rand_gen);
 
     gsl::vector A(params.lpc_order_vt + 1, true);
     gsl::vector A_tilt(params.lpc_order_glot + 1, true);
@@ -2135,9 +2195,8 @@ void GenerateUnvoicedSignal(const Param &params, const SynthesisData &data,
                 GetFrame(data.excitation_signal, frame_index,
                          rint(params.frame_shift / params.speed_scale), &noise_vec, NULL);
             } else {
-                for (i = 0; i < noise_vec.size(); i++) {
-                    noise_vec(i) = random_gauss_gen.get();
-                }
+                FillGaussianNoise(params.random_seed, NOISE_STREAM_UNVOICED, frame_index,
+                                  &noise_vec);
             }
 
 
@@ -2253,7 +2312,7 @@ void PostFilter(const double &postfilter_coefficient, const int &fs,
         if (fundf(frame_index) == 0) continue;
 
         /* Convert LSF to LPC */
-        Lsf2Poly(lsf->get_col_vec(frame_index), &poly_vec);
+        Lsf2Poly(*lsf, frame_index, &poly_vec);
 
         /* Compute power spectrum */
         FFTRadix2(poly_vec, POWER_SPECTRUM_FRAME_LEN, &poly_fft);
@@ -2434,8 +2493,6 @@ void HarmonicModification(const Param &params, const AnalysisData &data,
     gsl::vector hnr_interp(fft_mag.size());
 
     /* Noise generation */
-    gsl::random_generator rand_gen;
-    gsl::gaussian_random random_gauss_gen(rand_gen);
     ComplexVector noise_vec_fft;
     noise_vec_fft.setAllReal(1.0);
     noise_vec_fft.setAllImag(0.0);
@@ -2524,8 +2581,8 @@ void HarmonicModification(const Param &params, const AnalysisData &data,
             }
 
             /* Generate random Gaussian noise*/
-            for (i = 0; i < (int)noise_vec.size(); i++)
-                noise_vec(i) = random_gauss_gen.get();
+            FillGaussianNoise(params.random_seed, NOISE_STREAM_HARMONIC, frame_index,
+                              &noise_vec);
 
             /* Noise FFT with analysis window */
             noise_vec *= kbd_window;
@@ -2692,8 +2749,6 @@ void GenerateUnvoicedSignal(const Param &params, const AnalysisData &data,
 
     gsl::vector uv_signal((*signal).size(), true);
     gsl::vector noise_vec(params.frame_length_unvoiced);
-    gsl::random_generator rand_gen;
-    gsl::gaussian_random random_gauss_gen(rand_gen);
 
     gsl::vector A(params.lpc_order_vt + 1, true);
     gsl::vector A_tilt(params.lpc_order_glot + 1, true);
@@ -2748,9 +2803,8 @@ void GenerateUnvoicedSignal(const Param &params, const AnalysisData &data,
                 GetFrame(data.excitation_signal, frame_index,
                          rint(params.frame_shift / params.speed_scale), &noise_vec, NULL);
             } else {
-                for (i = 0; i < noise_vec.size(); i++) {
-                    noise_vec(i) = random_gauss_gen.get();
-                }
+                FillGaussianNoise(params.random_seed, NOISE_STREAM_UNVOICED, frame_index,
+                                  &noise_vec);
             }
 
 
@@ -2985,9 +3039,7 @@ void FftFilterExcitation(const Param &params, const AnalysisData &data,
             frame /= 0.5 * (double)frame.size() / (double)params.frame_shift;
 
             // In here add the Hanning window to the PSOLA (by Xiao)
-            for (int i = 0; i < frame.size(); i++) {
-                frame[i] *= hanningWindow(i, frame.size());
-            }
+            ApplyWindowingFunction(HANNING, &frame);
 
             OverlapAdd(frame,
                        frame_index * rint(params.frame_shift / params.speed_scale),
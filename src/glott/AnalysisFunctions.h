@@ -17,6 +17,7 @@
 
 void HighPassFiltering(const Param &params, gsl::vector *signal);
 int PolarityDetection(const Param &params, gsl::vector *signal, gsl::vector *source_signal_iaif);
+int PolarityDetection(const Param &params, gsl::vector *signal, gsl::vector *source_signal_iaif, SignalPolarity *applied);
 int GetF0(const Param &params, const gsl::vector &signal, const gsl::vector &source_signal_iaif, gsl::vector *fundf);
 int GetGci(const Param &params, const gsl::vector &signal, const gsl::vector &source_signal_iaif, const gsl::vector &fundf, gsl::vector_int *gci_inds);
 int GetGain(const Param &params, const gsl::vector &fundf, const gsl::vector &signal, gsl::vector *gain);
@@ -0,0 +1,40 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_ANALYSISPIPELINE_H_
+#define SRC_GLOTT_ANALYSISPIPELINE_H_
+
+#include <functional>
+#include <string>
+
+#include "definitions.h"
+
+/* Output of the LF pulse and LF synthesis signals (default directory and
+ * extension as for GetParamPath) */
+typedef std::function<int(const std::string &default_dir, const std::string &extension,
+                          const gsl::vector &signal)> SignalOutput;
+
+/* Whole analysis pipeline of the Analysis program on data->signal, up to
+ * (not including) saving the features. REAPER reads data->signal_pcm16,
+ * which is quantized from data->signal when it is empty. */
+int AnalyseSignal(const Param &params, const SignalOutput &output_signal,
+                  AnalysisData *data, SignalPolarity *polarity);
+
+/* The same in two stages: F0, GCI, gain, spectral analysis, inverse
+ * filtering and REAPER epochs (data is allocated here), then Rd, LF
+ * synthesis, pulses, HNR and LSFs. */
+int AnalyseSignalFront(const Param &params, AnalysisData *data, SignalPolarity *polarity);
+int AnalyseSignalBack(const Param &params, const SignalOutput &output_signal, AnalysisData *data);
+
+#endif /* SRC_GLOTT_ANALYSISPIPELINE_H_ */
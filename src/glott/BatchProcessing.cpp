@@ -0,0 +1,128 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gsl/gsl_math.h>
+#include <gslwrap/vector_double.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include "definitions.h"
+#include "FileIo.h"
+#include "FrameScheduler.h"
+#include "BatchProcessing.h"
+
+bool IsBatchCommandLine(int argc, char *argv[]) {
+   return argc > 1 && strcmp(argv[1], "--scp") == 0;
+}
+
+int ReadScpFile(const char *fname, std::vector<std::string> *files) {
+   std::ifstream scp(fname);
+   if (!scp) {
+      std::cerr << "Error: could not open scp file " << fname << std::endl;
+      return EXIT_FAILURE;
+   }
+   files->clear();
+   std::string line;
+   while (std::getline(scp, line)) {
+      std::istringstream fields(line);
+      std::string field, path;
+      while (fields >> field)
+         path = field;
+      if (!path.empty())
+         files->push_back(path);
+   }
+   if (files->empty()) {
+      std::cerr << "Error: no files listed in " << fname << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+static void SubstituteBasename(const std::string &basename, std::string *pattern) {
+   size_t pos;
+   while ((pos = pattern->find("%s")) != std::string::npos)
+      pattern->replace(pos, 2, basename);
+}
+
+/* Per-file copy of the configuration. The frame loops of each file keep
+ * NUM_THREADS: they share the scheduler with the other files. */
+static Param FileParams(const std::string &file, const Param &params) {
+   Param file_params = params;
+   std::string path, basename;
+   FilePathBasename(file.c_str(), &path, &basename);
+   SubstituteBasename(basename, &file_params.external_f0_filename);
+   SubstituteBasename(basename, &file_params.external_gci_filename);
+   SubstituteBasename(basename, &file_params.external_lsf_vt_filename);
+   SubstituteBasename(basename, &file_params.external_excitation_filename);
+   return file_params;
+}
+
+int RunBatch(const std::vector<std::string> &files, const Param &params,
+             const BatchFileFunction &process) {
+   return RunBatchIndexed(files, params,
+         [&process](size_t, const std::string &file, const Param &file_params) {
+            return process(file, file_params);
+         });
+}
+
+int RunBatchIndexed(const std::vector<std::string> &files, const Param &params,
+                    const BatchIndexedFileFunction &process) {
+   const int num_jobs = GSL_MAX(params.num_threads, 1);
+   const size_t num_files = files.size();
+   std::vector<int> status(num_files, EXIT_FAILURE);
+   std::mutex report_mutex;
+   size_t num_done = 0;
+
+   std::chrono::steady_clock::time_point batch_start = std::chrono::steady_clock::now();
+   ParallelTasks(num_jobs, num_files, [&](size_t i) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      int result;
+      try {
+         result = process(i, files[i], FileParams(files[i], params));
+      } catch (const std::exception &e) {
+         std::cerr << "Error: " << files[i] << ": " << e.what() << std::endl;
+         result = EXIT_FAILURE;
+      }
+      double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+      std::lock_guard<std::mutex> lock(report_mutex);
+      status[i] = result;
+      num_done++;
+      std::cout << "[" << num_done << "/" << num_files << "] " << files[i] << ": "
+                << (result == EXIT_SUCCESS ? "OK" : "FAILED")
+                << " (" << seconds << " s)" << std::endl;
+   });
+   double total_seconds = std::chrono::duration<double>(
+         std::chrono::steady_clock::now() - batch_start).count();
+
+   size_t i, num_failed = 0;
+   for (i = 0; i < num_files; i++) {
+      if (status[i] != EXIT_SUCCESS)
+         num_failed++;
+   }
+   std::cout << "Batch finished: " << num_files - num_failed << " of " << num_files
+             << " files OK, " << num_failed << " failed (" << total_seconds << " s, "
+             << num_jobs << " jobs)" << std::endl;
+   for (i = 0; i < num_files; i++) {
+      if (status[i] != EXIT_SUCCESS)
+         std::cerr << "Failed: " << files[i] << std::endl;
+   }
+
+   return num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,55 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_BATCHPROCESSING_H_
+#define SRC_GLOTT_BATCHPROCESSING_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "definitions.h"
+
+/* Processes one file of a batch, returns EXIT_SUCCESS or EXIT_FAILURE */
+typedef std::function<int(const std::string &file, const Param &params)> BatchFileFunction;
+/* As above, with the position of the file in the list */
+typedef std::function<int(size_t index, const std::string &file, const Param &params)>
+      BatchIndexedFileFunction;
+
+/* True if the command line starts with --scp */
+bool IsBatchCommandLine(int argc, char *argv[]);
+
+/**
+ * Function ReadScpFile
+ *
+ * Read a list of files, one per line. Blank lines are skipped. If a line
+ * has several fields (Kaldi "utt-id path"), the last one is the path.
+ */
+int ReadScpFile(const char *fname, std::vector<std::string> *files);
+
+/**
+ * Function RunBatch
+ *
+ * Run process() for every file with the configuration read once. With
+ * NUM_THREADS > 1, files are processed in parallel, and the frame loops of
+ * each file share the same scheduler threads with the other files. "%s" in
+ * the EXTERNAL_*_FILENAME options is replaced by the file basename. Prints a status line per file and a summary.
+ *
+ * @return EXIT_FAILURE if any file failed
+ */
+int RunBatch(const std::vector<std::string> &files, const Param &params,
+             const BatchFileFunction &process);
+int RunBatchIndexed(const std::vector<std::string> &files, const Param &params,
+                    const BatchIndexedFileFunction &process);
+
+#endif /* SRC_GLOTT_BATCHPROCESSING_H_ */
@@ -0,0 +1,315 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Conversion between the feature files of an utterance (one file per
+ * feature, as located by the DIR_* and EXT_* options) and a feature
+ * container (FEATURE_CONTAINER = true).
+ *
+ * usage:
+ *   ConvertFeatures pack (--scp) <file> config_default.cfg (config_user.cfg)
+ *   ConvertFeatures unpack (--scp) <file> config_default.cfg (config_user.cfg)
+ *   ConvertFeatures list <container>
+ *   ConvertFeatures dnn <dnn basename>
+ *   ConvertFeatures benchmark <directory> (frames) (order)
+ *
+ * <file> is the wav file (or any file with the same basename) of the
+ * utterance, as given to Analysis and Synthesis. Pulses are written with
+ * PULSE_ENCODING and read in any encoding. The dnn mode packs the weights
+ * of an excitation DNN (.dnnInfo, .dnnData and .dnnMinMax) into
+ * basename.dnnWeights, which the synthesis maps instead of reading them.
+ * The benchmark mode writes and reads a frames x order matrix (default
+ * 10000 x 400, the size of the pulses of a long utterance) in each
+ * DATA_TYPE and prints the throughput.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <gslwrap/vector_double.h>
+#include <gslwrap/matrix_double.h>
+
+#include "definitions.h"
+#include "BatchProcessing.h"
+#include "DnnClass.h"
+#include "FeatureContainer.h"
+#include "FileIo.h"
+#include "FrameScheduler.h"
+#include "PulseCodec.h"
+#include "ReadConfig.h"
+
+struct LegacyFeature {
+   std::string name;
+   std::string extension;
+   std::string dir;
+   size_t order;     // values per frame of a matrix, 0 for a vector
+};
+
+/* Feature files written by Analysis (AnalysisData::SaveData) */
+static std::vector<LegacyFeature> LegacyFeatures(const Param &params) {
+   const LegacyFeature features[] = {
+      {"f0", params.extension_f0, params.dir_f0, 0},
+      {"gain", params.extension_gain, params.dir_gain, 0},
+      {"lsf", params.extension_lsf, params.dir_lsf, (size_t)params.lpc_order_vt},
+      {"slsf", params.extension_lsfg, params.dir_lsfg, (size_t)params.lpc_order_glot},
+      {"hnr", params.extension_hnr, params.dir_hnr, (size_t)params.hnr_order},
+      {"pls", params.extension_paf, params.dir_paf, (size_t)params.paf_pulse_length},
+      {"sp", ".sp", params.dir_sp, 2049},
+      {"rd", params.extension_rd, params.dir_exc, 0},
+      {"ee", params.extension_ee, params.dir_ee, 0},
+      {"ra", params.extension_ra, params.dir_ra, 0},
+      {"rk", params.extension_rk, params.dir_rk, 0},
+      {"rg", params.extension_rg, params.dir_rg, 0},
+      {"reaper_gci", params.extension_reaper_gci, params.dir_reaper_gci, 0},
+      {"reaper_f0", params.extension_reaper_f0, params.dir_reaper_f0, 0},
+      {"gci", params.extension_gci, params.dir_gci, 0}};
+   return std::vector<LegacyFeature>(features, features + sizeof(features)/sizeof(features[0]));
+}
+
+static bool FileExists(const std::string &filename) {
+   struct stat info;
+   return stat(filename.c_str(), &info) == 0;
+}
+
+/* Feature files of an utterance -> container */
+static int PackFile(const std::string &file, Param params) {
+   FilePathBasename(file.c_str(), &(params.file_path), &(params.file_basename));
+   const std::vector<LegacyFeature> features = LegacyFeatures(params);
+
+   /* Not resized after this: the writer keeps pointers to the elements */
+   std::vector<gsl::vector> vectors(features.size());
+   std::vector<gsl::matrix> matrices(features.size());
+   FeatureContainerWriter container;
+   size_t i, n_streams = 0;
+   for (i = 0; i < features.size(); i++) {
+      const LegacyFeature &feature = features[i];
+      const std::string fname = GetParamPath(feature.name, feature.extension, feature.dir, params);
+      if (!FileExists(fname))
+         continue;
+      if (feature.order == 0) {
+         if (ReadGslVector(fname, params.data_type, &(vectors[i])) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+         container.AddVector(feature.name, vectors[i]);
+      } else if (feature.name == "pls") {
+         if (ReadPulseFile(fname, params.data_type, feature.order, &(matrices[i])) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+         container.AddPulses(feature.name, matrices[i], params.pulse_encoding);
+      } else {
+         if (ReadGslMatrix(fname, params.data_type, feature.order, &(matrices[i])) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+         container.AddMatrix(feature.name, matrices[i]);
+      }
+      n_streams++;
+   }
+   if (n_streams == 0) {
+      std::cerr << "Error: no feature files found for " << file << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   const std::string out_fname = GetParamPath("feat", params.extension_container,
+                                              params.dir_container, params);
+   if (container.Write(out_fname, params.data_type, false) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   std::cout << out_fname << ": " << n_streams << " streams" << std::endl;
+   return EXIT_SUCCESS;
+}
+
+/* Container -> feature files of an utterance */
+static int UnpackFile(const std::string &file, Param params) {
+   FilePathBasename(file.c_str(), &(params.file_path), &(params.file_basename));
+   const std::vector<LegacyFeature> features = LegacyFeatures(params);
+
+   const std::string in_fname = GetParamPath("feat", params.extension_container,
+                                             params.dir_container, params);
+   FeatureContainer container;
+   if (container.Open(in_fname) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+
+   size_t i, k;
+   for (k = 0; k < container.streams().size(); k++) {
+      const ContainerStream &stream = container.streams()[k];
+      for (i = 0; i < features.size(); i++)
+         if (features[i].name == stream.name)
+            break;
+      if (i == features.size()) {
+         std::cerr << "Warning: skipping unknown stream " << stream.name << " of "
+                   << in_fname << std::endl;
+         continue;
+      }
+      const LegacyFeature &feature = features[i];
+      const std::string fname = GetParamPath(feature.name, feature.extension, feature.dir, params);
+      int result;
+      if (feature.order == 0) {
+         gsl::vector vector;
+         result = container.ReadVector(stream.name, &vector);
+         if (result == EXIT_SUCCESS)
+            result = WriteGslVector(fname, params.data_type, vector);
+      } else {
+         gsl::matrix matrix;
+         result = container.ReadMatrix(stream.name, stream.order, &matrix);
+         if (result == EXIT_SUCCESS && feature.name == "pls")
+            result = WritePulseFile(fname, params.data_type, params.pulse_encoding, matrix, false);
+         else if (result == EXIT_SUCCESS)
+            result = WriteGslMatrix(fname, params.data_type, matrix);
+      }
+      if (result == EXIT_FAILURE)
+         return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+/* Print the stream table and check the data of every stream */
+static int ListContainer(const char *filename) {
+   FeatureContainer container;
+   if (container.Open(filename) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+
+   int result = EXIT_SUCCESS;
+   const char *type_names[] = {"float32", "float64", "pulses"};
+   std::cout << std::left << std::setw(FEATURE_CONTAINER_NAME_LENGTH) << "stream"
+             << std::setw(10) << "type" << std::setw(10) << "frames" << std::setw(8) << "order"
+             << std::setw(12) << "offset" << std::setw(12) << "bytes" << "crc" << std::endl;
+   size_t k;
+   for (k = 0; k < container.streams().size(); k++) {
+      const ContainerStream &stream = container.streams()[k];
+      const bool ok = (container.VerifyStream(stream) == EXIT_SUCCESS);
+      if (!ok)
+         result = EXIT_FAILURE;
+      std::cout << std::setw(FEATURE_CONTAINER_NAME_LENGTH) << stream.name
+                << std::setw(10) << type_names[stream.type]
+                << std::setw(10) << stream.frames << std::setw(8) << stream.order
+                << std::setw(12) << stream.offset << std::setw(12) << stream.bytes
+                << (ok ? "ok" : "MISMATCH") << std::endl;
+   }
+   return result;
+}
+
+/* Write and read a matrix in each DATA_TYPE, checking the shape and values */
+static int BenchmarkFormats(const std::string &directory, const size_t &n_frames,
+                            const size_t &order) {
+   gsl::matrix mat(order, n_frames);
+   size_t i, j;
+   for (j = 0; j < n_frames; j++)
+      for (i = 0; i < order; i++)
+         mat(i, j) = sin(0.01*j + 0.37*i)*pow(10.0, (double)(i % 5) - 2.0);
+
+   const DataType formats[] = {ASCII, FLOAT, DOUBLE};
+   const char *names[] = {"ASCII", "FLOAT", "DOUBLE"};
+   const double tolerance[] = {1e-7, 1e-6, 0.0};
+   int result = EXIT_SUCCESS;
+   std::cout << std::left << std::setw(8) << "format" << std::setw(10) << "MB"
+             << std::setw(14) << "write MB/s" << std::setw(14) << "read MB/s" << "max error" << std::endl;
+   for (size_t k = 0; k < 3; k++) {
+      const std::string fname = directory + "/benchmark." + names[k];
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      if (WriteGslMatrix(fname, formats[k], mat) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+      const std::chrono::duration<double> write_time = std::chrono::steady_clock::now() - start;
+
+      gsl::matrix read;
+      start = std::chrono::steady_clock::now();
+      if (ReadGslMatrix(fname, formats[k], order, &read) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+      const std::chrono::duration<double> read_time = std::chrono::steady_clock::now() - start;
+
+      struct stat info;
+      const double mb = (stat(fname.c_str(), &info) == 0) ? info.st_size/1048576.0 : 0.0;
+      remove(fname.c_str());
+      double max_error = 0.0;
+      if (read.size1() != order || read.size2() != n_frames) {
+         std::cerr << "Error: " << names[k] << " matrix read back as " << read.size1() << " x "
+                   << read.size2() << std::endl;
+         result = EXIT_FAILURE;
+         continue;
+      }
+      for (j = 0; j < n_frames; j++)
+         for (i = 0; i < order; i++)
+            max_error = GSL_MAX(max_error, fabs(read(i, j) - mat(i, j)));
+      if (max_error > tolerance[k])
+         result = EXIT_FAILURE;
+      std::cout << std::setw(8) << names[k] << std::setw(10) << std::setprecision(4) << mb
+                << std::setw(14) << mb/write_time.count() << std::setw(14) << mb/read_time.count()
+                << max_error << std::endl;
+   }
+   return result;
+}
+
+/* Old DNN weight files to the packed, mappable format */
+static int PackDnnWeights(const char *basename) {
+   Dnn dnn;
+   if (dnn.ReadInfo(basename) == EXIT_FAILURE || dnn.ReadDataFiles(basename) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   return dnn.WriteWeights(basename);
+}
+
+int main(int argc, char *argv[]) {
+
+   const std::string usage_string =
+      "Usage: ConvertFeatures pack|unpack (--scp) <file> config_default.cfg (config_user.cfg)\n"
+      "       ConvertFeatures list <container>\n"
+      "       ConvertFeatures dnn <dnn basename>\n"
+      "       ConvertFeatures benchmark <directory> (frames) (order)";
+
+   if (argc == 3 && strcmp(argv[1], "list") == 0)
+      return ListContainer(argv[2]);
+   if (argc == 3 && strcmp(argv[1], "dnn") == 0)
+      return PackDnnWeights(argv[2]);
+   if (argc >= 3 && argc <= 5 && strcmp(argv[1], "benchmark") == 0)
+      return BenchmarkFormats(argv[2], (argc > 3) ? (size_t)atol(argv[3]) : 10000,
+                              (argc > 4) ? (size_t)atol(argv[4]) : 400);
+
+   if (argc < 2 || (strcmp(argv[1], "pack") != 0 && strcmp(argv[1], "unpack") != 0)) {
+      std::cout << usage_string << std::endl;
+      return EXIT_FAILURE;
+   }
+   const bool pack = (strcmp(argv[1], "pack") == 0);
+   argc--;
+   argv++;
+
+   const bool batch = IsBatchCommandLine(argc, argv);
+   if (batch) {
+      argc--;
+      argv++;
+   }
+   if (argc < 3 || argc > 4) {
+      std::cout << usage_string << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   Param params;
+   if (ReadConfig(argv[2], true, &params) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (argc > 3) {
+      if (ReadConfig(argv[3], false, &params) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+   }
+
+   BatchFileFunction convert = [pack](const std::string &file, const Param &file_params) {
+      return pack ? PackFile(file, file_params) : UnpackFile(file, file_params);
+   };
+   if (!batch)
+      return convert(argv[1], params);
+
+   std::vector<std::string> files;
+   if (ReadScpFile(argv[1], &files) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   ConfigureScheduler(params.num_threads, params.pin_threads);
+   return RunBatch(files, params, convert);
+}
@@ -0,0 +1,322 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <sys/stat.h>
+#include <gslwrap/vector_double.h>
+#include <gslwrap/matrix_double.h>
+
+#include "DatasetWriter.h"
+
+/* .npy header (version 1.0) padded to a fixed size, so that the number of
+ * rows can be filled in when the shard is closed */
+#define NPY_HEADER_BYTES 128
+
+void GetDatasetFrames(const Param &params, const AnalysisData &data, DatasetUtterance *utterance) {
+   const size_t n_frames = data.fundf.size();
+   const size_t input_dim = 2 + params.hnr_order + params.lpc_order_glot + params.lpc_order_vt;
+   const size_t output_dim = params.paf_pulse_length;
+
+   utterance->name = params.file_basename;
+   utterance->total_frames = n_frames;
+   utterance->input.clear();
+   utterance->output.clear();
+   utterance->frame_numbers.clear();
+   utterance->input.reserve(n_frames*input_dim);
+   utterance->output.reserve(n_frames*output_dim);
+
+   size_t i, j;
+   for (j = 0; j < n_frames; j++) {
+      if (params.dataset_remove_unvoiced && data.fundf(j) <= 0.0)
+         continue;
+      utterance->input.push_back((float)data.fundf(j));
+      utterance->input.push_back((float)data.frame_energy(j));
+      for (i = 0; i < (size_t)params.hnr_order; i++)
+         utterance->input.push_back((float)data.hnr_glot(i,j));
+      for (i = 0; i < (size_t)params.lpc_order_glot; i++)
+         utterance->input.push_back((float)data.lsf_glot(i,j));
+      for (i = 0; i < (size_t)params.lpc_order_vt; i++)
+         utterance->input.push_back((float)data.lsf_vocal_tract(i,j));
+      for (i = 0; i < output_dim; i++)
+         utterance->output.push_back((float)data.excitation_pulses(i,j));
+      utterance->frame_numbers.push_back((int32_t)j);
+   }
+}
+
+DatasetWriter::DatasetWriter() : shard_frames_(0), remove_unvoiced_(true), input_dim_(0),
+      output_dim_(0), next_index_(0), max_pending_(1), failed_(false), num_shards_(0),
+      num_frames_(0), utterance_list_(NULL) {
+   input_file_.fid = output_file_.fid = frames_file_.fid = NULL;
+   input_file_.rows = output_file_.rows = frames_file_.rows = 0;
+}
+
+DatasetWriter::~DatasetWriter() {
+   NpyFile *files[3] = {&input_file_, &output_file_, &frames_file_};
+   size_t i;
+   for (i = 0; i < 3; i++)
+      if (files[i]->fid != NULL)
+         fclose(files[i]->fid);
+   if (utterance_list_ != NULL)
+      fclose(utterance_list_);
+}
+
+int DatasetWriter::Open(const Param &params) {
+   if (!params.extract_pulses_as_features) {
+      std::cerr << "Error: DATASET_DIRECTORY requires EXTRACT_PULSES_AS_FEATURES = true"
+                << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (params.analysis_chunk_seconds > 0.0) {
+      std::cerr << "Error: DATASET_DIRECTORY is not supported with ANALYSIS_CHUNK_SECONDS"
+                << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (params.dataset_shard_frames < 1) {
+      std::cerr << "Error: DATASET_SHARD_FRAMES must be positive" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   directory_ = params.dataset_directory;
+   if (directory_.back() != '/')
+      directory_ += "/";
+   if (mkdir(directory_.c_str(), 0777) != 0 && errno != EEXIST) {
+      std::cerr << "Error: could not create directory " << directory_ << std::endl;
+      return EXIT_FAILURE;
+   }
+   shard_frames_ = (size_t)params.dataset_shard_frames;
+   remove_unvoiced_ = params.dataset_remove_unvoiced;
+   max_pending_ = (size_t)std::max(params.num_threads, 1);
+
+   inputs_.clear();
+   inputs_.push_back(std::make_pair(std::string("f0"), (size_t)1));
+   inputs_.push_back(std::make_pair(std::string("gain"), (size_t)1));
+   inputs_.push_back(std::make_pair(std::string("hnr"), (size_t)params.hnr_order));
+   inputs_.push_back(std::make_pair(std::string("slsf"), (size_t)params.lpc_order_glot));
+   inputs_.push_back(std::make_pair(std::string("lsf"), (size_t)params.lpc_order_vt));
+   input_dim_ = 0;
+   size_t i;
+   for (i = 0; i < inputs_.size(); i++)
+      input_dim_ += inputs_[i].second;
+   output_dim_ = params.paf_pulse_length;
+   input_min_.assign(input_dim_, FLT_MAX);
+   input_max_.assign(input_dim_, -FLT_MAX);
+
+   const std::string list_fname = directory_ + "utterances.txt";
+   utterance_list_ = fopen(list_fname.c_str(), "w");
+   if (utterance_list_ == NULL) {
+      std::cerr << "Error: could not create file " << list_fname << std::endl;
+      return EXIT_FAILURE;
+   }
+   fprintf(utterance_list_, "# index name shard first_row rows total_frames\n");
+   return EXIT_SUCCESS;
+}
+
+int DatasetWriter::OpenNpy(const std::string &filename, NpyFile *file) {
+   file->fid = fopen(filename.c_str(), "wb");
+   file->rows = 0;
+   if (file->fid == NULL) {
+      std::cerr << "Error: could not create file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   const char zeros[NPY_HEADER_BYTES] = {0};
+   if (fwrite(zeros, 1, NPY_HEADER_BYTES, file->fid) != NPY_HEADER_BYTES) {
+      std::cerr << "Error: could not write file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+int DatasetWriter::CloseNpy(NpyFile *file, const char *descr, const size_t &cols) {
+   char header[NPY_HEADER_BYTES];
+   memset(header, ' ', sizeof(header));
+   memcpy(header, "\x93NUMPY\x01\x00", 8);
+   header[8] = (char)(NPY_HEADER_BYTES - 10);
+   header[9] = 0;
+   int n = snprintf(header + 10, NPY_HEADER_BYTES - 10,
+                    "{'descr': '%s', 'fortran_order': False, 'shape': (%zu, %zu), }",
+                    descr, file->rows, cols);
+   header[10 + n] = ' ';
+   header[NPY_HEADER_BYTES - 1] = '\n';
+   bool ok = (fseek(file->fid, 0, SEEK_SET) == 0
+              && fwrite(header, 1, NPY_HEADER_BYTES, file->fid) == NPY_HEADER_BYTES);
+   ok = (fclose(file->fid) == 0) && ok;
+   file->fid = NULL;
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int DatasetWriter::OpenShard() {
+   char name[32];
+   snprintf(name, sizeof(name), "shard-%05zu", num_shards_);
+   const std::string base = directory_ + name;
+   if (OpenNpy(base + ".input.npy", &input_file_) == EXIT_FAILURE
+       || OpenNpy(base + ".output.npy", &output_file_) == EXIT_FAILURE
+       || OpenNpy(base + ".frames.npy", &frames_file_) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   return EXIT_SUCCESS;
+}
+
+int DatasetWriter::CloseShard() {
+   if (input_file_.fid == NULL)
+      return EXIT_SUCCESS;
+   shard_sizes_.push_back(input_file_.rows);
+   num_shards_++;
+   int result = CloseNpy(&input_file_, "<f4", input_dim_);
+   if (CloseNpy(&output_file_, "<f4", output_dim_) == EXIT_FAILURE)
+      result = EXIT_FAILURE;
+   if (CloseNpy(&frames_file_, "<i4", 2) == EXIT_FAILURE)
+      result = EXIT_FAILURE;
+   if (result == EXIT_FAILURE)
+      std::cerr << "Error: could not write shard " << num_shards_ - 1 << " of "
+                << directory_ << std::endl;
+   return result;
+}
+
+int DatasetWriter::WriteUtterance(const DatasetUtterance &utterance, const size_t &index) {
+   const size_t n = utterance.frames();
+   if (n == 0) {
+      fprintf(utterance_list_, "%zu %s - 0 0 %zu\n", index, utterance.name.c_str(),
+              utterance.total_frames);
+      return EXIT_SUCCESS;
+   }
+   /* Utterances are not split between shards */
+   if (input_file_.fid != NULL && input_file_.rows > 0 && input_file_.rows + n > shard_frames_) {
+      if (CloseShard() == EXIT_FAILURE)
+         return EXIT_FAILURE;
+   }
+   if (input_file_.fid == NULL && OpenShard() == EXIT_FAILURE)
+      return EXIT_FAILURE;
+
+   std::vector<int32_t> frames(2*n);
+   size_t i, k;
+   for (i = 0; i < n; i++) {
+      frames[2*i] = (int32_t)index;
+      frames[2*i+1] = utterance.frame_numbers[i];
+   }
+   if (fwrite(utterance.input.data(), sizeof(float), n*input_dim_, input_file_.fid) != n*input_dim_
+       || fwrite(utterance.output.data(), sizeof(float), n*output_dim_, output_file_.fid) != n*output_dim_
+       || fwrite(frames.data(), sizeof(int32_t), 2*n, frames_file_.fid) != 2*n) {
+      std::cerr << "Error: could not write shard " << num_shards_ << " of " << directory_
+                << std::endl;
+      return EXIT_FAILURE;
+   }
+   fprintf(utterance_list_, "%zu %s %zu %zu %zu %zu\n", index, utterance.name.c_str(),
+           num_shards_, input_file_.rows, n, utterance.total_frames);
+   input_file_.rows += n;
+   output_file_.rows += n;
+   frames_file_.rows += n;
+   num_frames_ += n;
+
+   for (i = 0; i < n; i++) {
+      const float *x = utterance.input.data() + i*input_dim_;
+      for (k = 0; k < input_dim_; k++) {
+         input_min_[k] = std::min(input_min_[k], x[k]);
+         input_max_[k] = std::max(input_max_[k], x[k]);
+      }
+   }
+   return EXIT_SUCCESS;
+}
+
+int DatasetWriter::Add(const size_t &index, DatasetUtterance *utterance) {
+   std::unique_lock<std::mutex> lock(mutex_);
+   /* Bound the reorder buffer to max_pending_ utterances. The utterance at
+    * next_index_ never waits, so the wait always ends. */
+   pending_space_.wait(lock, [this, &index] {
+      return failed_ || index < next_index_ + max_pending_;
+   });
+   if (failed_)
+      return EXIT_FAILURE;
+   DatasetUtterance &slot = pending_[index];
+   if (utterance != NULL)
+      slot = std::move(*utterance);
+
+   /* Write the utterances that are next in file order (failed files have
+    * no name and are skipped) */
+   std::map<size_t, DatasetUtterance>::iterator next;
+   while (!failed_ && (next = pending_.find(next_index_)) != pending_.end()) {
+      if (!next->second.name.empty() && WriteUtterance(next->second, next_index_) == EXIT_FAILURE)
+         failed_ = true;
+      pending_.erase(next);
+      next_index_++;
+   }
+   pending_space_.notify_all();
+   return failed_ ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int DatasetWriter::Close() {
+   std::lock_guard<std::mutex> lock(mutex_);
+
+   /* Utterances after a file that never reported (e.g. an exception) */
+   std::map<size_t, DatasetUtterance>::iterator it;
+   for (it = pending_.begin(); it != pending_.end() && !failed_; ++it) {
+      if (!it->second.name.empty() && WriteUtterance(it->second, it->first) == EXIT_FAILURE)
+         failed_ = true;
+   }
+   pending_.clear();
+   if (CloseShard() == EXIT_FAILURE)
+      failed_ = true;
+   if (utterance_list_ != NULL && fclose(utterance_list_) != 0)
+      failed_ = true;
+   utterance_list_ = NULL;
+   if (failed_)
+      return EXIT_FAILURE;
+   if (num_frames_ == 0) {
+      std::cerr << "Error: no frames written to the dataset " << directory_ << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   /* Input min and max in the format of the DNN (.dnnMinMax) */
+   const std::string minmax_fname = directory_ + "dataset.dnnMinMax";
+   FILE *fid = fopen(minmax_fname.c_str(), "wb");
+   if (fid == NULL
+       || fwrite(input_min_.data(), sizeof(float), input_dim_, fid) != input_dim_
+       || fwrite(input_max_.data(), sizeof(float), input_dim_, fid) != input_dim_
+       || fclose(fid) != 0) {
+      std::cerr << "Error: could not write file " << minmax_fname << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   const std::string json_fname = directory_ + "dataset.json";
+   fid = fopen(json_fname.c_str(), "w");
+   if (fid == NULL) {
+      std::cerr << "Error: could not create file " << json_fname << std::endl;
+      return EXIT_FAILURE;
+   }
+   size_t i;
+   fprintf(fid, "{\n  \"version\": 1,\n  \"inputs\": [");
+   for (i = 0; i < inputs_.size(); i++)
+      fprintf(fid, "%s[\"%s\", %zu]", i > 0 ? ", " : "", inputs_[i].first.c_str(), inputs_[i].second);
+   fprintf(fid, "],\n  \"input_dim\": %zu,\n  \"output\": [\"pls\", %zu],\n  \"output_dim\": %zu,\n",
+           input_dim_, output_dim_, output_dim_);
+   fprintf(fid, "  \"remove_unvoiced_frames\": %s,\n  \"input_range\": [0.1, 0.9],\n",
+           remove_unvoiced_ ? "true" : "false");
+   fprintf(fid, "  \"min_max\": \"dataset.dnnMinMax\",\n  \"frames\": %zu,\n  \"shards\": [", num_frames_);
+   for (i = 0; i < shard_sizes_.size(); i++)
+      fprintf(fid, "%s\n    {\"name\": \"shard-%05zu\", \"frames\": %zu}", i > 0 ? "," : "", i,
+              shard_sizes_[i]);
+   fprintf(fid, "\n  ]\n}\n");
+   if (fclose(fid) != 0) {
+      std::cerr << "Error: could not write file " << json_fname << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::cout << "Dataset: " << num_frames_ << " frames in " << num_shards_ << " shards ("
+             << directory_ << ")" << std::endl;
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_DATASETWRITER_H_
+#define SRC_GLOTT_DATASETWRITER_H_
+
+/*
+ * Sharded DNN training dataset written by batch analysis
+ * (DATASET_DIRECTORY). Each shard holds whole utterances:
+ *
+ *   shard-NNNNN.input.npy    float32, frames x (f0, gain, hnr, slsf, lsf),
+ *                            the input layout of the excitation DNN
+ *   shard-NNNNN.output.npy   float32, frames x PAF_PULSE_LENGTH
+ *   shard-NNNNN.frames.npy   int32, frames x 2 (utterance, frame number)
+ *
+ * Inputs are not normalised; dataset.dnnMinMax holds the min and max of
+ * each input over all frames in the format read by the DNN. utterances.txt
+ * lists each utterance with its shard and rows, dataset.json the layout.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "definitions.h"
+
+/* Frames of one utterance, frame by frame */
+struct DatasetUtterance {
+   std::string name;
+   size_t total_frames;
+   std::vector<float> input;
+   std::vector<float> output;
+   std::vector<int32_t> frame_numbers;
+   size_t frames() const {return frame_numbers.size();}
+};
+
+/* Input and output frames of an analysed utterance (voiced frames only
+ * with DATASET_REMOVE_UNVOICED) */
+void GetDatasetFrames(const Param &params, const AnalysisData &data, DatasetUtterance *utterance);
+
+/**
+ * Class DatasetWriter
+ *
+ * Utterances are added from several threads and written in the order of
+ * their index (the order of the file list), so the dataset does not depend
+ * on the thread count. At most NUM_THREADS utterances are held for
+ * reordering: Add() of an utterance further ahead of the next one to write
+ * waits until that one has been added. Files have to be started in list
+ * order (as RunBatchIndexed does), and every index has to be added, also
+ * for failed files.
+ */
+class DatasetWriter {
+ public:
+   DatasetWriter();
+   ~DatasetWriter();
+
+   int Open(const Param &params);
+   /* index is the position in the file list; utterance is NULL if the
+    * file failed, otherwise its frames are moved into the writer */
+   int Add(const size_t &index, DatasetUtterance *utterance);
+   int Close();
+
+ private:
+   struct NpyFile {
+      FILE *fid;
+      size_t rows;
+   };
+   int OpenShard();
+   int CloseShard();
+   int WriteUtterance(const DatasetUtterance &utterance, const size_t &index);
+   int OpenNpy(const std::string &filename, NpyFile *file);
+   int CloseNpy(NpyFile *file, const char *descr, const size_t &cols);
+
+   std::string directory_;
+   size_t shard_frames_;
+   bool remove_unvoiced_;
+   size_t input_dim_;
+   size_t output_dim_;
+   std::vector<std::pair<std::string, size_t> > inputs_;
+
+   std::mutex mutex_;
+   std::condition_variable pending_space_;
+   size_t next_index_;
+   size_t max_pending_;
+   std::map<size_t, DatasetUtterance> pending_;
+   bool failed_;
+
+   size_t num_shards_;
+   size_t num_frames_;
+   std::vector<size_t> shard_sizes_;
+   NpyFile input_file_;
+   NpyFile output_file_;
+   NpyFile frames_file_;
+   FILE *utterance_list_;
+   std::vector<float> input_min_;
+   std::vector<float> input_max_;
+};
+
+#endif /* SRC_GLOTT_DATASETWRITER_H_ */
@@ -21,37 +21,43 @@
 #include <fstream>
 #include <cassert>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
 #include <libconfig.h++>
+#include "definitions.h"
 #include "ReadConfig.h"
 #include "Utils.h"
 #include "DnnClass.h"
 
 
 
-DnnLayer::DnnLayer(const gsl::matrix &W_init, const gsl::matrix &b_init, const DnnActivationFunction &af) {
-   this->W.copy(W_init);
-   this->b.copy(b_init);
-   this->activation_function = af;
-   this->layer_output = gsl::matrix(W_init.get_rows(), 1, true);
-}
-
-DnnLayer::~DnnLayer() {}
+DnnLayer::DnnLayer(const float *W, const float *b, const size_t &in_size, const size_t &out_size,
+                   const DnnActivationFunction &af)
+   : W_(W), b_(b), in_size_(in_size), out_size_(out_size), activation_function_(af) {}
 
-void DnnLayer::ForwardPass(const gsl::matrix &input) {
+void DnnLayer::ForwardPass(const gsl::vector &input, gsl::vector *output) const {
 
    // Check correct size
-   size_t in_size = W.size2();
-   //size_t out_size = W.size1();
-   assert(in_size == input.size1());
-
-
-   // Matrix multiplication
-   layer_output = (this->W * input) + this->b;
+   assert(in_size_ == input.size());
+   if (!output->is_set() || output->size() != out_size_)
+      *output = gsl::vector(out_size_);
+
+   // Matrix multiplication, one row of W at a time
+   size_t i, j;
+   for (i = 0; i < out_size_; i++) {
+      const float *row = W_ + i*in_size_;
+      double sum = 0.0;
+      for (j = 0; j < in_size_; j++)
+         sum += row[j]*input(j);
+      (*output)(i) = sum + b_[i];
+   }
 
    // Activation Function
-   switch(this->activation_function) {
+   switch(activation_function_) {
    case SIGMOID:
-      ApplySigmoid(&layer_output);
+      for (i = 0; i < out_size_; i++)
+         (*output)(i) = 1.0/(1.0+exp(-1.0*(*output)(i)));
       break;
    case RELU:
      // this->ApplyRelu(output);
@@ -64,13 +70,6 @@ void DnnLayer::ForwardPass(const gsl::matrix &input) {
    }
 }
 
-void DnnLayer::ApplySigmoid(gsl::matrix *mat) {
-   size_t i,j;
-   for (i=0;i<mat->size1();i++)
-      for(j=0;j<mat->size2();j++)
-         (*mat)(i,j) = 1.0/(1.0+exp(-1.0*(*mat)(i,j)));
-}
-
 
 DnnParams::DnnParams() {
    lpc_order_vt = 0;
@@ -97,6 +96,9 @@ size_t DnnParams::getInputDimension() {
 }
 
 Dnn::Dnn() {
+   num_layers = 0;
+   input_data_min = NULL;
+   input_data_max = NULL;
    input_min_value = 0.1;
    input_max_value = 0.9;
 }
@@ -106,17 +108,22 @@ const gsl::vector & Dnn::getOutput() {
 
    // input normalization
   // 0.1 + 0.8*(gsl_vector_get(inputdata,i+stack*NPAR) - min)/(max-min);
-   input_matrix = input_min_value + (-input_min_value)*ElementDivision(input_matrix - input_data_min, input_data_max - input_data_min);
+   size_t i;
+   for(i=0;i<input_vector.size();i++) {
+      const double min = input_data_min[i];
+      const double max = input_data_max[i];
+      input_vector(i) = input_min_value + (-input_min_value)*((input_vector(i) - min)/(max - min));
+   }
 
-   gsl::matrix &input_ref = input_matrix;
-   for(DnnLayer layer : this->layer_list) {
-      layer.ForwardPass(input_ref);
-      input_ref = layer.getOutput();
+   /* Layers alternate between two buffers */
+   const gsl::vector *input_ref = &input_vector;
+   for (i = 0; i < layers.size(); i++) {
+      layers[i].ForwardPass(*input_ref, &(layer_buffer[i % 2]));
+      input_ref = &(layer_buffer[i % 2]);
    }
 
-   size_t i;
    for(i=0;i<output_vector.size();i++)
-      output_vector(i) = input_ref(i,0);
+      output_vector(i) = (*input_ref)(i);
 
    // output scaling
 
@@ -138,52 +145,49 @@ int Dnn::checkInput(const std::string &type, const size_t &target_size, const si
 
 void Dnn::setInput(const SynthesisData &data, const size_t &frame_index) {
 
-   input_matrix.set_dimensions(this->input_params.getInputDimension(),1);
+   if (input_vector.size() != this->input_params.getInputDimension())
+      input_vector = gsl::vector(this->input_params.getInputDimension());
 
    int i,ind=0;
    //f0
    if (this->input_params.f0_order > 0)
       for (i=0;i<input_params.f0_order;i++)
-         input_matrix(ind++,0) = data.fundf(frame_index);
+         input_vector(ind++) = data.fundf(frame_index);
 
    //gain
    if (this->input_params.gain_order > 0)
       for (i=0;i<input_params.gain_order;i++)
-         input_matrix(ind++,0) = data.frame_energy(frame_index);
+         input_vector(ind++) = data.frame_energy(frame_index);
 
     //rd
     if (this->input_params.rd_order > 0)
 
         for (i=0;i<input_params.rd_order;i++)
-                input_matrix(ind++,0) = data.Rd_opt(frame_index);
+                input_vector(ind++) = data.Rd_opt(frame_index);
 
    //hnr
    if (this->input_params.hnr_order > 0) {
       this->checkInput("HNR", input_params.hnr_order, data.hnr_glot.size1());
       for (i=0;i<input_params.hnr_order;i++)
-         input_matrix(ind++,0) = data.hnr_glot(i,frame_index);
+         input_vector(ind++) = data.hnr_glot(i,frame_index);
    }
 
    // lsf_glot
    if (this->input_params.lpc_order_glot > 0) {
       this->checkInput("LSF_GL", input_params.lpc_order_glot, data.lsf_glot.size1());
       for (i=0;i<input_params.lpc_order_glot;i++)
-         input_matrix(ind++,0) = data.lsf_glot(i,frame_index);
+         input_vector(ind++) = data.lsf_glot(i,frame_index);
    }
 
    // lsf_vt
    if (this->input_params.lpc_order_vt > 0) {
       this->checkInput("LSF_VT", input_params.lpc_order_vt, data.lsf_vocal_tract.size1());
       for (i=0;i<input_params.lpc_order_vt;i++)
-         input_matrix(ind++,0) = data.lsf_vocal_tract(i,frame_index);
+         input_vector(ind++) = data.lsf_vocal_tract(i,frame_index);
    }
 
 }
 
-void Dnn::addLayer(const DnnLayer &layer) {
-   layer_list.push_back(layer);
-}
-
 DnnActivationFunction Dnn::ActivationParse(std::string &str) {
    if (!str.compare("S"))
       return SIGMOID;
@@ -264,110 +268,208 @@ int Dnn::ReadInfo(const char *basename) {
    return EXIT_SUCCESS;
 }
 
-int Dnn::ReadData(const char *basename) {
+/* Offsets (in floats) of the weight blocks: W and b of each layer, input
+ * min and max. Returns the total number of floats. */
+static size_t DnnBlockOffsets(const std::vector<int> &layer_sizes, std::vector<size_t> *offsets) {
+   const size_t align = DNN_WEIGHTS_ALIGNMENT/sizeof(float);
+   size_t n = 0;
+   offsets->clear();
+   for (size_t k = 0; k + 1 < layer_sizes.size(); k++) {
+      offsets->push_back(n);
+      n += ((size_t)layer_sizes[k+1]*layer_sizes[k] + align - 1)/align*align;
+      offsets->push_back(n);
+      n += ((size_t)layer_sizes[k+1] + align - 1)/align*align;
+   }
+   for (size_t k = 0; k < 2; k++) {
+      offsets->push_back(n);
+      n += ((size_t)layer_sizes[0] + align - 1)/align*align;
+   }
+   return n;
+}
+
+static size_t DnnHeaderBytes(const size_t &num_sizes) {
+   const size_t bytes = 8 + 4*sizeof(uint32_t) + (2*num_sizes - 1)*sizeof(uint32_t);
+   return (bytes + DNN_WEIGHTS_ALIGNMENT - 1)/DNN_WEIGHTS_ALIGNMENT*DNN_WEIGHTS_ALIGNMENT;
+}
+
+/* Layers and input scaling on the blocks at data */
+void Dnn::SetWeights(const float *data) {
+   std::vector<size_t> offsets;
+   DnnBlockOffsets(layer_sizes, &offsets);
+   layers.clear();
+   for (size_t k = 0; k + 1 < num_layers; k++)
+      layers.push_back(DnnLayer(data + offsets[2*k], data + offsets[2*k+1], layer_sizes[k],
+                                layer_sizes[k+1], activation_functions[k]));
+   input_data_min = data + offsets[2*(num_layers-1)];
+   input_data_max = data + offsets[2*(num_layers-1)+1];
+
+   // Allocate input and output
+   input_vector = gsl::vector(layer_sizes[0], true);
+   output_vector = gsl::vector(layer_sizes[num_layers-1], true);
+}
+
+/**
+ * Map the packed weights. The layer sizes and activations have to be those
+ * of the .dnnInfo file.
+ */
+int Dnn::ReadWeights(const std::string &fname) {
+   if (weights_file.Open(fname, 1) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   const uint8_t *file = weights_file.Values<uint8_t>();
+   const size_t header_bytes = DnnHeaderBytes(num_layers);
+   std::vector<size_t> offsets;
+   const size_t n_values = DnnBlockOffsets(layer_sizes, &offsets);
+   uint32_t fields[4];
+   if (weights_file.bytes() < header_bytes || memcmp(file, DNN_WEIGHTS_MAGIC, 8) != 0) {
+      std::cerr << "Error: " << fname << " is not a DNN weight file" << std::endl;
+      return EXIT_FAILURE;
+   }
+   memcpy(fields, file + 8, sizeof(fields));
+   if (fields[0] != DNN_WEIGHTS_VERSION || fields[2] != DNN_WEIGHTS_ALIGNMENT
+       || fields[3] != header_bytes || fields[1] != num_layers
+       || weights_file.bytes() != header_bytes + n_values*sizeof(float)) {
+      std::cerr << "Error: DNN weight file " << fname << " does not match its .dnnInfo" << std::endl;
+      return EXIT_FAILURE;
+   }
+   std::vector<uint32_t> shapes(2*num_layers - 1);
+   memcpy(shapes.data(), file + 8 + sizeof(fields), shapes.size()*sizeof(uint32_t));
+   for (size_t k = 0; k < num_layers; k++) {
+      if (shapes[k] != (uint32_t)layer_sizes[k]
+          || (k + 1 < num_layers && shapes[num_layers + k] != (uint32_t)activation_functions[k])) {
+         std::cerr << "Error: DNN weight file " << fname << " does not match its .dnnInfo" << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+   SetWeights(reinterpret_cast<const float *>(file + header_bytes));
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Old format: .dnnData has W (column-major, in x out) and b of each
+ * layer, .dnnMinMax the input min and max, all float32. Converted once to
+ * the blocks of the packed format.
+ */
+int Dnn::ReadDataFiles(const char *basename) {
+   std::vector<size_t> offsets;
+   weights_buffer.assign(DnnBlockOffsets(layer_sizes, &offsets), 0.0f);
 
    /* Filename processing */
    std::string fname_str;
    fname_str += basename;
    fname_str += ".dnnData";
 
-   std::ifstream file(fname_str, std::ios::in | std::ios::binary);
-   if (!file) {
-      std::cout << "Error: Failed to read file: " << fname_str << std::endl;
-      assert(false);
-    }
-   std::streampos file_size;
-   size_t n_values;
-
-   // File size
-   file.seekg(0, std::ios::end);
-   file_size = file.tellg();
-   file.seekg(0, std::ios::beg);
-
    // Check file length
    size_t expected_length = 0;
-   size_t in_size, out_size=0;
+   size_t in_size, out_size;
    for (size_t layer_index=0; layer_index<this->num_layers-1 ; layer_index++) {
       in_size = this->layer_sizes[layer_index];
       out_size = this->layer_sizes[layer_index+1];
       expected_length += in_size*out_size + out_size;
    }
 
-   n_values = file_size / sizeof(float);
-   assert(n_values == expected_length);
-   float *file_data = new float[n_values];
-   file.read(reinterpret_cast<char*>(file_data), file_size);
-
-   gsl::matrix W;
-   gsl::matrix b;
+   MappedFile file;
+   if (file.Open(fname_str, sizeof(float)) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (file.NumValues<float>() != expected_length) {
+      std::cerr << "Error: " << fname_str << " has " << file.NumValues<float>()
+                << " values, the layers of the DNN " << expected_length << std::endl;
+      return EXIT_FAILURE;
+   }
+   const float *file_data = file.Values<float>();
 
    size_t i,j, ind=0;
    for (size_t layer_index=0; layer_index<this->num_layers-1 ; layer_index++) {
       in_size = this->layer_sizes[layer_index];
       out_size = this->layer_sizes[layer_index+1];
-      W = gsl::matrix(out_size, in_size);
-      b = gsl::matrix(out_size, 1);
-
-//      for(i=0;i<out_size;i++)
-//         for(j=0;j<in_size;j++)
-//            W(i,j) = file_data[ind++];
-
+      float *W = weights_buffer.data() + offsets[2*layer_index];
+      float *b = weights_buffer.data() + offsets[2*layer_index+1];
 
       for(j=0;j<in_size;j++)
          for(i=0;i<out_size;i++)
-            W(i,j) = file_data[ind++];
+            W[i*in_size + j] = file_data[ind++];
 
       for(i=0;i<out_size;i++)
-         b(i,0) = file_data[ind++];
-
-      this->addLayer(DnnLayer(W,b, this->activation_functions[layer_index]));
-
+         b[i] = file_data[ind++];
    }
 
-   delete[] file_data;
-
-    /* Read input max and min*/
+   /* Read input max and min*/
 
    /* Filename processing */
-     fname_str = basename;
-     fname_str += ".dnnMinMax";
-
-     std::ifstream file2(fname_str, std::ios::in | std::ios::binary);
-     if (!file2)
-        return EXIT_FAILURE;
-
-     // File size
-     file2.seekg(0, std::ios::end);
-     file_size = file2.tellg();
-     file2.seekg(0, std::ios::beg);
-
-     // Check file length
-     expected_length = 2*(this->layer_sizes[0]);
+   fname_str = basename;
+   fname_str += ".dnnMinMax";
 
-     ind=0;
-     n_values = file_size / sizeof(float);
-     assert(n_values == expected_length);
-     file_data = new float[n_values];
-     file2.read(reinterpret_cast<char*>(file_data), file_size);
-
-   // Read input data min values
-   this->input_data_min = gsl::matrix(layer_sizes[0],1);
-   for (i=0;i<(size_t)this->layer_sizes[0];i++)
-      this->input_data_min(i,0) = file_data[ind++];
-
-   // Read input data max values
-   this->input_data_max = gsl::matrix(layer_sizes[0],1);
-   for (i=0;i<(size_t)this->layer_sizes[0];i++)
-      this->input_data_max(i,0) = file_data[ind++];
+   // Check file length
+   expected_length = 2*(this->layer_sizes[0]);
+   if (file.Open(fname_str, sizeof(float)) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (file.NumValues<float>() != expected_length) {
+      std::cerr << "Error: " << fname_str << " has " << file.NumValues<float>()
+                << " values, " << expected_length << " expected" << std::endl;
+      return EXIT_FAILURE;
+   }
+   file_data = file.Values<float>();
+   memcpy(weights_buffer.data() + offsets[2*(num_layers-1)], file_data, layer_sizes[0]*sizeof(float));
+   memcpy(weights_buffer.data() + offsets[2*(num_layers-1)+1], file_data + layer_sizes[0],
+          layer_sizes[0]*sizeof(float));
 
-   delete[] file_data;
+   SetWeights(weights_buffer.data());
+   return EXIT_SUCCESS;
+}
 
-   // Allocate input and output
-   input_matrix = gsl::matrix(layer_sizes[0],1, true);
-   output_vector = gsl::vector(out_size,true);
+int Dnn::ReadData(const char *basename) {
+   if (num_layers < 2) {
+      std::cerr << "Error: DNN has no layers (ReadInfo first)" << std::endl;
+      return EXIT_FAILURE;
+   }
+   const std::string fname_str = std::string(basename) + ".dnnWeights";
+   struct stat info;
+   if (stat(fname_str.c_str(), &info) == 0)
+      return ReadWeights(fname_str);
+   return ReadDataFiles(basename);
+}
 
+/* Packed weights of the network (see DNN_WEIGHTS_MAGIC) */
+int Dnn::WriteWeights(const char *basename) const {
+   const std::string fname_str = std::string(basename) + ".dnnWeights";
+   const std::string tmp_fname = fname_str + ".tmp";
+   std::vector<size_t> offsets;
+   const size_t n_values = DnnBlockOffsets(layer_sizes, &offsets);
+   const size_t header_bytes = DnnHeaderBytes(num_layers);
+
+   std::vector<uint8_t> header(header_bytes, 0);
+   const uint32_t fields[4] = {DNN_WEIGHTS_VERSION, (uint32_t)num_layers, DNN_WEIGHTS_ALIGNMENT,
+                               (uint32_t)header_bytes};
+   memcpy(header.data(), DNN_WEIGHTS_MAGIC, 8);
+   memcpy(header.data() + 8, fields, sizeof(fields));
+   std::vector<uint32_t> shapes(2*num_layers - 1);
+   for (size_t k = 0; k < num_layers; k++) {
+      shapes[k] = layer_sizes[k];
+      if (k + 1 < num_layers)
+         shapes[num_layers + k] = activation_functions[k];
+   }
+   memcpy(header.data() + 8 + sizeof(fields), shapes.data(), shapes.size()*sizeof(uint32_t));
 
+   std::vector<float> data(n_values, 0.0f);
+   for (size_t k = 0; k < layers.size(); k++) {
+      memcpy(data.data() + offsets[2*k], layers[k].W(),
+             layers[k].in_size()*layers[k].out_size()*sizeof(float));
+      memcpy(data.data() + offsets[2*k+1], layers[k].b(), layers[k].out_size()*sizeof(float));
+   }
+   memcpy(data.data() + offsets[2*layers.size()], input_data_min, layer_sizes[0]*sizeof(float));
+   memcpy(data.data() + offsets[2*layers.size()+1], input_data_max, layer_sizes[0]*sizeof(float));
+
+   FILE *fid = fopen(tmp_fname.c_str(), "wb");
+   bool ok = fid != NULL;
+   if (fid != NULL) {
+      ok = fwrite(header.data(), 1, header.size(), fid) == header.size();
+      ok = fwrite(data.data(), sizeof(float), data.size(), fid) == data.size() && ok;
+      ok = fclose(fid) == 0 && ok;
+   }
+   if (!ok || rename(tmp_fname.c_str(), fname_str.c_str()) != 0) {
+      std::cerr << "Error: could not write file " << fname_str << std::endl;
+      remove(tmp_fname.c_str());
+      return EXIT_FAILURE;
+   }
+   std::cout << "Wrote " << fname_str << std::endl;
    return EXIT_SUCCESS;
-
-
 }
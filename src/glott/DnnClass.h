@@ -15,29 +15,51 @@
 #ifndef SRC_GLOTT_DNNCLASS_H_
 #define SRC_GLOTT_DNNCLASS_H_
 
-#include <list>
+#include <cstdint>
+#include <string>
+#include <vector>
 #include <libconfig.h++>
 
+#include "MappedFile.h"
+
+/*
+ * Packed weights of an excitation DNN (basename.dnnWeights), used in place
+ * from a memory mapping:
+ *   header   magic "TOLGDNN1", then uint32 version, number of layer sizes
+ *            (n), alignment in bytes and header bytes, the n layer sizes
+ *            and the n-1 activations (DnnActivationFunction)
+ *   blocks   for each layer W (out x in, row-major) and b (out), then the
+ *            input min and max (n_0 each), all float32, every block
+ *            starting at a multiple of the alignment
+ * `ConvertFeatures dnn <basename>` writes it from the .dnnInfo, .dnnData
+ * and .dnnMinMax files.
+ */
+#define DNN_WEIGHTS_MAGIC "TOLGDNN1"
+#define DNN_WEIGHTS_VERSION 1
+#define DNN_WEIGHTS_ALIGNMENT 64
+
 enum DnnActivationFunction {SIGMOID, TANH, RELU, LINEAR};
 
+/* Layer on float32 weights owned by the Dnn (not copied) */
 class DnnLayer {
 public:
-   DnnLayer();
-   DnnLayer(const gsl::matrix &W, const gsl::matrix &b, const DnnActivationFunction &af);
-   ~DnnLayer();
-   void ForwardPass(const gsl::matrix &input);
-   const gsl::matrix & getOutput() const {return this->layer_output;};
+   DnnLayer(const float *W, const float *b, const size_t &in_size, const size_t &out_size,
+            const DnnActivationFunction &af);
+   void ForwardPass(const gsl::vector &input, gsl::vector *output) const;
+   size_t in_size() const {return in_size_;}
+   size_t out_size() const {return out_size_;}
+   DnnActivationFunction activation_function() const {return activation_function_;}
+   const float *W() const {return W_;}
+   const float *b() const {return b_;}
 
 private:
-   // Variables
-   gsl::matrix W;
-   gsl::matrix b;
-   gsl::matrix layer_output;
-   DnnActivationFunction activation_function;
-   // Functions
-   void ApplySigmoid(gsl::matrix *mat);
-   //void ApplyRelu(gsl::matrix *vec);
-   //void ApplyTanh(gsl::matrix *vec);
+   const float *W_;
+   const float *b_;
+   size_t in_size_;
+   size_t out_size_;
+   DnnActivationFunction activation_function_;
+   //void ApplyRelu(gsl::vector *vec);
+   //void ApplyTanh(gsl::vector *vec);
 
 };
 
@@ -61,29 +83,40 @@ class Dnn {
 public:
    Dnn();
    ~Dnn() {};
-   void addLayer(const DnnLayer &layer);
    int ReadInfo(const char *basename);
+   /* basename.dnnWeights if there is one, else .dnnData and .dnnMinMax */
    int ReadData(const char *basename);
+   /* .dnnData and .dnnMinMax only */
+   int ReadDataFiles(const char *basename);
+   int WriteWeights(const char *basename) const;
    const gsl::vector & getOutput();
    void setInput(const SynthesisData &data, const size_t &frame_index);
+   const DnnParams &getInputParams() const {return input_params;}
 
 private:
-   std::list<DnnLayer> layer_list;
+   Dnn(const Dnn &);
+   Dnn &operator=(const Dnn &);
+
+   std::vector<DnnLayer> layers;
    size_t num_layers;
    std::vector<int> layer_sizes;
    std::vector<DnnActivationFunction> activation_functions;
+   // weights: mapped file, or the float32 buffer of the old format
+   MappedFile weights_file;
+   std::vector<float> weights_buffer;
    // scaling variables
-   gsl::matrix input_data_min;
-   gsl::matrix input_data_max;
+   const float *input_data_min;
+   const float *input_data_max;
    double input_min_value;
    double input_max_value;
-   gsl::matrix output_mean;
-   gsl::matrix output_std;
-   gsl::matrix input_matrix;
+   gsl::vector input_vector;
+   gsl::vector layer_buffer[2];
    gsl::vector output_vector;
    DnnParams input_params;
 
    int checkInput(const std::string &type, const size_t &target_size, const size_t &actual_size);
+   int ReadWeights(const std::string &fname);
+   void SetWeights(const float *data);
 
    DnnActivationFunction ActivationParse(std::string &str);
 
@@ -0,0 +1,127 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+#include <gslwrap/vector_double.h>
+
+#include "definitions.h"
+#include "SynthesisFunctions.h"
+#include "FeatureBuffers.h"
+
+FeatureBuffers::FeatureBuffers()
+   : number_of_frames(0), f0(NULL), gain(NULL), rd(NULL), lsf(NULL), lsf_order(0),
+     slsf(NULL), slsf_order(0), hnr(NULL), hnr_order(0), pls(NULL), pls_length(0) {}
+
+/* Copy n_rows x number_of_frames float32 values, frame by frame */
+static void SetFeatureMatrix(const float *values, const size_t &n_rows,
+                             const size_t &number_of_frames, gsl::matrix *mat) {
+   *mat = gsl::matrix(n_rows, number_of_frames);
+   size_t i, j;
+   for (j = 0; j < number_of_frames; j++)
+      for (i = 0; i < n_rows; i++)
+         (*mat)(i, j) = (double)values[j*n_rows + i];
+}
+
+/**
+ * Function CheckFeatureOrders
+ *
+ * Check the feature orders against the configuration: the features the
+ * synthesis needs must be present and all given features must have the
+ * configured order.
+ */
+int CheckFeatureOrders(const FeatureBuffers &features, const Param &params, std::string *error) {
+   const bool need_slsf = params.use_spectral_matching ||
+         params.excitation_method == DNN_GENERATED_EXCITATION;
+   const bool need_hnr = params.noise_gain_voiced > 0.0 ||
+         params.excitation_method == DNN_GENERATED_EXCITATION;
+   const bool need_pls = params.excitation_method == PULSES_AS_FEATURES_EXCITATION;
+   std::ostringstream msg;
+   if (features.number_of_frames == 0)
+      msg << "no frames";
+   else if ((int)features.lsf_order != params.lpc_order_vt)
+      msg << "lsf order " << features.lsf_order << ", expected " << params.lpc_order_vt;
+   else if ((need_slsf || features.slsf_order > 0) && (int)features.slsf_order != params.lpc_order_glot)
+      msg << "slsf order " << features.slsf_order << ", expected " << params.lpc_order_glot;
+   else if ((need_hnr || features.hnr_order > 0) && (int)features.hnr_order != params.hnr_order)
+      msg << "hnr order " << features.hnr_order << ", expected " << params.hnr_order;
+   else if ((need_pls || features.pls_length > 0) && (int)features.pls_length != params.paf_pulse_length)
+      msg << "pulse length " << features.pls_length << ", expected " << params.paf_pulse_length;
+   *error = msg.str();
+   return error->empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Function SetSynthesisData
+ *
+ * Fill the synthesis data from features in memory, with the same checks
+ * and defaults as ReadSynthesisData. Sets the utterance-dependent fields
+ * of params.
+ */
+int SetSynthesisData(const FeatureBuffers &features, Param *params, SynthesisData *data,
+                     std::string *error) {
+   const size_t n = features.number_of_frames;
+   size_t i;
+
+   data->fundf = gsl::vector(n);
+   for (i = 0; i < n; i++)
+      data->fundf(i) = (double)features.f0[i]*params->pitch_scale;
+   if (data->fundf.max() >= params->fs || data->fundf.min() < 0.0) {
+      *error = "F0 values must be in [0, fs)";
+      return EXIT_FAILURE;
+   }
+   params->number_of_frames = (int)n;
+
+   data->frame_energy = gsl::vector(n);
+   for (i = 0; i < n; i++)
+      data->frame_energy(i) = (double)features.gain[i];
+
+   data->Rd_opt = gsl::vector(n);
+   for (i = 0; i < n; i++)
+      data->Rd_opt(i) = (double)features.rd[i];
+
+   SetFeatureMatrix(features.lsf, features.lsf_order, n, &(data->lsf_vocal_tract));
+
+   if (features.slsf_order > 0)
+      SetFeatureMatrix(features.slsf, features.slsf_order, n, &(data->lsf_glot));
+   else
+      data->lsf_glot = gsl::matrix(params->lpc_order_glot, n, true);
+
+   if (features.hnr_order > 0)
+      SetFeatureMatrix(features.hnr, features.hnr_order, n, &(data->hnr_glot));
+   else
+      data->hnr_glot = gsl::matrix(params->hnr_order, n, true);
+
+   if (features.pls_length > 0)
+      SetFeatureMatrix(features.pls, features.pls_length, n, &(data->excitation_pulses));
+   else
+      data->excitation_pulses = gsl::matrix(params->paf_pulse_length, n, true);
+
+   params->signal_length = rint(params->number_of_frames * params->frame_shift/params->speed_scale);
+   data->signal = gsl::vector(params->signal_length, true);
+   data->excitation_signal = gsl::vector(params->signal_length, true);
+   return EXIT_SUCCESS;
+}
+
+/* Synthesis as in Synthesis.cpp, without file output */
+int SynthesizeFeatures(Param params, SynthesisData *data) {
+   PrepareSynthesisParameters(params, data);
+   if (CreateExcitation(params, *data, &(data->excitation_signal)) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   FftFilterExcitation(params, *data, &(data->signal));
+   GenerateUnvoicedSignal(params, *data, &(data->signal));
+   return EXIT_SUCCESS;
+}
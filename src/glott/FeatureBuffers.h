@@ -0,0 +1,45 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_FEATUREBUFFERS_H_
+#define SRC_GLOTT_FEATUREBUFFERS_H_
+
+#include <string>
+#include "definitions.h"
+
+/* Features of one utterance in memory, frame by frame as in the FLOAT
+ * feature files (n_frames x order). Optional features (slsf, hnr, pls)
+ * are NULL with order 0. */
+struct FeatureBuffers {
+   FeatureBuffers();
+   size_t number_of_frames;
+   const float *f0;
+   const float *gain;
+   const float *rd;
+   const float *lsf;
+   size_t lsf_order;
+   const float *slsf;
+   size_t slsf_order;
+   const float *hnr;
+   size_t hnr_order;
+   const float *pls;
+   size_t pls_length;
+};
+
+int CheckFeatureOrders(const FeatureBuffers &features, const Param &params, std::string *error);
+int SetSynthesisData(const FeatureBuffers &features, Param *params, SynthesisData *data,
+                     std::string *error);
+int SynthesizeFeatures(Param params, SynthesisData *data);
+
+#endif /* SRC_GLOTT_FEATUREBUFFERS_H_ */
@@ -0,0 +1,497 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FeatureContainer.h"
+#include "PulseCodec.h"
+#include "SpFunctions.h"
+
+/* On-disk header and stream table entry */
+struct ContainerHeader {
+   char magic[8];
+   uint32_t version;
+   uint32_t num_streams;
+   uint64_t file_bytes;
+   uint32_t table_crc;
+   uint32_t reserved;
+};
+
+struct ContainerEntry {
+   char name[FEATURE_CONTAINER_NAME_LENGTH];
+   uint32_t type;
+   uint32_t data_crc;
+   uint64_t frames;
+   uint64_t order;
+   uint64_t offset;
+   uint64_t bytes;
+};
+
+static const char kContainerMagic[8] = {'T', 'O', 'L', 'G', 'F', 'E', 'A', 'T'};
+
+/* Values converted per block when reading or writing a stream */
+#define CONTAINER_BLOCK_VALUES 16384
+
+struct Crc32Table {
+   uint32_t values[256];
+   Crc32Table() {
+      uint32_t i, k;
+      for (i = 0; i < 256; i++) {
+         uint32_t c = i;
+         for (k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+         values[i] = c;
+      }
+   }
+};
+
+/**
+ * Function Crc32
+ *
+ * CRC-32 (as in zlib) of bytes, continued from crc (0 for the first block)
+ */
+uint32_t Crc32(const void *data, const size_t &bytes, const uint32_t &crc) {
+   static const Crc32Table table;
+   const unsigned char *p = static_cast<const unsigned char *>(data);
+   uint32_t c = crc ^ 0xFFFFFFFFu;
+   size_t i;
+   for (i = 0; i < bytes; i++)
+      c = table.values[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+   return c ^ 0xFFFFFFFFu;
+}
+
+/* Bytes per value of a float stream (encoded streams have no fixed size) */
+static size_t ContainerValueSize(const ContainerValueType &type) {
+   return (type == CONTAINER_FLOAT32) ? sizeof(float) : sizeof(double);
+}
+
+static size_t AlignOffset(const size_t &offset) {
+   return (offset + FEATURE_CONTAINER_ALIGN - 1)/FEATURE_CONTAINER_ALIGN*FEATURE_CONTAINER_ALIGN;
+}
+
+/* Size of the header and the stream table, padded to the data alignment */
+static size_t TableBytes(const size_t &num_streams) {
+   return AlignOffset(sizeof(ContainerHeader) + num_streams*sizeof(ContainerEntry));
+}
+
+void FeatureContainer::Close() {
+   file_.Close();
+   streams_.clear();
+   filename_.clear();
+}
+
+int FeatureContainer::Open(const std::string &filename) {
+   Close();
+   if (file_.Open(filename, 0) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   filename_ = filename;
+
+   const char *base = file_.Values<char>();
+   const size_t file_bytes = file_.bytes();
+   ContainerHeader header;
+   if (file_bytes < sizeof(header)) {
+      std::cerr << "Error: " << filename << " is not a feature container" << std::endl;
+      return EXIT_FAILURE;
+   }
+   memcpy(&header, base, sizeof(header));
+   if (memcmp(header.magic, kContainerMagic, sizeof(kContainerMagic)) != 0) {
+      std::cerr << "Error: " << filename << " is not a feature container" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (header.version != FEATURE_CONTAINER_VERSION) {
+      std::cerr << "Error: unsupported feature container version " << header.version
+                << " in " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (header.file_bytes != file_bytes
+       || header.num_streams > (file_bytes - sizeof(header))/sizeof(ContainerEntry)) {
+      std::cerr << "Error: feature container " << filename << " is truncated" << std::endl;
+      return EXIT_FAILURE;
+   }
+   const char *table = base + sizeof(header);
+   if (Crc32(table, header.num_streams*sizeof(ContainerEntry), 0) != header.table_crc) {
+      std::cerr << "Error: stream table of " << filename << " is corrupted (CRC mismatch)"
+                << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   size_t i;
+   for (i = 0; i < header.num_streams; i++) {
+      ContainerEntry entry;
+      memcpy(&entry, table + i*sizeof(entry), sizeof(entry));
+      ContainerStream stream;
+      stream.name.assign(entry.name, strnlen(entry.name, sizeof(entry.name)));
+      stream.type = (entry.type <= CONTAINER_PULSES) ? (ContainerValueType)entry.type
+                                                     : CONTAINER_FLOAT64;
+      stream.crc = entry.data_crc;
+      stream.frames = (size_t)entry.frames;
+      stream.order = (size_t)entry.order;
+      stream.offset = (size_t)entry.offset;
+      stream.bytes = (size_t)entry.bytes;
+      const bool encoded = (entry.type == CONTAINER_PULSES);
+      if (entry.type > CONTAINER_PULSES || stream.order == 0
+          || (!encoded && stream.frames > stream.bytes/stream.order)
+          || (!encoded && stream.bytes != stream.frames*stream.order*ContainerValueSize(stream.type))
+          || stream.offset % FEATURE_CONTAINER_ALIGN != 0
+          || stream.offset > file_bytes || stream.bytes > file_bytes - stream.offset) {
+         std::cerr << "Error: invalid stream " << stream.name << " in " << filename << std::endl;
+         return EXIT_FAILURE;
+      }
+      streams_.push_back(stream);
+   }
+   return EXIT_SUCCESS;
+}
+
+const ContainerStream *FeatureContainer::FindStream(const std::string &name) const {
+   size_t i;
+   for (i = 0; i < streams_.size(); i++)
+      if (streams_[i].name == name)
+         return &(streams_[i]);
+   return NULL;
+}
+
+const void *FeatureContainer::StreamData(const ContainerStream &stream) const {
+   return file_.Values<char>() + stream.offset;
+}
+
+int FeatureContainer::VerifyStream(const ContainerStream &stream) const {
+   if (Crc32(StreamData(stream), stream.bytes, 0) != stream.crc) {
+      std::cerr << "Error: stream " << stream.name << " of " << filename_
+                << " is corrupted (CRC mismatch)" << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+int FeatureContainer::GetStream(const std::string &name, const ContainerStream **stream) const {
+   *stream = FindStream(name);
+   if (*stream == NULL) {
+      std::cerr << "Error: no stream " << name << " in " << filename_ << std::endl;
+      return EXIT_FAILURE;
+   }
+   return VerifyStream(**stream);
+}
+
+/* Values begin ... begin+n-1 of a stream as double */
+static void GetStreamValues(const ContainerStream &stream, const void *data, const size_t &begin,
+                            const size_t &n, double *dst) {
+   if (stream.type == CONTAINER_FLOAT32)
+      FloatToDouble(static_cast<const float *>(data) + begin, n, dst);
+   else
+      memcpy(dst, static_cast<const double *>(data) + begin, n*sizeof(double));
+}
+
+int FeatureContainer::ReadVector(const std::string &name, gsl::vector *vector_ptr) const {
+   const ContainerStream *stream;
+   if (GetStream(name, &stream) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (stream->order != 1 || stream->type == CONTAINER_PULSES) {
+      std::cerr << "Error: stream " << name << " of " << filename_ << " has "
+                << stream->order << " values per frame, expected 1" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (stream->frames == 0) {
+      std::cerr << "Error: stream " << name << " of " << filename_ << " is empty" << std::endl;
+      return EXIT_FAILURE;
+   }
+   *vector_ptr = gsl::vector(stream->frames);
+   GetStreamValues(*stream, StreamData(*stream), 0, stream->frames, VectorData(vector_ptr));
+   return EXIT_SUCCESS;
+}
+
+int FeatureContainer::ReadMatrix(const std::string &name, const size_t &n_rows,
+                                 gsl::matrix *matrix_ptr) const {
+   const ContainerStream *stream;
+   if (GetStream(name, &stream) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (stream->order != n_rows || stream->frames == 0) {
+      std::cerr << "ERROR: Invalid matrix dimensions in stream " << name << " of " << filename_
+                << " (" << stream->frames << " frames of " << stream->order << " values, "
+                << n_rows << " expected)" << std::endl;
+      return EXIT_FAILURE;
+   }
+   const size_t n_cols = stream->frames;
+   if (stream->type == CONTAINER_PULSES) {
+      if (DecodePulses(StreamData(*stream), stream->bytes, n_rows, matrix_ptr) == EXIT_FAILURE
+          || matrix_ptr->size2() != n_cols) {
+         std::cerr << "Error: could not decode stream " << name << " of " << filename_
+                   << std::endl;
+         return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+   }
+   *matrix_ptr = gsl::matrix(n_rows, n_cols);
+
+   /* Frame-major in the stream, one column per frame in the matrix */
+   gsl_matrix *m = matrix_ptr->gslobj();
+   const void *data = StreamData(*stream);
+   const size_t block_cols = GSL_MAX(CONTAINER_BLOCK_VALUES/n_rows, (size_t)1);
+   std::vector<double> block(block_cols*n_rows);
+   size_t first, i, j;
+   for (first = 0; first < n_cols; first += block_cols) {
+      const size_t cols = GSL_MIN(block_cols, n_cols - first);
+      GetStreamValues(*stream, data, first*n_rows, cols*n_rows, block.data());
+      for (j = 0; j < cols; j++)
+         for (i = 0; i < n_rows; i++)
+            m->data[i*m->tda + first + j] = block[j*n_rows + i];
+   }
+   return EXIT_SUCCESS;
+}
+
+void FeatureContainerWriter::AddVector(const std::string &name, const gsl::vector &vector) {
+   PendingStream stream = {name, &vector, NULL, PULSES_RAW};
+   pending_.push_back(stream);
+}
+
+void FeatureContainerWriter::AddMatrix(const std::string &name, const gsl::matrix &matrix) {
+   PendingStream stream = {name, NULL, &matrix, PULSES_RAW};
+   pending_.push_back(stream);
+}
+
+void FeatureContainerWriter::AddPulses(const std::string &name, const gsl::matrix &pulses,
+                                       const PulseEncoding &encoding) {
+   PendingStream stream = {name, NULL, &pulses, encoding};
+   pending_.push_back(stream);
+}
+
+/* Stream of the output file: the frames of a previous container (append)
+ * followed by the frames of a vector or matrix */
+struct OutputStream {
+   ContainerStream entry;
+   const ContainerStream *previous;
+   const gsl::vector *vector;
+   const gsl::matrix *matrix;
+   PulseEncoding encoding;
+   std::vector<uint8_t> encoded;     // new frames of a CONTAINER_PULSES stream
+};
+
+/* Frames first ... first+n_frames-1 of a vector or matrix, frame by frame */
+static void GatherFrames(const OutputStream &stream, const size_t &first, const size_t &n_frames,
+                         double *dst) {
+   size_t i, j;
+   if (stream.vector != NULL) {
+      const gsl_vector *v = stream.vector->gslobj();
+      for (j = 0; j < n_frames; j++)
+         dst[j] = v->data[(first + j)*v->stride];
+   } else {
+      const gsl_matrix *m = stream.matrix->gslobj();
+      const size_t n_rows = stream.matrix->size1();
+      for (j = 0; j < n_frames; j++)
+         for (i = 0; i < n_rows; i++)
+            dst[j*n_rows + i] = m->data[i*m->tda + first + j];
+   }
+}
+
+/* Write bytes and update the CRC; returns false on a write error */
+static bool WriteBytes(FILE *fid, const void *data, const size_t &bytes, uint32_t *crc) {
+   if (bytes == 0)
+      return true;
+   if (crc != NULL)
+      *crc = Crc32(data, bytes, *crc);
+   return fwrite(data, 1, bytes, fid) == bytes;
+}
+
+/**
+ * Write the container to filename.tmp and rename it over filename, so that
+ * a reader never sees a partly written container. With append set, the
+ * existing container is mapped and its streams are copied in front of the
+ * new frames; streams that are not written again are kept as they are.
+ */
+int FeatureContainerWriter::Write(const std::string &filename, const DataType &format,
+                                  const bool &append) const {
+   return Write(filename, format, append, false);
+}
+
+/**
+ * With sync set, the new container is flushed to disk (fsync) before it
+ * replaces the old one.
+ */
+int FeatureContainerWriter::Write(const std::string &filename, const DataType &format,
+                                  const bool &append, const bool &sync) const {
+
+   const ContainerValueType type = (format == FLOAT) ? CONTAINER_FLOAT32 : CONTAINER_FLOAT64;
+   const size_t value_size = ContainerValueSize(type);
+
+   FeatureContainer previous;
+   struct stat info;
+   const bool has_previous = append && stat(filename.c_str(), &info) == 0;
+   if (has_previous && previous.Open(filename) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+
+   /* Output streams: the previous ones in their order, then new ones */
+   std::vector<OutputStream> streams;
+   std::vector<bool> used(pending_.size(), false);
+   size_t i, k;
+   for (k = 0; k < previous.streams().size(); k++) {
+      OutputStream stream = {previous.streams()[k], &(previous.streams()[k]), NULL, NULL,
+                             PULSES_RAW, std::vector<uint8_t>()};
+      for (i = 0; i < pending_.size(); i++) {
+         if (!used[i] && pending_[i].name == stream.entry.name) {
+            stream.vector = pending_[i].vector;
+            stream.matrix = pending_[i].matrix;
+            stream.encoding = pending_[i].encoding;
+            used[i] = true;
+            break;
+         }
+      }
+      streams.push_back(stream);
+   }
+   for (i = 0; i < pending_.size(); i++) {
+      if (used[i])
+         continue;
+      if (pending_[i].name.size() >= FEATURE_CONTAINER_NAME_LENGTH) {
+         std::cerr << "Error: feature stream name " << pending_[i].name << " is too long"
+                   << std::endl;
+         return EXIT_FAILURE;
+      }
+      OutputStream stream;
+      stream.entry.name = pending_[i].name;
+      stream.entry.type = (pending_[i].encoding == PULSES_RAW) ? type : CONTAINER_PULSES;
+      stream.entry.frames = 0;
+      stream.entry.order = (pending_[i].vector != NULL) ? 1 : pending_[i].matrix->size1();
+      stream.previous = NULL;
+      stream.vector = pending_[i].vector;
+      stream.matrix = pending_[i].matrix;
+      stream.encoding = pending_[i].encoding;
+      streams.push_back(stream);
+   }
+
+   /* Sizes and offsets */
+   size_t offset = TableBytes(streams.size());
+   for (k = 0; k < streams.size(); k++) {
+      OutputStream &stream = streams[k];
+      size_t new_frames = 0;
+      size_t new_order = stream.entry.order;
+      ContainerValueType new_type = stream.entry.type;
+      if (stream.vector != NULL || stream.matrix != NULL)
+         new_type = (stream.encoding == PULSES_RAW) ? type : CONTAINER_PULSES;
+      if (stream.vector != NULL) {
+         new_frames = stream.vector->size();
+         new_order = 1;
+      } else if (stream.matrix != NULL) {
+         new_frames = stream.matrix->size2();
+         new_order = stream.matrix->size1();
+      }
+      if (new_frames > 0 && (new_order != stream.entry.order || stream.entry.type != new_type)) {
+         std::cerr << "Error: cannot append to stream " << stream.entry.name << " of "
+                   << filename << ": different frame size or value type" << std::endl;
+         return EXIT_FAILURE;
+      }
+      stream.entry.frames += new_frames;
+      if (stream.entry.type == CONTAINER_PULSES) {
+         if (new_frames > 0
+             && EncodePulses(*(stream.matrix), stream.encoding, &(stream.encoded)) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+         stream.entry.bytes = (stream.previous != NULL ? stream.previous->bytes : 0)
+                              + stream.encoded.size();
+      } else {
+         stream.entry.bytes = stream.entry.frames*stream.entry.order*ContainerValueSize(stream.entry.type);
+      }
+      stream.entry.offset = offset;
+      offset = AlignOffset(offset + stream.entry.bytes);
+   }
+
+   const std::string tmp_filename = filename + ".tmp";
+   FILE *fid = fopen(tmp_filename.c_str(), "wb");
+   if (fid == NULL) {
+      std::cerr << "Error: could not create file " << tmp_filename << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   /* Placeholder for the header and table, then the data */
+   bool ok = true;
+   const std::vector<char> zeros(FEATURE_CONTAINER_ALIGN + TableBytes(streams.size()), 0);
+   size_t position = TableBytes(streams.size());
+   ok = WriteBytes(fid, zeros.data(), position, NULL);
+   std::vector<double> block(CONTAINER_BLOCK_VALUES);
+   std::vector<float> block_float(CONTAINER_BLOCK_VALUES);
+   for (k = 0; k < streams.size() && ok; k++) {
+      OutputStream &stream = streams[k];
+      uint32_t crc = 0;
+      ok = WriteBytes(fid, zeros.data(), stream.entry.offset - position, NULL);
+      if (stream.previous != NULL)
+         ok = ok && WriteBytes(fid, previous.StreamData(*stream.previous), stream.previous->bytes, &crc);
+      if (stream.entry.type == CONTAINER_PULSES) {
+         ok = ok && WriteBytes(fid, stream.encoded.data(), stream.encoded.size(), &crc);
+      } else if (stream.vector != NULL || stream.matrix != NULL) {
+         const size_t n_frames = (stream.vector != NULL) ? stream.vector->size()
+                                                         : stream.matrix->size2();
+         const size_t block_frames = GSL_MAX(CONTAINER_BLOCK_VALUES/stream.entry.order, (size_t)1);
+         if (block.size() < block_frames*stream.entry.order) {
+            block.resize(block_frames*stream.entry.order);
+            block_float.resize(block.size());
+         }
+         size_t first;
+         for (first = 0; first < n_frames && ok; first += block_frames) {
+            const size_t frames = GSL_MIN(block_frames, n_frames - first);
+            const size_t n = frames*stream.entry.order;
+            GatherFrames(stream, first, frames, block.data());
+            if (type == CONTAINER_FLOAT32) {
+               DoubleToFloat(block.data(), n, block_float.data());
+               ok = WriteBytes(fid, block_float.data(), n*value_size, &crc);
+            } else {
+               ok = WriteBytes(fid, block.data(), n*value_size, &crc);
+            }
+         }
+      }
+      stream.entry.crc = crc;
+      position = stream.entry.offset + stream.entry.bytes;
+   }
+
+   /* Header and table */
+   std::vector<char> table(TableBytes(streams.size()), 0);
+   for (k = 0; k < streams.size(); k++) {
+      ContainerEntry entry;
+      memset(&entry, 0, sizeof(entry));
+      memcpy(entry.name, streams[k].entry.name.c_str(), streams[k].entry.name.size());
+      entry.type = (uint32_t)streams[k].entry.type;
+      entry.data_crc = streams[k].entry.crc;
+      entry.frames = streams[k].entry.frames;
+      entry.order = streams[k].entry.order;
+      entry.offset = streams[k].entry.offset;
+      entry.bytes = streams[k].entry.bytes;
+      memcpy(table.data() + sizeof(ContainerHeader) + k*sizeof(entry), &entry, sizeof(entry));
+   }
+   ContainerHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, kContainerMagic, sizeof(kContainerMagic));
+   header.version = FEATURE_CONTAINER_VERSION;
+   header.num_streams = (uint32_t)streams.size();
+   header.file_bytes = std::max(position, TableBytes(streams.size()));
+   header.table_crc = Crc32(table.data() + sizeof(header), streams.size()*sizeof(ContainerEntry), 0);
+   memcpy(table.data(), &header, sizeof(header));
+   ok = ok && fseek(fid, 0, SEEK_SET) == 0;
+   ok = ok && WriteBytes(fid, table.data(), table.size(), NULL);
+   if (sync)
+      ok = ok && fflush(fid) == 0 && fsync(fileno(fid)) == 0;
+
+   if (fclose(fid) != 0 || !ok) {
+      std::cerr << "Error: could not write file " << tmp_filename << std::endl;
+      remove(tmp_filename.c_str());
+      return EXIT_FAILURE;
+   }
+   previous.Close();
+   if (rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+      std::cerr << "Error: could not rename " << tmp_filename << " to " << filename << std::endl;
+      remove(tmp_filename.c_str());
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_FEATURECONTAINER_H_
+#define SRC_GLOTT_FEATURECONTAINER_H_
+
+/*
+ * Feature container: all feature streams of one utterance in one file
+ * (FEATURE_CONTAINER = true), instead of one file per feature.
+ *
+ * Layout (little-endian):
+ *   header  32 bytes: magic "TOLGFEAT", version, number of streams,
+ *           file size, CRC-32 of the stream table
+ *   table   64 bytes per stream: name, value type (float32 / float64 /
+ *           encoded pulses), CRC-32 of the data, frames, values per frame,
+ *           offset, bytes
+ *   data    one block per stream, frame by frame as in the binary feature
+ *           files, each starting at a multiple of FEATURE_CONTAINER_ALIGN
+ *           bytes so that it can be used in place from a memory map;
+ *           encoded pulses (PULSE_ENCODING) are stored as the blocks of
+ *           an encoded .pls file
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gslwrap/vector_double.h>
+#include <gslwrap/matrix_double.h>
+
+#include "definitions.h"
+#include "MappedFile.h"
+
+#define FEATURE_CONTAINER_VERSION 1
+#define FEATURE_CONTAINER_ALIGN 64
+#define FEATURE_CONTAINER_NAME_LENGTH 24
+
+enum ContainerValueType {CONTAINER_FLOAT32, CONTAINER_FLOAT64, CONTAINER_PULSES};
+
+struct ContainerStream {
+   std::string name;
+   ContainerValueType type;
+   uint32_t crc;
+   size_t frames;
+   size_t order;     // values per frame, 1 for vectors
+   size_t offset;
+   size_t bytes;
+};
+
+/**
+ * Class FeatureContainer
+ *
+ * Reads a container file: the file is mapped once and each stream is
+ * converted to a gsl vector or matrix (one column per frame) on request.
+ * The CRC of a stream is checked when it is read.
+ */
+class FeatureContainer {
+ public:
+   int Open(const std::string &filename);
+   void Close();
+
+   const std::vector<ContainerStream> &streams() const {return streams_;}
+   const ContainerStream *FindStream(const std::string &name) const;
+   int VerifyStream(const ContainerStream &stream) const;
+   const void *StreamData(const ContainerStream &stream) const;
+
+   int ReadVector(const std::string &name, gsl::vector *vector_ptr) const;
+   int ReadMatrix(const std::string &name, const size_t &n_rows, gsl::matrix *matrix_ptr) const;
+
+ private:
+   int GetStream(const std::string &name, const ContainerStream **stream) const;
+
+   std::string filename_;
+   MappedFile file_;
+   std::vector<ContainerStream> streams_;
+};
+
+/**
+ * Class FeatureContainerWriter
+ *
+ * Collects the streams of an utterance and writes them as one container.
+ * The vectors and matrices are not copied: they must stay alive until
+ * Write() returns.
+ */
+class FeatureContainerWriter {
+ public:
+   void AddVector(const std::string &name, const gsl::vector &vector);
+   void AddMatrix(const std::string &name, const gsl::matrix &matrix);
+   /* Pulses stored with a PULSE_ENCODING (PULSES_RAW as AddMatrix) */
+   void AddPulses(const std::string &name, const gsl::matrix &pulses,
+                  const PulseEncoding &encoding);
+   /* DOUBLE and ASCII are stored as float64, FLOAT as float32. With append
+    * set, the frames are added to the end of the streams of an existing
+    * container (chunked analysis). */
+   int Write(const std::string &filename, const DataType &format, const bool &append) const;
+   int Write(const std::string &filename, const DataType &format, const bool &append,
+             const bool &sync) const;
+
+ private:
+   struct PendingStream {
+      std::string name;
+      const gsl::vector *vector;
+      const gsl::matrix *matrix;
+      PulseEncoding encoding;
+   };
+   std::vector<PendingStream> pending_;
+};
+
+uint32_t Crc32(const void *data, const size_t &bytes, const uint32_t &crc);
+
+#endif /* SRC_GLOTT_FEATURECONTAINER_H_ */
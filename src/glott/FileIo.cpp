@@ -22,10 +22,26 @@
 #include <iostream>
 #include <fstream>
 #include <libgen.h>
+#include <algorithm>
+#include <vector>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
 #include <gslwrap/vector_double.h>
 #include <gslwrap/matrix_double.h>
 
 #include "definitions.h"
+#include "FeatureContainer.h"
+#include "MappedFile.h"
+#include "PulseCodec.h"
+#include "SpFunctions.h"
+
+/* Values converted per block when reading or writing a file */
+#define FILE_BLOCK_VALUES 16384
 
 
 void create_file (const char * fname, int format)
@@ -52,43 +68,485 @@ void create_file (const char * fname, int format)
 	*/
 } /* create_file */
 
-int WriteWavFile(const std::string &fname_str, const gsl::vector &signal, const int &fs) {
+/* Largest absolute value of signal, in one pass */
+static double SignalPeak(const gsl::vector &signal) {
+   if (!signal.is_set() || signal.size() == 0)
+      return 0.0;
+   double min_value, max_value;
+   gsl_vector_minmax(signal.gslobj(), &min_value, &max_value);
+   return GSL_MAX(max_value, -min_value);
+}
 
-   /* Filename processing */
-//   std::string fname_str;
-//   fname_str += basename;
-//   fname_str += extension;
-   std::cout << "Writing file " << fname_str  << std::endl;
+/* Write all bytes to fd, retrying partial writes */
+static bool WriteAllBytes(const int &fd, const void *data, const size_t &bytes) {
+   const char *ptr = static_cast<const char *>(data);
+   size_t done = 0;
+   while (done < bytes) {
+      const ssize_t r = write(fd, ptr + done, bytes - done);
+      if (r < 0 && errno == EINTR)
+         continue;
+      if (r <= 0)
+         return false;
+      done += (size_t)r;
+   }
+   return true;
+}
 
-   /* Filename processing */
-   SndfileHandle file ;
-   int channels = 1;
-   file = SndfileHandle(fname_str.c_str(), SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_PCM_16, channels, fs) ;
-   if (file.error()) {
-      std::cerr << "Error: Failed to open file: " << fname_str.c_str() << std::endl;
-      return EXIT_FAILURE;
+/*
+ * Wav files are written directly as RIFF (little-endian, as the host): a
+ * 16-bit PCM file has the canonical 44-byte header, a float32 file
+ * (format 3) has an 18-byte fmt chunk and a fact chunk with the number of
+ * samples. Samples are converted one block at a time into the buffer that
+ * is written, so there is no copy of the whole signal and no second
+ * conversion in a library.
+ */
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_IEEE_FLOAT 3
+
+static size_t WavSampleBytes(const WavFormat &format) {
+   return (format == WAV_FLOAT) ? sizeof(float) : sizeof(int16_t);
+}
+
+static void PutLe16(const uint16_t &value, std::vector<uint8_t> *bytes) {
+   bytes->push_back((uint8_t)(value & 0xFF));
+   bytes->push_back((uint8_t)(value >> 8));
+}
+
+static void PutLe32(const uint32_t &value, std::vector<uint8_t> *bytes) {
+   PutLe16((uint16_t)(value & 0xFFFF), bytes);
+   PutLe16((uint16_t)(value >> 16), bytes);
+}
+
+static void PutTag(const char *tag, std::vector<uint8_t> *bytes) {
+   bytes->insert(bytes->end(), tag, tag + 4);
+}
+
+static uint32_t GetLe32(const uint8_t *p) {
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t GetLe16(const uint8_t *p) {
+   return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/* Header of a mono wav file of n_samples */
+static void WavHeader(const WavFormat &format, const int &fs, const uint32_t &n_samples,
+                      std::vector<uint8_t> *header) {
+   const uint16_t sample_bytes = (uint16_t)WavSampleBytes(format);
+   const uint32_t data_bytes = n_samples*sample_bytes;
+   const bool is_float = (format == WAV_FLOAT);
+   header->clear();
+   PutTag("RIFF", header);
+   PutLe32((is_float ? 50 : 36) + data_bytes, header);
+   PutTag("WAVE", header);
+   PutTag("fmt ", header);
+   PutLe32(is_float ? 18 : 16, header);
+   PutLe16(is_float ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM, header);
+   PutLe16(1, header);
+   PutLe32((uint32_t)fs, header);
+   PutLe32((uint32_t)fs*sample_bytes, header);
+   PutLe16(sample_bytes, header);
+   PutLe16((uint16_t)(8*sample_bytes), header);
+   if (is_float) {
+      PutLe16(0, header);
+      PutTag("fact", header);
+      PutLe32(4, header);
+      PutLe32(n_samples, header);
    }
+   PutTag("data", header);
+   PutLe32(data_bytes, header);
+}
 
+/* Size fields of a wav file that samples are appended to */
+struct WavLayout {
+   WavFormat format;
+   int fs;
+   off_t fact_offset;   // sample count of the fact chunk (0 if there is none)
+   off_t data_offset;   // size of the data chunk, the last one of the file
+   uint32_t data_bytes;
+};
 
-   double scale = GSL_MAX(signal.max(),-signal.min());
-   if (scale > 1.0)
-      std::cout << "Warning: Signal maximum value is: " << scale << ". Re-scaling signal." << std::endl;
+/**
+ * Function ReadWavLayout
+ *
+ * Find the format and the size fields of a mono 16-bit or float32 wav
+ * file whose last chunk is the data, as written by WriteWavFile and by
+ * libsndfile.
+ */
+static int ReadWavLayout(const int &fd, const std::string &filename, WavLayout *layout) {
+   uint8_t head[4096];
+   ssize_t n_read;
+   do {
+      n_read = pread(fd, head, sizeof(head), 0);
+   } while (n_read < 0 && errno == EINTR);
+   struct stat info;
+   if (n_read < 12 || fstat(fd, &info) != 0 || memcmp(head, "RIFF", 4) != 0 ||
+       memcmp(head + 8, "WAVE", 4) != 0) {
+      std::cerr << "Error: " << filename << " is not a wav file" << std::endl;
+      return EXIT_FAILURE;
+   }
+   bool have_format = false;
+   uint16_t tag = 0, channels = 0, bits = 0;
+   layout->fact_offset = 0;
+   layout->data_offset = 0;
+   size_t offset = 12;
+   while (offset + 8 <= (size_t)n_read) {
+      const uint8_t *chunk = head + offset;
+      const uint32_t size = GetLe32(chunk + 4);
+      if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && offset + 24 <= (size_t)n_read) {
+         tag = GetLe16(chunk + 8);
+         channels = GetLe16(chunk + 10);
+         layout->fs = (int)GetLe32(chunk + 12);
+         bits = GetLe16(chunk + 22);
+         have_format = true;
+      } else if (memcmp(chunk, "fact", 4) == 0) {
+         layout->fact_offset = (off_t)offset + 8;
+      } else if (memcmp(chunk, "data", 4) == 0) {
+         layout->data_offset = (off_t)offset + 4;
+         layout->data_bytes = size;
+         break;
+      }
+      offset += 8 + size + (size & 1);
+   }
+   if (tag == WAV_FORMAT_PCM && bits == 16)
+      layout->format = WAV_PCM16;
+   else if (tag == WAV_FORMAT_IEEE_FLOAT && bits == 32)
+      layout->format = WAV_FLOAT;
    else
-      scale = 1.0;
+      have_format = false;
+   if (!have_format || channels != 1 || layout->data_offset == 0 ||
+       layout->data_offset + 4 + (off_t)layout->data_bytes != info.st_size) {
+      std::cerr << "Error: cannot append to " << filename
+                << ", not a mono 16-bit or float wav file ending with its data" << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+/* Update the RIFF, fact and data sizes after appending n_samples */
+static bool UpdateWavLayout(const int &fd, const WavLayout &layout, const uint32_t &n_samples) {
+   const uint32_t data_bytes = layout.data_bytes + n_samples*(uint32_t)WavSampleBytes(layout.format);
+   std::vector<uint8_t> field;
+   PutLe32(data_bytes, &field);
+   PutLe32((uint32_t)layout.data_offset + data_bytes - 4, &field);
+   if (layout.fact_offset > 0) {
+      uint8_t samples[4];
+      if (pread(fd, samples, 4, layout.fact_offset) != 4)
+         return false;
+      PutLe32(GetLe32(samples) + n_samples, &field);
+   }
+   return pwrite(fd, field.data(), 4, layout.data_offset) == 4 &&
+          pwrite(fd, field.data() + 4, 4, 4) == 4 &&
+          (layout.fact_offset == 0 || pwrite(fd, field.data() + 8, 4, layout.fact_offset) == 4);
+}
+
+/**
+ * Function SignalToPcm16
+ *
+ * x[i*stride]*gain (i < count) as 16-bit samples: scaled by 32768 (the
+ * inverse of ReadWavBlock, so that a 16-bit input is written back
+ * unchanged), rounded to the nearest integer and clipped. This is the only
+ * double to PCM16 conversion: wav files, the analysis input and the
+ * synthesis server all use it.
+ */
+void SignalToPcm16(const double *x, const size_t &stride, const size_t &count,
+                   const double &gain, int16_t *pcm16) {
+   /* Adding and subtracting 1.5*2^52 rounds to the nearest integer (ties
+    * to even, as rint) without a library call */
+   const double kRound = 6755399441055744.0;
+   size_t i;
+   for (i = 0; i < count; i++) {
+      double s = x[i*stride]*gain*32768.0;
+      s = (s < -32768.0) ? -32768.0 : s;
+      s = (s > 32767.0) ? 32767.0 : s;
+      pcm16[i] = (int16_t)(int32_t)((s + kRound) - kRound);
+   }
+}
+
+/**
+ * Function ConvertWavSamples
+ *
+ * signal(first .. first+count-1)*gain as samples of format (16-bit with
+ * SignalToPcm16). The contiguous case is a plain loop over the block that
+ * the compiler can vectorise. Returns the largest absolute value of
+ * signal*gain.
+ */
+static double ConvertWavSamples(const gsl_vector *v, const size_t &first, const size_t &count,
+                                const double &gain, const WavFormat &format, int16_t *pcm16,
+                                float *pcm_float) {
+   const double *x = v->data + first*v->stride;
+   const size_t stride = v->stride;
+   double peak = 0.0;
+   size_t i;
+   if (format == WAV_FLOAT) {
+      for (i = 0; i < count; i++) {
+         const double y = x[i*stride]*gain;
+         peak = GSL_MAX(peak, fabs(y));
+         pcm_float[i] = (float)y;
+      }
+      return peak;
+   }
+   for (i = 0; i < count; i++)
+      peak = GSL_MAX(peak, fabs(x[i*stride]*gain));
+   SignalToPcm16(x, stride, count, gain, pcm16);
+   return peak;
+}
+
+/**
+ * Function WriteWavSignal
+ *
+ * Write signal*gain to a new wav file, or append it to an existing one
+ * of the same format and sample rate. The largest absolute value of
+ * signal*gain is returned in peak.
+ */
+static int WriteWavSignal(const std::string &filename, const gsl::vector &signal, const int &fs,
+                          const WavFormat &format, const double &gain, const bool &append,
+                          const bool &sync, double *peak) {
+   *peak = 0.0;
+   const size_t n = signal.is_set() ? signal.size() : 0;
+   const int fd = open(filename.c_str(), append ? O_RDWR : (O_WRONLY | O_CREAT | O_TRUNC), 0666);
+   if (fd < 0) {
+      std::cerr << "Error: Failed to open file: " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   WavLayout layout;
+   bool ok = true;
+   if (append) {
+      if (ReadWavLayout(fd, filename, &layout) == EXIT_FAILURE) {
+         close(fd);
+         return EXIT_FAILURE;
+      }
+      if (layout.fs != fs || layout.format != format) {
+         std::cerr << "Error: cannot append to " << filename << ", format does not match" << std::endl;
+         close(fd);
+         return EXIT_FAILURE;
+      }
+      ok = (lseek(fd, 0, SEEK_END) >= 0);
+   }
+   /* RIFF sizes are 32-bit */
+   const uint64_t data_bytes = (append ? layout.data_bytes : 0) + (uint64_t)n*WavSampleBytes(format);
+   if (data_bytes > 0xFFFFFFFFu - 64) {
+      std::cerr << "Error: " << filename << " would be too large for a wav file" << std::endl;
+      close(fd);
+      return EXIT_FAILURE;
+   }
+   if (ok && !append) {
+      std::vector<uint8_t> header;
+      WavHeader(format, fs, (uint32_t)n, &header);
+      ok = WriteAllBytes(fd, header.data(), header.size());
+   }
+
+   const size_t block = GSL_MIN((size_t)FILE_BLOCK_VALUES, GSL_MAX(n, (size_t)1));
+   std::vector<int16_t> pcm16((format == WAV_PCM16) ? block : 0);
+   std::vector<float> pcm_float((format == WAV_FLOAT) ? block : 0);
+   size_t first;
+   for (first = 0; ok && first < n; first += block) {
+      const size_t count = GSL_MIN(block, n - first);
+      *peak = GSL_MAX(*peak, ConvertWavSamples(signal.gslobj(), first, count, gain, format,
+                                               pcm16.data(), pcm_float.data()));
+      if (format == WAV_FLOAT)
+         ok = WriteAllBytes(fd, pcm_float.data(), count*sizeof(float));
+      else
+         ok = WriteAllBytes(fd, pcm16.data(), count*sizeof(int16_t));
+   }
+   if (ok && append)
+      ok = UpdateWavLayout(fd, layout, (uint32_t)n);
+   if (ok && sync && fsync(fd) != 0)
+      ok = false;
+   if (close(fd) != 0)
+      ok = false;
+   if (!ok) {
+      std::cerr << "Error: could not write file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+int WriteWavFile(const std::string &fname_str, const gsl::vector &signal, const int &fs) {
+   return WriteWavFile(fname_str, signal, fs, WAV_PCM16, false);
+}
+
+int WriteWavFile(const std::string &fname_str, const gsl::vector &signal, const int &fs,
+                 const bool &sync) {
+   return WriteWavFile(fname_str, signal, fs, WAV_PCM16, sync);
+}
+
+/**
+ * 16-bit output is re-scaled to the peak of the signal if it exceeds 1;
+ * float output is written as is. With sync set, the file is flushed to
+ * disk (fsync) before returning.
+ */
+int WriteWavFile(const std::string &fname_str, const gsl::vector &signal, const int &fs,
+                 const WavFormat &format, const bool &sync) {
+   double gain = 1.0;
+   if (format == WAV_PCM16) {
+      const double scale = SignalPeak(signal);
+      if (scale > 1.0) {
+         std::cout << "Warning: Signal maximum value is: " << scale << ". Re-scaling signal." << std::endl;
+         gain = 1.0/scale;
+      }
+   }
+   std::cout << "Writing file " << fname_str << std::endl;
+   double peak;
+   return WriteWavSignal(fname_str, signal, fs, format, gain, false, sync, &peak);
+}
+
+/**
+ * Write signal*gain, for a caller that already knows the level of the
+ * signal: there is no pass over the signal for the peak, and 16-bit
+ * values outside [-1, 1] are clipped.
+ */
+int WriteWavFile(const std::string &fname_str, const gsl::vector &signal, const int &fs,
+                 const WavFormat &format, const double &gain, const bool &sync) {
+   std::cout << "Writing file " << fname_str << std::endl;
+   double peak;
+   if (WriteWavSignal(fname_str, signal, fs, format, gain, false, sync, &peak) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (format == WAV_PCM16 && peak > 1.0)
+      std::cout << "Warning: Signal maximum value is: " << peak << ". Clipping signal." << std::endl;
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Function AppendWavFile
+ *
+ * Append signal to a wav file (created when create is set). The file is
+ * written in blocks, so the signal cannot be re-scaled as a whole like in
+ * WriteWavFile: 16-bit values outside [-1, 1] are clipped.
+ */
+int AppendWavFile(const std::string &fname_str, const gsl::vector &signal, const int &fs,
+                  const bool &create) {
+   return AppendWavFile(fname_str, signal, fs, WAV_PCM16, create, false);
+}
+
+int AppendWavFile(const std::string &fname_str, const gsl::vector &signal, const int &fs,
+                  const bool &create, const bool &sync) {
+   return AppendWavFile(fname_str, signal, fs, WAV_PCM16, create, sync);
+}
+
+int AppendWavFile(const std::string &fname_str, const gsl::vector &signal, const int &fs,
+                  const WavFormat &format, const bool &create, const bool &sync) {
+   if (create)
+      std::cout << "Writing file " << fname_str << std::endl;
+   /* The peak for the warning comes from the conversion, not from a pass of its own */
+   double peak;
+   if (WriteWavSignal(fname_str, signal, fs, format, 1.0, !create, sync, &peak) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (format == WAV_PCM16 && peak > 1.0)
+      std::cout << "Warning: Signal maximum value is: " << peak << ". Clipping signal." << std::endl;
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Function GetWavFileLength
+ *
+ * Number of samples in a wav file, without reading it. The sample rate
+ * must match fs.
+ */
+int GetWavFileLength(const char *fname, const int &fs, size_t *n_samples) {
+
+   SndfileHandle file(fname);
+   if(file.error()) {
+      std::cerr << "Error: Failed to open file: " << fname << std::endl;
+      return EXIT_FAILURE;
+   }
+   printf ("Reading file '%s'\n", fname) ;
+   printf ("    Sample rate : %d\n", file.samplerate ()) ;
+   printf ("    Channels    : %d\n", file.channels ()) ;
+   if (file.samplerate() != fs) {
+      std::cerr << "Error: Sample rate does not match with config" << std::endl;
+      return EXIT_FAILURE;
+   }
+   *n_samples = static_cast<size_t>(file.frames());
 
-   /* Create buffer and write signal to file */
-   double *buffer = new double[signal.size()];
+   return EXIT_SUCCESS;
+}
 
+/**
+ * Function SignalToPcm16
+ *
+ * 16-bit samples of signal, as they are stored in a PCM16 wav file.
+ */
+void SignalToPcm16(const gsl::vector &signal, std::vector<int16_t> *pcm16) {
+   const size_t n = signal.is_set() ? signal.size() : 0;
+   pcm16->resize(n);
+   if (n > 0)
+      SignalToPcm16(signal.gslobj()->data, signal.gslobj()->stride, n, 1.0, pcm16->data());
+}
+
+/**
+ * Function ReadSamples
+ *
+ * Decode length samples from the current position of file into signal
+ * and, if pcm16 is given, into 16-bit samples. PCM16 files are decoded
+ * once as 16-bit values (signal is then exactly pcm16/32768); other formats
+ * are decoded as double and quantized.
+ *
+ * @return number of samples read
+ */
+static size_t ReadSamples(SndfileHandle &file, const size_t &length, gsl::vector *signal,
+                          std::vector<int16_t> *pcm16) {
+   *(signal) = gsl::vector(length);
    size_t i;
-   for(i=0;i<signal.size();i++)
-      buffer[i] = signal(i)/scale;
-   file.write(buffer, signal.size());
+   if (pcm16 != NULL && (file.format() & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_16) {
+      pcm16->resize(length);
+      sf_count_t n_read = file.read(pcm16->data(), length);
+      for (i=0;i<length;i++)
+         (*signal)(i) = (double)(*pcm16)[i]/32768.0;
+      return n_read < 0 ? 0 : (size_t)n_read;
+   }
+
+   double *buffer = new double[length];
+   sf_count_t n_read = file.read(buffer, length);
+   for (i=0;i<length;i++)
+      (*signal)(i) = buffer[i];
    delete[] buffer;
+   if (pcm16 != NULL)
+      SignalToPcm16(*signal, pcm16);
+   return n_read < 0 ? 0 : (size_t)n_read;
+}
+
+/**
+ * Function ReadWavBlock
+ *
+ * Read samples begin ... begin+length-1 of a wav file into signal (and
+ * pcm16, see ReadSamples).
+ */
+int ReadWavBlock(const char *fname, const size_t &begin, const size_t &length,
+                 gsl::vector *signal, std::vector<int16_t> *pcm16) {
+
+   SndfileHandle file(fname);
+   if(file.error()) {
+      std::cerr << "Error: Failed to open file: " << fname << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (file.seek(static_cast<sf_count_t>(begin), SEEK_SET) < 0) {
+      std::cerr << "Error: Failed to seek to sample " << begin << " in " << fname << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   if (ReadSamples(file, length, signal, pcm16) != length) {
+      std::cerr << "Error: Failed to read " << length << " samples from " << fname << std::endl;
+      return EXIT_FAILURE;
+   }
 
    return EXIT_SUCCESS;
 }
 
-int ReadWavFile(const char *fname, gsl::vector *signal, Param *params) {
+int ReadWavBlock(const char *fname, const size_t &begin, const size_t &length,
+                 gsl::vector *signal) {
+   return ReadWavBlock(fname, begin, length, signal, NULL);
+}
+
+/**
+ * Function ReadWavFile
+ *
+ * Read a wav file into signal, check its sample rate against params->fs
+ * and set the file-dependent fields of params. With pcm16, the 16-bit
+ * samples are returned from the same decode (see ReadSamples).
+ */
+int ReadWavFile(const char *fname, gsl::vector *signal, Param *params,
+                std::vector<int16_t> *pcm16) {
 
 	SndfileHandle file ;
 
@@ -108,16 +566,8 @@ int ReadWavFile(const char *fname, gsl::vector *signal, Param *params) {
 		return EXIT_FAILURE;
 	}
 
-	/* define buffer for sndfile and read */
-	*(signal) = gsl::vector(static_cast <size_t> (file.frames()));
-	// double buffer[signal->size()];
-	double *buffer = (double*)malloc(signal->size() * sizeof(double));
-	file.read(buffer, signal->size()) ;
-
-	/* copy read buffer to signal */
-	size_t i;
-	for (i=0;i<signal->size();i++)
-		(*signal)(i) = buffer[i];
+	/* decode once into signal (and pcm16) */
+	ReadSamples(file, static_cast <size_t> (file.frames()), signal, pcm16);
 
 	/* set file parameters */
 	params->number_of_frames = (int)ceil((double)signal->size()/(double)params->frame_shift);
@@ -134,12 +584,13 @@ int ReadWavFile(const char *fname, gsl::vector *signal, Param *params) {
    */
 	FilePathBasename(fname, &(params->file_path), &(params->file_basename));
 
-
-   free(buffer);
-
    return EXIT_SUCCESS;
 }
 
+int ReadWavFile(const char *fname, gsl::vector *signal, Param *params) {
+   return ReadWavFile(fname, signal, params, NULL);
+}
+
 
 /**
  * Function version that doesn't modify params
@@ -177,11 +628,191 @@ int ReadWavFile(const std::string &fname, gsl::vector *signal) {
 }
 
 
+/* Bytes per value of a binary parameter file */
+static size_t BinaryValueSize(const DataType &format) {
+   return (format == DOUBLE) ? sizeof(double) : sizeof(float);
+}
+
+/* Separators of the values of an ASCII parameter file (as for fscanf) */
+static inline bool IsTextSpace(const char &c) {
+   return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static const double kPowersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                      1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+                                      1e20, 1e21, 1e22};
+
+/**
+ * Function ParseTextValue
+ *
+ * Value of the token [begin, end). Plain decimals of up to 15 digits (as
+ * written with "%.7f") are converted with one exact multiplication or
+ * division, which rounds correctly; anything else goes through strtod.
+ * With single set, the value is rounded to float as by fscanf("%f").
+ */
+static bool ParseTextValue(const char *begin, const char *end, const bool &single,
+                           double *value) {
+   const char *ptr = begin;
+   const bool negative = (*ptr == '-');
+   if (*ptr == '-' || *ptr == '+')
+      ptr++;
+   uint64_t mantissa = 0;
+   int digits = 0, fraction_digits = 0;
+   bool point = false;
+   for (; ptr < end; ptr++) {
+      if (*ptr >= '0' && *ptr <= '9') {
+         mantissa = mantissa*10 + (uint64_t)(*ptr - '0');
+         digits++;
+         if (point)
+            fraction_digits++;
+      } else if (*ptr == '.' && !point) {
+         point = true;
+      } else {
+         break;
+      }
+   }
+   bool fast = (ptr == end && digits > 0 && digits <= 15);
+   double v = 0.0;
+   if (fast) {
+      v = (double)mantissa/kPowersOfTen[fraction_digits];
+      if (negative)
+         v = -v;
+   }
+   if (fast && single) {
+      /* double then float rounds twice; only a tie at float precision can
+       * differ from rounding the decimal to float directly */
+      const float f = (float)v;
+      const float other = nextafterf(f, (v > f) ? INFINITY : -INFINITY);
+      if ((double)f != v && ((double)f + (double)other)*0.5 == v)
+         fast = false;
+      else
+         v = f;
+   }
+   if (!fast) {
+      /* "%.7f" of a large value can take up to 317 characters */
+      const std::string token(begin, end);
+      char *parsed;
+      v = single ? (double)strtof(token.c_str(), &parsed) : strtod(token.c_str(), &parsed);
+      if (parsed != token.c_str() + token.size())
+         return false;
+   }
+   *value = v;
+   return true;
+}
+
+/**
+ * Function ReadTextValues
+ *
+ * All values of an ASCII parameter file, parsed in one pass over the
+ * mapped file.
+ */
+static int ReadTextValues(const std::string &filename, const bool &single,
+                          std::vector<double> *values) {
+   MappedFile text;
+   if (text.Open(filename, 1) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   const char *ptr = text.Values<char>();
+   const char *end = ptr + text.bytes();
+   values->clear();
+   values->reserve(text.bytes()/8);
+   size_t line = 1;
+   while (ptr < end) {
+      while (ptr < end && IsTextSpace(*ptr)) {
+         if (*ptr == '\n')
+            line++;
+         ptr++;
+      }
+      if (ptr == end)
+         break;
+      const char *token = ptr;
+      while (ptr < end && !IsTextSpace(*ptr))
+         ptr++;
+      double value;
+      if (!ParseTextValue(token, ptr, single, &value)) {
+         std::cerr << "Error: invalid value \"" << std::string(token, GSL_MIN(ptr - token, 40))
+                   << "\" on line " << line << " of " << filename << std::endl;
+         return EXIT_FAILURE;
+      }
+      values->push_back(value);
+   }
+   if (values->empty()) {
+      std::cerr << "Error: " << filename << " is empty" << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Function FormatTextValue
+ *
+ * value as by snprintf("%.7f\n"), the format of the ASCII parameter
+ * files. Values of moderate size are rounded with integer arithmetic,
+ * others (and the rare near-ties) with snprintf. Returns the length.
+ */
+static size_t FormatTextValue(const double &value, char *text, const size_t &size) {
+   const double magnitude = fabs(value);
+   const double scaled = magnitude*1e7;
+   /* scaled is within 2^-13 of the exact product below 2^40 */
+   if (scaled < 1099511627776.0) {
+      const double whole = floor(scaled);
+      const double fraction = scaled - whole;
+      if (fabs(fraction - 0.5) > 1.0/4096.0) {
+         uint64_t digits = (uint64_t)whole + (fraction > 0.5 ? 1 : 0);
+         char reversed[24];
+         size_t n = 0, i;
+         for (i = 0; i < 7; i++) {
+            reversed[n++] = (char)('0' + digits % 10);
+            digits /= 10;
+         }
+         reversed[n++] = '.';
+         do {
+            reversed[n++] = (char)('0' + digits % 10);
+            digits /= 10;
+         } while (digits > 0);
+         size_t length = 0;
+         if (std::signbit(value))
+            text[length++] = '-';
+         while (n > 0)
+            text[length++] = reversed[--n];
+         text[length++] = '\n';
+         return length;
+      }
+   }
+   const int length = snprintf(text, size, "%.7f\n", value);
+   return GSL_MIN((size_t)length, size - 1);
+}
+
+/* Append n values (double) to bytes as in a DOUBLE, FLOAT or ASCII file */
+static void AppendValues(const DataType &format, const double *values, const size_t &n,
+                         std::vector<uint8_t> *bytes) {
+   const size_t begin = bytes->size();
+   size_t i;
+   switch (format) {
+   case ASCII: {
+      char text[400];
+      for (i = 0; i < n; i++) {
+         const size_t length = FormatTextValue(values[i], text, sizeof(text));
+         bytes->insert(bytes->end(), text, text + length);
+      }
+      break;
+   }
+   case DOUBLE:
+      bytes->resize(begin + n*sizeof(double));
+      memcpy(bytes->data() + begin, values, n*sizeof(double));
+      break;
+   case FLOAT:
+      bytes->resize(begin + n*sizeof(float));
+      DoubleToFloat(values, n, reinterpret_cast<float *>(bytes->data() + begin));
+      break;
+   }
+}
+
 /**
  * Function EvalFileLength
  *
  * If file is in ASCII mode, read file and count the number of lines.
- * If file is in DOUBLE of FLOAT mode, read file size.
+ * If file is in DOUBLE of FLOAT mode, get the file size (without opening
+ * the file).
  *
  * @param name filename
  * @return number of parameters
@@ -189,210 +820,323 @@ int ReadWavFile(const std::string &fname, gsl::vector *signal) {
 int EvalFileLength(const char *filename, DataType data_format) {
    // TODO: change filename to std::string
 
-	FILE *file;
-	char *s = new char[300];
 	int fileSize = 0;
 
-	/* Open file */
-	file = fopen(filename, "r");
-	if(!file) {
-		std::cerr << "Error opening file " << filename << std::endl;
-		return -1;
+	if (data_format != ASCII) {
+		struct stat info;
+		if (stat(filename, &info) != 0) {
+			std::cerr << "Error opening file " << filename << std::endl;
+			return -1;
+		}
+		return (int)((size_t)info.st_size/BinaryValueSize(data_format));
 	}
 
-	/* Read lines until EOF */
-	switch (data_format) {
-	   case ASCII:
-	      while(fscanf(file,"%s",s) != EOF)
-	         fileSize++;
-	      break;
-	   case DOUBLE:
-	      fseek(file, 0, SEEK_END);
-	      fileSize = ftell(file)/sizeof(double);
-	      break;
-	   case FLOAT:
-         fseek(file, 0, SEEK_END);
-         fileSize = ftell(file)/sizeof(float);
-         break;
+	/* Count the whitespace-separated values */
+	MappedFile text;
+	if (text.Open(filename, 1) == EXIT_FAILURE)
+		return -1;
+	const char *ptr = text.Values<char>();
+	const char *end = ptr + text.bytes();
+	while (ptr < end) {
+		while (ptr < end && IsTextSpace(*ptr))
+			ptr++;
+		if (ptr == end)
+			break;
+		while (ptr < end && !IsTextSpace(*ptr))
+			ptr++;
+		fileSize++;
 	}
 
-
-	fclose(file);
-	delete[] s;
-
 	return fileSize;
 }
 
-int ReadGslVector(const std::string &filename, const DataType format, gsl::vector *vector_ptr){
-
-   int size;
-   FILE *inputfile = NULL;
-
-   /* Get file length */
-   size = EvalFileLength(filename.c_str(), format);
-   if (size < 0)
+/**
+ * Function MapParameterFile
+ *
+ * Map a binary (DOUBLE or FLOAT) parameter file and check that it holds a
+ * whole number of frames of n_rows values.
+ */
+static int MapParameterFile(const std::string &filename, const DataType &format,
+                            const size_t &n_rows, MappedFile *file, size_t *n_values) {
+   if (file->Open(filename, BinaryValueSize(format)) == EXIT_FAILURE)
       return EXIT_FAILURE;
+   *n_values = file->bytes()/BinaryValueSize(format);
+   if (*n_values == 0) {
+      std::cerr << "Error: " << filename << " is empty" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (*n_values % n_rows != 0) {
+      std::cerr << "ERROR: Invalid matrix dimensions in " << filename << " ("
+                << *n_values << " values, " << n_rows << " per frame)" << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
 
-
-
-   /* Allocate vector */
-   if (vector_ptr == NULL)
-      *(vector_ptr) = gsl::vector(size);
+/* Values begin ... begin+n-1 of a mapped file as double */
+static void GetFileValues(const MappedFile &file, const DataType &format, const size_t &begin,
+                          const size_t &n, double *dst) {
+   if (format == FLOAT)
+      FloatToDouble(file.Values<float>() + begin, n, dst);
    else
-      vector_ptr->resize(size);
+      std::copy(file.Values<double>() + begin, file.Values<double>() + begin + n, dst);
+}
 
+int ReadGslVector(const std::string &filename, const DataType format, gsl::vector *vector_ptr){
 
-   inputfile = fopen(filename.c_str(), "r");
-   if(inputfile==NULL){
-      std::cerr << "Error opening file " << filename << std::endl;
-      return EXIT_FAILURE;
+   if (format == ASCII) {
+      std::vector<double> values;
+      if (ReadTextValues(filename, false, &values) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+      *vector_ptr = gsl::vector(values.size());
+      std::copy(values.begin(), values.end(), VectorData(vector_ptr));
+      return EXIT_SUCCESS;
    }
 
-   /* Read data */
-   size_t i;
-	switch (format) {
-	case ASCII:
-	   vector_ptr->fscanf(inputfile);
-	   break;
-	case DOUBLE:
-	   vector_ptr->fread(inputfile);
-	   break;
-	case FLOAT:
-      float fbuffer[1];
-      for(i=0;i<(size_t)size;i++) {
-         fread(fbuffer, sizeof(float), 1 , inputfile);
-         (*vector_ptr)(i) = static_cast<double>(fbuffer[0]);
-      }
-      break;
-	}
-
-	fclose(inputfile);
+   /* Binary: map the file and convert all values in one pass */
+   MappedFile file;
+   size_t size;
+   if (MapParameterFile(filename, format, 1, &file, &size) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   *vector_ptr = gsl::vector(size);
+   GetFileValues(file, format, 0, size, VectorData(vector_ptr));
 
 	return EXIT_SUCCESS;
 }
 
-
 int ReadGslMatrix(const std::string &filename, const DataType format, const size_t n_rows,  gsl::matrix *matrix_ptr) {
-	/* Get file length */
-	int size;
-	size = EvalFileLength(filename.c_str(), format);
-	if (size < 0)
-		return EXIT_FAILURE;
 
-	if (size % n_rows != 0) {
-		std::cerr << "ERROR: Invalid matrix dimensions in " << filename << std::endl;
-		return EXIT_FAILURE;
+	if (format == ASCII) {
+		/* Values are read in float precision, as with fscanf("%f") */
+		std::vector<double> values;
+		if (ReadTextValues(filename, true, &values) == EXIT_FAILURE)
+			return EXIT_FAILURE;
+		if (values.size() % n_rows != 0) {
+			std::cerr << "ERROR: Invalid matrix dimensions in " << filename << " ("
+			          << values.size() << " values, " << n_rows << " per frame)" << std::endl;
+			return EXIT_FAILURE;
+		}
+		const size_t n_cols = values.size()/n_rows;
+		*matrix_ptr = gsl::matrix(n_rows,n_cols);
+		gsl_matrix *m = matrix_ptr->gslobj();
+		size_t i,j;
+		for(j=0;j<n_cols;j++)
+			for(i=0;i<n_rows;i++)
+				m->data[i*m->tda + j] = values[j*n_rows + i];
+		return EXIT_SUCCESS;
 	}
-	size_t n_cols = size/n_rows;
 
-	FILE *inputfile = NULL;
-	inputfile = fopen(filename.c_str(), "r");
-	if(inputfile==NULL){
-		std::cerr << "Error opening file " << filename << std::endl;
+	/* Binary: frame-major in the file, one column per frame in the matrix.
+	 * Convert a block of frames at a time and scatter it into the columns. */
+	MappedFile file;
+	size_t size;
+	if (MapParameterFile(filename, format, n_rows, &file, &size) == EXIT_FAILURE)
 		return EXIT_FAILURE;
-	}
-
+	const size_t n_cols = size/n_rows;
 	*matrix_ptr = gsl::matrix(n_rows,n_cols);
-	size_t i,j;
-	switch (format) {
-	case ASCII:
-	   float val;
-      for(j=0;j<n_cols;j++)
-         for(i=0;i<n_rows;i++) {
-            fscanf(inputfile,"%f", &val);
-            (*matrix_ptr)(i,j) = static_cast<double>(val);
-         }
-	   break;
-	case DOUBLE:
-      float dbuffer[1];
-      for(j=0;j<n_cols;j++)
-         for(i=0;i<n_rows;i++) {
-            fread(dbuffer, sizeof(double), 1 , inputfile);
-            (*matrix_ptr)(i,j) = static_cast<double>(dbuffer[0]);
-         }
-	   break;
-	case FLOAT:
-	   float fbuffer[1];
-	   for(j=0;j<n_cols;j++)
-	      for(i=0;i<n_rows;i++) {
-	         fread(fbuffer, sizeof(float), 1 , inputfile);
-	         (*matrix_ptr)(i,j) = static_cast<double>(fbuffer[0]);
-	      }
-	   break;
-	}
 
-	fclose(inputfile);
+	gsl_matrix *m = matrix_ptr->gslobj();
+	const size_t block_cols = GSL_MAX(FILE_BLOCK_VALUES/n_rows, (size_t)1);
+	std::vector<double> block(block_cols*n_rows);
+	size_t first, i, j;
+	for (first = 0; first < n_cols; first += block_cols) {
+		const size_t cols = GSL_MIN(block_cols, n_cols - first);
+		GetFileValues(file, format, first*n_rows, cols*n_rows, block.data());
+		for (j = 0; j < cols; j++)
+			for (i = 0; i < n_rows; i++)
+				m->data[i*m->tda + first + j] = block[j*n_rows + i];
+	}
 
 	return EXIT_SUCCESS;
 }
 
+/* Write n values (double) to a binary file as DOUBLE or FLOAT */
+static size_t WriteBinaryValues(FILE *fid, const DataType &format, const double *values,
+                                const size_t &n) {
+   if (format == DOUBLE)
+      return fwrite(values, sizeof(double), n, fid);
+   float buffer[FILE_BLOCK_VALUES];
+   size_t first, written = 0;
+   for (first = 0; first < n; first += FILE_BLOCK_VALUES) {
+      const size_t count = GSL_MIN((size_t)FILE_BLOCK_VALUES, n - first);
+      DoubleToFloat(values + first, count, buffer);
+      written += fwrite(buffer, sizeof(float), count, fid);
+   }
+   return written;
+}
+
 int WriteGslVector(const std::string &filename, const DataType &format, const gsl::vector &vector) {
+   return WriteGslVector(filename, format, vector, false);
+}
 
-   size_t i;
+/**
+ * Append the values to the end of the file instead of replacing it when
+ * append is set. The files are frame-major, so writing consecutive blocks
+ * of frames gives the same file as writing them at once.
+ */
+int WriteGslVector(const std::string &filename, const DataType &format, const gsl::vector &vector,
+                   const bool &append) {
 
    FILE *fid = NULL;
-   fid = fopen(filename.c_str(), "w");
+   fid = fopen(filename.c_str(), append ? "a" : "w");
    if(fid==NULL){
       std::cerr << "Error: could not create file " << filename << std::endl;
       return EXIT_FAILURE;
    }
 
+   size_t written = vector.size();
    switch (format) {
-   case ASCII:
-      vector.fprintf(fid, "%.7f");
+   case ASCII: {
+      std::vector<uint8_t> text;
+      EncodeGslVector(format, vector, &text);
+      if (fwrite(text.data(), 1, text.size(), fid) != text.size())
+         written = 0;
       break;
+   }
    case DOUBLE:
-      vector.fwrite(fid);
-      break;
    case FLOAT:
-      float fbuffer[1];
-      for(i=0;i<vector.size();i++) {
-         fbuffer[0] = static_cast<float>(vector(i));
-         fwrite(fbuffer, sizeof(float), 1 , fid);
+      if (vector.gslobj()->stride == 1) {
+         written = WriteBinaryValues(fid, format, VectorData(vector), vector.size());
+      } else {
+         std::vector<double> values(vector.size());
+         size_t i;
+         for(i=0;i<vector.size();i++)
+            values[i] = vector(i);
+         written = WriteBinaryValues(fid, format, values.data(), values.size());
       }
       break;
    }
 
-   fclose(fid);
+   if (fclose(fid) != 0 || written != vector.size()) {
+      std::cerr << "Error: could not write file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
    return EXIT_SUCCESS;
 }
 
 
 int WriteGslMatrix(const std::string &filename, const DataType &format, const gsl::matrix &mat) {
+   return WriteGslMatrix(filename, format, mat, false);
+}
+
+int WriteGslMatrix(const std::string &filename, const DataType &format, const gsl::matrix &mat,
+                   const bool &append) {
 
    FILE *fid = NULL;
-   fid = fopen(filename.c_str(), "w");
+   fid = fopen(filename.c_str(), append ? "a" : "w");
    if(fid==NULL){
       std::cerr << "Error: could not create file " << filename << std::endl;
       return EXIT_FAILURE;
    }
 
    size_t i,j;
+   const size_t n_values = mat.size1()*mat.size2();
+   size_t written = n_values;
    switch (format) {
-   case ASCII:
-      for(j=0;j<mat.size2();j++)
-         for(i=0;i<mat.size1();i++)
-            fprintf(fid,"%.7f\n", mat(i,j));
+   case ASCII: {
+      std::vector<uint8_t> text;
+      EncodeGslMatrix(format, mat, &text);
+      if (fwrite(text.data(), 1, text.size(), fid) != text.size())
+         written = 0;
       break;
+   }
    case DOUBLE:
-      double dbuffer[1];
-      for(j=0;j<mat.size2();j++)
-         for(i=0;i<mat.size1();i++) {
-            dbuffer[0] = static_cast<double>(mat(i,j));
-            fwrite(dbuffer, sizeof(double), 1 , fid);
-         }
+   case FLOAT: {
+      /* Gather a block of columns frame by frame, then write it at once */
+      const gsl_matrix *m = mat.gslobj();
+      const size_t n_rows = mat.size1();
+      const size_t block_cols = GSL_MAX(FILE_BLOCK_VALUES/GSL_MAX(n_rows, (size_t)1), (size_t)1);
+      std::vector<double> block(block_cols*n_rows);
+      size_t first;
+      written = 0;
+      for (first = 0; first < mat.size2(); first += block_cols) {
+         const size_t cols = GSL_MIN(block_cols, mat.size2() - first);
+         for (j = 0; j < cols; j++)
+            for (i = 0; i < n_rows; i++)
+               block[j*n_rows + i] = m->data[i*m->tda + first + j];
+         written += WriteBinaryValues(fid, format, block.data(), cols*n_rows);
+      }
       break;
-   case FLOAT:
-      float fbuffer[1];
-      for(j=0;j<mat.size2();j++)
-         for(i=0;i<mat.size1();i++) {
-            fbuffer[0] = static_cast<float>(mat(i,j));
-            fwrite(fbuffer, sizeof(float), 1 , fid);
-         }
    }
+   }
+
+   if (fclose(fid) != 0 || written != n_values) {
+      std::cerr << "Error: could not write file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Function EncodeGslVector
+ *
+ * Contents of the file that WriteGslVector writes, in memory, so that the
+ * file can be written with one system call (WriteFileBytes).
+ */
+void EncodeGslVector(const DataType &format, const gsl::vector &vector, std::vector<uint8_t> *bytes) {
+   bytes->clear();
+   if (vector.size() == 0)
+      return;
+   if (vector.gslobj()->stride == 1) {
+      AppendValues(format, VectorData(vector), vector.size(), bytes);
+   } else {
+      std::vector<double> values(vector.size());
+      size_t i;
+      for(i=0;i<vector.size();i++)
+         values[i] = vector(i);
+      AppendValues(format, values.data(), values.size(), bytes);
+   }
+}
 
-   fclose(fid);
+/**
+ * Function EncodeGslMatrix
+ *
+ * Contents of the file that WriteGslMatrix writes (frame by frame), in
+ * memory.
+ */
+void EncodeGslMatrix(const DataType &format, const gsl::matrix &mat, std::vector<uint8_t> *bytes) {
+   bytes->clear();
+   const size_t n_rows = mat.size1();
+   if (n_rows == 0 || mat.size2() == 0)
+      return;
+   bytes->reserve(n_rows*mat.size2()*(format == DOUBLE ? sizeof(double) : sizeof(float)));
+   const gsl_matrix *m = mat.gslobj();
+   const size_t block_cols = GSL_MAX(FILE_BLOCK_VALUES/n_rows, (size_t)1);
+   std::vector<double> block(block_cols*n_rows);
+   size_t first, i, j;
+   for (first = 0; first < mat.size2(); first += block_cols) {
+      const size_t cols = GSL_MIN(block_cols, mat.size2() - first);
+      for (j = 0; j < cols; j++)
+         for (i = 0; i < n_rows; i++)
+            block[j*n_rows + i] = m->data[i*m->tda + first + j];
+      AppendValues(format, block.data(), cols*n_rows, bytes);
+   }
+}
 
+/**
+ * Function WriteFileBytes
+ *
+ * Write (or with append set, append) bytes to a file at once. With sync
+ * set, the file is flushed to disk (fsync) before returning.
+ */
+int WriteFileBytes(const std::string &filename, const void *data, const size_t &bytes,
+                   const bool &append, const bool &sync) {
+
+   const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0666);
+   if (fd < 0) {
+      std::cerr << "Error: could not create file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   bool ok = WriteAllBytes(fd, data, bytes);
+   if (ok && sync && fsync(fd) != 0)
+      ok = false;
+   if (close(fd) != 0)
+      ok = false;
+   if (!ok) {
+      std::cerr << "Error: could not write file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
    return EXIT_SUCCESS;
 }
 
@@ -420,7 +1164,15 @@ int FilePathBasename(const char *filename, std::string *filepath, std::string *b
    return EXIT_SUCCESS;
 }
 
-int ReadSynthesisData(const char *filename, Param *params, SynthesisData *data) {
+/**
+ * Function ReadSynthesisData
+ *
+ * Read the feature streams of an utterance that the synthesis uses
+ * (features, from SynthesisFeatures); the others are not opened. F0 is
+ * always read and gives the number of frames.
+ */
+int ReadSynthesisData(const char *filename, const unsigned &features, Param *params,
+                      SynthesisData *data) {
 
 
    /* Get basename (without extension) for saving parameters later*/
@@ -428,9 +1180,35 @@ int ReadSynthesisData(const char *filename, Param *params, SynthesisData *data)
 
    std::string param_fname;
 
+   /* Features are read from their own files, or all from one container */
+   FeatureContainer container;
+   std::string container_fname;
+   if (params->feature_container) {
+      container_fname = GetParamPath("feat", params->extension_container, params->dir_container, *params);
+      if (container.Open(container_fname) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+   }
+   auto ReadVectorFeature = [&](const std::string &name, const std::string &extension,
+                                const std::string &dir, gsl::vector *vector_ptr) {
+      if (params->feature_container) {
+         param_fname = container_fname + ":" + name;
+         return container.ReadVector(name, vector_ptr);
+      }
+      param_fname = GetParamPath(name, extension, dir, *params);
+      return ReadGslVector(param_fname, params->data_type, vector_ptr);
+   };
+   auto ReadMatrixFeature = [&](const std::string &name, const std::string &extension,
+                                const std::string &dir, const size_t &n_rows, gsl::matrix *matrix_ptr) {
+      if (params->feature_container) {
+         param_fname = container_fname + ":" + name;
+         return container.ReadMatrix(name, n_rows, matrix_ptr);
+      }
+      param_fname = GetParamPath(name, extension, dir, *params);
+      return ReadGslMatrix(param_fname, params->data_type, n_rows, matrix_ptr);
+   };
+
    /* F0 (expected length for other features is taken from F0) */
-   param_fname = GetParamPath("f0", params->extension_f0, params->dir_f0, *params);
-   if (ReadGslVector(param_fname, params->data_type, &(data->fundf)) == EXIT_FAILURE)
+   if (ReadVectorFeature("f0", params->extension_f0, params->dir_f0, &(data->fundf)) == EXIT_FAILURE)
       return EXIT_FAILURE;
 
    data->fundf *= params->pitch_scale;
@@ -448,94 +1226,56 @@ int ReadSynthesisData(const char *filename, Param *params, SynthesisData *data)
 
    params->number_of_frames = (int)(data->fundf.size());
 
-   /* Pre-allocate and initialize everything for safety */
-   data->frame_energy = gsl::vector(params->number_of_frames, true);
-   data->lsf_vocal_tract = gsl::matrix(params->lpc_order_vt, params->number_of_frames, true);
-   data->lsf_glot = gsl::matrix(params->lpc_order_glot, params->number_of_frames, true);
-   data->hnr_glot = gsl::matrix( params->hnr_order, params->number_of_frames, true);
-   data->excitation_pulses = gsl::matrix(params->paf_pulse_length, params->number_of_frames, true);
-   // TODO: add generic spectrum
-
-   /* Gain */
-   param_fname = GetParamPath("gain", params->extension_gain, params->dir_gain, *params);
-   if (ReadGslVector(param_fname, params->data_type, &(data->frame_energy)) == EXIT_FAILURE)
-      return EXIT_FAILURE;
-   if (params->number_of_frames != (int)data->frame_energy.size()) {
-      std::cerr << "Error: Number of frames in input files do not match." << std::endl;
-      std::cerr << "In file"  << param_fname << std::endl;
-      return EXIT_FAILURE;
-   }
-
-
-    /* Rd */
-    param_fname = GetParamPath("rd", params->extension_rd, params->dir_gain, *params);
-    if (ReadGslVector(param_fname, params->data_type, &(data->Rd_opt)) == EXIT_FAILURE)
-        return EXIT_FAILURE;
-    if (params->number_of_frames != (double)data-> Rd_opt.size()) {
-        std::cerr << "Error: Number of frames in input files do not match." << std::endl;
-        std::cerr << "In file"  << param_fname << std::endl;
-        return EXIT_FAILURE;
-    }
-
-   /* Vocal tract LSFs */
-   if (! params->use_generic_envelope) {
-      param_fname = GetParamPath("lsf", params->extension_lsf, params->dir_lsf, *params);
-      if (ReadGslMatrix(param_fname, params->data_type, params->lpc_order_vt, &(data->lsf_vocal_tract)) == EXIT_FAILURE)
-         return EXIT_FAILURE;
-      if (params->number_of_frames != (int)data->lsf_vocal_tract.get_cols()) {
-         std::cerr << "Error: Number of frames in input files do not match." << std::endl;
-         std::cerr << "In file"  << param_fname << std::endl;
-         return EXIT_FAILURE;
-      }
-   }
-
-   /* Glottal source LSFs */
-   if (params->use_spectral_matching || params->excitation_method == DNN_GENERATED_EXCITATION) {
-      // TODO: more elaborate check for whether the features are actually used in internal DNN
-      param_fname = GetParamPath("slsf", params->extension_lsfg, params->dir_lsfg, *params);
-      if (ReadGslMatrix(param_fname, params->data_type, params->lpc_order_glot, &(data->lsf_glot)) == EXIT_FAILURE)
-         return EXIT_FAILURE;
-      if (params->number_of_frames != (int)data->lsf_glot.get_cols()) {
-         std::cerr << "Error: Number of frames in input files do not match." << std::endl;
-         std::cerr << "In file"  << param_fname << std::endl;
-         return EXIT_FAILURE;
-      }
-   }
-
-   /* Harmonic-to-Noise Ratio*/
-   if (params->noise_gain_voiced > 0.0 || params->excitation_method == DNN_GENERATED_EXCITATION) {
-      // TODO: more elaborate check for whether the features are actually used in internal DNN
-      param_fname = GetParamPath("hnr", params->extension_hnr, params->dir_hnr, *params);
-      if (ReadGslMatrix(param_fname, params->data_type, params->hnr_order, &(data->hnr_glot)) == EXIT_FAILURE)
-         return EXIT_FAILURE;
-      if (params->number_of_frames != (int)data->hnr_glot.get_cols()) {
-         std::cerr << "Error: Number of frames in input files do not match." << std::endl;
-         std::cerr << "In file"  << param_fname << std::endl;
-         return EXIT_FAILURE;
+   /* Features that are not read but used (smoothing, filtering) are zero;
+    * pulses, Rd and the generic spectrum are left empty */
+   if (!(features & SYNTHESIS_LSF))
+      data->lsf_vocal_tract = gsl::matrix(params->lpc_order_vt, params->number_of_frames, true);
+   if (!(features & SYNTHESIS_SLSF))
+      data->lsf_glot = gsl::matrix(params->lpc_order_glot, params->number_of_frames, true);
+   if (!(features & SYNTHESIS_HNR))
+      data->hnr_glot = gsl::matrix(params->hnr_order, params->number_of_frames, true);
+
+   /* The other streams, each opened only if the synthesis uses it */
+   struct FeatureStream {
+      unsigned feature;
+      const char *name;
+      std::string extension;
+      std::string dir;
+      size_t n_rows;          // 0 for a vector
+      gsl::vector *vector;
+      gsl::matrix *matrix;
+   };
+   // TODO: add parameter for generic spectrum length
+   const FeatureStream streams[] = {
+      {SYNTHESIS_GAIN, "gain", params->extension_gain, params->dir_gain, 0, &(data->frame_energy), NULL},
+      {SYNTHESIS_RD, "rd", params->extension_rd, params->dir_gain, 0, &(data->Rd_opt), NULL},
+      {SYNTHESIS_LSF, "lsf", params->extension_lsf, params->dir_lsf, (size_t)params->lpc_order_vt,
+       NULL, &(data->lsf_vocal_tract)},
+      {SYNTHESIS_SLSF, "slsf", params->extension_lsfg, params->dir_lsfg, (size_t)params->lpc_order_glot,
+       NULL, &(data->lsf_glot)},
+      {SYNTHESIS_HNR, "hnr", params->extension_hnr, params->dir_hnr, (size_t)params->hnr_order,
+       NULL, &(data->hnr_glot)},
+      {SYNTHESIS_PULSES, "pls", params->extension_paf, params->dir_paf, (size_t)params->paf_pulse_length,
+       NULL, &(data->excitation_pulses)},
+      {SYNTHESIS_SPECTRUM, "sp", ".sp", params->dir_sp, 2049, NULL, &(data->spectrum)}};
+
+   for (const FeatureStream &stream : streams) {
+      if (!(features & stream.feature))
+         continue;
+      int result;
+      if (stream.vector != NULL) {
+         result = ReadVectorFeature(stream.name, stream.extension, stream.dir, stream.vector);
+      } else if (stream.feature == SYNTHESIS_PULSES && !params->feature_container) {
+         /* Plain or encoded (PULSE_ENCODING) pulses */
+         param_fname = GetParamPath(stream.name, stream.extension, stream.dir, *params);
+         result = ReadPulseFile(param_fname, params->data_type, stream.n_rows, stream.matrix);
+      } else {
+         result = ReadMatrixFeature(stream.name, stream.extension, stream.dir, stream.n_rows, stream.matrix);
       }
-   }
-
-   /* External excitation pulses as features */
-   if (params->excitation_method == PULSES_AS_FEATURES_EXCITATION) {
-      param_fname = GetParamPath("pls", params->extension_paf, params->dir_paf, *params);
-      if (params->excitation_method == PULSES_AS_FEATURES_EXCITATION) {
-         if (ReadGslMatrix(param_fname, params->data_type, params->paf_pulse_length, &(data->excitation_pulses)) == EXIT_FAILURE)
-            return EXIT_FAILURE;
-      }
-      if (params->number_of_frames != (int)data->excitation_pulses.get_cols()) {
-         std::cerr << "Error: Number of frames in input files do not match." << std::endl;
-         std::cerr << "In file"  << param_fname << std::endl;
-         return EXIT_FAILURE;
-      }
-   }
-
-   /* Generic spectrum for filter envelope */
-   if (params->use_generic_envelope) {
-      param_fname = GetParamPath("sp", ".sp", params->dir_sp, *params);
-      // TODO: add parameter for generic spectrum length
-      if (ReadGslMatrix(param_fname, params->data_type, 2049, &(data->spectrum)) == EXIT_FAILURE)
+      if (result == EXIT_FAILURE)
          return EXIT_FAILURE;
-      if (params->number_of_frames != (int)data->spectrum.get_cols()) {
+      const size_t n_frames = (stream.vector != NULL) ? stream.vector->size() : stream.matrix->get_cols();
+      if ((size_t)params->number_of_frames != n_frames) {
          std::cerr << "Error: Number of frames in input files do not match." << std::endl;
          std::cerr << "In file"  << param_fname << std::endl;
          return EXIT_FAILURE;
@@ -579,10 +1319,10 @@ int ReadFileFloat(const std::string &fname_str, float **file_data, size_t *n_rea
    file_size = file.tellg();
    file.seekg(0, std::ios::beg);
 
-   // Read file
+   // Read file (whole values only)
    n_values = file_size / sizeof(float);
    *file_data = new float[n_values];
-   file.read(reinterpret_cast<char*>(*file_data), file_size);
+   file.read(reinterpret_cast<char*>(*file_data), n_values*sizeof(float));
 
    *n_read = n_values;
 
@@ -605,15 +1345,10 @@ int WriteFileFloat(const std::string &fname_str, const float *data, const size_t
       return EXIT_FAILURE;
    }
 
-   size_t bytes_written;
-   size_t bytes_float = sizeof(float);
-   float buffer[1];
-   for (size_t i=0;i<n_values;i++) {
-      buffer[0] = data[i];
-      file.write(reinterpret_cast<char*>(buffer), bytes_float);
-      //bytes_written = file.write(reinterpret_cast<char*>(buffer), bytes_float);
-      //if (bytes_written != bytes_float)
-      //    return EXIT_FAILURE;
+   file.write(reinterpret_cast<const char*>(data), n_values*sizeof(float));
+   if (!file) {
+      std::cerr << "Error: could not write file " << fname_str << std::endl;
+      return EXIT_FAILURE;
    }
    file.close();
 
@@ -23,14 +23,31 @@ void PrintUsageAnalysis();
 int ReadExternalExcitation(const std::string &filename, gsl::vector *source_signal);
 
 int ReadWavFile(const char *fname, gsl::vector *signal, Param *params);
+int ReadWavFile(const char *fname, gsl::vector *signal, Param *params, std::vector<int16_t> *pcm16);
 int ReadWavFile(const char *fname, gsl::vector *signal);
 int ReadWavFile(const std::string &fname, gsl::vector *signal);
 int WriteWavFile(const std::string &filename, const gsl::vector &signal, const int &fs);
+int WriteWavFile(const std::string &filename, const gsl::vector &signal, const int &fs, const bool &sync);
+int WriteWavFile(const std::string &filename, const gsl::vector &signal, const int &fs, const WavFormat &format, const bool &sync);
+int WriteWavFile(const std::string &filename, const gsl::vector &signal, const int &fs, const WavFormat &format, const double &gain, const bool &sync);
+int AppendWavFile(const std::string &filename, const gsl::vector &signal, const int &fs, const bool &create);
+int AppendWavFile(const std::string &filename, const gsl::vector &signal, const int &fs, const bool &create, const bool &sync);
+int AppendWavFile(const std::string &filename, const gsl::vector &signal, const int &fs, const WavFormat &format, const bool &create, const bool &sync);
+int GetWavFileLength(const char *fname, const int &fs, size_t *n_samples);
+int ReadWavBlock(const char *fname, const size_t &begin, const size_t &length, gsl::vector *signal);
+int ReadWavBlock(const char *fname, const size_t &begin, const size_t &length, gsl::vector *signal, std::vector<int16_t> *pcm16);
+void SignalToPcm16(const gsl::vector &signal, std::vector<int16_t> *pcm16);
+void SignalToPcm16(const double *x, const size_t &stride, const size_t &count, const double &gain, int16_t *pcm16);
 int ReadGslVector(const std::string &filename, const DataType format, gsl::vector *vector_ptr);
 int ReadGslMatrix(const std::string &filename, const DataType format, const size_t n_rows,  gsl::matrix *matrix_ptr);
 int WriteGslVector(const std::string &filename, const DataType &format, const gsl::vector &vector);
+int WriteGslVector(const std::string &filename, const DataType &format, const gsl::vector &vector, const bool &append);
 int WriteGslMatrix(const std::string &filename, const DataType &format, const gsl::matrix &mat);
-int ReadSynthesisData(const char *basename, Param *params, SynthesisData *data);
+int WriteGslMatrix(const std::string &filename, const DataType &format, const gsl::matrix &mat, const bool &append);
+void EncodeGslVector(const DataType &format, const gsl::vector &vector, std::vector<uint8_t> *bytes);
+void EncodeGslMatrix(const DataType &format, const gsl::matrix &mat, std::vector<uint8_t> *bytes);
+int WriteFileBytes(const std::string &filename, const void *data, const size_t &bytes, const bool &append, const bool &sync);
+int ReadSynthesisData(const char *basename, const unsigned &features, Param *params, SynthesisData *data);
 
 int ReadFileFloat(const std::string &fname_str, float **file_data, size_t *n_read);
 int WriteFileFloat(const std::string &fname_str, const float *data, const size_t &n_values);
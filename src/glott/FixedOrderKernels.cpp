@@ -0,0 +1,178 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gsl/gsl_math.h>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include "definitions.h"
+#include "FixedOrderKernels.h"
+
+/* Whether the specialisations are used. Set once per process by the first
+ * ConfigureFixedOrderKernels() and read without locks afterwards. */
+static std::once_flag fixed_orders_once;
+static std::atomic<bool> fixed_orders_enabled(false);
+
+template <size_t P>
+static void LevinsonFixed(const double *r, double *A) {
+   double tmp[P+1];
+   double e, ki;
+   size_t i, j;
+
+   for(i = 0; i <= P; i++) {
+      A[i] = 0.0;
+      tmp[i] = 0.0;
+   }
+
+   e = r[0];
+   A[0] = 1.0;
+   for(i = 1; i <= P; i++) {
+      ki = 0.0;
+      for(j = 1; j < i; j++) ki += A[j] * r[i-j];
+      ki = (r[i] - ki) / e;
+      A[i] = ki;
+      for(j = 1; j < i; j++) tmp[j] = A[j] - ki * A[i-j];
+      for(j = 1; j < i; j++) A[j] = tmp[j];
+      e = (1 - ki * ki) * e;
+   }
+   for(i = 0; i <= P; i++)
+      A[i] *= -1.0;
+   A[0] = 1.0;
+   for(i = 0; i <= P; i++) {
+      if(gsl_isnan(A[i]))
+         A[i] = 0.0;
+   }
+}
+
+template <size_t P>
+static void AutocorrelationFixed(const double *frame, const size_t &n, double *r) {
+   size_t i, k;
+   double sum;
+   for(i = 0; i <= P; i++) {
+      sum = 0.0;
+      for(k = i; k < n; k++)
+         sum += frame[k]*frame[k-i];
+      r[i] = sum;
+   }
+}
+
+/* Direct form filter with NB feed-forward and NA feedback coefficients.
+ * The first GSL_MAX(NB,NA) samples need the bounds checks of the generic
+ * Filter, the rest run with constant trip counts. */
+template <size_t NB, size_t NA>
+static void FilterFixed(const double *b, const double *a, const double *x,
+                        const size_t &n, double *y) {
+   size_t i, j;
+   double sum;
+   size_t warmup = GSL_MIN(n, GSL_MAX(NB, NA));
+   for(i = 0; i < warmup; i++) {
+      sum = 0.0;
+      for(j = 0; j < NB; j++) {
+         if(j <= i)
+            sum += x[i-j]*b[j];
+      }
+      for(j = 1; j < NA; j++) {
+         if(j <= i)
+            sum -= y[i-j]*a[j];
+      }
+      y[i] = sum;
+   }
+   for(i = warmup; i < n; i++) {
+      sum = 0.0;
+      for(j = 0; j < NB; j++)
+         sum += x[i-j]*b[j];
+      for(j = 1; j < NA; j++)
+         sum -= y[i-j]*a[j];
+      y[i] = sum;
+   }
+}
+
+template <size_t P>
+static void AllPoleFilterFixed(const double *b, const double *a, const double *x,
+                               const size_t &n, double *y) {
+   FilterFixed<1, P+1>(b, a, x, n, y);
+}
+
+template <size_t P>
+static void FirFilterFixed(const double *b, const double *a, const double *x,
+                           const size_t &n, double *y) {
+   FilterFixed<P+1, 1>(b, a, x, n, y);
+}
+
+/**
+ * Function ConfigureFixedOrderKernels
+ *
+ * Enable every compiled fixed-order specialisation if the configuration asks
+ * for them; LP orders without one keep using the generic routines. Only the
+ * first call has an effect: the selection is shared by all threads (and all
+ * configurations loaded through the library), so it never changes while
+ * kernels are in use.
+ *
+ * @param params
+ */
+void ConfigureFixedOrderKernels(const Param &params) {
+   std::call_once(fixed_orders_once, [&params] {
+      fixed_orders_enabled = params.use_fixed_order_kernels;
+   });
+}
+
+/* Specialisations compiled in. LP orders cover the 16 kHz and 48 kHz
+ * defaults (vocal tract, glottal source, IAIF, QMF sub-bands). */
+#define FIXED_ORDER_CASES(kernel) \
+   case 6: return &kernel<6>; \
+   case 8: return &kernel<8>; \
+   case 10: return &kernel<10>; \
+   case 12: return &kernel<12>; \
+   case 20: return &kernel<20>; \
+   case 24: return &kernel<24>; \
+   case 30: return &kernel<30>; \
+   case 40: return &kernel<40>; \
+   case 48: return &kernel<48>; \
+   case 50: return &kernel<50>;
+
+LevinsonKernel GetLevinsonKernel(const size_t &order) {
+   if(!fixed_orders_enabled)
+      return NULL;
+   switch(order) {
+   FIXED_ORDER_CASES(LevinsonFixed)
+   default: return NULL;
+   }
+}
+
+AutocorrelationKernel GetAutocorrelationKernel(const size_t &order) {
+   if(!fixed_orders_enabled)
+      return NULL;
+   switch(order) {
+   FIXED_ORDER_CASES(AutocorrelationFixed)
+   default: return NULL;
+   }
+}
+
+FilterKernel GetAllPoleFilterKernel(const size_t &order) {
+   if(!fixed_orders_enabled)
+      return NULL;
+   switch(order) {
+   FIXED_ORDER_CASES(AllPoleFilterFixed)
+   default: return NULL;
+   }
+}
+
+FilterKernel GetFirFilterKernel(const size_t &order) {
+   if(!fixed_orders_enabled)
+      return NULL;
+   switch(order) {
+   FIXED_ORDER_CASES(FirFilterFixed)
+   default: return NULL;
+   }
+}
@@ -0,0 +1,39 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_FIXEDORDERKERNELS_H_
+#define SRC_GLOTT_FIXEDORDERKERNELS_H_
+
+#include <cstddef>
+#include "definitions.h"
+
+/* Kernels with compile-time LP orders for the common (fs, LPC order)
+ * configurations. ConfigureFixedOrderKernels() enables the specialisations
+ * once per process, the Get*Kernel() lookups return NULL for other orders
+ * (or when disabled) and callers use the generic path. Windows are served from
+ * WindowCache instead. */
+
+typedef void (*LevinsonKernel)(const double *r, double *A);
+typedef void (*AutocorrelationKernel)(const double *frame, const size_t &n, double *r);
+typedef void (*FilterKernel)(const double *b, const double *a, const double *x,
+                             const size_t &n, double *y);
+
+void ConfigureFixedOrderKernels(const Param &params);
+
+LevinsonKernel GetLevinsonKernel(const size_t &order);
+AutocorrelationKernel GetAutocorrelationKernel(const size_t &order);
+FilterKernel GetAllPoleFilterKernel(const size_t &order);
+FilterKernel GetFirFilterKernel(const size_t &order);
+
+#endif /* SRC_GLOTT_FIXEDORDERKERNELS_H_ */
@@ -0,0 +1,357 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "FrameScheduler.h"
+
+/* Upper limit of worker threads (queues are allocated up front so that
+ * workers can be added while others steal) */
+#define SCHEDULER_MAX_THREADS 256
+
+/* Queue of the calling thread: 0 is shared by all threads that are not
+ * workers of the scheduler (main thread, server connections) */
+static thread_local size_t tls_queue = 0;
+/* Nesting level of the group whose task the thread is running */
+static thread_local size_t tls_depth = 0;
+
+/**
+ * Class TaskScheduler
+ *
+ * Work-stealing scheduler. Each worker owns a deque and pops its newest
+ * task; idle threads take the oldest task of another deque. Threads that
+ * wait for a group run tasks of the same or deeper nesting level in the
+ * meantime, so nested groups need no extra threads and cannot deadlock: a
+ * task of the group is either queued (and will be run by the waiter or a
+ * thief) or running on a thread that makes progress.
+ */
+class TaskScheduler {
+ public:
+   struct Task {
+      std::function<void()> function;
+      TaskGroup *group;
+   };
+
+   TaskScheduler() : queues_(new Queue[SCHEDULER_MAX_THREADS]), num_queues_(1),
+                     epoch_(0), stop_(false), pinned_(false) {}
+   ~TaskScheduler() {
+      {
+         std::unique_lock<std::mutex> lock(mutex_);
+         stop_ = true;
+         epoch_++;
+      }
+      wake_.notify_all();
+      size_t i;
+      for (i = 0; i < threads_.size(); i++)
+         threads_[i].join();
+   }
+
+   /* Grow to num_threads. Pinning applies to the calling thread and to
+    * the workers started from then on. */
+   void Configure(const size_t &num_threads, const bool &pin_threads) {
+      const size_t target = std::min(std::max(num_threads, (size_t)1), (size_t)SCHEDULER_MAX_THREADS);
+      if (num_queues_ >= target && !(pin_threads && !pinned_))
+         return;
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (pin_threads && !pinned_) {
+         PinThread(0);
+         pinned_ = true;
+      }
+      while (num_queues_ < target) {
+         const size_t index = num_queues_;
+         threads_.push_back(std::thread(&TaskScheduler::WorkerLoop, this, index, (bool)pinned_));
+         num_queues_++;
+      }
+   }
+
+   /* Run function on the calling thread as a task of group (without
+    * counting it as pending) */
+   void RunInline(const TaskGroup &group, const std::function<void()> &function) {
+      const size_t outer_depth = tls_depth;
+      tls_depth = group.depth_;
+      try {
+         function();
+      } catch (...) {
+         tls_depth = outer_depth;
+         throw;
+      }
+      tls_depth = outer_depth;
+   }
+
+   void Submit(TaskGroup *group, const std::function<void()> &function) {
+      Task task;
+      task.function = function;
+      task.group = group;
+      group->pending_++;
+      Queue &queue = queues_[tls_queue];
+      {
+         std::lock_guard<std::mutex> lock(queue.mutex);
+         queue.tasks.push_back(task);
+      }
+      Signal();
+   }
+
+   void Wait(TaskGroup *group) {
+      while (group->pending_ > 0) {
+         const size_t epoch = epoch_;
+         Task task;
+         if (FindTask(tls_queue, group->depth_, &task)) {
+            Execute(&task);
+            continue;
+         }
+         std::unique_lock<std::mutex> lock(mutex_);
+         wake_.wait(lock, [this, group, epoch] {
+            return group->pending_ == 0 || epoch_ != epoch;});
+      }
+   }
+
+ private:
+   struct Queue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+   };
+
+   /* Wake sleeping threads: new task or a group done */
+   void Signal() {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         epoch_++;
+      }
+      wake_.notify_all();
+   }
+
+   /* Own queue from the back, then the other queues from the front; only
+    * tasks of groups at min_depth or deeper */
+   bool FindTask(const size_t &self, const size_t &min_depth, Task *task) {
+      {
+         Queue &queue = queues_[self];
+         std::lock_guard<std::mutex> lock(queue.mutex);
+         if (!queue.tasks.empty() && queue.tasks.back().group->depth_ >= min_depth) {
+            *task = queue.tasks.back();
+            queue.tasks.pop_back();
+            return true;
+         }
+      }
+      const size_t n = num_queues_;
+      size_t k;
+      for (k = 1; k < n; k++) {
+         Queue &victim = queues_[(self + k) % n];
+         std::lock_guard<std::mutex> lock(victim.mutex);
+         std::deque<Task>::iterator it;
+         for (it = victim.tasks.begin(); it != victim.tasks.end(); ++it) {
+            if (it->group->depth_ >= min_depth) {
+               *task = *it;
+               victim.tasks.erase(it);
+               return true;
+            }
+         }
+      }
+      return false;
+   }
+
+   void Execute(Task *task) {
+      TaskGroup *group = task->group;
+      const size_t outer_depth = tls_depth;
+      tls_depth = group->depth_;
+      try {
+         task->function();
+      } catch (...) {
+         std::lock_guard<std::mutex> lock(group->error_mutex_);
+         if (!group->error_)
+            group->error_ = std::current_exception();
+      }
+      tls_depth = outer_depth;
+      task->function = std::function<void()>();
+      /* The group may be gone as soon as pending_ reaches zero */
+      if (--group->pending_ == 0)
+         Signal();
+   }
+
+   void WorkerLoop(const size_t index, const bool pin) {
+      tls_queue = index;
+      if (pin)
+         PinThread(index);
+      while (true) {
+         const size_t epoch = epoch_;
+         Task task;
+         if (FindTask(index, 0, &task)) {
+            Execute(&task);
+            continue;
+         }
+         std::unique_lock<std::mutex> lock(mutex_);
+         wake_.wait(lock, [this, epoch] {return stop_ || epoch_ != epoch;});
+         if (stop_)
+            return;
+      }
+   }
+
+   static void PinThread(const size_t &index) {
+#ifdef __linux__
+      const unsigned num_cores = std::max(std::thread::hardware_concurrency(), 1u);
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(index % num_cores, &cpus);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+#else
+      (void)index;
+#endif
+   }
+
+   std::unique_ptr<Queue[]> queues_;
+   std::atomic<size_t> num_queues_;
+   std::vector<std::thread> threads_;
+   std::mutex mutex_;
+   std::condition_variable wake_;
+   std::atomic<size_t> epoch_;
+   bool stop_;
+   std::atomic<bool> pinned_;
+};
+
+static TaskScheduler &Scheduler() {
+   static TaskScheduler scheduler;
+   return scheduler;
+}
+
+static TaskScheduler &GetScheduler(const int &num_threads) {
+   TaskScheduler &scheduler = Scheduler();
+   scheduler.Configure((size_t)std::max(num_threads, 1), false);
+   return scheduler;
+}
+
+TaskGroup::TaskGroup() : depth_(tls_depth + 1), pending_(0) {}
+
+TaskGroup::~TaskGroup() {
+   if (pending_ > 0)
+      Scheduler().Wait(this);
+}
+
+void TaskGroup::Run(const std::function<void()> &task) {
+   Scheduler().Submit(this, task);
+}
+
+void TaskGroup::Wait() {
+   Scheduler().Wait(this);
+   std::exception_ptr error;
+   {
+      std::lock_guard<std::mutex> lock(error_mutex_);
+      std::swap(error, error_);
+   }
+   if (error)
+      std::rethrow_exception(error);
+}
+
+void ConfigureScheduler(const int &num_threads, const bool &pin_threads) {
+   Scheduler().Configure((size_t)std::max(num_threads, 1), pin_threads);
+}
+
+/* Run runner(slot) for slot = 0 ... num_runners-1, slot 0 on the calling
+ * thread */
+static void RunSlots(const size_t &num_runners, const std::function<void(size_t)> &runner) {
+   TaskGroup group;
+   size_t slot;
+   for (slot = 1; slot < num_runners; slot++)
+      group.Run([&runner, slot] {runner(slot);});
+   try {
+      Scheduler().RunInline(group, [&runner] {runner(0);});
+   } catch (...) {
+      group.Wait();
+      throw;
+   }
+   group.Wait();
+}
+
+static size_t NumberOfChunks(const size_t &number_of_frames) {
+   return (number_of_frames + FRAME_CHUNK_SIZE - 1)/FRAME_CHUNK_SIZE;
+}
+
+void ParallelFrames(const int &num_threads, const size_t &number_of_frames,
+                    const FrameChunkFunction &process) {
+   const size_t num_chunks = NumberOfChunks(number_of_frames);
+   if (num_threads <= 1 || num_chunks <= 1) {
+      if (number_of_frames > 0)
+         process(0, number_of_frames, 0);
+      return;
+   }
+   GetScheduler(num_threads);
+   /* Each runner owns one scratch slot and takes chunks until none are left */
+   std::atomic<size_t> next_chunk(0);
+   RunSlots(std::min((size_t)num_threads, num_chunks), [&](size_t slot) {
+      size_t chunk;
+      while ((chunk = next_chunk++) < num_chunks) {
+         size_t begin = chunk*FRAME_CHUNK_SIZE;
+         size_t end = std::min(begin + FRAME_CHUNK_SIZE, number_of_frames);
+         process(begin, end, slot);
+      }
+   });
+}
+
+void ParallelFramesOrdered(const int &num_threads, const size_t &number_of_frames,
+                           const FrameChunkFunction &process,
+                           const FrameChunkFunction &merge) {
+   const size_t num_chunks = NumberOfChunks(number_of_frames);
+   size_t first_chunk, chunk;
+   if (num_threads <= 1 || num_chunks <= 1) {
+      /* Chunk by chunk as well, so that the scratch holds one chunk */
+      for (chunk = 0; chunk < num_chunks; chunk++) {
+         size_t begin = chunk*FRAME_CHUNK_SIZE;
+         size_t end = std::min(begin + FRAME_CHUNK_SIZE, number_of_frames);
+         process(begin, end, 0);
+         merge(begin, end, 0);
+      }
+      return;
+   }
+   GetScheduler(num_threads);
+   const size_t wave_size = (size_t)num_threads;
+   for (first_chunk = 0; first_chunk < num_chunks; first_chunk += wave_size) {
+      size_t chunks_in_wave = std::min(wave_size, num_chunks - first_chunk);
+      /* In a wave, chunk k uses scratch slot k */
+      RunSlots(chunks_in_wave, [&](size_t k) {
+         size_t begin = (first_chunk + k)*FRAME_CHUNK_SIZE;
+         size_t end = std::min(begin + FRAME_CHUNK_SIZE, number_of_frames);
+         process(begin, end, k);
+      });
+      for (chunk = 0; chunk < chunks_in_wave; chunk++) {
+         size_t begin = (first_chunk + chunk)*FRAME_CHUNK_SIZE;
+         size_t end = std::min(begin + FRAME_CHUNK_SIZE, number_of_frames);
+         merge(begin, end, chunk);
+      }
+   }
+}
+
+void ParallelTasks(const int &num_threads, const size_t &n,
+                   const std::function<void(size_t)> &task) {
+   if (num_threads <= 1 || n <= 1) {
+      size_t i;
+      for (i = 0; i < n; i++)
+         task(i);
+      return;
+   }
+   GetScheduler(num_threads);
+   std::atomic<size_t> next_task(0);
+   RunSlots(std::min((size_t)num_threads, n), [&](size_t) {
+      size_t i;
+      while ((i = next_task++) < n)
+         task(i);
+   });
+}
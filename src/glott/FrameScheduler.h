@@ -0,0 +1,113 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_FRAMESCHEDULER_H_
+#define SRC_GLOTT_FRAMESCHEDULER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+/* Frames per chunk. Chunk boundaries depend only on the number of frames,
+ * never on the thread count or timing, so chunk-local results are the
+ * same in every run. */
+#define FRAME_CHUNK_SIZE 64
+
+/**
+ * Class TaskGroup
+ *
+ * Tasks run on the shared work-stealing scheduler. Every thread (workers
+ * and the threads that submit) has its own deque: Run() pushes to the
+ * deque of the calling thread, idle threads steal from the other end.
+ * Wait() runs queued tasks on the calling thread until all tasks of the
+ * group are done, so a task can run a group of its own (files -> frames)
+ * without extra threads. While waiting, a thread only takes tasks of
+ * groups nested as deep or deeper than the one it waits for (frames of
+ * other files, not another file). An exception of a task is rethrown by
+ * Wait().
+ */
+class TaskGroup {
+ public:
+   TaskGroup();
+   ~TaskGroup();
+
+   void Run(const std::function<void()> &task);
+   void Wait();
+
+ private:
+   TaskGroup(const TaskGroup &);
+   TaskGroup &operator=(const TaskGroup &);
+
+   friend class TaskScheduler;
+   const size_t depth_;  // nesting level: groups created in tasks of this group are deeper
+   std::atomic<size_t> pending_;
+   std::mutex error_mutex_;
+   std::exception_ptr error_;
+};
+
+/**
+ * Function ConfigureScheduler
+ *
+ * Start the worker threads of the scheduler (num_threads including the
+ * calling thread). With pin_threads, worker i is bound to core i (Linux).
+ * Later calls with a larger num_threads add workers; the scheduler never
+ * shrinks.
+ */
+void ConfigureScheduler(const int &num_threads, const bool &pin_threads);
+
+/* Processes frames [begin, end). slot (0 ... num_threads-1) identifies
+ * per-thread scratch owned by the caller. */
+typedef std::function<void(size_t begin, size_t end, size_t slot)> FrameChunkFunction;
+
+/**
+ * Function ParallelFrames
+ *
+ * Run process() over all frames in FRAME_CHUNK_SIZE chunks on the shared
+ * scheduler, with at most num_threads chunks running at a time. For loops
+ * where every frame writes only its own outputs (matrix column, vector
+ * element). num_threads <= 1 runs serially on the calling thread.
+ */
+void ParallelFrames(const int &num_threads, const size_t &number_of_frames,
+                    const FrameChunkFunction &process);
+
+/**
+ * Function ParallelFramesOrdered
+ *
+ * As ParallelFrames, for loops that accumulate into a shared buffer
+ * (overlap-add). Chunks run in waves of num_threads. After each wave,
+ * merge() is called on the calling thread for the chunks of that wave in
+ * frame order. process() keeps its per-frame results in the scratch for
+ * its slot, and merge() adds them to the shared buffer frame by frame,
+ * so the output is bit-identical to the serial loop. With num_threads <= 1
+ * the chunks are processed and merged one at a time on the calling thread,
+ * so the scratch never holds more than one chunk (or one wave).
+ */
+void ParallelFramesOrdered(const int &num_threads, const size_t &number_of_frames,
+                           const FrameChunkFunction &process,
+                           const FrameChunkFunction &merge);
+
+/**
+ * Function ParallelTasks
+ *
+ * Run task(i) for i = 0 ... n-1 on the same scheduler, at most num_threads
+ * at a time (e.g. one file per task in batch mode). The tasks may run
+ * ParallelFrames themselves; the frame chunks are then shared with the
+ * other tasks on the same threads.
+ */
+void ParallelTasks(const int &num_threads, const size_t &n,
+                   const std::function<void(size_t)> &task);
+
+#endif /* SRC_GLOTT_FRAMESCHEDULER_H_ */
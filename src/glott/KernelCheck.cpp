@@ -0,0 +1,170 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Equivalence check of the fixed-order kernels (FixedOrderKernels.h) with
+ * the generic routines of SpFunctions: Autocorrelation, Levinson, all-pole
+ * and FIR Filter are run on the same random frames for every LP order up
+ * to CHECK_MAX_ORDER, first with the kernels disabled (generic loops), then
+ * enabled. Every order that has a fixed-order kernel must give the same
+ * result; the kernels keep the generic summation order, so the results are
+ * expected to be identical, and any difference above CHECK_TOLERANCE fails.
+ *
+ * usage: KernelCheck (or make check-kernels in src/), exit status 0 if all pass
+ */
+
+#include <gslwrap/vector_double.h>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "definitions.h"
+#include "SpFunctions.h"
+#include "FixedOrderKernels.h"
+
+#define CHECK_MAX_ORDER 60
+#define CHECK_FRAME_LENGTH 400
+#define CHECK_TOLERANCE 1e-12
+
+/* Frame lengths of the filter check: shorter than the order (warm-up
+ * only) and a full frame */
+static const size_t filter_lengths[] = {5, CHECK_FRAME_LENGTH};
+
+struct OrderResults {
+   gsl::vector r;
+   gsl::vector A;
+   std::vector<gsl::vector> all_pole;
+   std::vector<gsl::vector> fir;
+};
+
+static std::vector<gsl::vector> frames;
+static std::vector<gsl::vector> fir_coefficients;
+
+/* Random frames and FIR coefficients, one per order */
+static void MakeInputs() {
+   std::mt19937 rng(1234);
+   std::normal_distribution<double> normal(0.0, 1.0);
+   size_t order, i;
+   for (order = 0; order <= CHECK_MAX_ORDER; order++) {
+      gsl::vector frame(CHECK_FRAME_LENGTH);
+      double state = 0.0;
+      for (i = 0; i < CHECK_FRAME_LENGTH; i++) {
+         /* coloured noise under a Hann window */
+         state = 0.9*state + normal(rng);
+         frame(i) = state*(0.5 - 0.5*cos(2.0*M_PI*(double)i/(CHECK_FRAME_LENGTH-1)));
+      }
+      frames.push_back(frame);
+      gsl::vector b(order + 1);
+      for (i = 0; i <= order; i++)
+         b(i) = normal(rng)/(double)(order + 1);
+      fir_coefficients.push_back(b);
+   }
+}
+
+static OrderResults Run(const size_t &order) {
+   OrderResults res;
+   const gsl::vector &frame = frames[order];
+   Autocorrelation(frame, (int)order, &res.r);
+   Levinson(res.r, &res.A);
+
+   gsl::vector one(1);
+   one(0) = 1.0;
+   for (const size_t &len : filter_lengths) {
+      gsl::vector x(len);
+      size_t i;
+      for (i = 0; i < len; i++)
+         x(i) = frame(i);
+      gsl::vector y;
+      Filter(one, res.A, x, &y);
+      res.all_pole.push_back(y);
+      gsl::vector z;
+      Filter(fir_coefficients[order], one, x, &z);
+      res.fir.push_back(z);
+   }
+   return res;
+}
+
+static double MaxDifference(const gsl::vector &a, const gsl::vector &b) {
+   if (a.size() != b.size())
+      return INFINITY;
+   double diff = 0.0;
+   size_t i;
+   for (i = 0; i < a.size(); i++)
+      diff = fmax(diff, fabs(a(i) - b(i))/(1.0 + fabs(b(i))));
+   return diff;
+}
+
+int main() {
+   size_t order, k;
+   int failures = 0;
+   int kernels = 0;
+
+   MakeInputs();
+
+   /* Generic routines: no ConfigureFixedOrderKernels call yet */
+   std::vector<OrderResults> generic;
+   for (order = 1; order <= CHECK_MAX_ORDER; order++) {
+      if (GetLevinsonKernel(order) != NULL) {
+         std::cerr << "Error: fixed-order kernels enabled before configuration" << std::endl;
+         return EXIT_FAILURE;
+      }
+      generic.push_back(Run(order));
+   }
+
+   Param params;
+   params.use_fixed_order_kernels = true;
+   ConfigureFixedOrderKernels(params);
+
+   for (order = 1; order <= CHECK_MAX_ORDER; order++) {
+      const bool levinson = GetLevinsonKernel(order) != NULL;
+      const bool autocorrelation = GetAutocorrelationKernel(order) != NULL;
+      const bool all_pole = GetAllPoleFilterKernel(order) != NULL;
+      const bool fir = GetFirFilterKernel(order) != NULL;
+      if (!levinson && !autocorrelation && !all_pole && !fir)
+         continue;
+
+      const OrderResults &ref = generic[order-1];
+      OrderResults res = Run(order);
+      double diff_r = MaxDifference(res.r, ref.r);
+      double diff_A = MaxDifference(res.A, ref.A);
+      double diff_all_pole = 0.0, diff_fir = 0.0;
+      for (k = 0; k < res.all_pole.size(); k++) {
+         diff_all_pole = fmax(diff_all_pole, MaxDifference(res.all_pole[k], ref.all_pole[k]));
+         diff_fir = fmax(diff_fir, MaxDifference(res.fir[k], ref.fir[k]));
+      }
+      const bool ok = diff_r <= CHECK_TOLERANCE && diff_A <= CHECK_TOLERANCE &&
+                      diff_all_pole <= CHECK_TOLERANCE && diff_fir <= CHECK_TOLERANCE;
+      std::cout << (ok ? "ok   " : "FAIL ") << "order " << order
+                << ": autocorrelation " << diff_r << (autocorrelation ? "" : " (generic)")
+                << ", levinson " << diff_A << (levinson ? "" : " (generic)")
+                << ", all-pole " << diff_all_pole << (all_pole ? "" : " (generic)")
+                << ", fir " << diff_fir << (fir ? "" : " (generic)") << std::endl;
+      kernels++;
+      if (!ok)
+         failures++;
+   }
+
+   if (kernels == 0) {
+      std::cerr << "Error: no fixed-order kernels enabled" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (failures) {
+      std::cerr << "Error: " << failures << " of " << kernels
+                << " fixed orders differ from the generic routines" << std::endl;
+      return EXIT_FAILURE;
+   }
+   std::cout << "all " << kernels << " fixed orders match the generic routines" << std::endl;
+   return EXIT_SUCCESS;
+}
@@ -34,6 +34,7 @@
 #include "definitions.h"
 #include "FileIo.h"
 #include "ReadConfig.h"
+#include "FixedOrderKernels.h"
 #include "SpFunctions.h"
 #include "DnnClass.h"
 #include "SynthesisFunctions.h"
@@ -65,6 +66,7 @@ int main(int argc, char *argv[]) {
       //std::cerr << "Error: could not read config file" <<  std::endl;
       return EXIT_FAILURE;
    }
+   ConfigureFixedOrderKernels(params);
 
    gsl::matrix lsf;
    if (ReadGslMatrix(in_filename, params.data_type, params.lpc_order_vt, &lsf) == EXIT_FAILURE) {
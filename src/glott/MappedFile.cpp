@@ -0,0 +1,135 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "MappedFile.h"
+
+MappedFile::MappedFile() : data_(NULL), bytes_(0), mapped_(false) {}
+
+MappedFile::~MappedFile() {
+   Close();
+}
+
+void MappedFile::Close() {
+   if (data_ != NULL) {
+      if (mapped_)
+         munmap(data_, bytes_);
+      else
+         free(data_);
+   }
+   data_ = NULL;
+   bytes_ = 0;
+   mapped_ = false;
+}
+
+/* Whole contents of fd with read() calls, for files that cannot be mapped */
+static void *ReadAll(const int &fd, size_t *bytes) {
+   size_t capacity = 1 << 16;
+   size_t n = 0;
+   char *buffer = (char *)malloc(capacity);
+   while (buffer != NULL) {
+      if (n == capacity) {
+         char *grown = (char *)realloc(buffer, 2*capacity);
+         if (grown == NULL)
+            break;
+         buffer = grown;
+         capacity *= 2;
+      }
+      ssize_t r = read(fd, buffer + n, capacity - n);
+      if (r < 0) {
+         break;
+      } else if (r == 0) {
+         *bytes = n;
+         return buffer;
+      }
+      n += (size_t)r;
+   }
+   free(buffer);
+   return NULL;
+}
+
+int MappedFile::Open(const std::string &filename, const size_t &value_size) {
+   Close();
+   int fd = open(filename.c_str(), O_RDONLY);
+   if (fd < 0) {
+      std::cerr << "Error opening file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   struct stat info;
+   if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+      bytes_ = (size_t)info.st_size;
+      if (bytes_ > 0) {
+         void *data = mmap(NULL, bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (data != MAP_FAILED) {
+            data_ = data;
+            mapped_ = true;
+#ifdef MADV_SEQUENTIAL
+            madvise(data_, bytes_, MADV_SEQUENTIAL);
+#endif
+         }
+      }
+   }
+   if (!mapped_) {
+      data_ = ReadAll(fd, &bytes_);
+      if (data_ == NULL) {
+         close(fd);
+         bytes_ = 0;
+         std::cerr << "Error reading file " << filename << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+   close(fd);
+
+   if (value_size > 0 && bytes_ % value_size != 0) {
+      std::cerr << "Error: size of " << filename << " (" << bytes_ << " bytes) is not a "
+                << "multiple of " << value_size << " bytes" << std::endl;
+      Close();
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+void FloatToDouble(const float *src, const size_t &n, double *dst) {
+   size_t i = 0;
+#ifdef __SSE2__
+   for (; i + 4 <= n; i += 4) {
+      __m128 f = _mm_loadu_ps(src + i);
+      _mm_storeu_pd(dst + i, _mm_cvtps_pd(f));
+      _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+   }
+#endif
+   for (; i < n; i++)
+      dst[i] = static_cast<double>(src[i]);
+}
+
+void DoubleToFloat(const double *src, const size_t &n, float *dst) {
+   size_t i = 0;
+#ifdef __SSE2__
+   for (; i + 4 <= n; i += 4) {
+      __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+      __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+      _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+   }
+#endif
+   for (; i < n; i++)
+      dst[i] = static_cast<float>(src[i]);
+}
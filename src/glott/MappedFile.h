@@ -0,0 +1,59 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_MAPPEDFILE_H_
+#define SRC_GLOTT_MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Class MappedFile
+ *
+ * Read-only view of a whole binary file: memory mapped, or read with one
+ * call when the file cannot be mapped (pipes). Values<T>() gives the
+ * contents as an array of T without copying. Released by Close() or the
+ * destructor.
+ */
+class MappedFile {
+ public:
+   MappedFile();
+   ~MappedFile();
+
+   /* Fails when the file cannot be read or its size is not a multiple of
+    * value_size bytes */
+   int Open(const std::string &filename, const size_t &value_size);
+   void Close();
+
+   size_t bytes() const {return bytes_;}
+   template <typename T>
+   const T *Values() const {return static_cast<const T *>(data_);}
+   template <typename T>
+   size_t NumValues() const {return bytes_/sizeof(T);}
+
+ private:
+   MappedFile(const MappedFile &);
+   MappedFile &operator=(const MappedFile &);
+
+   void *data_;
+   size_t bytes_;
+   bool mapped_;   // data_ is a mapping (else a heap buffer)
+};
+
+/* Bulk conversion between float32 file data and double (SSE2 where
+ * available) */
+void FloatToDouble(const float *src, const size_t &n, double *dst);
+void DoubleToFloat(const double *src, const size_t &n, float *dst);
+
+#endif /* SRC_GLOTT_MAPPEDFILE_H_ */
@@ -0,0 +1,163 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check of the counter-based noise generator (NoiseGenerator.h):
+ *  - Philox4x32-10 known-answer vectors of Random123 (kat_vectors),
+ *  - reproducibility of FillGaussianNoise: the same (seed, stream, index)
+ *    gives the same samples however many are drawn, other seeds, streams
+ *    and indices give other samples, and the first samples of a fixed
+ *    stream match stored reference values,
+ *  - UniformNoise returns the uniforms under the Gaussian samples.
+ *
+ * usage: NoiseCheck (or make check-noise in src/), exit status 0 if all pass
+ */
+
+#include <gslwrap/vector_double.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "NoiseGenerator.h"
+
+/* Relative tolerance of libm differences in the Box-Muller transform */
+#define CHECK_TOLERANCE 1e-12
+
+static int failures = 0;
+
+static void Report(const bool &ok, const char *what) {
+   std::cout << (ok ? "ok   " : "FAIL ") << what << std::endl;
+   if (!ok)
+      failures++;
+}
+
+static bool Close(const double &a, const double &b) {
+   return fabs(a - b) <= CHECK_TOLERANCE*(1.0 + fabs(b));
+}
+
+static void CheckKat() {
+   /* key[2], counter[4], expected[4] */
+   static const uint32_t kat[3][10] = {
+      {0x00000000u, 0x00000000u,
+       0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u,
+       0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u},
+      {0xffffffffu, 0xffffffffu,
+       0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu,
+       0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu},
+      {0xa4093822u, 0x299f31d0u,
+       0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u,
+       0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u}};
+   size_t i, j;
+   for (i = 0; i < 3; i++) {
+      uint32_t counter[4] = {kat[i][2], kat[i][3], kat[i][4], kat[i][5]};
+      Philox4x32(kat[i], counter);
+      bool ok = true;
+      for (j = 0; j < 4; j++)
+         ok = ok && counter[j] == kat[i][6+j];
+      char what[128];
+      snprintf(what, sizeof(what), "Philox4x32-10 known answer %zu: %08x %08x %08x %08x",
+               i, counter[0], counter[1], counter[2], counter[3]);
+      Report(ok, what);
+   }
+}
+
+static void CheckGaussian() {
+   const int seed = 1;
+   const size_t n = 1000;
+   std::vector<double> x(n), y(n);
+   size_t i;
+
+   /* First samples of (seed 1, NOISE_STREAM_UNVOICED, index 0) */
+   static const double reference[4] = {
+      -0.91992309241922843, -0.92636227415220129,
+      0.81947234204773256, -0.46946537466328553};
+   FillGaussianNoise(seed, NOISE_STREAM_UNVOICED, 0, x.data(), n);
+   bool ok = true;
+   for (i = 0; i < 4; i++)
+      ok = ok && Close(x[i], reference[i]);
+   Report(ok, "FillGaussianNoise reference values");
+
+   FillGaussianNoise(seed, NOISE_STREAM_UNVOICED, 0, y.data(), n);
+   Report(x == y, "FillGaussianNoise repeatable");
+
+   /* Shorter draws are prefixes of the long one, across batch boundaries */
+   static const size_t lengths[] = {1, 2, 37, 63, 64, 65, 129, 999};
+   ok = true;
+   for (const size_t &len : lengths) {
+      std::vector<double> z(len);
+      FillGaussianNoise(seed, NOISE_STREAM_UNVOICED, 0, z.data(), len);
+      for (i = 0; i < len; i++)
+         ok = ok && z[i] == x[i];
+   }
+   Report(ok, "FillGaussianNoise prefix of a longer draw");
+
+   gsl::vector v(n);
+   FillGaussianNoise(seed, NOISE_STREAM_UNVOICED, 0, &v);
+   ok = true;
+   for (i = 0; i < n; i++)
+      ok = ok && v(i) == x[i];
+   Report(ok, "FillGaussianNoise gsl::vector overload");
+
+   FillGaussianNoise(seed + 1, NOISE_STREAM_UNVOICED, 0, y.data(), n);
+   Report(x != y, "FillGaussianNoise differs for another seed");
+   FillGaussianNoise(seed, NOISE_STREAM_HARMONIC, 0, y.data(), n);
+   Report(x != y, "FillGaussianNoise differs for another stream");
+   FillGaussianNoise(seed, NOISE_STREAM_UNVOICED, 1, y.data(), n);
+   Report(x != y, "FillGaussianNoise differs for another index");
+
+   /* Sample mean and variance, loose bounds (about 5 sigma) */
+   const size_t m = 100000;
+   std::vector<double> w(m);
+   FillGaussianNoise(seed, NOISE_STREAM_EXCITATION, 12345, w.data(), m);
+   double mean = 0.0, var = 0.0;
+   for (i = 0; i < m; i++)
+      mean += w[i];
+   mean /= (double)m;
+   for (i = 0; i < m; i++)
+      var += (w[i] - mean)*(w[i] - mean);
+   var /= (double)(m - 1);
+   Report(fabs(mean) < 0.016 && fabs(var - 1.0) < 0.023, "FillGaussianNoise mean and variance");
+
+   /* Uniforms: sample 2k and 2k+1 are the Box-Muller inputs of Gaussian
+    * samples 2k and 2k+1 (UniformNoise is 2^-54 below the open uniform) */
+   ok = true;
+   for (i = 0; i + 1 < n; i += 2) {
+      const double half = 0.5/9007199254740992.0;
+      const double u0 = UniformNoise(seed, NOISE_STREAM_UNVOICED, 0, i) + half;
+      const double u1 = UniformNoise(seed, NOISE_STREAM_UNVOICED, 0, i + 1) + half;
+      const double radius = sqrt(-2.0*log(u0));
+      ok = ok && Close(radius*cos(2.0*M_PI*u1), x[i]) && Close(radius*sin(2.0*M_PI*u1), x[i+1]);
+   }
+   Report(ok, "UniformNoise matches FillGaussianNoise");
+
+   ok = true;
+   for (i = 0; i < n; i++) {
+      const double u = UniformNoise(seed, NOISE_STREAM_JITTER, 7, i);
+      ok = ok && u >= 0.0 && u < 1.0 && UniformNoiseInt(seed, NOISE_STREAM_JITTER, 7, i, 10) < 10;
+   }
+   Report(ok, "UniformNoise range");
+}
+
+int main() {
+   CheckKat();
+   CheckGaussian();
+   if (failures) {
+      std::cerr << "Error: " << failures << " noise check(s) failed" << std::endl;
+      return EXIT_FAILURE;
+   }
+   std::cout << "all noise checks passed" << std::endl;
+   return EXIT_SUCCESS;
+}
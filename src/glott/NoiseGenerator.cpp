@@ -0,0 +1,134 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gsl/gsl_math.h>
+#include <gslwrap/vector_double.h>
+#include <cmath>
+#include <cstdint>
+#include "definitions.h"
+#include "SpFunctions.h"
+#include "NoiseGenerator.h"
+
+/* Philox4x32-10 constants (Salmon et al., "Parallel random numbers: as
+ * easy as 1, 2, 3", SC 2011) */
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+/* Second key word, fixed */
+#define NOISE_KEY1 0x6C6F7474u
+
+/* Philox blocks per batch. Each block gives two Gaussian samples. */
+#define NOISE_BATCH 32
+
+/**
+ * Philox4x32-10 rounds over num_blocks (<= NOISE_BATCH) counter blocks
+ * with key (k0, k1), in place. The rounds run over the whole batch so that
+ * the compiler can vectorise the block loop.
+ */
+static inline void PhiloxRounds(uint32_t k0, uint32_t k1, const size_t &num_blocks,
+                                uint32_t c0[], uint32_t c1[], uint32_t c2[], uint32_t c3[]) {
+   size_t j;
+   int r;
+   for (r = 0; r < PHILOX_ROUNDS; r++) {
+      for (j = 0; j < num_blocks; j++) {
+         uint64_t p0 = (uint64_t)PHILOX_M0 * c0[j];
+         uint64_t p1 = (uint64_t)PHILOX_M1 * c2[j];
+         uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1[j] ^ k0;
+         uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3[j] ^ k1;
+         c1[j] = (uint32_t)p1;
+         c3[j] = (uint32_t)p0;
+         c0[j] = n0;
+         c2[j] = n2;
+      }
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+   }
+}
+
+/* Philox4x32-10 of num_blocks consecutive blocks of stream (seed, stream, index) */
+static void PhiloxBatch(const int &seed, const NoiseStream &stream,
+                        const size_t &index, const uint32_t &first_block,
+                        const size_t &num_blocks,
+                        uint32_t c0[], uint32_t c1[], uint32_t c2[], uint32_t c3[]) {
+   size_t j;
+   for (j = 0; j < num_blocks; j++) {
+      c0[j] = first_block + (uint32_t)j;
+      c1[j] = (uint32_t)((uint64_t)index >> 32);
+      c2[j] = (uint32_t)index;
+      c3[j] = (uint32_t)stream;
+   }
+   PhiloxRounds((uint32_t)seed, NOISE_KEY1, num_blocks, c0, c1, c2, c3);
+}
+
+void Philox4x32(const uint32_t key[2], uint32_t counter[4]) {
+   PhiloxRounds(key[0], key[1], 1, &counter[0], &counter[1], &counter[2], &counter[3]);
+}
+
+/* Uniform in the open interval (0,1) from 64 random bits */
+static inline double OpenUniform(const uint32_t &hi, const uint32_t &lo) {
+   uint64_t bits = (((uint64_t)hi << 32) | lo) >> 11;
+   return ((double)bits + 0.5)*(1.0/9007199254740992.0);
+}
+
+void FillGaussianNoise(const int &seed, const NoiseStream &stream,
+                       const size_t &index, double *x, const size_t &n) {
+   uint32_t c0[NOISE_BATCH], c1[NOISE_BATCH], c2[NOISE_BATCH], c3[NOISE_BATCH];
+   double radius[NOISE_BATCH], angle[NOISE_BATCH];
+   size_t sample = 0;
+   uint32_t block = 0;
+   size_t j;
+
+   while (sample < n) {
+      PhiloxBatch(seed, stream, index, block, NOISE_BATCH, c0, c1, c2, c3);
+      /* Box-Muller */
+      for (j = 0; j < NOISE_BATCH; j++) {
+         radius[j] = sqrt(-2.0*log(OpenUniform(c0[j], c1[j])));
+         angle[j] = 2.0*M_PI*OpenUniform(c2[j], c3[j]);
+      }
+      for (j = 0; j < NOISE_BATCH && sample < n; j++) {
+         x[sample++] = radius[j]*cos(angle[j]);
+         if (sample < n)
+            x[sample++] = radius[j]*sin(angle[j]);
+      }
+      block += NOISE_BATCH;
+   }
+}
+
+void FillGaussianNoise(const int &seed, const NoiseStream &stream,
+                       const size_t &index, gsl::vector *noise) {
+   if (!noise->is_set() || noise->size() == 0)
+      return;
+   FillGaussianNoise(seed, stream, index, VectorData(noise), noise->size());
+}
+
+double UniformNoise(const int &seed, const NoiseStream &stream,
+                    const size_t &index, const size_t &sample) {
+   uint32_t c0[1], c1[1], c2[1], c3[1];
+   /* Two uniforms per block, as for the Gaussian samples */
+   PhiloxBatch(seed, stream, index, (uint32_t)(sample/2), 1, c0, c1, c2, c3);
+   if (sample % 2 == 0)
+      return OpenUniform(c0[0], c1[0]) - 0.5/9007199254740992.0;
+   return OpenUniform(c2[0], c3[0]) - 0.5/9007199254740992.0;
+}
+
+size_t UniformNoiseInt(const int &seed, const NoiseStream &stream,
+                       const size_t &index, const size_t &sample, const size_t &n) {
+   if (n == 0)
+      return 0;
+   size_t value = (size_t)(UniformNoise(seed, stream, index, sample)*(double)n);
+   return GSL_MIN(value, n - 1);
+}
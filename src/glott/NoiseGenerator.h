@@ -0,0 +1,59 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_NOISEGENERATOR_H_
+#define SRC_GLOTT_NOISEGENERATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <gslwrap/vector_double.h>
+
+/* Counter-based noise: every value is a pure function of
+ * (seed, stream, index, sample), computed with the Philox4x32-10 block
+ * cipher. Any frame can be generated on its own, in any order and on any
+ * thread, with the same result. The seed comes from RANDOM_SEED. */
+
+/* Independent streams, one per use */
+enum NoiseStream {
+   NOISE_STREAM_UNVOICED = 1,  /* unvoiced synthesis noise, index = frame */
+   NOISE_STREAM_EXCITATION,    /* unvoiced excitation noise, index = sample */
+   NOISE_STREAM_JITTER,        /* pulse position/sign jitter, index = sample */
+   NOISE_STREAM_HARMONIC,      /* HNR modification noise, index = frame */
+   NOISE_STREAM_PHASE          /* phase randomisation, index = caller's */
+};
+
+/**
+ * Function FillGaussianNoise
+ *
+ * Write n standard normal samples of stream (seed, stream, index), from
+ * sample 0 on. Box-Muller over Philox uniforms, computed in blocks so
+ * that the loops vectorise.
+ */
+void FillGaussianNoise(const int &seed, const NoiseStream &stream,
+                       const size_t &index, double *x, const size_t &n);
+void FillGaussianNoise(const int &seed, const NoiseStream &stream,
+                       const size_t &index, gsl::vector *noise);
+
+/* Single uniform value in [0,1) and uniform integer in [0,n) */
+double UniformNoise(const int &seed, const NoiseStream &stream,
+                    const size_t &index, const size_t &sample);
+size_t UniformNoiseInt(const int &seed, const NoiseStream &stream,
+                       const size_t &index, const size_t &sample, const size_t &n);
+
+/* One Philox4x32-10 block with an explicit key, in place. The functions
+ * above use key (seed, fixed word); this one is for the known-answer check
+ * (NoiseCheck). */
+void Philox4x32(const uint32_t key[2], uint32_t counter[4]);
+
+#endif /* SRC_GLOTT_NOISEGENERATOR_H_ */
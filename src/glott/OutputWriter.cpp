@@ -0,0 +1,185 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+#include <iostream>
+
+#include "OutputWriter.h"
+#include "FileIo.h"
+#include "PulseCodec.h"
+
+const gsl::vector &OutputBatch::Take(gsl::vector *vector) {
+   vectors_.emplace_back();
+   vectors_.back().swap(*vector);
+   if (vectors_.back().is_set())
+      bytes_ += vectors_.back().size()*sizeof(double);
+   return vectors_.back();
+}
+
+const gsl::matrix &OutputBatch::Take(gsl::matrix *matrix) {
+   matrices_.emplace_back();
+   matrices_.back().swap(*matrix);
+   if (matrices_.back().is_set())
+      bytes_ += matrices_.back().size1()*matrices_.back().size2()*sizeof(double);
+   return matrices_.back();
+}
+
+void OutputBatch::AddVector(const std::string &filename, const DataType &format,
+                            gsl::vector *vector, const bool &append) {
+   const gsl::vector *values = &Take(vector);
+   writes_.push_back([filename, format, values, append](const bool &sync) {
+      std::vector<uint8_t> bytes;
+      EncodeGslVector(format, *values, &bytes);
+      return WriteFileBytes(filename, bytes.data(), bytes.size(), append, sync);
+   });
+}
+
+void OutputBatch::AddMatrix(const std::string &filename, const DataType &format,
+                            gsl::matrix *matrix, const bool &append) {
+   const gsl::matrix *values = &Take(matrix);
+   writes_.push_back([filename, format, values, append](const bool &sync) {
+      std::vector<uint8_t> bytes;
+      EncodeGslMatrix(format, *values, &bytes);
+      return WriteFileBytes(filename, bytes.data(), bytes.size(), append, sync);
+   });
+}
+
+void OutputBatch::AddPulses(const std::string &filename, const DataType &format,
+                            const PulseEncoding &encoding, gsl::matrix *pulses,
+                            const bool &append) {
+   if (encoding == PULSES_RAW) {
+      AddMatrix(filename, format, pulses, append);
+      return;
+   }
+   const gsl::matrix *values = &Take(pulses);
+   writes_.push_back([filename, encoding, values, append](const bool &sync) {
+      std::vector<uint8_t> bytes;
+      if (EncodePulses(*values, encoding, &bytes) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+      return WriteFileBytes(filename, bytes.data(), bytes.size(), append, sync);
+   });
+}
+
+void OutputBatch::AddWav(const std::string &filename, gsl::vector *signal, const int &fs,
+                         const WavFormat &format) {
+   const gsl::vector *values = &Take(signal);
+   writes_.push_back([filename, values, fs, format](const bool &sync) {
+      return WriteWavFile(filename, *values, fs, format, sync);
+   });
+}
+
+void OutputBatch::AddAppendWav(const std::string &filename, gsl::vector *signal, const int &fs,
+                               const WavFormat &format, const bool &create) {
+   const gsl::vector *values = &Take(signal);
+   writes_.push_back([filename, values, fs, format, create](const bool &sync) {
+      return AppendWavFile(filename, *values, fs, format, create, sync);
+   });
+}
+
+void OutputBatch::Add(const WriteFunction &write) {
+   writes_.push_back(write);
+}
+
+/* All files are attempted even if one of them fails */
+int OutputBatch::Write(const bool &sync) const {
+   int result = EXIT_SUCCESS;
+   for (const WriteFunction &write : writes_)
+      if (write(sync) != EXIT_SUCCESS)
+         result = EXIT_FAILURE;
+   return result;
+}
+
+OutputWriter::OutputWriter()
+   : capacity_(0), queued_bytes_(0), failures_(0), sync_(false), closed_(false) {}
+
+OutputWriter::~OutputWriter() {
+   Finish();
+}
+
+void OutputWriter::Start(const size_t &queue_bytes, const bool &sync) {
+   if (started())
+      return;
+   capacity_ = queue_bytes;
+   sync_ = sync;
+   closed_ = false;
+   thread_ = std::thread(&OutputWriter::Run, this);
+}
+
+/**
+ * Queue a batch for writing (written at once if the thread has not been
+ * started). A batch larger than the whole queue is accepted when nothing
+ * else is queued, so that one long utterance cannot block forever.
+ */
+void OutputWriter::Submit(std::unique_ptr<OutputBatch> batch) {
+   if (batch == NULL || batch->empty())
+      return;
+   if (!started()) {
+      const int result = batch->Write(sync_);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (result != EXIT_SUCCESS)
+         failures_++;
+      return;
+   }
+   const size_t bytes = batch->bytes();
+   std::unique_lock<std::mutex> lock(mutex_);
+   queue_changed_.wait(lock, [&] {
+      return queued_bytes_ == 0 || queued_bytes_ + bytes <= capacity_;
+   });
+   queued_bytes_ += bytes;
+   queue_.push_back(std::move(batch));
+   queue_changed_.notify_all();
+}
+
+int OutputWriter::Finish() {
+   if (started()) {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         closed_ = true;
+      }
+      queue_changed_.notify_all();
+      thread_.join();
+   }
+   if (failures_ > 0) {
+      std::cerr << "Error: " << failures_ << " output batch(es) could not be written" << std::endl;
+      failures_ = 0;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+bool OutputWriter::failed() {
+   std::lock_guard<std::mutex> lock(mutex_);
+   return failures_ > 0;
+}
+
+void OutputWriter::Run() {
+   std::unique_lock<std::mutex> lock(mutex_);
+   while (true) {
+      queue_changed_.wait(lock, [this] {return closed_ || !queue_.empty();});
+      if (queue_.empty())
+         return;
+      /* The batch stays counted in the queue until it is freed */
+      std::unique_ptr<OutputBatch> batch = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+      const int result = batch->Write(sync_);
+      const size_t bytes = batch->bytes();
+      batch.reset();
+      lock.lock();
+      if (result != EXIT_SUCCESS)
+         failures_++;
+      queued_bytes_ -= bytes;
+      queue_changed_.notify_all();
+   }
+}
@@ -0,0 +1,123 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_OUTPUTWRITER_H_
+#define SRC_GLOTT_OUTPUTWRITER_H_
+
+/*
+ * Asynchronous output of the Analysis program (ASYNC_OUTPUT): the features
+ * and signals of an utterance are handed over to a writer thread, which
+ * writes them while the next utterance (or the rest of the pipeline) is
+ * computed. Batches are written in the order they are submitted, so the
+ * blocks of chunked analysis are appended in order.
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <gslwrap/vector_double.h>
+#include <gslwrap/matrix_double.h>
+
+#include "definitions.h"
+
+/**
+ * Class OutputBatch
+ *
+ * Files written by one job of the writer thread. Buffers are taken over
+ * from the caller (swapped, the caller is left with an empty vector or
+ * matrix) and freed when the batch has been written. Feature files are
+ * encoded in memory on the writer thread and written with one system call
+ * each.
+ */
+class OutputBatch {
+ public:
+   typedef std::function<int(const bool &sync)> WriteFunction;
+
+   OutputBatch() : bytes_(0) {}
+
+   /* Take over the buffer; the reference stays valid until the batch is written */
+   const gsl::vector &Take(gsl::vector *vector);
+   const gsl::matrix &Take(gsl::matrix *matrix);
+
+   void AddVector(const std::string &filename, const DataType &format, gsl::vector *vector,
+                  const bool &append);
+   void AddMatrix(const std::string &filename, const DataType &format, gsl::matrix *matrix,
+                  const bool &append);
+   void AddPulses(const std::string &filename, const DataType &format,
+                  const PulseEncoding &encoding, gsl::matrix *pulses, const bool &append);
+   /* As WriteWavFile (re-scaled) */
+   void AddWav(const std::string &filename, gsl::vector *signal, const int &fs,
+               const WavFormat &format);
+   /* As AppendWavFile (clipped) */
+   void AddAppendWav(const std::string &filename, gsl::vector *signal, const int &fs,
+                     const WavFormat &format, const bool &create);
+   /* Any other write, on buffers taken over with Take() */
+   void Add(const WriteFunction &write);
+
+   int Write(const bool &sync) const;
+   size_t bytes() const {return bytes_;}
+   bool empty() const {return writes_.empty();}
+
+ private:
+   std::list<gsl::vector> vectors_;
+   std::list<gsl::matrix> matrices_;
+   std::vector<WriteFunction> writes_;
+   size_t bytes_;
+};
+
+/**
+ * Class OutputWriter
+ *
+ * Writer thread with a queue bounded by the memory of the queued batches.
+ * Submit() blocks while the queue is full, so that the compute threads
+ * cannot run arbitrarily far ahead of the disk. Write errors are reported
+ * when they happen and counted; Finish() fails if there was any.
+ */
+class OutputWriter {
+ public:
+   OutputWriter();
+   ~OutputWriter();
+
+   void Start(const size_t &queue_bytes, const bool &sync);
+   bool started() const {return thread_.joinable();}
+   void Submit(std::unique_ptr<OutputBatch> batch);
+   /* Write the rest of the queue and stop the thread */
+   int Finish();
+   /* Some batch could not be written (so far) */
+   bool failed();
+
+ private:
+   OutputWriter(const OutputWriter &);
+   OutputWriter &operator=(const OutputWriter &);
+
+   void Run();
+
+   std::mutex mutex_;
+   std::condition_variable queue_changed_;
+   std::deque<std::unique_ptr<OutputBatch> > queue_;
+   std::thread thread_;
+   size_t capacity_;
+   size_t queued_bytes_;
+   size_t failures_;
+   bool sync_;
+   bool closed_;
+};
+
+#endif /* SRC_GLOTT_OUTPUTWRITER_H_ */
@@ -0,0 +1,132 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_PACKEDSPECTRUM_H_
+#define SRC_GLOTT_PACKEDSPECTRUM_H_
+
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include <gsl/gsl_fft_real_float.h>
+#include <gsl/gsl_fft_halfcomplex_float.h>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <gslwrap/vector_double.h>
+#include "ComplexVector.h"
+
+/* Radix-2 real FFTs for the supported sample types */
+inline void RealRadix2Transform(double *data, const size_t &nfft) {
+   gsl_fft_real_radix2_transform(data, 1, nfft);
+}
+
+inline void RealRadix2Transform(float *data, const size_t &nfft) {
+   gsl_fft_real_float_radix2_transform(data, 1, nfft);
+}
+
+inline void HalfcomplexRadix2Inverse(double *data, const size_t &nfft) {
+   gsl_fft_halfcomplex_radix2_inverse(data, 1, nfft);
+}
+
+inline void HalfcomplexRadix2Inverse(float *data, const size_t &nfft) {
+   gsl_fft_halfcomplex_float_radix2_inverse(data, 1, nfft);
+}
+
+/**
+ * Class PackedSpectrum
+ *
+ * Spectrum of a real signal in GSL half-complex packing, with sample
+ * type T (double or float). Used by the FFT-based synthesis filtering so
+ * that the transforms and the per-bin magnitude/phase arithmetic can run
+ * in single precision (COMPUTE_PRECISION = "FLOAT"). The buffer is
+ * allocated once and reused between frames.
+ *
+ * With T = double, Transform/Inverse and the bin accessors give the same
+ * values as FFTRadix2/IFFTRadix2 with a ComplexVector.
+ *
+ * author: @ljuvela
+ */
+template <typename T>
+class PackedSpectrum {
+ public:
+   explicit PackedSpectrum(size_t nfft)
+      : nfft_(nfft), data_(nfft, T(0)), dc_imag_(0), nyquist_imag_(0) {}
+
+   /* Number of frequency bins (nfft/2+1) */
+   size_t getSize() const {return nfft_/2+1;}
+
+   /* Zero-padded forward transform of x */
+   template <class oclass>
+   void Transform(const oclass &x) {
+      size_t i;
+      assert(x.size() <= nfft_);
+      for(i=0;i<x.size();i++)
+         data_[i] = (T)x[i];
+      for(;i<nfft_;i++)
+         data_[i] = T(0);
+      dc_imag_ = T(0);
+      nyquist_imag_ = T(0);
+      RealRadix2Transform(data_.data(), nfft_);
+   }
+
+   /* Inverse transform, first x->size() samples are written to x */
+   void Inverse(gsl::vector *x) {
+      size_t i;
+      assert(x->size() <= nfft_);
+      HalfcomplexRadix2Inverse(data_.data(), nfft_);
+      for(i=0;i<x->size();i++)
+         (*x)(i) = (double)data_[i];
+   }
+
+   void Copy(const ComplexVector &X) {
+      size_t i;
+      assert(X.getSize() == getSize());
+      for(i=0;i<getSize();i++)
+         setBin(i, (T)X.getReal(i), (T)X.getImag(i));
+   }
+
+   T getReal(size_t idx) const {assert(idx<getSize()); return data_[idx];}
+   T getImag(size_t idx) const {
+      assert(idx<getSize());
+      if(idx == 0)
+         return dc_imag_;
+      if(idx == nfft_/2)
+         return nyquist_imag_;
+      return data_[nfft_-idx];
+   }
+   T getAbs(size_t idx) const {
+      return std::sqrt(getReal(idx)*getReal(idx) + getImag(idx)*getImag(idx));
+   }
+   T getAng(size_t idx) const {return std::atan2(getImag(idx), getReal(idx));}
+
+   /* Imaginary parts of the DC and Nyquist bins are kept for getAbs/getAng
+    * but do not enter the inverse transform, as in IFFTRadix2 */
+   void setBin(size_t idx, T re, T im) {
+      assert(idx<getSize());
+      data_[idx] = re;
+      if(idx == 0)
+         dc_imag_ = im;
+      else if(idx == nfft_/2)
+         nyquist_imag_ = im;
+      else
+         data_[nfft_-idx] = im;
+   }
+
+ private:
+   size_t nfft_;
+   std::vector<T> data_;
+   T dc_imag_;
+   T nyquist_imag_;
+};
+
+#endif /* SRC_GLOTT_PACKEDSPECTRUM_H_ */
@@ -0,0 +1,474 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <gslwrap/matrix_double.h>
+
+#include "PulseCodec.h"
+#include "FileIo.h"
+#include "MappedFile.h"
+
+static const char kPulseMagic[8] = {'T', 'O', 'L', 'G', 'P', 'L', 'S', '1'};
+
+struct PulseBlockHeader {
+   char magic[8];
+   uint32_t encoding;
+   uint32_t order;
+   uint64_t frames;
+   uint64_t bytes;
+};
+
+/* Quantisation of the RICE encoding: samples in [-1, 1] of the frame peak */
+#define PULSE_QUANT_MAX 32767
+/* Unary part of a Rice code longer than this is an escape followed by the
+ * value in PULSE_ESCAPE_BITS bits */
+#define PULSE_ESCAPE_LENGTH 24
+#define PULSE_ESCAPE_BITS 20
+/* Window of the adaptive Rice parameter (halved when full) */
+#define PULSE_RICE_WINDOW 8
+
+/*********************************************************************/
+/*                          IEEE half float                          */
+/*********************************************************************/
+
+/* Round to nearest even; out-of-range values saturate to +-65504 */
+static uint16_t FloatToHalf(const float &value) {
+   uint32_t x;
+   memcpy(&x, &value, sizeof(x));
+   const uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+   const uint32_t abs_x = x & 0x7fffffff;
+   if (abs_x > 0x7f800000)
+      return sign | 0x7e00;                               // NaN
+   if (abs_x >= 0x477ff000)
+      return sign | 0x7bff;                               // >= 65520 rounds to inf
+   if (abs_x < 0x38800000) {                              // subnormal half
+      if (abs_x < 0x33000000)
+         return sign;
+      const uint32_t exponent = abs_x >> 23;
+      const uint32_t mantissa = (abs_x & 0x007fffff) | 0x00800000;
+      const uint32_t shift = 126 - exponent;              // 14 ... 24
+      uint32_t half = mantissa >> shift;
+      const uint32_t rest = mantissa & ((1u << shift) - 1);
+      const uint32_t halfway = 1u << (shift - 1);
+      if (rest > halfway || (rest == halfway && (half & 1)))
+         half++;
+      return sign | (uint16_t)half;
+   }
+   uint32_t half = ((abs_x - 0x38000000) >> 13);
+   const uint32_t rest = abs_x & 0x1fff;
+   if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+      half++;
+   return sign | (uint16_t)half;
+}
+
+static float HalfToFloatSlow(const uint16_t &half) {
+   const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+   const uint32_t exponent = (half >> 10) & 0x1f;
+   uint32_t mantissa = half & 0x3ff;
+   uint32_t x;
+   if (exponent == 0x1f) {
+      x = sign | 0x7f800000 | (mantissa << 13);
+   } else if (exponent != 0) {
+      x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+   } else if (mantissa == 0) {
+      x = sign;
+   } else {
+      uint32_t e = 113;
+      while ((mantissa & 0x400) == 0) {
+         mantissa <<= 1;
+         e--;
+      }
+      x = sign | (e << 23) | ((mantissa & 0x3ff) << 13);
+   }
+   float value;
+   memcpy(&value, &x, sizeof(value));
+   return value;
+}
+
+/* Decoding table of all half floats (built on first use) */
+static const float *HalfTable() {
+   static const std::vector<float> table = [] {
+      std::vector<float> values(65536);
+      size_t i;
+      for (i = 0; i < values.size(); i++)
+         values[i] = HalfToFloatSlow((uint16_t)i);
+      return values;
+   }();
+   return table.data();
+}
+
+/*********************************************************************/
+/*                            Rice coding                            */
+/*********************************************************************/
+
+class BitWriter {
+ public:
+   explicit BitWriter(std::vector<uint8_t> *bytes) : bytes_(bytes), buffer_(0), count_(0) {}
+   /* n <= 32 bits of value, most significant first */
+   void Put(const uint32_t &value, const int &n) {
+      buffer_ = (buffer_ << n) | (value & (uint32_t)((1ull << n) - 1));
+      count_ += n;
+      while (count_ >= 8) {
+         count_ -= 8;
+         bytes_->push_back((uint8_t)(buffer_ >> count_));
+      }
+   }
+   /* Pad with zero bits to a byte boundary */
+   void Flush() {
+      if (count_ > 0)
+         Put(0, 8 - count_);
+      buffer_ = 0;
+   }
+
+ private:
+   std::vector<uint8_t> *bytes_;
+   uint64_t buffer_;
+   int count_;
+};
+
+class BitReader {
+ public:
+   BitReader(const uint8_t *data, const size_t &bytes)
+         : data_(data), bytes_(bytes), next_(0), buffer_(0), count_(0) {}
+   /* At least 57 bits in the buffer (zeros past the end of the data) */
+   void Refill() {
+      while (count_ <= 56) {
+         const uint64_t byte = (next_ < bytes_) ? data_[next_] : 0;
+         next_++;
+         buffer_ |= byte << (56 - count_);
+         count_ += 8;
+      }
+   }
+   /* Leading zero bits of the buffer */
+   int Zeros() const {
+      if (buffer_ == 0)
+         return 64;
+#if defined(__GNUC__)
+      return __builtin_clzll(buffer_);
+#else
+      int n = 0;
+      while ((buffer_ & (1ull << (63 - n))) == 0)
+         n++;
+      return n;
+#endif
+   }
+   uint32_t Get(const int &n) {
+      if (n == 0)
+         return 0;
+      const uint32_t value = (uint32_t)(buffer_ >> (64 - n));
+      Skip(n);
+      return value;
+   }
+   void Skip(const int &n) {
+      buffer_ <<= n;
+      count_ -= n;
+   }
+   /* Drop the padding bits of the current byte */
+   void Align() {
+      Skip(count_ % 8);
+   }
+   /* Bytes consumed, past the end of the data if it was truncated */
+   size_t position() const {return next_ - count_/8;}
+
+ private:
+   const uint8_t *data_;
+   size_t bytes_;
+   size_t next_;
+   uint64_t buffer_;
+   int count_;
+};
+
+/* Adaptive Rice parameter: the mean of the recent values, as in LOCO-I */
+struct RiceState {
+   uint32_t sum;
+   uint32_t count;
+   RiceState() : sum(16), count(1) {}
+   int Parameter() const {
+      int k = 0;
+      while ((count << k) < sum && k < 24)
+         k++;
+      return k;
+   }
+   void Update(const uint32_t &value) {
+      sum += value;
+      count++;
+      if (count >= PULSE_RICE_WINDOW) {
+         sum >>= 1;
+         count >>= 1;
+      }
+   }
+};
+
+static void EncodeFrameRice(const double *x, const size_t &n, std::vector<uint8_t> *bytes) {
+   double peak = 0.0;
+   size_t i;
+   for (i = 0; i < n; i++)
+      peak = GSL_MAX(peak, std::fabs(x[i]));
+   const float peak_float = (float)peak;
+   const uint8_t *peak_bytes = reinterpret_cast<const uint8_t *>(&peak_float);
+   bytes->insert(bytes->end(), peak_bytes, peak_bytes + sizeof(peak_float));
+   if (peak_float == 0.0f || !std::isfinite(peak_float))
+      return;
+
+   const double scale = PULSE_QUANT_MAX/(double)peak_float;
+   BitWriter writer(bytes);
+   RiceState state;
+   int32_t q1 = 0, q2 = 0;
+   for (i = 0; i < n; i++) {
+      long q = lrint(x[i]*scale);
+      q = GSL_MAX(GSL_MIN(q, (long)PULSE_QUANT_MAX), -(long)PULSE_QUANT_MAX);
+      const int32_t residual = (int32_t)q - (2*q1 - q2);
+      const uint32_t value = (residual >= 0) ? 2*(uint32_t)residual : 2*(uint32_t)(-residual) - 1;
+      const int k = state.Parameter();
+      const uint32_t quotient = value >> k;
+      if (quotient < PULSE_ESCAPE_LENGTH) {
+         writer.Put(1, quotient + 1);
+         writer.Put(value, k);
+      } else {
+         writer.Put(1, PULSE_ESCAPE_LENGTH + 1);
+         writer.Put(value, PULSE_ESCAPE_BITS);
+      }
+      state.Update(value);
+      q2 = q1;
+      q1 = (int32_t)q;
+   }
+   writer.Flush();
+}
+
+/* Returns the number of bytes used, 0 on corrupt data */
+static size_t DecodeFrameRice(const uint8_t *data, const size_t &bytes, const size_t &n,
+                              float *x) {
+   float peak;
+   if (bytes < sizeof(peak))
+      return 0;
+   memcpy(&peak, data, sizeof(peak));
+   size_t i;
+   if (peak == 0.0f || !std::isfinite(peak)) {
+      for (i = 0; i < n; i++)
+         x[i] = 0.0f;
+      return sizeof(peak);
+   }
+
+   const float step = peak/PULSE_QUANT_MAX;
+   BitReader reader(data + sizeof(peak), bytes - sizeof(peak));
+   RiceState state;
+   int32_t q1 = 0, q2 = 0;
+   for (i = 0; i < n; i++) {
+      reader.Refill();
+      const int k = state.Parameter();
+      const int zeros = reader.Zeros();
+      uint32_t value;
+      if (zeros < PULSE_ESCAPE_LENGTH) {
+         reader.Skip(zeros + 1);
+         value = ((uint32_t)zeros << k) | reader.Get(k);
+      } else if (zeros == PULSE_ESCAPE_LENGTH) {
+         reader.Skip(zeros + 1);
+         value = reader.Get(PULSE_ESCAPE_BITS);
+      } else {
+         return 0;
+      }
+      state.Update(value);
+      const int32_t residual = (value & 1) ? -(int32_t)((value + 1) >> 1) : (int32_t)(value >> 1);
+      const int32_t q = residual + (2*q1 - q2);
+      if (q > PULSE_QUANT_MAX || q < -PULSE_QUANT_MAX)
+         return 0;
+      x[i] = (float)q*step;
+      q2 = q1;
+      q1 = q;
+   }
+   reader.Align();
+   const size_t used = sizeof(peak) + reader.position();
+   return (used <= bytes) ? used : 0;
+}
+
+/*********************************************************************/
+/*                              Blocks                               */
+/*********************************************************************/
+
+int EncodePulses(const gsl::matrix &pulses, const PulseEncoding &encoding,
+                 std::vector<uint8_t> *bytes) {
+   if (encoding != PULSES_FLOAT16 && encoding != PULSES_RICE) {
+      std::cerr << "Error: invalid pulse encoding" << std::endl;
+      return EXIT_FAILURE;
+   }
+   const size_t n_rows = pulses.size1();
+   const size_t n_cols = pulses.size2();
+   const size_t header_pos = bytes->size();
+   bytes->resize(header_pos + sizeof(PulseBlockHeader));
+   if (encoding == PULSES_FLOAT16)
+      bytes->reserve(header_pos + sizeof(PulseBlockHeader) + 2*n_rows*n_cols);
+
+   const gsl_matrix *m = pulses.gslobj();
+   std::vector<double> frame(n_rows);
+   size_t i, j;
+   for (j = 0; j < n_cols; j++) {
+      for (i = 0; i < n_rows; i++)
+         frame[i] = m->data[i*m->tda + j];
+      if (encoding == PULSES_FLOAT16) {
+         for (i = 0; i < n_rows; i++) {
+            const uint16_t half = FloatToHalf((float)frame[i]);
+            bytes->push_back((uint8_t)(half & 0xff));
+            bytes->push_back((uint8_t)(half >> 8));
+         }
+      } else {
+         EncodeFrameRice(frame.data(), n_rows, bytes);
+      }
+   }
+
+   PulseBlockHeader header;
+   memcpy(header.magic, kPulseMagic, sizeof(kPulseMagic));
+   header.encoding = (uint32_t)encoding;
+   header.order = (uint32_t)n_rows;
+   header.frames = n_cols;
+   header.bytes = bytes->size() - header_pos - sizeof(header);
+   memcpy(bytes->data() + header_pos, &header, sizeof(header));
+   return EXIT_SUCCESS;
+}
+
+bool IsEncodedPulses(const void *data, const size_t &bytes) {
+   return bytes >= sizeof(PulseBlockHeader) && memcmp(data, kPulseMagic, sizeof(kPulseMagic)) == 0;
+}
+
+int DecodePulses(const void *data, const size_t &bytes, const size_t &n_rows,
+                 std::vector<float> *frames) {
+   const uint8_t *p = static_cast<const uint8_t *>(data);
+   const uint8_t *end = p + bytes;
+   frames->clear();
+   if (n_rows == 0) {
+      std::cerr << "Error: invalid pulse length 0" << std::endl;
+      return EXIT_FAILURE;
+   }
+   while (p < end) {
+      PulseBlockHeader header;
+      if ((size_t)(end - p) < sizeof(header) || !IsEncodedPulses(p, sizeof(header))) {
+         std::cerr << "Error: invalid pulse block header" << std::endl;
+         return EXIT_FAILURE;
+      }
+      memcpy(&header, p, sizeof(header));
+      p += sizeof(header);
+      if (header.order != n_rows) {
+         std::cerr << "ERROR: Invalid pulse length " << header.order << ", " << n_rows
+                   << " expected" << std::endl;
+         return EXIT_FAILURE;
+      }
+      if (header.encoding != PULSES_FLOAT16 && header.encoding != PULSES_RICE) {
+         std::cerr << "Error: unknown pulse encoding " << header.encoding << std::endl;
+         return EXIT_FAILURE;
+      }
+      if (header.bytes > (uint64_t)(end - p)) {
+         std::cerr << "Error: truncated pulse block" << std::endl;
+         return EXIT_FAILURE;
+      }
+      /* The frame count is bounded by the payload (FLOAT16: 2 bytes per
+       * value, RICE: at least the peak of each frame) before any size is
+       * computed from it, so that a corrupt header cannot overflow or
+       * allocate beyond the input */
+      const uint64_t max_frames = (header.encoding == PULSES_FLOAT16) ?
+            header.bytes/(2*n_rows) : header.bytes/sizeof(float);
+      if (header.frames > max_frames
+          || header.frames > (SIZE_MAX - frames->size())/n_rows
+          || (header.encoding == PULSES_FLOAT16 && header.bytes != 2*n_rows*header.frames)) {
+         std::cerr << "Error: corrupt pulse block header" << std::endl;
+         return EXIT_FAILURE;
+      }
+      const size_t first = frames->size();
+      frames->resize(first + header.frames*n_rows);
+      float *dst = frames->data() + first;
+      size_t i, j;
+      if (header.encoding == PULSES_FLOAT16) {
+         const float *table = HalfTable();
+         for (i = 0; i < header.frames*n_rows; i++)
+            dst[i] = table[p[2*i] | ((uint16_t)p[2*i+1] << 8)];
+      } else {
+         size_t position = 0;
+         for (j = 0; j < header.frames; j++) {
+            const size_t used = DecodeFrameRice(p + position, header.bytes - position, n_rows,
+                                                dst + j*n_rows);
+            if (used == 0) {
+               std::cerr << "Error: corrupt pulse data in frame " << first/n_rows + j
+                         << std::endl;
+               return EXIT_FAILURE;
+            }
+            position += used;
+         }
+         if (position != header.bytes) {
+            std::cerr << "Error: corrupt pulse data" << std::endl;
+            return EXIT_FAILURE;
+         }
+      }
+      p += header.bytes;
+   }
+   return EXIT_SUCCESS;
+}
+
+int DecodePulses(const void *data, const size_t &bytes, const size_t &n_rows,
+                 gsl::matrix *pulses) {
+   std::vector<float> frames;
+   if (DecodePulses(data, bytes, n_rows, &frames) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   const size_t n_cols = frames.size()/n_rows;
+   if (n_cols == 0) {
+      std::cerr << "Error: no pulse frames" << std::endl;
+      return EXIT_FAILURE;
+   }
+   *pulses = gsl::matrix(n_rows, n_cols);
+   gsl_matrix *m = pulses->gslobj();
+   size_t i, j;
+   for (j = 0; j < n_cols; j++)
+      for (i = 0; i < n_rows; i++)
+         m->data[i*m->tda + j] = frames[j*n_rows + i];
+   return EXIT_SUCCESS;
+}
+
+int WritePulseFile(const std::string &filename, const DataType &format,
+                   const PulseEncoding &encoding, const gsl::matrix &pulses, const bool &append) {
+   if (encoding == PULSES_RAW)
+      return WriteGslMatrix(filename, format, pulses, append);
+
+   std::vector<uint8_t> bytes;
+   if (EncodePulses(pulses, encoding, &bytes) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   FILE *fid = fopen(filename.c_str(), append ? "ab" : "wb");
+   if (fid == NULL) {
+      std::cerr << "Error: could not create file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   const size_t written = fwrite(bytes.data(), 1, bytes.size(), fid);
+   if (fclose(fid) != 0 || written != bytes.size()) {
+      std::cerr << "Error: could not write file " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+int ReadPulseFile(const std::string &filename, const DataType &format, const size_t &n_rows,
+                  gsl::matrix *pulses) {
+   MappedFile file;
+   if (file.Open(filename, 1) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (!IsEncodedPulses(file.Values<uint8_t>(), file.bytes())) {
+      file.Close();
+      return ReadGslMatrix(filename, format, n_rows, pulses);
+   }
+   if (DecodePulses(file.Values<uint8_t>(), file.bytes(), n_rows, pulses) == EXIT_FAILURE) {
+      std::cerr << "Error: could not decode " << filename << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_PULSECODEC_H_
+#define SRC_GLOTT_PULSECODEC_H_
+
+/*
+ * Compressed storage of the pulses-as-features matrix (.pls,
+ * PULSE_ENCODING). An encoded file is a sequence of blocks, so that
+ * chunked analysis can append to it:
+ *
+ *   header  32 bytes: magic "TOLGPLS1", encoding, values per frame,
+ *           frames, payload bytes
+ *   payload FLOAT16: IEEE half floats, frame by frame
+ *           RICE:    per frame a float32 peak amplitude (0 for an empty
+ *                    frame), then the samples quantised to 16 bits of the
+ *                    peak, predicted from the two previous samples, with
+ *                    the residuals Rice coded (adaptive parameter); each
+ *                    frame ends on a byte boundary
+ *
+ * Files without the magic are read as plain DATA_TYPE matrices, so old
+ * feature files can still be used.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gslwrap/matrix_double.h>
+
+#include "definitions.h"
+
+/* Encode pulses (one column per frame) as one block */
+int EncodePulses(const gsl::matrix &pulses, const PulseEncoding &encoding,
+                 std::vector<uint8_t> *bytes);
+
+/* True if data starts with an encoded pulse block */
+bool IsEncodedPulses(const void *data, const size_t &bytes);
+
+/* Decode all blocks, frame by frame, to float */
+int DecodePulses(const void *data, const size_t &bytes, const size_t &n_rows,
+                 std::vector<float> *frames);
+/* Decode all blocks to a matrix with one column per frame */
+int DecodePulses(const void *data, const size_t &bytes, const size_t &n_rows,
+                 gsl::matrix *pulses);
+
+/* With PULSES_RAW, the same as WriteGslMatrix */
+int WritePulseFile(const std::string &filename, const DataType &format,
+                   const PulseEncoding &encoding, const gsl::matrix &pulses, const bool &append);
+/* Encoded or plain (DATA_TYPE) pulse file */
+int ReadPulseFile(const std::string &filename, const DataType &format, const size_t &n_rows,
+                  gsl::matrix *pulses);
+
+#endif /* SRC_GLOTT_PULSECODEC_H_ */
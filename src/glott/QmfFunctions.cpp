@@ -80,90 +80,72 @@ void Qmf::Decimate(const gsl::vector &frame_orig, const int skip, gsl::vector *f
 }
 
 
-void Qmf::CombinePoly(const gsl::vector &a_qmf1, const gsl::vector &a_qmf2,
-               const double &qmf_gain, const int &Nsub, gsl::vector *a_combined) {
+void Qmf::CombinePoly(const double *a_qmf1, const size_t &Nlow, const double *a_qmf2, const size_t &Nhigh,
+               const double &qmf_gain, const int &Nsub, double *a_combined, const size_t &Ncomb_size) {
 	// RADIX2 Implementation:
    size_t i;
    double temp;
    double thresh = 0.0000001;
-	size_t Nlow = a_qmf1.size();
-	size_t Nhigh = a_qmf2.size();
-	int Ncomb = a_combined->size()-1;
 	size_t nfft = NextPow2(Nsub);
 
 	double *dataLow = (double *)calloc(nfft,sizeof(double)); /* complex, takes 2*nfft/2  values*/
 	double *dataHigh = (double *)calloc(nfft,sizeof(double)); /* complex, takes 2*nfft/2  values*/
-	double *dataComb = (double *)calloc(2*nfft,sizeof(double));
-	gsl::vector fftlow(nfft/2);
-	gsl::vector ffthigh(nfft/2);
+	double *dataComb = (double *)calloc(2*nfft+Ncomb_size,sizeof(double)); /* tail is Levinson scratch */
+	double *fftlow = dataComb; /* Power spectra are combined in place */
+	double *ffthigh = dataComb + nfft/2;
 
 	/** FFT LOW-BAND **/
 	for (i=0; i<Nlow; i++)
-		dataLow[i] = a_qmf1(i);
+		dataLow[i] = a_qmf1[i];
 
 	gsl_fft_real_radix2_transform(dataLow, 1, nfft);
 
-	fftlow(0) = 1.0/pow(dataLow[0],2);
+	fftlow[0] = 1.0/pow(dataLow[0],2);
 	for(i=1; i<nfft/2; i++){
 		temp = (pow(dataLow[i], 2) + pow(dataLow[nfft-i], 2));
 		if(temp < thresh)
 			temp = thresh;
-		fftlow(i) = 1.0/temp;
+		fftlow[i] = 1.0/temp;
 	}
 
 	double elow = 0.0;
-	for(i = 0; i<fftlow.size(); i++) {
-		elow += fftlow(i);
+	for(i = 0; i<nfft/2; i++) {
+		elow += fftlow[i];
 	}
 	elow = sqrt(elow); // Low-band energy
 
 
 	/** FFT HIGH-BAND **/
 	for (i=0; i<Nhigh; i++)
-		dataHigh[i] = a_qmf2(i);
+		dataHigh[i] = a_qmf2[i];
 
 	gsl_fft_real_radix2_transform(dataHigh, 1, nfft);
 
-	ffthigh(0) = 1.0/pow(dataHigh[0],2);
+	/* High-band has mirrored frequency, store reversed */
+	ffthigh[nfft/2-1] = 1.0/pow(dataHigh[0],2);
 	for(i=1; i<nfft/2; i++){
 		temp = (pow(dataHigh[i], 2) + pow(dataHigh[nfft-i], 2));
 		if(temp < thresh)
 			temp = thresh;
-		ffthigh(i) = 1.0/temp;
+		ffthigh[nfft/2-1-i] = 1.0/temp;
 	}
 
 	double ehigh = 0.0;
-	for(i = 0; i<ffthigh.size(); i++) {
-		ehigh += ffthigh(i);
+	for(i = 0; i<nfft/2; i++) {
+		ehigh += ffthigh[nfft/2-1-i];
 	}
 	ehigh = sqrt(ehigh); // High-band energy
 
-	ffthigh.reverse(); // High-band has mirrored frequency
-
 	/* Scale power of ffthigh according to QMF gain */
-   ffthigh *= elow/ehigh * powf(10,qmf_gain/20.0);
-
-	/** Combine PSD vectors **/
-	for(i=0;i<nfft/2;i++)
-		dataComb[i] = fftlow(i);
-
-	for(i=nfft/2;i<nfft;i++)
-		dataComb[i] = ffthigh(i-nfft/2);
-
-	//dataComb[nfft] = dataComb[nfft-1];
-	//for(i=nfft+1;i<2*nfft;i++)
-	//	dataComb[i] = 0;
+	double scale = elow/ehigh * powf(10,qmf_gain/20.0);
+	for(i = 0; i<nfft/2; i++)
+		ffthigh[i] *= scale;
 
 	/** IFFT combined PSD vector for Autocorrelation **/
 	gsl_fft_halfcomplex_radix2_inverse(dataComb, 1,2*nfft);
 
-	/** Set values to AC vector and compute minimum phase polynomial with Levinson **/
-	gsl::vector ac(Ncomb+1);
-
-	for(i=0;i<ac.size();i++)
-    	ac(i) = dataComb[i];
-
-   Levinson(ac, a_combined);
+	/** Autocorrelation is the head of dataComb, compute minimum phase polynomial with Levinson **/
+	Levinson(dataComb, Ncomb_size-1, a_combined, dataComb+2*nfft);
 
     // Free memory
 	free(dataLow);
@@ -171,5 +153,11 @@ void Qmf::CombinePoly(const gsl::vector &a_qmf1, const gsl::vector &a_qmf2,
 	free(dataComb);
 }
 
+void Qmf::CombinePoly(const gsl::vector &a_qmf1, const gsl::vector &a_qmf2,
+               const double &qmf_gain, const int &Nsub, gsl::vector *a_combined) {
+	CombinePoly(VectorData(a_qmf1), a_qmf1.size(), VectorData(a_qmf2), a_qmf2.size(),
+	            qmf_gain, Nsub, VectorData(a_combined), a_combined->size());
+}
+
 
 
@@ -31,6 +31,9 @@ void Decimate(const gsl::vector &frame_orig, const int skip, gsl::vector *frame_
 void CombinePoly(const gsl::vector &a_qmf1, const gsl::vector &a_qmf2,
                const double &qmf_gain, const int &Nsub, gsl::vector *a_combined);
 
+void CombinePoly(const double *a_qmf1, const size_t &Nlow, const double *a_qmf2, const size_t &Nhigh,
+               const double &qmf_gain, const int &Nsub, double *a_combined, const size_t &Ncomb_size);
+
 }
 
 
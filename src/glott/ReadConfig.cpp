@@ -277,6 +277,60 @@ int AssignConfigParams(const libconfig::Config &cfg, const bool required,
     ConfigLookupBool("USE_SPECTRAL_MATCHING", cfg, required,
                      &(params->use_spectral_matching));
 
+    ConfigLookupBool("USE_FIXED_ORDER_KERNELS", cfg, false,
+                     &(params->use_fixed_order_kernels));
+
+    ConfigLookupBool("PRECISION_REPORT", cfg, false,
+                     &(params->precision_report));
+
+    ConfigLookupInt("MEMORY_BUDGET_MB", cfg, false,
+                    &(params->memory_budget_mb));
+
+    ConfigLookupBool("MEMORY_REPORT", cfg, false,
+                     &(params->memory_report));
+
+    ConfigLookupInt("NUM_THREADS", cfg, false, &(params->num_threads));
+
+    ConfigLookupBool("PIN_THREADS", cfg, false, &(params->pin_threads));
+
+    ConfigLookupBool("TIMING_REPORT", cfg, false, &(params->timing_report));
+
+    ConfigLookupInt("RANDOM_SEED", cfg, false, &(params->random_seed));
+
+    ConfigLookupInt("SERVER_QUEUE_LENGTH", cfg, false, &(params->server_queue_length));
+
+    ConfigLookupInt("SERVER_IDLE_TIMEOUT", cfg, false, &(params->server_idle_timeout));
+
+    ConfigLookupBool("STREAMING_SYNTHESIS", cfg, false, &(params->streaming_synthesis));
+
+    ConfigLookupInt("STREAM_BLOCK_FRAMES", cfg, false, &(params->stream_block_frames));
+
+    ConfigLookupBool("STREAMING_REPORT", cfg, false, &(params->streaming_report));
+
+    ConfigLookupDouble("ANALYSIS_CHUNK_SECONDS", cfg, false, &(params->analysis_chunk_seconds));
+
+    ConfigLookupDouble("ANALYSIS_CHUNK_OVERLAP_SECONDS", cfg, false, &(params->analysis_chunk_overlap_seconds));
+
+    ConfigLookupBool("ANALYSIS_CHUNK_REPORT", cfg, false, &(params->analysis_chunk_report));
+
+    ConfigLookupBool("FEATURE_CONTAINER", cfg, false, &(params->feature_container));
+
+    ConfigLookupString("DATASET_DIRECTORY", cfg, false, params->dataset_directory);
+
+    ConfigLookupInt("DATASET_SHARD_FRAMES", cfg, false, &(params->dataset_shard_frames));
+
+    ConfigLookupBool("DATASET_REMOVE_UNVOICED", cfg, false, &(params->dataset_remove_unvoiced));
+
+    ConfigLookupBool("ASYNC_OUTPUT", cfg, false, &(params->async_output));
+
+    ConfigLookupInt("OUTPUT_QUEUE_MB", cfg, false, &(params->output_queue_mb));
+
+    ConfigLookupBool("OUTPUT_FSYNC", cfg, false, &(params->output_fsync));
+
+    ConfigLookupString("ANALYSIS_CACHE_DIRECTORY", cfg, false, params->analysis_cache_directory);
+
+    ConfigLookupBool("ANALYSIS_CACHE_STAGES", cfg, false, &(params->analysis_cache_stages));
+
     ConfigLookupInt("LSF_VT_SMOOTH_LEN", cfg, required,
                     &(params->lsf_vt_smooth_len));
 
@@ -346,6 +400,7 @@ int AssignConfigParams(const libconfig::Config &cfg, const bool required,
     ConfigLookupString("DIR_EXCITATION", cfg, false, params->dir_exc);
     ConfigLookupString("DIR_SPECTRUM", cfg, false, params->dir_sp);
     ConfigLookupString("DIR_SYN", cfg, false, params->dir_syn);
+    ConfigLookupString("DIR_FEATURE_CONTAINER", cfg, false, params->dir_container);
 
     /* Lookup for parameter extensions,  optional */
     ConfigLookupString("EXT_GAIN", cfg, false, params->extension_gain);
@@ -358,6 +413,8 @@ int AssignConfigParams(const libconfig::Config &cfg, const bool required,
     ConfigLookupString("EXT_EXCITATION", cfg, false, params->extension_exc);
     ConfigLookupString("EXT_EXCITATION_ORIG", cfg, false,
                        params->extension_src);
+    ConfigLookupString("EXT_FEATURE_CONTAINER", cfg, false,
+                       params->extension_container);
 
     /* Read enum style configurations */
     std::string str;
@@ -432,6 +489,56 @@ int AssignConfigParams(const libconfig::Config &cfg, const bool required,
       }
     }
 
+    /* Sample type of the FFT-based synthesis filtering */
+    str.clear();
+    ConfigLookupString("COMPUTE_PRECISION", cfg, false, str);
+    if (str != "") {
+      if (str == "DOUBLE") {
+        params->compute_precision = COMPUTE_DOUBLE;
+      } else if (str == "FLOAT") {
+        params->compute_precision = COMPUTE_FLOAT;
+      } else {
+        std::cerr << "Error: invalid compute precision flag \"" << str << "\""
+                  << std::endl;
+        std::cerr << "Valid options are DOUBLE / FLOAT" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    /* Storage of the pulses-as-features matrix */
+    str.clear();
+    ConfigLookupString("PULSE_ENCODING", cfg, false, str);
+    if (str != "") {
+      if (str == "RAW") {
+        params->pulse_encoding = PULSES_RAW;
+      } else if (str == "FLOAT16") {
+        params->pulse_encoding = PULSES_FLOAT16;
+      } else if (str == "RICE") {
+        params->pulse_encoding = PULSES_RICE;
+      } else {
+        std::cerr << "Error: invalid pulse encoding \"" << str << "\""
+                  << std::endl;
+        std::cerr << "Valid options are RAW / FLOAT16 / RICE" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    /* Sample format of the wav files written */
+    str.clear();
+    ConfigLookupString("WAV_FORMAT", cfg, false, str);
+    if (str != "") {
+      if (str == "PCM16") {
+        params->wav_format = WAV_PCM16;
+      } else if (str == "FLOAT") {
+        params->wav_format = WAV_FLOAT;
+      } else {
+        std::cerr << "Error: invalid wav format \"" << str << "\""
+                  << std::endl;
+        std::cerr << "Valid options are PCM16 / FLOAT" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
     /* require external excitation filename if used */
     // TODO: should not be required in config_default
     if (params->excitation_method == EXTERNAL_EXCITATION) {
@@ -0,0 +1,175 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Stress benchmark of the frame scheduler: a batch of utterances (mostly
+ * short, some long) is processed with 1, 2, 4, ... threads, once with the
+ * files in parallel and the frame loops serial (the old batch mode) and
+ * once with both levels on the scheduler. The per-frame work is an LP
+ * analysis of a windowed synthetic frame (autocorrelation and Levinson,
+ * order 30 at 16 kHz).
+ *
+ * usage: SchedulerBenchmark [max_threads (64)] [utterances (256)] [pin (0)]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "FrameScheduler.h"
+
+#define BENCH_FS 16000
+#define BENCH_FRAME_SHIFT 80
+#define BENCH_FRAME_LENGTH 400
+#define BENCH_LPC_ORDER 30
+
+/* Sum of the LP coefficients of all frames of an utterance */
+static double AnalyseUtterance(const size_t &number_of_frames, const size_t &seed,
+                               const int &num_threads) {
+   std::vector<double> gain(number_of_frames);
+   const size_t num_slots = (size_t)std::max(num_threads, 1);
+   std::vector<std::vector<double> > frames(num_slots, std::vector<double>(BENCH_FRAME_LENGTH));
+   std::vector<std::vector<double> > polys(num_slots, std::vector<double>(2*(BENCH_LPC_ORDER+1)));
+
+   ParallelFrames(num_threads, number_of_frames, [&](size_t begin, size_t end, size_t slot) {
+      std::vector<double> &frame = frames[slot];
+      double *r = polys[slot].data();
+      double *a = r + BENCH_LPC_ORDER + 1;
+      size_t i, j, k;
+      for (i = begin; i < end; i++) {
+         /* voiced-like frame: a few harmonics of a frame-dependent f0 */
+         const double f0 = 100.0 + (double)((seed*31 + i) % 150);
+         for (j = 0; j < BENCH_FRAME_LENGTH; j++) {
+            const double t = (double)(i*BENCH_FRAME_SHIFT + j)/BENCH_FS;
+            const double w = 0.5 - 0.5*cos(2.0*M_PI*(double)j/(BENCH_FRAME_LENGTH-1));
+            frame[j] = w*(sin(2.0*M_PI*f0*t) + 0.5*sin(4.0*M_PI*f0*t) + 0.25*sin(6.0*M_PI*f0*t));
+         }
+         for (k = 0; k <= BENCH_LPC_ORDER; k++) {
+            double sum = 0.0;
+            for (j = k; j < BENCH_FRAME_LENGTH; j++)
+               sum += frame[j]*frame[j-k];
+            r[k] = sum;
+         }
+         r[0] *= 1.0 + 1e-9;
+         /* Levinson-Durbin */
+         double err = r[0];
+         a[0] = 1.0;
+         for (k = 1; k <= BENCH_LPC_ORDER; k++)
+            a[k] = 0.0;
+         for (k = 1; k <= BENCH_LPC_ORDER; k++) {
+            double acc = r[k];
+            for (j = 1; j < k; j++)
+               acc += a[j]*r[k-j];
+            const double refl = -acc/err;
+            for (j = 1; j <= k/2; j++) {
+               const double tmp = a[j] + refl*a[k-j];
+               a[k-j] += refl*a[j];
+               a[j] = tmp;
+            }
+            a[k] = refl;
+            err *= 1.0 - refl*refl;
+         }
+         double sum = 0.0;
+         for (k = 0; k <= BENCH_LPC_ORDER; k++)
+            sum += a[k];
+         gain[i] = sum;
+      }
+   });
+
+   double total = 0.0;
+   size_t i;
+   for (i = 0; i < number_of_frames; i++)
+      total += gain[i];
+   return total;
+}
+
+/* Seconds to analyse all utterances; checksum returns the sum of results
+ * in utterance order */
+static double RunBatch(const std::vector<size_t> &utterance_frames, const int &num_threads,
+                       const bool &nested, double *checksum) {
+   std::vector<double> results(utterance_frames.size());
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   ParallelTasks(num_threads, utterance_frames.size(), [&](size_t i) {
+      results[i] = AnalyseUtterance(utterance_frames[i], i, nested ? num_threads : 1);
+   });
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   *checksum = 0.0;
+   size_t i;
+   for (i = 0; i < results.size(); i++)
+      *checksum += results[i];
+   return seconds;
+}
+
+int main(int argc, char *argv[]) {
+
+   const int max_threads = (argc > 1) ? atoi(argv[1]) : 64;
+   const size_t num_utterances = (argc > 2) ? (size_t)atoi(argv[2]) : 256;
+   const bool pin = (argc > 3) ? (atoi(argv[3]) != 0) : false;
+   if (max_threads < 1 || num_utterances < 1) {
+      std::cerr << "usage: SchedulerBenchmark [max_threads] [utterances] [pin]" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   /* 3 of 4 utterances 1-4 s, the rest 15-60 s */
+   std::mt19937 rng(1234);
+   std::uniform_real_distribution<double> short_len(1.0, 4.0);
+   std::uniform_real_distribution<double> long_len(15.0, 60.0);
+   std::vector<size_t> utterance_frames(num_utterances);
+   double total_seconds = 0.0;
+   size_t i;
+   for (i = 0; i < num_utterances; i++) {
+      double seconds = (rng() % 4 == 0) ? long_len(rng) : short_len(rng);
+      utterance_frames[i] = (size_t)(seconds*BENCH_FS/BENCH_FRAME_SHIFT);
+      total_seconds += seconds;
+   }
+   std::cout << num_utterances << " utterances, " << total_seconds << " s of speech, "
+             << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+   ConfigureScheduler(max_threads, pin);
+
+   double serial_checksum;
+   const double serial = RunBatch(utterance_frames, 1, false, &serial_checksum);
+   std::cout << std::setw(8) << "threads" << std::setw(14) << "files (s)" << std::setw(10) << "speedup"
+             << std::setw(16) << "nested (s)" << std::setw(10) << "speedup"
+             << std::setw(12) << "efficiency" << std::endl;
+
+   int num_threads;
+   bool identical = true;
+   for (num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+      double files_checksum, nested_checksum;
+      const double files = (num_threads == 1) ? serial
+            : RunBatch(utterance_frames, num_threads, false, &files_checksum);
+      const double nested = RunBatch(utterance_frames, num_threads, true, &nested_checksum);
+      if (num_threads > 1 && files_checksum != serial_checksum)
+         identical = false;
+      if (nested_checksum != serial_checksum)
+         identical = false;
+      std::cout << std::fixed << std::setprecision(3)
+                << std::setw(8) << num_threads << std::setw(14) << files
+                << std::setw(10) << serial/files << std::setw(16) << nested
+                << std::setw(10) << serial/nested
+                << std::setw(12) << serial/nested/num_threads << std::endl;
+      if (num_threads < max_threads && num_threads*2 > max_threads)
+         num_threads = max_threads/2;
+   }
+   std::cout << (identical ? "Results identical for all thread counts"
+                           : "Error: results differ between thread counts") << std::endl;
+
+   return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
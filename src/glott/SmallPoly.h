@@ -0,0 +1,93 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_SMALLPOLY_H_
+#define SRC_GLOTT_SMALLPOLY_H_
+
+#include <cassert>
+#include <cstddef>
+
+/* Largest LP order handled by the stack-allocated frame routines.
+ * Orders above this fall back to heap-backed gsl::vector temporaries. */
+#define SMALL_POLY_MAX_ORDER 64
+
+/**
+ * Class SmallPoly
+ *
+ * Fixed-capacity polynomial / LSF vector with inline storage, for the
+ * per-frame Lsf2Poly / Poly2Lsf conversions (matrix loops and single
+ * matrix columns) where the vectors are at most a few tens of
+ * coefficients and heap allocation per frame is pure overhead.
+ *
+ * The element interface mirrors gsl::vector (size, is_set, resize,
+ * operator(), set_all, ...), so gsl::vector's templated copy constructor
+ * converts a SmallPoly directly: gsl::vector v(poly);
+ *
+ * author: @ljuvela
+ */
+template <size_t N>
+class SmallPoly {
+ public:
+   SmallPoly() : size_(0) {}
+   explicit SmallPoly(size_t n, bool clear = false) : size_(0) {
+      resize(n);
+      if (clear)
+         set_zero();
+   }
+   template <class oclass>
+   explicit SmallPoly(const oclass &other) : size_(0) {
+      copy(other);
+   }
+
+   template <class oclass>
+   void copy(const oclass &other) {
+      resize(other.size());
+      for (size_t i = 0; i < size_; i++)
+         data_[i] = other[i];
+   }
+
+   bool is_set() const { return size_ > 0; }
+   size_t size() const { return size_; }
+   static size_t capacity() { return N; }
+   void resize(size_t n) { assert(n <= N); size_ = n; }
+
+   double &operator()(size_t i) { assert(i < size_); return data_[i]; }
+   const double &operator()(size_t i) const { assert(i < size_); return data_[i]; }
+   double &operator[](size_t i) { assert(i < size_); return data_[i]; }
+   const double &operator[](size_t i) const { assert(i < size_); return data_[i]; }
+
+   double *data() { return data_; }
+   const double *data() const { return data_; }
+
+   void set_all(double x) {
+      for (size_t i = 0; i < size_; i++)
+         data_[i] = x;
+   }
+   void set_zero() { set_all(0.0); }
+
+   void operator*=(double x) {
+      for (size_t i = 0; i < size_; i++)
+         data_[i] *= x;
+   }
+   void operator/=(double x) { *this *= 1.0/x; }
+
+ private:
+   double data_[N];
+   size_t size_;
+};
+
+/* Default capacity for LP polynomials (order + 1 coefficients) */
+typedef SmallPoly<SMALL_POLY_MAX_ORDER+1> LpPoly;
+
+#endif /* SRC_GLOTT_SMALLPOLY_H_ */
@@ -25,16 +25,27 @@
 #include <gslwrap/vector_double.h>
 #include <vector>
 #include <queue>
+#include <cassert>
 #include "ComplexVector.h"
 #include "definitions.h"
 #include "SpFunctions.h"
+#include "FixedOrderKernels.h"
+#include "WindowCache.h"
 #include "Utils.h"
+#include "NoiseGenerator.h"
 
-/* Initialize global rng */
-#include <gslwrap/random_generator.h>
-#include <gslwrap/random_number_distribution.h>
-gsl::random_generator rand_gen; // TODO: take time as seed, default seed=0
-gsl::gaussian_random global_randn(rand_gen);
+/** Raw data pointer of a gsl::vector for the array-based routines.
+ *  Vectors allocated by gslwrap are contiguous (stride 1).
+ */
+double *VectorData(gsl::vector *vec) {
+   assert(vec->gslobj()->stride == 1);
+   return vec->gslobj()->data;
+}
+
+const double *VectorData(const gsl::vector &vec) {
+   assert(vec.gslobj()->stride == 1);
+   return vec.gslobj()->data;
+}
 
 void Filter(const gsl::vector &b, const gsl::vector &a, const gsl::vector &x, gsl::vector *y) {
 	int i,j;
@@ -54,6 +65,20 @@ void Filter(const gsl::vector &b, const gsl::vector &a, const gsl::vector &x, gs
 	}
 
 	gsl::vector result(x.size(),true);
+
+	/* Fixed-order all-pole or FIR kernel if available */
+	FilterKernel kernel = NULL;
+	if(b.size() == 1 && a.size() > 1)
+		kernel = GetAllPoleFilterKernel(a.size()-1);
+	else if(a.size() == 1 && b.size() > 1)
+		kernel = GetFirFilterKernel(b.size()-1);
+	if(kernel != NULL) {
+		kernel(VectorData(b), VectorData(a), VectorData(x), x.size(), VectorData(&result));
+		for(i=0;i<(int)y->size();i++)
+			(*y)(i) = result(i+order);
+		return;
+	}
+
 	/* Filter */
 	for (i=0;i<(int)x.size();i++){
 		sum = 0.0;
@@ -318,41 +343,9 @@ void InterpolateNearest(const gsl::vector &vector, const size_t interpolated_siz
 }
 
 void ApplyWindowingFunction(const WindowingFunctionType &window_function, gsl::vector *frame) {
-  size_t i;
-  double n = (double)frame->size();
-  switch(window_function) {
-  case HANN :
-    for(i=0;i<frame->size();i++)
-      (*frame)(i) *= 0.5*(1.0-cos(2.0*M_PI*((double)i)/((n)-1.0)));
-    break;
-  case HAMMING :
-    for(i=0;i<frame->size();i++)
-      (*frame)(i) *= 0.53836 - 0.46164*(cos(2.0*M_PI*((double)i)/((n)-1.0)));
-    break;
-  case BLACKMAN :
-    for(i=0;i<frame->size();i++)
-      (*frame)(i) *= 0.42-0.5*cos(2.0*M_PI*((double)i)/((n)-1))+0.08*cos(4.0*M_PI*((double)i)/((n)-1.0));
-    break;
-  case COSINE :
-    for(i=0;i<frame->size();i++)
-      (*frame)(i) *= sqrt(0.5*(1.0-cos(2.0*M_PI*((double)i)/((n)-1.0))));
-    break;
-  case HANNING : // Hann window with non-zero edges
-    for(i=0;i<frame->size();i++)
-      (*frame)(i) *= 0.5*(1.0-cos(2.0*M_PI*((double)i+1.0)/((n+2.0)-1.0)));
-    break;
-  case RECT :
-    break;
-  case NUTTALL :
-    double a0 = 0.3635819;
-    double a1 = 0.4891775;
-    double a2 = 0.1365995;
-    double a3 = 0.0106411;
-    for(i=0;i<frame->size();i++)
-      (*frame)(i) *= a0-a1*cos(2.0*M_PI*(i/((double)(n-1)))) + a2*cos(4.0*M_PI*(i/((double)(n-1)))) - a3*cos(6.0*M_PI*(i/((double)(n-1))));
-    break;
-
-  }
+  if(window_function == RECT)
+    return;
+  ApplyWindow(*GetWindowTable(window_function, frame->size()), frame);
 }
 
 
@@ -361,38 +354,16 @@ void ApplyWindowingFunction(const WindowingFunctionType &window_function, gsl::v
  * args: N is the window size, alpha is the shape parameter
  * return: window in gsl::vector
  *
- * NOTE: Generating the KBD window is computationally expensive and should not be done often
- *       For PSOLA, interpolation of a prototype KBD window is recommended
+ * NOTE: Generating the KBD window is computationally expensive, windows are
+ *       cached per (N, alpha) in WindowCache. For PSOLA, interpolation of a
+ *       prototype KBD window is recommended
  *
  * */
 gsl::vector getKaiserBesselDerivedWindow(const size_t &N, const double &alpha) {
-
-   gsl::vector win(N,true);
-   double sum;
-   size_t k;
-   /*
-   for (k=0; k<N/2+1; k++) { // +1 for odd N
-      sum = 0.0;
-      size_t h;
-      for(h=0;h<k;h++)
-         sum += gsl_sf_bessel_I0(M_PI*alpha*sqrt(1.0-pow(2.0*(double)h/(double)(N-1)-1.0,2.0)));
-      win(k) = sqrt(sum);
-      win(N-k-1) = sqrt(sum);
-   }
-*/
-
-   size_t M = N/2;
-
-   for (k=0; k<M; k++) {
-      sum = 0.0;
-      size_t h;
-      for(h=0;h<k;h++)
-         sum += gsl_sf_bessel_I0(M_PI*alpha*sqrt(1.0-pow(2.0*(double)h/(double)(M-1)-1.0,2.0)));
-      win(k) = sqrt(sum);
-      win(N-k-1) = sqrt(sum);
-   }
-
-   win /= win.max();
+   WindowTablePtr table = GetKbdWindowTable(N, alpha);
+   gsl::vector win(N);
+   for (size_t k=0; k<N; k++)
+      win(k) = (*table)[k];
    return win;
 }
 
@@ -524,6 +495,11 @@ void Autocorrelation(const gsl::vector &frame, const int &order, gsl::vector *r)
 			r->set_all(0.0);
 		}
 	}
+	AutocorrelationKernel kernel = GetAutocorrelationKernel(order);
+	if(kernel != NULL) {
+		kernel(VectorData(frame), frame.size(), VectorData(r));
+		return;
+	}
 	/* Autocorrelation sequence */
 	int i,n;
 	for(i=0; i<order+1;i++) {
@@ -534,6 +510,50 @@ void Autocorrelation(const gsl::vector &frame, const int &order, gsl::vector *r)
 }
 
 
+/**
+ * Levinson-Durbin recursion on raw arrays
+ *
+ * @param r autocorrelation sequence (p+1 values)
+ * @param p prediction order
+ * @param A output polynomial (p+1 values)
+ * @param tmp scratch space (p+1 values)
+ */
+void Levinson(const double *r, const size_t &p, double *A, double *tmp) {
+    LevinsonKernel kernel = GetLevinsonKernel(p);
+    if(kernel != NULL) {
+        kernel(r, A);
+        return;
+    }
+
+    double e, ki;
+    size_t i, j;
+
+    for(i = 0; i <= p; i++) {
+        A[i] = 0.0;
+        tmp[i] = 0.0;
+    }
+
+    /* Levinson-Durbin recursion for finding AR polynomial coefficients */
+    e = r[0];
+    A[0] = 1.0;
+    for(i = 1; i <= p; i++) {
+        ki= 0.0;
+        for(j = 1; j < i; j++) ki+= A[j] * r[i-j];
+        ki= (r[i] - ki) / e;
+        A[i] = ki;
+        for(j = 1; j < i; j++) tmp[j] = A[j] - ki * A[i-j];
+        for(j = 1; j < i; j++) A[j] = tmp[j];
+        e = (1 - ki* ki) * e;
+    }
+    for(i = 0; i <= p; i++)
+        A[i] *= -1.0; /* Invert coefficient signs */
+    A[0] = 1.0;
+    for(i = 0; i <= p; i++) {
+       if(gsl_isnan(A[i]))
+          A[i] = 0.0;
+    }
+}
+
 void Levinson(const gsl::vector &r, gsl::vector *A) {
     size_t p = r.size()-1;
 	if(!A->is_set()) {
@@ -541,33 +561,16 @@ void Levinson(const gsl::vector &r, gsl::vector *A) {
 	} else {
 		if(A->size() != p+1) {
 			A->resize(p+1);
-		} else {
-			A->set_all(0.0);
 		}
 	}
 
-    gsl::vector tmp = gsl::vector(p+1,true);
-    double e, ki;
-    size_t i, j;
-
-    /* Levinson-Durbin recursion for finding AR polynomial coefficients */
-    e = r(0);
-    (*A)(0) = 1.0;
-    for(i = 1; i <= p; i++) {
-        ki= 0.0;
-        for(j = 1; j < i; j++) ki+= (*A)(j) * r(i-j);
-        ki= (r(i) - ki) / e;
-        (*A)(i) = ki;
-        for(j = 1; j < i; j++) tmp(j) = (*A)(j) - ki * (*A)(i-j);
-        for(j = 1; j < i; j++) (*A)(j) = tmp(j);
-        e = (1 - ki* ki) * e;
+    if(p+1 <= SMALL_POLY_MAX_ORDER+1) {
+       double tmp[SMALL_POLY_MAX_ORDER+1];
+       Levinson(VectorData(r), p, VectorData(A), tmp);
+    } else {
+       gsl::vector tmp(p+1);
+       Levinson(VectorData(r), p, VectorData(A), VectorData(&tmp));
     }
-    (*A) *= -1.0; /* Invert coefficient signs */
-    (*A)(0) = 1.0;
-    for(i=0;i<A->size();i++) {
-       if(gsl_isnan((*A)(i)))
-          (*A)(i) = (0.0);
-       } 
 }
 
 
@@ -938,88 +941,131 @@ gsl::vector Conv(const gsl::vector &conv1, const gsl::vector &conv2) {
    return result;
 }
 
+/**
+ * Function ConvInPlace
+ *
+ * Convolve x (length len) in place with h (length hlen).
+ * x must have room for len+hlen-1 values. Summation order matches Conv.
+ */
+static void ConvInPlace(const double *h, const size_t hlen, const size_t len, double *x) {
+   size_t i,j;
+   double sum;
+   for(i=len;i<len+hlen-1;i++)
+      x[i] = 0.0;
+   for(i=len+hlen-1;i-- > 0;) {
+      sum = 0.0;
+      for(j=0;j<=GSL_MIN(i,hlen-1);j++)
+         sum += x[i-j]*h[j];
+      x[i] = sum;
+   }
+}
+
 /**
  * Function lsf2poly
  *
- * Convert LSF to polynomial
+ * Convert LSF to polynomial (raw arrays)
  *
- * @param lsf_matrix
- * @param poly
- * @param index
+ * @param lsf LSF values (l values)
+ * @param l number of LSFs
+ * @param poly output polynomial (l+1 values)
+ * @param work scratch space (3*l+4 values)
  */
-void Lsf2Poly(const gsl::vector &lsf_vec, gsl::vector *poly_vec) {
+void Lsf2Poly(const double *lsf, const size_t &l, double *poly, double *work) {
 
-   int i,l = lsf_vec.size();
-   gsl::vector fi_p, fi_q;
+   size_t i;
+   size_t n_p = (l+1)/2;
+   size_t n_q = l/2;
+   double *P = work;
+   double *Q = work + l + 2;
+   double *fi_p = work + 2*(l + 2);
+   double *fi_q = fi_p + n_p;
 
    /* Create fi_p and fi_q */
-   if(l%2 == 0) {
-      fi_p = gsl::vector(l/2);
-      fi_q = gsl::vector(l/2);
-      for(i=0;i<l;i=i+2) {
-         fi_p(i/2) = lsf_vec(i);
-      }
-      for(i=1;i<l;i=i+2) {
-         fi_q((i-1)/2) = lsf_vec(i);
-      }
-   } else {
-      fi_p = gsl::vector((l+1)/2);
-      for(i=0;i<l;i=i+2) {
-         fi_p(i/2) = lsf_vec(i);
-      }
-      if((l-1)/2 > 0) {
-         fi_q = gsl::vector((l-1)/2);
-         for(i=1;i<l-1;i=i+2) {
-            fi_q((i-1)/2) = lsf_vec(i);
-         }
-      }
-   }
+   for(i=0;i<n_p;i++)
+      fi_p[i] = lsf[2*i];
+   for(i=0;i<n_q;i++)
+      fi_q[i] = lsf[2*i+1];
 
    if (l >= 50) {
-      Leja(&fi_p);
-      Leja(&fi_q);
+      gsl::vector fi(n_p);
+      for(i=0;i<n_p;i++) fi(i) = fi_p[i];
+      Leja(&fi);
+      for(i=0;i<n_p;i++) fi_p[i] = fi(i);
+      fi = gsl::vector(n_q);
+      for(i=0;i<n_q;i++) fi(i) = fi_q[i];
+      Leja(&fi);
+      for(i=0;i<n_q;i++) fi_q[i] = fi(i);
    }
 
    /* Construct vectors P and Q */
-   gsl::vector cp(3);
-   gsl::vector cq(3);
-   cp.set_all(1.0);
-   cq.set_all(1.0);
-   gsl::vector P(1); P(0)=1.0;
-   gsl::vector Q(1); Q(0)=1.0;
-
-   for(i=0;i<(int)fi_p.size();i++) {
-      cp(1) = -2*cos(fi_p(i));
-      P = Conv(P,cp);
+   double cp[3] = {1.0, 1.0, 1.0};
+   double cq[3] = {1.0, 1.0, 1.0};
+   size_t len_p = 1, len_q = 1;
+   P[0] = 1.0;
+   Q[0] = 1.0;
+
+   for(i=0;i<n_p;i++) {
+      cp[1] = -2*cos(fi_p[i]);
+      ConvInPlace(cp, 3, len_p, P);
+      len_p += 2;
    }
-   if((l-1)/2 > 0) {
-      for(i=0;i<(int)fi_q.size();i++) {
-         cq(1) = -2*cos(fi_q(i));
-         Q = Conv(Q,cq);
-      }
+   for(i=0;i<n_q;i++) {
+      cq[1] = -2*cos(fi_q[i]);
+      ConvInPlace(cq, 3, len_q, Q);
+      len_q += 2;
    }
 
    /* Add trivial zeros */
    if(l%2 == 0) {
-      gsl::vector conv(2);
-      conv.set_all(1.0);
-      P = Conv(P,conv);
-      conv(0) = -1.0;
-      Q = Conv(Q,conv);
+      double conv_p[2] = {1.0, 1.0};
+      double conv_q[2] = {-1.0, 1.0};
+      ConvInPlace(conv_p, 2, len_p, P);
+      len_p += 1;
+      ConvInPlace(conv_q, 2, len_q, Q);
+      len_q += 1;
    } else {
-      gsl::vector conv(3,true);
-      conv(0) = -1.0;
-      conv(2) = 1.0;
-      Q = Conv(Q,conv);
+      double conv_q[3] = {-1.0, 0.0, 1.0};
+      ConvInPlace(conv_q, 3, len_q, Q);
+      len_q += 2;
    }
 
    /* Construct polynomial */
-   for(i=1;i<(int)P.size();i++) {
-      (*poly_vec)(P.size()-i-1)  = 0.5*(P(i)+Q(i));
+   for(i=1;i<len_p;i++) {
+      poly[len_p-i-1]  = 0.5*(P[i]+Q[i]);
+   }
+}
+
+void Lsf2Poly(const gsl::vector &lsf_vec, gsl::vector *poly_vec) {
+   size_t l = lsf_vec.size();
+   if(l <= SMALL_POLY_MAX_ORDER) {
+      double work[3*SMALL_POLY_MAX_ORDER+4];
+      Lsf2Poly(VectorData(lsf_vec), l, VectorData(poly_vec), work);
+   } else {
+      gsl::vector work(3*l+4);
+      Lsf2Poly(VectorData(lsf_vec), l, VectorData(poly_vec), VectorData(&work));
    }
 }
 
 
+/**
+ * Column col of lsf_mat as a polynomial (poly_vec has lsf_mat.size1()+1
+ * values). The column is copied to the stack instead of a gsl::vector, for
+ * the per-frame callers (synthesis kernels, post-filter).
+ */
+void Lsf2Poly(const gsl::matrix &lsf_mat, const size_t &col, gsl::vector *poly_vec) {
+   const size_t l = lsf_mat.size1();
+   if(l > SMALL_POLY_MAX_ORDER) {
+      Lsf2Poly(lsf_mat.get_col_vec(col), poly_vec);
+      return;
+   }
+   LpPoly lsf_vec(l);
+   size_t j;
+   for(j=0;j<l;j++)
+      lsf_vec(j) = lsf_mat(j,col);
+   double work[3*SMALL_POLY_MAX_ORDER+4];
+   Lsf2Poly(lsf_vec.data(), l, VectorData(poly_vec), work);
+}
+
 void Lsf2Poly(const gsl::matrix &lsf_mat, gsl::matrix *poly_mat) {
 
    if (poly_mat->isnull()) {
@@ -1028,7 +1074,20 @@ void Lsf2Poly(const gsl::matrix &lsf_mat, gsl::matrix *poly_mat) {
       // TODO: resize (not urgent, lsf_mat is correctly allocated)
    }
 
-   size_t i;
+   size_t i,j;
+   if(lsf_mat.size1() <= SMALL_POLY_MAX_ORDER) {
+      /* Per-frame conversion on the stack */
+      LpPoly lsf_vec(lsf_mat.size1());
+      LpPoly poly_vec;
+      for(i=0;i<lsf_mat.size2();i++) {
+         for(j=0;j<lsf_vec.size();j++)
+            lsf_vec(j) = lsf_mat(j,i);
+         Lsf2Poly(lsf_vec, &poly_vec);
+         for(j=0;j<poly_vec.size();j++)
+            (*poly_mat)(j,i) = poly_vec(j);
+      }
+      return;
+   }
    gsl::vector poly_vec(lsf_mat.size1()+1);
    for(i=0;i<lsf_mat.size2();i++) {
       Lsf2Poly(lsf_mat.get_col_vec(i), &poly_vec);
@@ -1036,23 +1095,34 @@ void Lsf2Poly(const gsl::matrix &lsf_mat, gsl::matrix *poly_mat) {
    }
 }
 
-void Poly2Lsf(const gsl::vector &a, gsl::vector *lsf) {
+/**
+ * Function Poly2Lsf
+ *
+ * Convert polynomial to LSF (raw arrays)
+ *
+ * @param a polynomial coefficients
+ * @param a_size number of coefficients
+ * @param lsf output LSFs
+ * @param lsf_size number of LSFs in output
+ * @param work scratch space (5*a_size+2 values)
+ */
+void Poly2Lsf(const double *a, const size_t &a_size, double *lsf, const size_t &lsf_size, double *work) {
 
    /* by ljuvela, based on traitio and matlab implementation of poly2lsf */
    size_t i,n;
 
    /* Count the number of nonzero elements in "a" */
    n = 0;
-   for(i=0; i<a.size(); i++) {
-      if(a(i) != 0.0) {
+   for(i=0; i<a_size; i++) {
+      if(a[i] != 0.0) {
          n++;
       }
    }
 
    /* In case of only one non-zero element */
    if(n == 1) {
-      for(i=0; i<lsf->size(); i++)
-         (*lsf)(i) = (i+1)*M_PI/(double)(lsf->size()+1);
+      for(i=0; i<lsf_size; i++)
+         lsf[i] = (i+1)*M_PI/(double)(lsf_size+1);
       return;
    }
 
@@ -1063,21 +1133,20 @@ void Poly2Lsf(const gsl::vector &a, gsl::vector *lsf) {
       poly_order_even = false;
    }
 
-   gsl::vector aa = gsl::vector(n+1,true);
-   gsl::vector flip_aa = gsl::vector(n+1,true);
-   gsl::vector p = gsl::vector(n+1,true);
-   gsl::vector q = gsl::vector(n+1,true);
-
-   /* Construct vectors aa=[a 0] and flip_aa=[0 flip(a)] */
-   for(i=0; i<n; i++) {
-      aa(i) = a(i);
-      flip_aa(flip_aa.size()-1-i) = a(i);
-   }
+   double *p = work;
+   double *q = work + n + 1;
+   double *roots = work + 2*(n + 1);
+   double *lsf_double = roots + 2*n;
+   size_t p_size = n+1;
+   size_t q_size = n+1;
 
-   /* Construct vectors p and q */
+   /* Construct vectors p and q from aa=[a 0] and flip_aa=[0 flip(a)] */
+   double aa, flip_aa;
    for(i=0; i<n+1; i++) {
-      p(i) = aa(i) + flip_aa(i);
-      q(i) = aa(i) - flip_aa(i);
+      aa = (i < n) ? a[i] : 0.0;
+      flip_aa = (i > 0) ? a[n-i] : 0.0;
+      p[i] = aa + flip_aa;
+      q[i] = aa - flip_aa;
    }
 
    /* ljuvela: NOTE deconvolution of a with b is the same as filtering with: Filter(a,b) */
@@ -1086,71 +1155,80 @@ void Poly2Lsf(const gsl::vector &a, gsl::vector *lsf) {
       double y;
       /* Deconvolve p with [1 1] */
       y = 0;
-      for(i=0; i<p.size(); i++) {
-         p(i) = p(i)-y;
-         y = p(i);
+      for(i=0; i<p_size; i++) {
+         p[i] = p[i]-y;
+         y = p[i];
       }
-      p(p.size()-1) = 0;
+      p[p_size-1] = 0;
       /* Deconvolve q with [1 -1] */
       y = 0;
-      for(i=0; i<q.size(); i++) {
-         q(i) = q(i)+y;
-         y = q(i);
+      for(i=0; i<q_size; i++) {
+         q[i] = q[i]+y;
+         y = q[i];
       }
-      q(q.size()-1) = 0;
+      q[q_size-1] = 0;
    } else {
       double y;
       /* Deconvolve q with [1 1] */
       y = 0;
-      for(i=0; i<q.size(); i++) {
-         q(i) = q(i)-y;
-         y = q(i);
+      for(i=0; i<q_size; i++) {
+         q[i] = q[i]-y;
+         y = q[i];
       }
       /* Deconvolve q with [1 -1] */
       y = 0;
-      for(i=0; i<q.size(); i++) {
-         q(i) = q(i)+y;
-         y = q(i);
+      for(i=0; i<q_size; i++) {
+         q[i] = q[i]+y;
+         y = q[i];
       }
-      q(q.size()-1) = 0.0;
-      q(q.size()-2) = 0.0;
+      q[q_size-1] = 0.0;
+      q[q_size-2] = 0.0;
    }
 
    /* NOTE deconvolution leaves a trailing zero to vector */
    size_t nroots_p;
    size_t nroots_q;
    if (poly_order_even) {
-       nroots_p = p.size()-2;
-       nroots_q = q.size()-2;
+       nroots_p = p_size-2;
+       nroots_q = q_size-2;
    } else {
-       nroots_p = p.size()-1;
-       nroots_q = q.size()-3;
+       nroots_p = p_size-1;
+       nroots_q = q_size-3;
    }
-   size_t lsf_size = (nroots_p+nroots_q)/2;
+   size_t n_lsf = (nroots_p+nroots_q)/2;
    size_t ind=0;
-   double *lsf_double = new double[lsf_size];
 
-   /* Solve roots of P and convert to angle */
-   ComplexVector r_p;
-//   Roots(p, p.size()-1, &r_p); // ignore last coefficient (zero)
-   Roots(p, nroots_p+1, &r_p); // ignore last coefficient (zero)
+   /* Solve roots of P and convert to angle, ignore last coefficient (zero) */
+   /* Roots are in complex conjugate pairs: [Re=x,Im=y,Re=x,Im=-y] */
+   gsl_poly_complex_workspace *w = gsl_poly_complex_workspace_alloc(nroots_p+1);
+   gsl_poly_complex_solve(p, nroots_p+1, w, roots);
+   gsl_poly_complex_workspace_free(w);
    /* skip odd roots (complex conjugates) */
    for(i=0; i<nroots_p; i+=2, ind++)
-      lsf_double[ind] = r_p.getAng(i);
+      lsf_double[ind] = atan2(roots[2*i+1], roots[2*i]);
 
    /* Solve roots of Q and convert to angle */
-   ComplexVector r_q;
-   //Roots(q, q.size()-1, &r_q); // ignore last coefficient (zero)
-   Roots(q, nroots_q+1, &r_q); // ignore last coefficient (zero)
+   w = gsl_poly_complex_workspace_alloc(nroots_q+1);
+   gsl_poly_complex_solve(q, nroots_q+1, w, roots);
+   gsl_poly_complex_workspace_free(w);
    for(i=0; i<nroots_q; i+=2, ind++)
-      lsf_double[ind] = r_q.getAng(i);
+      lsf_double[ind] = atan2(roots[2*i+1], roots[2*i]);
 
-   /* Sort and copy LSFs to gsl::vector LSF */
-   gsl_sort(lsf_double, 1, (nroots_p+nroots_q)/2);
-   for(i=0; i<lsf_size; i++)
-      (*lsf)(i) = lsf_double[i];
+   /* Sort and copy LSFs to output */
+   gsl_sort(lsf_double, 1, n_lsf);
+   for(i=0; i<GSL_MIN(n_lsf, lsf_size); i++)
+      lsf[i] = lsf_double[i];
+}
 
-   delete[] lsf_double;
+void Poly2Lsf(const gsl::vector &a, gsl::vector *lsf) {
+   size_t a_size = a.size();
+   if(a_size <= SMALL_POLY_MAX_ORDER+1) {
+      double work[5*(SMALL_POLY_MAX_ORDER+1)+2];
+      Poly2Lsf(VectorData(a), a_size, VectorData(lsf), lsf->size(), work);
+   } else {
+      gsl::vector work(5*a_size+2);
+      Poly2Lsf(VectorData(a), a_size, VectorData(lsf), lsf->size(), VectorData(&work));
+   }
 }
 
 void Poly2Lsf(const gsl::matrix &a_mat, gsl::matrix *lsf_mat) {
@@ -1161,7 +1239,20 @@ void Poly2Lsf(const gsl::matrix &a_mat, gsl::matrix *lsf_mat) {
       // TODO: resize (not urgent, lsf_mat is correctly allocated)
    }
 
-   size_t i;
+   size_t i,j;
+   if(a_mat.size1() <= SMALL_POLY_MAX_ORDER+1) {
+      /* Per-frame conversion on the stack */
+      LpPoly a(a_mat.size1());
+      LpPoly lsf(a_mat.size1()-1);
+      for(i=0;i<a_mat.size2();i++) {
+         for(j=0;j<a.size();j++)
+            a(j) = a_mat(j,i);
+         Poly2Lsf(a, &lsf);
+         for(j=0;j<lsf.size();j++)
+            (*lsf_mat)(j,i) = lsf(j);
+      }
+      return;
+   }
    gsl::vector lsf(a_mat.size1()-1);
    for(i=0;i<a_mat.size2();i++) {
       Poly2Lsf(a_mat.get_col_vec(i), &lsf);
@@ -1174,6 +1265,16 @@ void Poly2Lsf(const gsl::matrix &a_mat, gsl::matrix *lsf_mat) {
  *  author: @mairaksi
  */
 void OverlapAdd(const gsl::vector &frame, const size_t center_index, gsl::vector *target) {
+   OverlapAdd(frame, center_index, 0, target->size(), target);
+}
+
+/** Overlap-add into a window of a longer signal: target holds samples
+ *  offset ... offset+target->size()-1 of a signal of signal_length samples.
+ *  Same result as OverlapAdd on the full signal; the window must cover the
+ *  samples the frame lands on.
+ */
+void OverlapAdd(const gsl::vector &frame, const size_t center_index, const size_t &offset,
+                const size_t &signal_length, gsl::vector *target) {
    //center index = frame_index*params.frame_shift , start_ind = frame_index*params.frame_shift - ((int)frame->size())/2 + i;
    // Frame must be HANN windowed beforehand!
 
@@ -1185,11 +1286,11 @@ void OverlapAdd(const gsl::vector &frame, const size_t center_index, gsl::vector
    stop_ind = start_ind+frame.size()-1;
    if(start_ind < 0)
       start_ind = 0;
-   if(stop_ind > (int)target->size())
-      stop_ind = (int)target->size();
+   if(stop_ind > (int)signal_length)
+      stop_ind = (int)signal_length;
 
    for(i=start_ind;i<stop_ind;i++) {
-      (*target)(i) += frame(i-start_ind);
+      (*target)(i-offset) += frame(i-start_ind);
    }
 }
 
@@ -1198,6 +1299,14 @@ void OverlapAdd(const gsl::vector &frame, const size_t center_index, gsl::vector
 gsl::vector GetPulseWsola(const gsl::vector &frame, const int &t0, const double &energy,
       const int &sample_index,  const bool &previous_unvoiced, const bool &pitch_shift,
       gsl::vector *signal) {
+   return GetPulseWsola(frame, t0, energy, sample_index, previous_unvoiced, pitch_shift,
+                        0, signal->size(), signal);
+}
+
+/* As above, signal holds samples offset ... of a signal of signal_length samples */
+gsl::vector GetPulseWsola(const gsl::vector &frame, const int &t0, const double &energy,
+      const int &sample_index,  const bool &previous_unvoiced, const bool &pitch_shift,
+      const size_t &offset, const size_t &signal_length, const gsl::vector *signal) {
 
    gsl::vector pulse(2*t0);
 
@@ -1279,12 +1388,12 @@ gsl::vector GetPulseWsola(const gsl::vector &frame, const int &t0, const double
          stop_ind = start_ind + 2*t0 - 1;
          if(start_ind < 0)
             start_ind = 0;
-         if(stop_ind > (int)signal->size())
-            stop_ind = (int)signal->size();
+         if(stop_ind > (int)signal_length)
+            stop_ind = (int)signal_length;
 
          /* cross-correlation */
          for(i=(size_t)start_ind; i<(size_t)stop_ind; i++) {
-            corr(m_ind) += (*signal)(i) * pulse(i-start_ind);
+            corr(m_ind) += (*signal)(i-offset) * pulse(i-start_ind);
          }
       }
       m_opt = (int)corr.max_index() - M;
@@ -1502,28 +1611,50 @@ gsl::vector_int FindHarmonicPeaks(const gsl::vector &fft_mag, const double &f0,
 }
 
 /** Stabilize a filter polynomial by computing the FFT autocorrelation of
- *  its inverse power spectrum and performing Levinson
+ *  its inverse power spectrum and performing Levinson (raw arrays)
+ *  The order of the filter may change in the process (n_orig -> n_new).
  *  author: @mairaksi
  */
-void StabilizePoly(const int &fft_length, gsl::vector *A) {
+void StabilizePoly(const int &fft_length, const double *A_orig, const size_t &n_orig,
+                   double *A_new, const size_t &n_new) {
 
-   ComplexVector a_fft;
-   FFTRadix2(*A,(size_t)fft_length,&a_fft);
-
-   gsl::vector a_mag = a_fft.getAbs();
    size_t i;
+   size_t nfft = (size_t)fft_length;
+   if(!IsPow2(nfft))
+      nfft = (size_t)NextPow2(nfft);
+
+   /* FFT buffer followed by Levinson scratch */
+   double *data = (double *)calloc(nfft+n_new,sizeof(double));
+   for(i=0;i<n_orig;i++)
+      data[i] = A_orig[i];
+   gsl_fft_real_radix2_transform(data, 1, nfft);
+
+   /* Inverse power spectrum, zero phase */
    double thresh = 0.0001;
-   for(i=0;i<a_mag.size();i++) {
-      a_mag(i) = 1.0/GSL_MAX(pow(a_mag(i),2),thresh);
+   double mag;
+   mag = sqrt(data[0]*data[0]);
+   data[0] = 1.0/GSL_MAX(pow(mag,2),thresh);
+   mag = sqrt(data[nfft/2]*data[nfft/2]);
+   data[nfft/2] = 1.0/GSL_MAX(pow(mag,2),thresh);
+   for(i=1;i<nfft/2;i++) {
+      mag = sqrt(data[i]*data[i] + data[nfft-i]*data[nfft-i]);
+      data[i] = 1.0/GSL_MAX(pow(mag,2),thresh);
+      data[nfft-i] = 0.0;
    }
+   gsl_fft_halfcomplex_radix2_inverse(data, 1, nfft);
 
-   a_fft.setAllImag(0.0);
-   a_fft.setReal(a_mag);
+   /* Autocorrelation is the head of the buffer */
+   Levinson(data, n_new-1, A_new, data+nfft);
 
-   gsl::vector ac(A->size());
-   IFFTRadix2(a_fft, &ac);
+   free(data);
+}
 
-   Levinson(ac, A);
+/** Stabilize a filter polynomial by computing the FFT autocorrelation of
+ *  its inverse power spectrum and performing Levinson
+ *  author: @mairaksi
+ */
+void StabilizePoly(const int &fft_length, gsl::vector *A) {
+   StabilizePoly(fft_length, VectorData(*A), A->size(), VectorData(A), A->size());
 }
 
 /** Stabilize a filter polynomial by computing the FFT autocorrelation of
@@ -1531,24 +1662,7 @@ void StabilizePoly(const int &fft_length, gsl::vector *A) {
  *  This version enables the change or filter order in the process
  */
 void StabilizePoly(const int &fft_length, const gsl::vector &A_orig, gsl::vector *A_new) {
-
-   ComplexVector a_fft;
-   FFTRadix2(A_orig,(size_t)fft_length,&a_fft);
-
-   gsl::vector a_mag = a_fft.getAbs();
-   size_t i;
-   double thresh = 0.0001;
-   for(i=0;i<a_mag.size();i++) {
-      a_mag(i) = 1.0/GSL_MAX(pow(a_mag(i),2),thresh);
-   }
-
-   a_fft.setAllImag(0.0);
-   a_fft.setReal(a_mag);
-
-   gsl::vector ac(A_new->size());
-   IFFTRadix2(a_fft, &ac);
-
-   Levinson(ac, A_new);
+   StabilizePoly(fft_length, VectorData(A_orig), A_orig.size(), VectorData(A_new), A_new->size());
 }
 
 gsl::vector_int LinspaceInt(const int &start_val, const int &hop_val,const int &end_val) {
@@ -1695,6 +1809,21 @@ void MovingAverageFilter(const size_t &filterlen, gsl::matrix *mat) {
 }
 
 
+/* Frame from a window of a longer signal: signal holds samples offset ...
+ * of a signal of signal_length samples, samples outside [0, signal_length)
+ * are zero */
+void GetFrame(const gsl::vector &signal, const size_t &offset, const size_t &signal_length,
+              const int &frame_index, const int &frame_shift, gsl::vector *frame) {
+	int i, ind;
+	for(i=0; i<(int)frame->size(); i++) {
+		ind = frame_index*frame_shift - ((int)frame->size())/2 + i;
+		if (ind >= 0 && ind < (int)signal_length)
+			(*frame)(i) = signal(ind - offset);
+		else
+			(*frame)(i) = 0.0;
+	}
+}
+
 int GetFrame(const gsl::vector &signal, const int &frame_index, const int &frame_shift,gsl::vector *frame, gsl::vector *pre_frame) {
 	int i, ind;
 	/* Get samples to frame */
@@ -1703,6 +1832,8 @@ int GetFrame(const gsl::vector &signal, const int &frame_index, const int &frame
 			ind = frame_index*frame_shift - ((int)frame->size())/2 + i; // SPTK compatible, ljuvela
 			if (ind >= 0 && ind < (int)signal.size()){
 				(*frame)(i) = signal(ind);
+			} else {
+				(*frame)(i) = 0.0; /* zero-pad, do not keep the previous frame */
 			}
 		}
 	} else {
@@ -1715,7 +1846,8 @@ int GetFrame(const gsl::vector &signal, const int &frame_index, const int &frame
 			ind = frame_index*frame_shift - (int)frame->size()/2+ i - pre_frame->size(); // SPTK compatible, ljuvela
 			if(ind >= 0 && ind < (int)signal.size())
 				(*pre_frame)(i) = signal(ind);
-
+			else
+				(*pre_frame)(i) = 0.0;
   		}
 	}
 
@@ -2052,13 +2184,10 @@ void Lp2Walp(const gsl::vector &a_orig,const double &alpha, gsl::vector *a_w) {
 
 /**
  * Function that randomizes phase of gsl::vector, while keeping the amplitude
+ * The phases are taken from noise stream (seed, index), e.g. index = frame
  *
  **/
-void RandomizePhase(gsl::vector *frame) {
-
-   /* Noise generation */
-//   gsl::random_generator rand_gen;
-//   gsl::gaussian_random random_gauss_gen(rand_gen);
+void RandomizePhase(const int &seed, const size_t &index, gsl::vector *frame) {
 
    /* FFT of frame */
    size_t NFFT = NextPow2(frame->size());
@@ -2073,17 +2202,19 @@ void RandomizePhase(gsl::vector *frame) {
    double phi;
    size_t i;
    /* Set phase to random */
+   gsl::vector noise(frame_fft.getSize());
+   FillGaussianNoise(seed, NOISE_STREAM_PHASE, index, &noise);
 
    for (i=0; i<frame_fft.getSize(); i++) {
       // TODO: phase should be sampled from uniform distribution [0, 2pi] (not normal dist)
-      phi = global_randn.get();
+      phi = noise(i);
       frame_fft.setReal(i, fft_mag(i)*cos(phi));
       frame_fft.setImag(i, fft_mag(i)*sin(phi));
    }
 
    /* Random shift  */
    /*
-   double x = global_randn.get();
+   double x = noise(0);
    for (i=0; i<frame_fft.getSize(); i++) {
       phi = fft_phase(i) + M_PI*x;
       frame_fft.setReal(i, fft_mag(i)*cos(phi));
@@ -2102,27 +2233,43 @@ void RandomizePhase(gsl::vector *frame) {
  * Use positive alpha for WLP -> LP and negative for LP -> WLP
  *
  */
-void WarpLP(const gsl::vector &a_orig, double alpha, gsl::vector *a_w) {
+void WarpLP(const double *a_orig, const size_t &n_orig, double alpha,
+            double *a_w, const size_t &n_w, double *a_prev) {
 
    int i,j,m;
-   int N = a_w->size()-1;
-   int M = a_orig.size()-1;
-   gsl::vector a_prev(N+1,true);
+   int N = n_w-1;
+   int M = n_orig-1;
+
+   for(j=0;j<N+1;j++)
+      a_prev[j] = 0.0;
 
    for(i=M;i>=0;i--) {
       // For m=0:
-      (*a_w)(0) = a_orig(i) + alpha*a_prev(0);
+      a_w[0] = a_orig[i] + alpha*a_prev[0];
       // For m=1:
-      (*a_w)(1) = (1-alpha*alpha)*a_prev(0) + alpha*a_prev(1);
+      a_w[1] = (1-alpha*alpha)*a_prev[0] + alpha*a_prev[1];
       // For m=2:N
       for(m=2;m<N+1;m++) {
-         (*a_w)(m) = a_prev(m-1) + alpha*(a_prev(m)-(*a_w)(m-1));
+         a_w[m] = a_prev[m-1] + alpha*(a_prev[m]-a_w[m-1]);
       }
       for(j=0;j<N+1;j++) {
-         a_prev(j) = (*a_w)(j);
+         a_prev[j] = a_w[j];
       }
    }
-   (*a_w) *= 1.0/(*a_w)(0);
+   double scale = 1.0/a_w[0];
+   for(j=0;j<N+1;j++)
+      a_w[j] *= scale;
+}
+
+void WarpLP(const gsl::vector &a_orig, double alpha, gsl::vector *a_w) {
+   size_t n_w = a_w->size();
+   if(n_w <= SMALL_POLY_MAX_ORDER+1) {
+      double a_prev[SMALL_POLY_MAX_ORDER+1];
+      WarpLP(VectorData(a_orig), a_orig.size(), alpha, VectorData(a_w), n_w, a_prev);
+   } else {
+      gsl::vector a_prev(n_w);
+      WarpLP(VectorData(a_orig), a_orig.size(), alpha, VectorData(a_w), n_w, VectorData(&a_prev));
+   }
 }
 
 void Spectrum2MinPhase(ComplexVector *sp) {
@@ -17,6 +17,10 @@
 #include <vector>
 #include "ComplexVector.h"
 #include "definitions.h"
+#include "SmallPoly.h"
+
+double *VectorData(gsl::vector *vec);
+const double *VectorData(const gsl::vector &vec);
 
 void Interpolate(const gsl::vector &vector, gsl::vector *i_vector);
 void InterpolateNearest(const gsl::vector &vector, const size_t interpolated_size, gsl::vector *i_vector);
@@ -36,10 +40,14 @@ void UpperLowerEnvelope(const gsl::vector &fft_mag, const double &f0, const int
 void ApplyPsolaWindow(const WindowingFunctionType &window_function, const double &t0_previous, const double &t0_next, gsl::vector *frame);
 void Autocorrelation(const gsl::vector &frame, const int &order, gsl::vector *r);
 void Levinson(const gsl::vector &r, gsl::vector *A);
+void Levinson(const double *r, const size_t &p, double *A, double *tmp);
 void Lsf2Poly(const gsl::vector &lsf_vec, gsl::vector *poly_vec);
 void Lsf2Poly(const gsl::matrix &lsf_mat, gsl::matrix *poly_mat);
+void Lsf2Poly(const gsl::matrix &lsf_mat, const size_t &col, gsl::vector *poly_vec);
+void Lsf2Poly(const double *lsf, const size_t &l, double *poly, double *work);
 void Poly2Lsf(const gsl::vector &a, gsl::vector *lsf);
 void Poly2Lsf(const gsl::matrix &a_mat, gsl::matrix *lsf_mat);
+void Poly2Lsf(const double *a, const size_t &a_size, double *lsf, const size_t &lsf_size, double *work);
 void Roots(const gsl::vector &x, ComplexVector *r);
 void Roots(const gsl::vector &x, const size_t ncoef, ComplexVector *r);
 void AllPassDelay(const double &lambda, gsl::vector *signal);
@@ -52,9 +60,14 @@ void IFFTRadix2(const ComplexVector &X, gsl::vector *x);
 void WFilter(const gsl::vector &A, const gsl::vector &B,const gsl::vector &signal,const double &lambda, gsl::vector *result);
 void WarpingAlphas2Sigmas(const gsl::vector &alp, const double &lambda, gsl::vector *sigm);
 void OverlapAdd(const gsl::vector &frame, const size_t center_index, gsl::vector *target);
+void OverlapAdd(const gsl::vector &frame, const size_t center_index, const size_t &offset,
+                const size_t &signal_length, gsl::vector *target);
 gsl::vector GetPulseWsola(const gsl::vector &frame, const int &t0, const double &energy,
       const int &sample_index,  const bool &previous_unvoiced, const bool &pitch_shift,
       gsl::vector *signal);
+gsl::vector GetPulseWsola(const gsl::vector &frame, const int &t0, const double &energy,
+      const int &sample_index,  const bool &previous_unvoiced, const bool &pitch_shift,
+      const size_t &offset, const size_t &signal_length, const gsl::vector *signal);
 double getMean(const gsl::vector &vec);
 double getMeanF0(const gsl::vector &fundf);
 double getEnergy(const gsl::vector &vec);
@@ -66,10 +79,14 @@ int FindPeaks(const gsl::vector &vec, const double &threshold, gsl::vector_int *
 gsl::vector_int FindHarmonicPeaks(const gsl::vector &fft_mag, const double &f0, const int &fs);
 void StabilizePoly(const int &fft_length, gsl::vector *A);
 void StabilizePoly(const int &fft_length, const gsl::vector &A_orig, gsl::vector *A_new);
+void StabilizePoly(const int &fft_length, const double *A_orig, const size_t &n_orig,
+                   double *A_new, const size_t &n_new);
 gsl::vector_int LinspaceInt(const int &start_val, const int &hop_val,const int &end_val);
 void Linear2Erb(const gsl::vector &linvec, const int &fs, gsl::vector *erbvec);
 void Erb2Linear(const gsl::vector &vector_erb, const int &fs,  gsl::vector *vector_lin);
 int GetFrame(const gsl::vector &signal, const int &frame_index, const int &frame_shift,gsl::vector *frame, gsl::vector *pre_frame);
+void GetFrame(const gsl::vector &signal, const size_t &offset, const size_t &signal_length,
+              const int &frame_index, const int &frame_shift, gsl::vector *frame);
 double GetFilteringGain(const gsl::vector &b, const gsl::vector &a,
                         const gsl::vector &signal, const double &target_gain_db, const size_t &center_index,
                         const size_t &frame_length, const double &warping_lambda);
@@ -84,9 +101,29 @@ void MovingAverageFilter(const size_t &filterlen, gsl::vector *x);
 void MovingAverageFilter(const size_t &filterlen, gsl::matrix *mat);
 void Leja(gsl::vector *lsfvec);
 void Lp2Walp(const gsl::vector &a_orig,const double &alpha, gsl::vector *a_w);
-void RandomizePhase(gsl::vector *frame);
+void RandomizePhase(const int &seed, const size_t &index, gsl::vector *frame);
 void WarpLP(const gsl::vector &a_orig, double alpha, gsl::vector *a_w);
+void WarpLP(const double *a_orig, const size_t &n_orig, double alpha,
+            double *a_w, const size_t &n_w, double *a_prev);
 void FastAutocorr(const gsl::vector &x, gsl::vector *ac);
 void Spectrum2MinPhase(ComplexVector *sp);
 
+/* SmallPoly<N> overloads for the per-frame loops over LSF / polynomial
+ * matrices: temporaries live on the stack, sized by N */
+
+template <size_t N>
+void Lsf2Poly(const SmallPoly<N> &lsf_vec, SmallPoly<N> *poly_vec) {
+   double work[3*N+4];
+   poly_vec->resize(lsf_vec.size()+1);
+   Lsf2Poly(lsf_vec.data(), lsf_vec.size(), poly_vec->data(), work);
+}
+
+template <size_t N>
+void Poly2Lsf(const SmallPoly<N> &a, SmallPoly<N> *lsf) {
+   double work[5*N+2];
+   if(!lsf->is_set())
+      lsf->resize(a.size()-1);
+   Poly2Lsf(a.data(), a.size(), lsf->data(), lsf->size(), work);
+}
+
 #endif /* SRC_GLOTT_SPFUNCTIONS_H_ */
@@ -0,0 +1,479 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gslwrap/vector_double.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "definitions.h"
+#include "SpFunctions.h"
+#include "SynthesisFunctions.h"
+#include "StreamingSynthesis.h"
+
+/* Pipeline, run after every push:
+ *
+ *  1. Features of frame i are final (postfilter, smoothing, LSF
+ *     stabilisation) once the smoothing windows around it are complete.
+ *  2. Pulses are generated while the frame of the next pulse is final.
+ *     A pulse reaches at most pulse_reach_ samples around its center, so
+ *     the excitation before (next pulse - pulse_reach_) is final.
+ *  3. Voiced frames are filtered in order once their excitation frame is
+ *     final, unvoiced frames once their features are final. The two are
+ *     kept apart and summed on output, as FftFilterExcitation and
+ *     GenerateUnvoicedSignal do.
+ *  4. Output before the first sample of the next unprocessed frame is
+ *     final.
+ */
+
+void StreamingSynthesis::SignalWindow::Reset() {
+  data = gsl::vector(1024, true);
+  offset = 0;
+}
+
+/* Cover samples up to end-1; new samples are zero */
+void StreamingSynthesis::SignalWindow::Extend(const size_t &end) {
+  if (end <= offset + data.size())
+    return;
+  gsl::vector grown(std::max(end - offset, 2 * data.size()), true);
+  size_t i;
+  for (i = 0; i < data.size(); i++)
+    grown(i) = data(i);
+  data = grown;
+}
+
+/* Drop samples before begin. The window is compacted only when more than
+ * half of it can go, so every sample is moved at most a few times. */
+void StreamingSynthesis::SignalWindow::Discard(const size_t &begin) {
+  if (begin <= offset)
+    return;
+  size_t n = std::min(begin - offset, data.size());
+  if (2 * n < data.size())
+    return;
+  size_t i;
+  for (i = n; i < data.size(); i++)
+    data(i - n) = data(i);
+  for (i = data.size() - n; i < data.size(); i++)
+    data(i) = 0.0;
+  offset += n;
+}
+
+StreamingSynthesis::StreamingSynthesis() : open_(false) {}
+
+StreamingSynthesis::~StreamingSynthesis() {}
+
+int StreamingSynthesis::Open(const Param &params, const size_t &number_of_frames) {
+  if (params.noise_gated_synthesis) {
+    std::cerr << "Error: streaming synthesis does not support NOISE_GATED_SYNTHESIS"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (params.excitation_method == EXTERNAL_EXCITATION || params.use_external_excitation) {
+    std::cerr << "Error: streaming synthesis does not support external excitation"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (number_of_frames < 2) {
+    std::cerr << "Error: streaming synthesis needs at least 2 frames" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  params_ = params;
+  params_.num_threads = 1;
+  params_.number_of_frames = (int)number_of_frames;
+  params_.signal_length = rint(params_.number_of_frames * params_.frame_shift / params_.speed_scale);
+  number_of_frames_ = number_of_frames;
+  signal_length_ = params_.signal_length;
+  hop_ = rint(params_.frame_shift / params_.speed_scale);
+
+  const size_t N = number_of_frames;
+  data_.fundf = gsl::vector(N, true);
+  data_.frame_energy = gsl::vector(N, true);
+  data_.Rd_opt = gsl::vector(N, true);
+  data_.lsf_vocal_tract = gsl::matrix(params_.lpc_order_vt, N, true);
+  data_.lsf_glot = gsl::matrix(params_.lpc_order_glot, N, true);
+  data_.hnr_glot = gsl::matrix(params_.hnr_order, N, true);
+  if (params_.excitation_method == PULSES_AS_FEATURES_EXCITATION)
+    data_.excitation_pulses = gsl::matrix(params_.paf_pulse_length, N, true);
+
+  /* Smoothing of frame i reads frames up to i + len-1-len/2 */
+  lookahead_ = 0;
+  if (params_.use_trajectory_smoothing) {
+    const int lens[] = {params_.lsf_vt_smooth_len, params_.lsf_glot_smooth_len,
+                        params_.gain_smooth_len, params_.hnr_smooth_len};
+    for (size_t k = 0; k < 4; k++) {
+      if (lens[k] > 2)
+        lookahead_ = std::max(lookahead_, (size_t)(lens[k] - 1 - lens[k] / 2));
+    }
+    unsmoothed_.frame_energy = gsl::vector(N, true);
+    unsmoothed_.lsf_vocal_tract = gsl::matrix(params_.lpc_order_vt, N, true);
+    unsmoothed_.lsf_glot = gsl::matrix(params_.lpc_order_glot, N, true);
+    unsmoothed_.hnr_glot = gsl::matrix(params_.hnr_order, N, true);
+  }
+
+  /* Longest pulse period: SINGLE_PULSE periods are not limited by the
+   * pulse length, so F0 is checked against F0_MIN in PushFrames */
+  size_t max_period = params_.paf_pulse_length;
+  if (params_.excitation_method == SINGLE_PULSE_EXCITATION)
+    max_period = ceil(params_.fs / params_.f0_min);
+  pulse_reach_ = std::max(max_period, (size_t)std::max(params_.paf_pulse_length,
+                                                       2 * params_.frame_shift))
+                 + params_.frame_shift + 2;
+
+  generator_.reset(new ExcitationGenerator(params_));
+  if (!generator_->Ready()) {
+    open_ = false;
+    return EXIT_FAILURE;
+  }
+  if (params_.compute_precision == COMPUTE_FLOAT) {
+    voiced_float_.reset(new VoicedFilterKernel<float>(params_));
+    unvoiced_float_.reset(new UnvoicedNoiseKernel<float>(params_));
+  } else {
+    voiced_double_.reset(new VoicedFilterKernel<double>(params_));
+    unvoiced_double_.reset(new UnvoicedNoiseKernel<double>(params_));
+  }
+  unvoiced_enabled_ = UnvoicedNoiseKernel<double>::Enabled(params_);
+
+  excitation_.Reset();
+  voiced_.Reset();
+  unvoiced_.Reset();
+  frame_ = gsl::vector(params_.frame_length);
+  noise_frame_ = gsl::vector(params_.frame_length_unvoiced);
+
+  frames_received_ = 0;
+  frames_final_ = 0;
+  next_voiced_ = 0;
+  next_unvoiced_ = 0;
+  excitation_checked_ = 0;
+  samples_pulled_ = 0;
+  lsf_fixes_vt_ = 0;
+  lsf_fixes_glot_ = 0;
+  nan_inf_count_ = 0;
+  open_ = true;
+  return EXIT_SUCCESS;
+}
+
+static void CopyColumns(const gsl::matrix &src, const size_t &target_begin,
+                        gsl::matrix *target) {
+  size_t j;
+  for (j = 0; j < src.get_cols(); j++)
+    target->set_col_vec(target_begin + j, src.get_col_vec(j));
+}
+
+int StreamingSynthesis::PushFrames(const SynthesisData &frames) {
+  if (!open_) {
+    std::cerr << "Error: streaming synthesis is not open" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const size_t n = frames.fundf.size();
+  const size_t begin = frames_received_;
+  const size_t end = begin + n;
+  size_t i;
+  if (end > number_of_frames_) {
+    std::cerr << "Error: more frames pushed than the " << number_of_frames_
+              << " given at open" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (frames.frame_energy.size() != n || frames.lsf_vocal_tract.get_cols() != n ||
+      frames.lsf_vocal_tract.get_rows() != (size_t)params_.lpc_order_vt) {
+    std::cerr << "Error: number of frames or LSF order of pushed features do not match"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ((params_.excitation_method == PULSES_AS_FEATURES_EXCITATION &&
+       (!frames.excitation_pulses.is_set() || frames.excitation_pulses.get_cols() != n)) ||
+      (params_.use_generic_envelope &&
+       (!frames.spectrum.is_set() || frames.spectrum.get_cols() != n))) {
+    std::cerr << "Error: pushed frames have no excitation pulses or spectrum" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < n; i++) {
+    if (frames.fundf(i) < 0.0 || frames.fundf(i) >= params_.fs) {
+      std::cerr << "Error: F0 values must be in [0, fs)" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (params_.excitation_method == SINGLE_PULSE_EXCITATION &&
+        frames.fundf(i) > 0.0 && frames.fundf(i) < params_.f0_min) {
+      std::cerr << "Error: streaming synthesis needs voiced F0 >= F0_MIN" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    data_.fundf(begin + i) = frames.fundf(i);
+    data_.frame_energy(begin + i) = frames.frame_energy(i);
+    if (frames.Rd_opt.is_set())
+      data_.Rd_opt(begin + i) = frames.Rd_opt(i);
+  }
+  CopyColumns(frames.lsf_vocal_tract, begin, &(data_.lsf_vocal_tract));
+  if (frames.lsf_glot.is_set() && frames.lsf_glot.get_rows() == data_.lsf_glot.get_rows())
+    CopyColumns(frames.lsf_glot, begin, &(data_.lsf_glot));
+  if (frames.hnr_glot.is_set() && frames.hnr_glot.get_rows() == data_.hnr_glot.get_rows())
+    CopyColumns(frames.hnr_glot, begin, &(data_.hnr_glot));
+  if (params_.excitation_method == PULSES_AS_FEATURES_EXCITATION)
+    CopyColumns(frames.excitation_pulses, begin, &(data_.excitation_pulses));
+  if (params_.use_generic_envelope) {
+    if (!data_.spectrum.is_set())
+      data_.spectrum = gsl::matrix(frames.spectrum.get_rows(), number_of_frames_, true);
+    CopyColumns(frames.spectrum, begin, &(data_.spectrum));
+  }
+
+  /* Postfiltering is frame-wise, smoothing comes after it */
+  if (params_.use_postfiltering)
+    PostFilter(params_.postfilter_coefficient, params_.fs, data_.fundf, begin, end,
+               &(data_.lsf_vocal_tract));
+  if (params_.use_postfiltering || params_.use_spectral_matching)
+    PostFilter(params_.postfilter_coefficient_glot, params_.fs, data_.fundf, begin, end,
+               &(data_.lsf_glot));
+
+  if (params_.use_trajectory_smoothing) {
+    for (i = begin; i < end; i++) {
+      unsmoothed_.frame_energy(i) = data_.frame_energy(i);
+      unsmoothed_.lsf_vocal_tract.set_col_vec(i, data_.lsf_vocal_tract.get_col_vec(i));
+      unsmoothed_.lsf_glot.set_col_vec(i, data_.lsf_glot.get_col_vec(i));
+      unsmoothed_.hnr_glot.set_col_vec(i, data_.hnr_glot.get_col_vec(i));
+    }
+  }
+
+  frames_received_ = end;
+  Process();
+  return EXIT_SUCCESS;
+}
+
+/* Frame i of MovingAverageFilter along the rows of x: the mean of a
+ * filterlen buffer, frames near the ends keep their value */
+static bool SmoothingWindow(const size_t &filterlen, const size_t &i,
+                            const size_t &number_of_frames) {
+  return filterlen > 2 && i >= filterlen / 2 && i + filterlen / 2 < number_of_frames;
+}
+
+static void SmoothColumn(const gsl::matrix &x, const size_t &filterlen,
+                         const size_t &i, gsl::matrix *y) {
+  if (!SmoothingWindow(filterlen, i, x.get_cols()))
+    return;
+  gsl::vector val_buffer(filterlen);
+  size_t n, j;
+  for (n = 0; n < x.get_rows(); n++) {
+    for (j = 0; j < filterlen; j++)
+      val_buffer(j) = x(n, i - filterlen / 2 + j);
+    (*y)(n, i) = val_buffer.mean();
+  }
+}
+
+void StreamingSynthesis::SmoothFrame(const size_t &i) {
+  const size_t gain_len = params_.gain_smooth_len;
+  if (SmoothingWindow(gain_len, i, number_of_frames_)) {
+    gsl::vector val_buffer(gain_len);
+    size_t j;
+    for (j = 0; j < gain_len; j++)
+      val_buffer(j) = unsmoothed_.frame_energy(i - gain_len / 2 + j);
+    data_.frame_energy(i) = val_buffer.mean();
+  }
+  SmoothColumn(unsmoothed_.lsf_vocal_tract, params_.lsf_vt_smooth_len, i,
+               &(data_.lsf_vocal_tract));
+  SmoothColumn(unsmoothed_.lsf_glot, params_.lsf_glot_smooth_len, i, &(data_.lsf_glot));
+  SmoothColumn(unsmoothed_.hnr_glot, params_.hnr_smooth_len, i, &(data_.hnr_glot));
+}
+
+void StreamingSynthesis::FinalizeFeatures() {
+  gsl::vector lsf_vec;
+  while (frames_final_ < frames_received_ &&
+         (frames_received_ == number_of_frames_ ||
+          frames_final_ + lookahead_ < frames_received_)) {
+    const size_t i = frames_final_;
+    if (params_.use_trajectory_smoothing)
+      SmoothFrame(i);
+
+    /* Check LSF stability and fix if needed */
+    lsf_vec = data_.lsf_vocal_tract.get_col_vec(i);
+    if (StabilizeLsf(&lsf_vec) > 0)
+      lsf_fixes_vt_++;
+    data_.lsf_vocal_tract.set_col_vec(i, lsf_vec);
+    if (params_.use_spectral_matching) {
+      lsf_vec = data_.lsf_glot.get_col_vec(i);
+      if (StabilizeLsf(&lsf_vec) > 0)
+        lsf_fixes_glot_++;
+      data_.lsf_glot.set_col_vec(i, lsf_vec);
+    }
+    frames_final_++;
+  }
+}
+
+bool StreamingSynthesis::FilterVoiced(const size_t &frame_index, gsl::vector *frame) {
+  if (voiced_float_)
+    return voiced_float_->Filter(data_, frame_index, excitation_.data,
+                                 excitation_.offset, frame);
+  return voiced_double_->Filter(data_, frame_index, excitation_.data,
+                                excitation_.offset, frame);
+}
+
+bool StreamingSynthesis::GenerateUnvoiced(const size_t &frame_index, gsl::vector *frame) {
+  if (unvoiced_float_)
+    return unvoiced_float_->Generate(data_, frame_index, frame);
+  return unvoiced_double_->Generate(data_, frame_index, frame);
+}
+
+/* First sample of frame_index written by OverlapAdd, clipped to [0, L] */
+static size_t FrameStart(const size_t &frame_index, const int &hop,
+                         const size_t &frame_length, const size_t &signal_length) {
+  double start = (double)(frame_index * hop) - round(frame_length / 2.0);
+  return (size_t)GSL_MIN(GSL_MAX(start, 0.0), (double)signal_length);
+}
+
+size_t StreamingSynthesis::OutputReady() const {
+  size_t ready = signal_length_;
+  if (next_voiced_ < number_of_frames_)
+    ready = std::min(ready, FrameStart(next_voiced_, hop_, params_.frame_length,
+                                       signal_length_));
+  if (unvoiced_enabled_ && next_unvoiced_ < number_of_frames_)
+    ready = std::min(ready, FrameStart(next_unvoiced_, hop_, params_.frame_length_unvoiced,
+                                       signal_length_));
+  return ready;
+}
+
+void StreamingSynthesis::Process() {
+  size_t i;
+  FinalizeFeatures();
+
+  /* Excitation */
+  while (!generator_->Finished() &&
+         (frames_final_ == number_of_frames_ || generator_->FrameIndex() < frames_final_)) {
+    excitation_.Extend(std::min(signal_length_, generator_->SampleIndex() + pulse_reach_));
+    generator_->Step(data_, excitation_.offset, &(excitation_.data));
+  }
+  size_t excitation_final = signal_length_;
+  if (!generator_->Finished())
+    excitation_final = generator_->SampleIndex() > pulse_reach_ ?
+                       generator_->SampleIndex() - pulse_reach_ : 0;
+  excitation_.Extend(excitation_final);
+  for (i = excitation_checked_; i < excitation_final; i++) {
+    double &x = excitation_.data(i - excitation_.offset);
+    if (std::isnan(x) || std::isinf(x)) {
+      x = 0.0;
+      nan_inf_count_++;
+    }
+  }
+  excitation_checked_ = excitation_final;
+
+  /* Voiced frames, in order (GetFrame reads frame_index*hop - len/2 ...) */
+  const int frame_length = params_.frame_length;
+  while (next_voiced_ < frames_final_) {
+    int frame_end = (int)next_voiced_ * hop_ - frame_length / 2 + frame_length;
+    if ((size_t)GSL_MAX(frame_end, 0) > excitation_final && excitation_final < signal_length_)
+      break;
+    if (FilterVoiced(next_voiced_, &frame_)) {
+      voiced_.Extend(std::min(signal_length_, (size_t)GSL_MAX(frame_end, 0) + 1));
+      OverlapAdd(frame_, next_voiced_ * hop_, voiced_.offset, signal_length_,
+                 &(voiced_.data));
+    }
+    next_voiced_++;
+  }
+
+  /* Unvoiced frames need only their features */
+  if (unvoiced_enabled_) {
+    while (next_unvoiced_ < frames_final_) {
+      if (GenerateUnvoiced(next_unvoiced_, &noise_frame_)) {
+        size_t stop = next_unvoiced_ * hop_ + noise_frame_.size();
+        unvoiced_.Extend(std::min(signal_length_, stop));
+        OverlapAdd(noise_frame_, next_unvoiced_ * hop_, unvoiced_.offset, signal_length_,
+                   &(unvoiced_.data));
+      }
+      next_unvoiced_++;
+    }
+  }
+
+  /* Excitation still needed: WS-PSOLA around the next pulse and the
+   * frames not yet filtered */
+  size_t needed = excitation_final;
+  if (next_voiced_ < number_of_frames_) {
+    int frame_begin = (int)next_voiced_ * hop_ - frame_length / 2;
+    needed = std::min(needed, (size_t)GSL_MAX(frame_begin, 0));
+  }
+  excitation_.Discard(needed);
+}
+
+size_t StreamingSynthesis::Pull(gsl::vector *block) {
+  if (!open_)
+    return 0;
+  const size_t ready = OutputReady();
+  if (ready <= samples_pulled_)
+    return 0;
+  const size_t n = ready - samples_pulled_;
+  voiced_.Extend(ready);
+  unvoiced_.Extend(ready);
+  *block = gsl::vector(n);
+  size_t i;
+  for (i = 0; i < n; i++) {
+    /* signal += uv_signal */
+    (*block)(i) = voiced_.data(samples_pulled_ + i - voiced_.offset) +
+                  unvoiced_.data(samples_pulled_ + i - unvoiced_.offset);
+  }
+  samples_pulled_ = ready;
+  voiced_.Discard(samples_pulled_);
+  unvoiced_.Discard(samples_pulled_);
+  return n;
+}
+
+int StreamingSynthesis::Finish() {
+  if (!open_)
+    return EXIT_FAILURE;
+  if (frames_received_ != number_of_frames_) {
+    std::cerr << "Error: streaming synthesis expected " << number_of_frames_
+              << " frames, got " << frames_received_ << std::endl;
+    return EXIT_FAILURE;
+  }
+  Process();
+  if (lsf_fixes_vt_ > 0)
+    std::cout << "Warning: fixed LSFs in " << lsf_fixes_vt_ << " frames" << std::endl;
+  if (lsf_fixes_glot_ > 0)
+    std::cout << "Warning: fixed LSFs in " << lsf_fixes_glot_ << " frames" << std::endl;
+  if (nan_inf_count_ > 0)
+    std::cerr << "Warning: " << nan_inf_count_
+              << " NaN/Inf excitation values found, replaced with zeros" << std::endl;
+  return EXIT_SUCCESS;
+}
+
+size_t StreamingSynthesis::LatencySamples() const {
+  if (!open_)
+    return 0;
+  return (lookahead_ + 1) * hop_ + pulse_reach_ + params_.frame_length;
+}
+
+void GetSynthesisFrames(const SynthesisData &data, const size_t &begin,
+                        const size_t &end, SynthesisData *frames) {
+  const size_t n = end - begin;
+  size_t i;
+  frames->fundf = gsl::vector(n);
+  frames->frame_energy = gsl::vector(n);
+  frames->Rd_opt = gsl::vector(n, true);
+  for (i = 0; i < n; i++) {
+    frames->fundf(i) = data.fundf(begin + i);
+    frames->frame_energy(i) = data.frame_energy(begin + i);
+    if (data.Rd_opt.is_set())
+      frames->Rd_opt(i) = data.Rd_opt(begin + i);
+  }
+  const gsl::matrix *src[] = {&data.lsf_vocal_tract, &data.lsf_glot, &data.hnr_glot,
+                              &data.excitation_pulses, &data.spectrum};
+  gsl::matrix *dst[] = {&frames->lsf_vocal_tract, &frames->lsf_glot, &frames->hnr_glot,
+                        &frames->excitation_pulses, &frames->spectrum};
+  size_t k;
+  for (k = 0; k < 5; k++) {
+    if (!src[k]->is_set() || src[k]->get_cols() < end) {
+      *dst[k] = gsl::matrix();
+      continue;
+    }
+    *dst[k] = gsl::matrix(src[k]->get_rows(), n);
+    for (i = 0; i < n; i++)
+      dst[k]->set_col_vec(i, src[k]->get_col_vec(begin + i));
+  }
+}
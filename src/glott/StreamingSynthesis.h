@@ -0,0 +1,114 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_STREAMINGSYNTHESIS_H_
+#define SRC_GLOTT_STREAMINGSYNTHESIS_H_
+
+#include <memory>
+#include "SynthesisKernels.h"
+
+/**
+ * Class StreamingSynthesis
+ *
+ * Frame-by-frame synthesis: features are pushed a few frames at a time
+ * and audio is pulled as soon as no later frame can change it. The output
+ * is the same as PrepareSynthesisParameters, CreateExcitation,
+ * FftFilterExcitation and GenerateUnvoicedSignal on the whole utterance.
+ *
+ * The number of frames must be known at Open(), since the pulse positions
+ * are mapped to frames over the whole utterance (and SPEED_SCALE). Audio
+ * is kept in sliding windows of a few frames; the features of the
+ * utterance are kept until Finish(). Noise gating (needs the maximum gain
+ * of the utterance) and external excitation are not supported.
+ */
+class StreamingSynthesis {
+ public:
+  StreamingSynthesis();
+  ~StreamingSynthesis();
+
+  int Open(const Param &params, const size_t &number_of_frames);
+
+  /* Append the next frames: fundf (pitch scaled), frame_energy, Rd_opt,
+   * lsf_vocal_tract, lsf_glot and hnr_glot as ReadSynthesisData fills
+   * them, plus excitation_pulses / spectrum when the configuration uses
+   * them. */
+  int PushFrames(const SynthesisData &frames);
+
+  /* Audio that became final since the last call; returns the number of
+   * samples (block is left untouched when there are none) */
+  size_t Pull(gsl::vector *block);
+
+  /* All frames pushed: complete the synthesis. The rest of the audio is
+   * then available from Pull(). */
+  int Finish();
+
+  /* Approximate delay from pushing a frame to pulling its audio, in
+   * samples */
+  size_t LatencySamples() const;
+
+ private:
+  /* Samples offset ... offset+data.size()-1 of a signal */
+  struct SignalWindow {
+    gsl::vector data;
+    size_t offset;
+    void Reset();
+    void Extend(const size_t &end);
+    void Discard(const size_t &begin);
+  };
+
+  void FinalizeFeatures();
+  void SmoothFrame(const size_t &frame_index);
+  void Process();
+  bool FilterVoiced(const size_t &frame_index, gsl::vector *frame);
+  bool GenerateUnvoiced(const size_t &frame_index, gsl::vector *frame);
+  size_t OutputReady() const;
+
+  Param params_;
+  SynthesisData data_;
+  SynthesisData unsmoothed_;
+  std::unique_ptr<ExcitationGenerator> generator_;
+  std::unique_ptr<VoicedFilterKernel<float> > voiced_float_;
+  std::unique_ptr<VoicedFilterKernel<double> > voiced_double_;
+  std::unique_ptr<UnvoicedNoiseKernel<float> > unvoiced_float_;
+  std::unique_ptr<UnvoicedNoiseKernel<double> > unvoiced_double_;
+  bool unvoiced_enabled_;
+
+  SignalWindow excitation_;
+  SignalWindow voiced_;
+  SignalWindow unvoiced_;
+  gsl::vector frame_;
+  gsl::vector noise_frame_;
+
+  size_t number_of_frames_;
+  size_t signal_length_;
+  int hop_;                  // frame shift in output samples
+  size_t lookahead_;         // frames of trajectory smoothing lookahead
+  size_t pulse_reach_;       // samples a pulse reaches around its center
+  size_t frames_received_;
+  size_t frames_final_;      // frames with post-processed features
+  size_t next_voiced_;
+  size_t next_unvoiced_;
+  size_t excitation_checked_;
+  size_t samples_pulled_;
+  size_t lsf_fixes_vt_;
+  size_t lsf_fixes_glot_;
+  size_t nan_inf_count_;
+  bool open_;
+};
+
+/* Frames begin ... end-1 of data, in the form PushFrames takes them */
+void GetSynthesisFrames(const SynthesisData &data, const size_t &begin,
+                        const size_t &end, SynthesisData *frames);
+
+#endif /* SRC_GLOTT_STREAMINGSYNTHESIS_H_ */
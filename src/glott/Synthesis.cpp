@@ -26,6 +26,8 @@
 #include <iomanip>
 
 #include <vector>
+#include <chrono>
+#include <algorithm>
 #include <gslwrap/vector_double.h>
 #include <gslwrap/vector_int.h>
 
@@ -33,60 +35,117 @@
 #include "definitions.h"
 #include "FileIo.h"
 #include "ReadConfig.h"
+#include "FixedOrderKernels.h"
+#include "FrameScheduler.h"
 #include "SpFunctions.h"
 #include "DnnClass.h"
 #include "SynthesisFunctions.h"
+#include "StreamingSynthesis.h"
 
 #include "Utils.h"
+#include "BatchProcessing.h"
 
 /*******************************************************************/
 /*                          MAIN                                   */
 /*******************************************************************/
 
-int main(int argc, char *argv[]) {
-
-
-    if (CheckCommandLineSynthesis(argc) == EXIT_FAILURE) {
+/**
+ * Streaming synthesis (STREAMING_SYNTHESIS): push the features
+ * STREAM_BLOCK_FRAMES frames at a time, as a live frontend would, and
+ * collect the audio as it becomes final.
+ */
+static int SynthesizeStreaming(const Param &params, const SynthesisData &data,
+                               gsl::vector *signal) {
+   StreamingSynthesis stream;
+   if (stream.Open(params, params.number_of_frames) == EXIT_FAILURE)
       return EXIT_FAILURE;
-    }
 
-   const char *filename = argv[1];
-   const char *default_config_filename = argv[2];
-   const char *user_config_filename = argv[3];
+   const size_t number_of_frames = params.number_of_frames;
+   const size_t block_frames = (size_t)std::max(params.stream_block_frames, 1);
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   double first_audio_time = -1.0;
+   size_t first_audio_frames = 0;
+   SynthesisData frames;
+   gsl::vector block;
+   size_t begin, end, n, i, position = 0;
+   for (begin = 0; begin <= number_of_frames; begin = end) {
+      if (begin < number_of_frames) {
+         end = std::min(begin + block_frames, number_of_frames);
+         GetSynthesisFrames(data, begin, end, &frames);
+         if (stream.PushFrames(frames) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+      } else {
+         end = number_of_frames + 1;
+         if (stream.Finish() == EXIT_FAILURE)
+            return EXIT_FAILURE;
+      }
+      n = stream.Pull(&block);
+      if (n > 0 && first_audio_time < 0.0) {
+         std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+         first_audio_time = elapsed.count();
+         first_audio_frames = std::min(end, number_of_frames);
+      }
+      for (i = 0; i < n; i++)
+         (*signal)(position + i) = block(i);
+      position += n;
+   }
 
-   std::cout << "Synthesis of " << filename << std::endl;
+   if (params.streaming_report) {
+      std::cout << "Streaming report:" << std::endl;
+      std::cout << "   block:               " << block_frames << " frames" << std::endl;
+      std::cout << "   time to first audio: " << first_audio_time << " s (after "
+                << first_audio_frames << " frames)" << std::endl;
+      std::cout << "   latency:             " << stream.LatencySamples() << " samples ("
+                << 1000.0*stream.LatencySamples()/params.fs << " ms)" << std::endl;
+   }
+   return EXIT_SUCCESS;
+}
 
-   /* Read configuration file */
-   Param params;
-   if (ReadConfig(default_config_filename, true, &params) == EXIT_FAILURE)
+static int SynthesizeFileStreaming(const Param &params, SynthesisData *data) {
+   gsl::vector signal(params.signal_length, true);
+   if (SynthesizeStreaming(params, *data, &signal) == EXIT_FAILURE)
       return EXIT_FAILURE;
-   if (argc > 3) {
-      if (ReadConfig(user_config_filename, false, &params) == EXIT_FAILURE)
+
+   /* Compare with the offline synthesis of the same features */
+   if (params.streaming_report) {
+      PrepareSynthesisParameters(params, data);
+      if (CreateExcitation(params, *data, &(data->excitation_signal)) == EXIT_FAILURE)
          return EXIT_FAILURE;
+      FftFilterExcitation(params, *data, &(data->signal));
+      GenerateUnvoicedSignal(params, *data, &(data->signal));
+      double max_diff = 0.0;
+      for (size_t i = 0; i < signal.size(); i++)
+         max_diff = std::max(max_diff, fabs(data->signal(i) - signal(i)));
+      std::cout << "   max abs difference to offline synthesis: " << max_diff << std::endl;
    }
 
-   SynthesisData data;
-   if(ReadSynthesisData(filename, &params, &data) == EXIT_FAILURE)
-      return EXIT_FAILURE;
+   std::string out_fname = GetParamPath("syn", ".syn.wav", params.dir_syn, params);
+   std::cout << out_fname << std::endl;
+   if(WriteWavFile(out_fname, signal, params.fs, params.wav_format, false) == EXIT_FAILURE)
+       return EXIT_FAILURE;
 
-   if(params.noise_gated_synthesis)
-      NoiseGating(params, &(data.frame_energy));
-   
-   if(params.use_postfiltering) {
-      PostFilter(params.postfilter_coefficient, params.fs, data.fundf, &(data.lsf_vocal_tract));
-   }
+   std::cout << "Finished synthesis" << std::endl;
+   return EXIT_SUCCESS;
+}
 
-   if(params.use_postfiltering || params.use_spectral_matching) {
-      PostFilter(params.postfilter_coefficient_glot, params.fs, data.fundf, &(data.lsf_glot));
-   }
+/**
+ * Synthesise one file with its own copy of the parameters
+ * (ReadSynthesisData sets the file-dependent fields).
+ */
+static int SynthesizeFile(const char *filename, Param params) {
 
-   if(params.use_trajectory_smoothing)
-      ParameterSmoothing(params, &data);
+   std::cout << "Synthesis of " << filename << std::endl;
+
+   SynthesisData data;
+   unsigned features;
+   if(SynthesisFeatures(params, &features) == EXIT_FAILURE ||
+      ReadSynthesisData(filename, features, &params, &data) == EXIT_FAILURE)
+      return EXIT_FAILURE;
 
-   /* Check LSF stability and fix if needed */
-   StabilizeLsf(&(data.lsf_vocal_tract));
-   if (params.use_spectral_matching)
-      StabilizeLsf(&(data.lsf_glot));
+   if (params.streaming_synthesis)
+      return SynthesizeFileStreaming(params, &data);
+
+   PrepareSynthesisParameters(params, &data);
 
    /* Create excitation with overlap-add or read external excitation file */
    if (CreateExcitation(params, data, &(data.excitation_signal)) == EXIT_FAILURE)
@@ -102,23 +161,86 @@ int main(int argc, char *argv[]) {
    
    //FilterExcitation(params, data, &(data.signal));
 
+   /* Keep the unfiltered signal for the double precision reference */
+   gsl::vector signal_reference;
+   bool precision_report = params.precision_report &&
+         params.compute_precision == COMPUTE_FLOAT;
+   if (precision_report)
+      signal_reference.copy(data.signal);
+
    /* FFT based filtering includes spectral matching */ 
+   std::chrono::steady_clock::time_point filter_start = std::chrono::steady_clock::now();
    FftFilterExcitation(params, data, &(data.signal));
    GenerateUnvoicedSignal(params, data, &(data.signal));
+   if (params.timing_report) {
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - filter_start;
+      PrintTimingReport("synthesis filtering", elapsed.count(), data.signal.size(),
+                        params.fs, params.num_threads);
+   }
+
+   if (precision_report) {
+      Param params_reference = params;
+      params_reference.compute_precision = COMPUTE_DOUBLE;
+      FftFilterExcitation(params_reference, data, &signal_reference);
+      GenerateUnvoicedSignal(params_reference, data, &signal_reference);
+      PrintPrecisionReport(signal_reference, data.signal);
+   }
 
 //   std::cout << "********************* cost params *********************" << data.Rd_opt << std::endl;
 
     std::string out_fname;
    out_fname = GetParamPath("exc", ".exc.wav", params.dir_exc, params);
-   if(WriteWavFile(out_fname, data.excitation_signal, params.fs) == EXIT_FAILURE)
+   if(WriteWavFile(out_fname, data.excitation_signal, params.fs, params.wav_format, false) == EXIT_FAILURE)
        return EXIT_FAILURE;
 
    out_fname = GetParamPath("syn", ".syn.wav", params.dir_syn, params);
    std::cout << out_fname << std::endl;
-   if(WriteWavFile(out_fname, data.signal, params.fs) == EXIT_FAILURE)
+   if(WriteWavFile(out_fname, data.signal, params.fs, params.wav_format, false) == EXIT_FAILURE)
        return EXIT_FAILURE;
 
    std::cout << "Finished synthesis" << std::endl;
 
    return EXIT_SUCCESS;
 }
+
+int main(int argc, char *argv[]) {
+
+   /* Batch mode: Synthesis --scp file.scp config_default.cfg (config_user.cfg) */
+   const bool batch = IsBatchCommandLine(argc, argv);
+   if (batch) {
+      argc--;
+      argv++;
+   }
+
+    if (CheckCommandLineSynthesis(argc) == EXIT_FAILURE) {
+      return EXIT_FAILURE;
+    }
+
+   const char *filename = argv[1];
+   const char *default_config_filename = argv[2];
+   const char *user_config_filename = argv[3];
+
+   /* Read configuration file */
+   Param params;
+   if (ReadConfig(default_config_filename, true, &params) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (argc > 3) {
+      if (ReadConfig(user_config_filename, false, &params) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+   }
+
+   /* Select fixed-order kernels for the configured LP orders */
+   ConfigureFixedOrderKernels(params);
+   ConfigureScheduler(params.num_threads, params.pin_threads);
+
+   if (!batch)
+      return SynthesizeFile(filename, params);
+
+   std::vector<std::string> files;
+   if (ReadScpFile(filename, &files) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+
+   return RunBatch(files, params, [](const std::string &file, const Param &file_params) {
+      return SynthesizeFile(file.c_str(), file_params);
+   });
+}
@@ -12,10 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <gslwrap/random_generator.h>
-#include <gslwrap/random_number_distribution.h>
-
 #include <gslwrap/vector_double.h>
+#include <map>
+#include <string>
+#include <vector>
 #include "definitions.h"
 #include "Utils.h"
 #include "SpFunctions.h"
@@ -24,11 +24,27 @@
 #include "FileIo.h"
 #include "DnnClass.h"
 #include "SynthesisFunctions.h"
+#include "SynthesisKernels.h"
+#include "PackedSpectrum.h"
+#include "FrameScheduler.h"
+#include "NoiseGenerator.h"
 
 void PostFilter(const double &postfilter_coefficient, const int &fs,
                 const gsl::vector &fundf, gsl::matrix *lsf) {
   if (postfilter_coefficient == 1.0) return;
 
+  std::cout << "Using LPC postfiltering with a coefficient of "
+            << postfilter_coefficient << std::endl;
+
+  PostFilter(postfilter_coefficient, fs, fundf, 0, lsf->get_cols(), lsf);
+}
+
+/* Postfilter frames begin ... end-1 only (streaming synthesis) */
+void PostFilter(const double &postfilter_coefficient, const int &fs,
+                const gsl::vector &fundf, const size_t &begin,
+                const size_t &end, gsl::matrix *lsf) {
+  if (postfilter_coefficient == 1.0) return;
+
   size_t POWER_SPECTRUM_FRAME_LEN = 4096;
   size_t frame_index, i;
   gsl::vector lsf_vec(lsf->get_rows());
@@ -42,16 +58,13 @@ void PostFilter(const double &postfilter_coefficient, const int &fs,
   // as 20 samples, should be fs adaptive?
   int POWER_SPECTRUM_WIN = rint(20 * 16000 / fs);
 
-  std::cout << "Using LPC postfiltering with a coefficient of "
-            << postfilter_coefficient << std::endl;
-
   /* Loop for every index of the LSF matrix */
-  for (frame_index = 0; frame_index < lsf->get_cols(); frame_index++) {
+  for (frame_index = begin; frame_index < end; frame_index++) {
     // skip post-filtering for unvoiced (ljuvela 2017-07-03)
     if (fundf(frame_index) == 0) continue;
 
     /* Convert LSF to LPC */
-    Lsf2Poly(lsf->get_col_vec(frame_index), &poly_vec);
+    Lsf2Poly(*lsf, frame_index, &poly_vec);
 
     /* Compute power spectrum */
     FFTRadix2(poly_vec, POWER_SPECTRUM_FRAME_LEN, &poly_fft);
@@ -236,309 +249,399 @@ gsl::vector GetDnnPulse(const size_t &pulse_len, const double &energy,
     return pulse;
 }
 
-int CreateExcitation(const Param &params, const SynthesisData &data,
-                     gsl::vector *excitation_signal) {
-  gsl::vector single_pulse_base;
-  gsl::random_generator rand_gen;
+/**
+ * Function GetExcitationDnn
+ *
+ * Excitation DNN for basename, read on first use and kept for the
+ * following files (batch mode). One copy per thread, since the network
+ * keeps its input and output buffers; packed weights (.dnnWeights) are
+ * mapped, so the copies share the page cache. Returns NULL if the network
+ * cannot be read; nothing is cached then, so a later call tries again.
+ */
+static Dnn *GetExcitationDnn(const std::string &basename) {
+  thread_local std::map<std::string, Dnn> dnn_cache;
+  std::map<std::string, Dnn>::iterator it = dnn_cache.find(basename);
+  if (it != dnn_cache.end())
+    return &(it->second);
+  Dnn &dnn = dnn_cache[basename];
+  if (dnn.ReadInfo(basename.c_str()) == EXIT_FAILURE ||
+      dnn.ReadData(basename.c_str()) == EXIT_FAILURE) {
+    std::cerr << "Error: could not load the excitation DNN " << basename << std::endl;
+    dnn_cache.erase(basename);
+    return NULL;
+  }
+  return &dnn;
+}
 
-  gsl::gaussian_random gauss_gen(rand_gen);
+/**
+ * Function LoadExcitationModels
+ *
+ * Read the excitation DNN of the calling thread ahead of the first
+ * CreateExcitation call (long-running processes).
+ */
+int LoadExcitationModels(const Param &params) {
+  if (params.excitation_method == DNN_GENERATED_EXCITATION &&
+      GetExcitationDnn(params.dnn_path_basename) == NULL)
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
 
-  Dnn excDnn;
+/* The excitation DNN takes the feature as input (order of DnnParams).
+ * SynthesisFeatures has loaded the network. */
+static bool DnnInput(const Param &params, int DnnParams::*order) {
+  if (params.excitation_method != DNN_GENERATED_EXCITATION)
+    return false;
+  const Dnn *dnn = GetExcitationDnn(params.dnn_path_basename);
+  return dnn != NULL && dnn->getInputParams().*order > 0;
+}
 
+/* Feature streams and the excitation methods and options that use them */
+struct SynthesisFeatureRule {
+  unsigned feature;
+  bool (*needed)(const Param &params);
+};
+
+static const SynthesisFeatureRule kSynthesisFeatureRules[] = {
+    {SYNTHESIS_F0, [](const Param &) { return true; }},
+    {SYNTHESIS_GAIN, [](const Param &) { return true; }},
+    {SYNTHESIS_LSF,
+     [](const Param &p) {
+       return !p.use_generic_envelope || DnnInput(p, &DnnParams::lpc_order_vt);
+     }},
+    {SYNTHESIS_SPECTRUM, [](const Param &p) { return p.use_generic_envelope; }},
+    {SYNTHESIS_SLSF,
+     [](const Param &p) {
+       return p.use_spectral_matching || DnnInput(p, &DnnParams::lpc_order_glot);
+     }},
+    {SYNTHESIS_HNR,
+     [](const Param &p) {
+       return p.noise_gain_voiced > 0.0 || DnnInput(p, &DnnParams::hnr_order);
+     }},
+    {SYNTHESIS_RD, [](const Param &p) { return DnnInput(p, &DnnParams::rd_order); }},
+    {SYNTHESIS_PULSES,
+     [](const Param &p) {
+       return p.excitation_method == PULSES_AS_FEATURES_EXCITATION;
+     }},
+};
+
+/**
+ * Function SynthesisFeatures
+ *
+ * Feature streams (SynthesisFeature flags) that the synthesis reads with
+ * these settings. The inputs of the excitation DNN are taken from its
+ * .dnnInfo, which loads the network of the calling thread; fails if the
+ * network cannot be read.
+ */
+int SynthesisFeatures(const Param &params, unsigned *features) {
+  if (LoadExcitationModels(params) == EXIT_FAILURE)
+    return EXIT_FAILURE;
+  *features = 0;
+  for (const SynthesisFeatureRule &rule : kSynthesisFeatureRules)
+    if (rule.needed(params)) *features |= rule.feature;
+  return EXIT_SUCCESS;
+}
+
+ExcitationGenerator::ExcitationGenerator(const Param &params)
+    : params_(params),
+      dnn_(NULL),
+      use_wsola_(params.use_wsola),
+      sample_index_(0),
+      pulse_prev_(1, true),
+      unvoiced_psola_flip_(false),
+      noise_(params.frame_shift * 2) {
   // Load excitation pulses
-  switch (params.excitation_method) {
+  switch (params_.excitation_method) {
     case SINGLE_PULSE_EXCITATION:
-      single_pulse_base = StdVector2GslVector(kDGLOTPULSE);
+      single_pulse_base_ = StdVector2GslVector(kDGLOTPULSE);
       break;
     case DNN_GENERATED_EXCITATION:
       // Load DNN
-      excDnn.ReadInfo(params.dnn_path_basename.c_str());
-      excDnn.ReadData(params.dnn_path_basename.c_str());
-      break;
-    case PULSES_AS_FEATURES_EXCITATION:
-      // Use the original pulses as features (no-op here)
+      dnn_ = GetExcitationDnn(params_.dnn_path_basename);
       break;
-    case EXTERNAL_EXCITATION:
-      if (ReadExternalExcitation(params.external_excitation_filename,
-                                 excitation_signal) == EXIT_FAILURE) {
-        std::cerr << "Error: failed to read excitation signal from "
-                  << params.external_excitation_filename << std::endl;
-        return EXIT_FAILURE;
-      }
-      return EXIT_SUCCESS;
-      break;
-    case IMPULSE_EXCITATION:
-      // nothing to read
+    default:
+      // Pulses as features, impulses: nothing to read
       break;
   }
-  /*  Experimental for accurate PSOLA */
-  // size_t frame_index_nx;
-  // size_t frame_index_pr = 0;
-  // double t0_pr;
-  // double t0_nx;
-
-  size_t i, frame_index, sample_index = 0;
-  gsl::vector pulse;
-  gsl::vector pulse_prev(
-      1, true);  // previous pulse for WSOLA similarity estimation
-  gsl::vector pulse_orig(1, true);
-  gsl::vector p2;
-  gsl::vector noise(params.frame_shift * 2);
-  // gsl::vector noise(params.frame_shift);
-  double T0, energy;
-  bool unvoiced_psola_flip =
-      false;  // alternatingly flip unvoiced frames in psola
 
   /* Waveform similarity PSOLA is available only when PAF waveforms haven't been
    * windowed */
-  bool use_wsola = params.use_wsola;
-  if (use_wsola && (params.paf_analysis_window != RECT ||
-                    params.use_pulse_interpolation != false)) {
-    use_wsola = false;
+  if (use_wsola_ && (params_.paf_analysis_window != RECT ||
+                     params_.use_pulse_interpolation != false)) {
+    use_wsola_ = false;
     std::cerr << "Warning: WS-PSOLA can't be used if PAF window is not NONE or "
                  "with pulse interpolation, "
               << std::endl;
   }
+}
 
-  size_t pulse_len;
-  int count;
-  while (sample_index < (size_t)params.signal_length) {
-    frame_index =
-        rint(params.speed_scale * sample_index / (params.signal_length - 1) *
-             (params.number_of_frames - 1));
+size_t ExcitationGenerator::FrameIndex() const {
+  return rint(params_.speed_scale * sample_index_ / (params_.signal_length - 1) *
+              (params_.number_of_frames - 1));
+}
 
-    /** Voiced excitation **/
-    // if(data.fundf(frame_index) > 0 || params.use_paf_unvoiced_synthesis) {
+void ExcitationGenerator::Step(const SynthesisData &data,
+                               const size_t &buffer_offset,
+                               gsl::vector *excitation) {
+  size_t frame_index, pulse_len;
+  gsl::vector pulse;
+  gsl::vector pulse_orig(1, true);
+  double T0, energy;
 
-    if (data.fundf(frame_index) > 0) {
-      double pulse_sign = 1.0;
-      if (data.fundf(frame_index) > 0) {
-        // Voiced
-        T0 = params.fs / data.fundf(frame_index);
-      } else {
-        // Unvoiced
-        int offset =
-            round(0.1 * ((double)rand_gen.uniform_int(params.frame_shift) -
-                         (double)params.frame_shift / 2));
-        // int offset = 0;
-        pulse_sign = -1.0 + 2.0 * rand_gen.uniform_int(2);
-        T0 = params.frame_shift + offset;
-        // pulse_sign /= 0.5*(double)(2*T0)/(double)params.frame_shift; //
-        // Compensate OLA gain
-      }
+  frame_index = FrameIndex();
 
-      if (params.excitation_method != SINGLE_PULSE_EXCITATION &&
-          T0 > params.paf_pulse_length)
-        T0 = params.paf_pulse_length;
-
-      /*  Experimental for accurate PSOLA */
-      // frame_index_nx = rint(params.speed_scale * (sample_index+T0) /
-      // (params.signal_length-1) * (params.number_of_frames-1));;
-      // if(data.fundf(frame_index_nx) > 0)
-      //   t0_nx = params.fs/data.fundf(frame_index_nx);
-      // else
-      //   t0_nx = (double)params.frame_shift;
-      // if(data.fundf(frame_index_pr) > 0)
-      //   t0_pr = params.fs/data.fundf(frame_index_pr);
-      // else
-      //   t0_pr = (double)params.frame_shift;
-
-      pulse_len = rint(2 * T0);
-      if (data.fundf(frame_index) == 0) pulse_len = params.paf_pulse_length;
-      energy = LogEnergy2FrameEnergy(data.frame_energy(frame_index), pulse_len);
-
-      // std::cout << "excitation method " << params.excitation_method << " "<<
-      // SINGLE_PULSE_EXCITATION << std::endl;
-
-      switch (params.excitation_method) {
-        case SINGLE_PULSE_EXCITATION:
-          pulse = GetSinglePulse(pulse_len, energy, single_pulse_base);
-          // pulse.set_all(0.0);
-          // pulse(pulse.size()/2) = 1.0;
-          // count = 1;
-          // for(i=pulse.size()/2+1;i<pulse.size()/2+10;i++) {
-          //     pulse(i) = pow(0.99,count);
-          //     count++;
-          // } // Hard-coded impulse train excitation with deficient
-          // pre-emphasis cancellation for anchor samples
+  /** Voiced excitation **/
+  // if(data.fundf(frame_index) > 0 || params_.use_paf_unvoiced_synthesis) {
 
-          ApplyWindowingFunction(HANN, &pulse);
-          // p2 = gsl::vector(pulse.size());
-          // p2.set_all(1.0);
-          // ApplyPsolaWindow(HANN, t0_pr, t0_nx, &p2);
-
-          break;
-        case IMPULSE_EXCITATION:
-          pulse = GetImpulsePulse(pulse_len, energy,
-                                  params.gif_pre_emphasis_coefficient);
+  if (data.fundf(frame_index) > 0) {
+    double pulse_sign = 1.0;
+    if (data.fundf(frame_index) > 0) {
+      // Voiced
+      T0 = params_.fs / data.fundf(frame_index);
+    } else {
+      // Unvoiced
+      int offset =
+          round(0.1 * ((double)UniformNoiseInt(params_.random_seed, NOISE_STREAM_JITTER,
+                                               sample_index_, 0, params_.frame_shift) -
+                       (double)params_.frame_shift / 2));
+      // int offset = 0;
+      pulse_sign = -1.0 + 2.0 * UniformNoiseInt(params_.random_seed, NOISE_STREAM_JITTER,
+                                                sample_index_, 1, 2);
+      T0 = params_.frame_shift + offset;
+      // pulse_sign /= 0.5*(double)(2*T0)/(double)params_.frame_shift; //
+      // Compensate OLA gain
+    }
 
-          ApplyWindowingFunction(HANN, &pulse);
+    if (params_.excitation_method != SINGLE_PULSE_EXCITATION &&
+        T0 > params_.paf_pulse_length)
+      T0 = params_.paf_pulse_length;
+
+    /*  Experimental for accurate PSOLA */
+    // frame_index_nx = rint(params_.speed_scale * (sample_index_+T0) /
+    // (params_.signal_length-1) * (params_.number_of_frames-1));;
+    // if(data.fundf(frame_index_nx) > 0)
+    //   t0_nx = params_.fs/data.fundf(frame_index_nx);
+    // else
+    //   t0_nx = (double)params_.frame_shift;
+    // if(data.fundf(frame_index_pr) > 0)
+    //   t0_pr = params_.fs/data.fundf(frame_index_pr);
+    // else
+    //   t0_pr = (double)params_.frame_shift;
+
+    pulse_len = rint(2 * T0);
+    if (data.fundf(frame_index) == 0) pulse_len = params_.paf_pulse_length;
+    energy = LogEnergy2FrameEnergy(data.frame_energy(frame_index), pulse_len);
+
+    // std::cout << "excitation method " << params_.excitation_method << " "<<
+    // SINGLE_PULSE_EXCITATION << std::endl;
+
+    switch (params_.excitation_method) {
+      case SINGLE_PULSE_EXCITATION:
+        pulse = GetSinglePulse(pulse_len, energy, single_pulse_base_);
+        // pulse.set_all(0.0);
+        // pulse(pulse.size()/2) = 1.0;
+        // count = 1;
+        // for(i=pulse.size()/2+1;i<pulse.size()/2+10;i++) {
+        //     pulse(i) = pow(0.99,count);
+        //     count++;
+        // } // Hard-coded impulse train excitation with deficient
+        // pre-emphasis cancellation for anchor samples
+
+        ApplyWindowingFunction(HANN, &pulse);
+        // p2 = gsl::vector(pulse.size());
+        // p2.set_all(1.0);
+        // ApplyPsolaWindow(HANN, t0_pr, t0_nx, &p2);
+
+        break;
+      case IMPULSE_EXCITATION:
+        pulse = GetImpulsePulse(pulse_len, energy,
+                                params_.gif_pre_emphasis_coefficient);
+
+        ApplyWindowingFunction(HANN, &pulse);
+
+        break;
+      case DNN_GENERATED_EXCITATION:
+
+        /* Waveform similarity PSOLA is available only when PAF waveforms
+         * haven't been windowed */
+        // use_wsola_ = false;
+        if (use_wsola_) {
+          // get unwindowed pulse from DNN
+          pulse = GetDnnPulse(params_.paf_pulse_length, energy, frame_index,
+                              data, *dnn_);
+          pulse = GetPulseWsola(
+              pulse, T0, energy, sample_index_, (pulse_prev_.size() == 1),
+              params_.use_wsola_pitch_shift, buffer_offset,
+              params_.signal_length, excitation);
+        } else {
+          pulse = GetDnnPulse(pulse_len, energy, frame_index, data, *dnn_);
+        }
 
-          break;
-        case DNN_GENERATED_EXCITATION:
-
-          /* Waveform similarity PSOLA is available only when PAF waveforms
-           * haven't been windowed */
-          // use_wsola = false;
-          if (use_wsola) {
-            // get unwindowed pulse from DNN
-            pulse = GetDnnPulse(params.paf_pulse_length, energy, frame_index,
-                                data, excDnn);
-            pulse = GetPulseWsola(
-                pulse, T0, energy, sample_index, (pulse_prev.size() == 1),
-                params.use_wsola_pitch_shift, excitation_signal);
+        pulse_orig = pulse;
+
+        ApplyWindowingFunction(params_.psola_windowing_function, &pulse);
+        pulse *= energy / getEnergy(pulse);
+        break;
+      case PULSES_AS_FEATURES_EXCITATION:
+        /* Waveform similarity PSOLA is available only when PAF waveforms
+         * haven't been windowed */
+        if (use_wsola_) {
+          gsl::vector pulse_full(
+              data.excitation_pulses.get_col_vec(frame_index));
+          pulse = GetPulseWsola(
+              pulse_full, T0, energy, sample_index_, (pulse_prev_.size() == 1),
+              params_.use_wsola_pitch_shift, buffer_offset,
+              params_.signal_length, excitation);
+        } else {
+          /* Scale by energy if energy normalization was used in pulse
+           * exctraction */
+          if (params_.use_paf_energy_normalization) {
+            pulse = GetExternalPulse(
+                pulse_len, params_.use_pulse_interpolation, energy,
+                frame_index, params_.psola_windowing_function,
+                data.excitation_pulses);
           } else {
-            pulse = GetDnnPulse(pulse_len, energy, frame_index, data, excDnn);
+            double nan_val = NAN;
+            pulse = GetExternalPulse(
+                pulse_len, params_.use_pulse_interpolation, nan_val,
+                frame_index, params_.psola_windowing_function,
+                data.excitation_pulses);
           }
+        }
+        pulse_orig = pulse;
+        ApplyWindowingFunction(params_.psola_windowing_function, &pulse);
+        break;
+      case EXTERNAL_EXCITATION:
+        // this is never reached
+        break;
+    }
 
-          pulse_orig = pulse;
-
-          ApplyWindowingFunction(params.psola_windowing_function, &pulse);
-          pulse *= energy / getEnergy(pulse);
-          break;
-        case PULSES_AS_FEATURES_EXCITATION:
-          /* Waveform similarity PSOLA is available only when PAF waveforms
-           * haven't been windowed */
-          if (use_wsola) {
-            gsl::vector pulse_full(
-                data.excitation_pulses.get_col_vec(frame_index));
-            pulse = GetPulseWsola(
-                pulse_full, T0, energy, sample_index, (pulse_prev.size() == 1),
-                params.use_wsola_pitch_shift, excitation_signal);
-          } else {
-            /* Scale by energy if energy normalization was used in pulse
-             * exctraction */
-            if (params.use_paf_energy_normalization) {
-              pulse = GetExternalPulse(
-                  pulse_len, params.use_pulse_interpolation, energy,
-                  frame_index, params.psola_windowing_function,
-                  data.excitation_pulses);
-            } else {
-              double nan_val = NAN;
-              pulse = GetExternalPulse(
-                  pulse_len, params.use_pulse_interpolation, nan_val,
-                  frame_index, params.psola_windowing_function,
-                  data.excitation_pulses);
-            }
-          }
-          pulse_orig = pulse;
-          ApplyWindowingFunction(params.psola_windowing_function, &pulse);
-          break;
-        case EXTERNAL_EXCITATION:
-          // this is never reached
-          break;
-      }
+    pulse *= pulse_sign;
+    OverlapAdd(pulse, sample_index_, buffer_offset, params_.signal_length, excitation);
 
-      pulse *= pulse_sign;
-      OverlapAdd(pulse, sample_index, excitation_signal);
+    sample_index_ += rint(T0);
+    // pulse_prev_ = pulse_orig; // non-windowed
+    pulse_prev_ = pulse;  // hann windowed pulse
 
-      sample_index += rint(T0);
-      // pulse_prev = pulse_orig; // non-windowed
-      pulse_prev = pulse;  // hann windowed pulse
+    /** Unvoiced excitation **/
+  } else {
+    pulse_prev_ = gsl::vector(
+        1, true);  // sets the previous pulse to undefined for WS-Psola
+    if (params_.noise_gain_unvoiced == 0.0) {
+      sample_index_ += params_.frame_shift;
+      return;
+    }
 
-      /** Unvoiced excitation **/
-    } else {
-      pulse_prev = gsl::vector(
-          1, true);  // sets the previous pulse to undefined for WS-Psola
-      if (params.noise_gain_unvoiced == 0.0) {
-        sample_index += params.frame_shift;
-        continue;
-      }
+    FillGaussianNoise(params_.random_seed, NOISE_STREAM_EXCITATION, sample_index_,
+                      &noise_);  // GSL_SIGN(tmp)*powf(fabs(tmp),2);
+    // gsl::vector noise_cpy;
+    // noise_cpy.copy(noise);
+    // Filter(std::vector<double>{1.0},std::vector<double>{1.0,
+    // -params_.gif_pre_emphasis_coefficient},noise_cpy, &noise_);
+    noise_ += -1 * getMean(noise_);
+    energy =
+        LogEnergy2FrameEnergy(data.frame_energy(frame_index), noise_.size());
+
+    switch (params_.excitation_method) {
+      case SINGLE_PULSE_EXCITATION:
+        pulse = noise_;
+        pulse *= params_.noise_gain_unvoiced * energy / getEnergy(noise_);
+        pulse /= 0.5 * (double)noise_.size() /
+                 (double)params_.frame_shift;  // Compensate OLA gain
+        ApplyWindowingFunction(HANN, &pulse);
+        break;
+      case IMPULSE_EXCITATION:
+        pulse = noise_;
+        pulse *= params_.noise_gain_unvoiced * energy / getEnergy(noise_);
+        pulse /= 0.5 * (double)noise_.size() /
+                 (double)params_.frame_shift;  // Compensate OLA gain
+        ApplyWindowingFunction(HANN, &pulse);
+        break;
+      case DNN_GENERATED_EXCITATION:
+        pulse = noise_;
+        pulse *= params_.noise_gain_unvoiced * energy / getEnergy(noise_);
+        pulse /= 0.5 * (double)noise_.size() /
+                 (double)params_.frame_shift;  // Compensate OLA gain
+        ApplyWindowingFunction(HANN, &pulse);
+        break;
+      case PULSES_AS_FEATURES_EXCITATION:
+        if (params_.use_paf_unvoiced_synthesis) {
+          int uv_pulse_len = params_.paf_pulse_length - 0;  // trim edges
+          pulse = GetExternalPulse(uv_pulse_len, false, energy, frame_index,
+                                   params_.psola_windowing_function,
+                                   data.excitation_pulses);
+
+          pulse /= 0.5 * (double)uv_pulse_len /
+                   (double)params_.frame_shift;  // Compensate OLA gain
+          // alternate between time flipping or not
+          if (unvoiced_psola_flip_) {
+            for (size_t k = 0; k < pulse.size(); k++)
+              pulse.swap_elements(k, pulse.size() - 1 - k);
+            unvoiced_psola_flip_ = false;
+          } else {
+            unvoiced_psola_flip_ = true;
+          }
+          // RandomizePhase(&pulse);
+          ApplyWindowingFunction(params_.psola_windowing_function, &pulse);
+        } else {
+          pulse = noise_;
+          pulse *= params_.noise_gain_unvoiced * energy / getEnergy(noise_);
+          pulse /= 0.5 * (double)noise_.size() /
+                   (double)params_.frame_shift;  // Compensate OLA gain
 
-      size_t i;
-      double tmp;
-      for (i = 0; i < noise.size(); i++) {
-        tmp = gauss_gen.get();
-        noise(i) = tmp;  // GSL_SIGN(tmp)*powf(fabs(tmp),2);
-      };
-      // gsl::vector noise_cpy;
-      // noise_cpy.copy(noise);
-      // Filter(std::vector<double>{1.0},std::vector<double>{1.0,
-      // -params.gif_pre_emphasis_coefficient},noise_cpy, &noise);
-      noise += -1 * getMean(noise);
-      energy =
-          LogEnergy2FrameEnergy(data.frame_energy(frame_index), noise.size());
-
-      switch (params.excitation_method) {
-        case SINGLE_PULSE_EXCITATION:
-          pulse = noise;
-          pulse *= params.noise_gain_unvoiced * energy / getEnergy(noise);
-          pulse /= 0.5 * (double)noise.size() /
-                   (double)params.frame_shift;  // Compensate OLA gain
-          ApplyWindowingFunction(HANN, &pulse);
-          break;
-        case IMPULSE_EXCITATION:
-          pulse = noise;
-          pulse *= params.noise_gain_unvoiced * energy / getEnergy(noise);
-          pulse /= 0.5 * (double)noise.size() /
-                   (double)params.frame_shift;  // Compensate OLA gain
-          ApplyWindowingFunction(HANN, &pulse);
-          break;
-        case DNN_GENERATED_EXCITATION:
-          pulse = noise;
-          pulse *= params.noise_gain_unvoiced * energy / getEnergy(noise);
-          pulse /= 0.5 * (double)noise.size() /
-                   (double)params.frame_shift;  // Compensate OLA gain
           ApplyWindowingFunction(HANN, &pulse);
-          break;
-        case PULSES_AS_FEATURES_EXCITATION:
-          if (params.use_paf_unvoiced_synthesis) {
-            int uv_pulse_len = params.paf_pulse_length - 0;  // trim edges
-            pulse = GetExternalPulse(uv_pulse_len, false, energy, frame_index,
-                                     params.psola_windowing_function,
-                                     data.excitation_pulses);
-
-            pulse /= 0.5 * (double)uv_pulse_len /
-                     (double)params.frame_shift;  // Compensate OLA gain
-            // alternate between time flipping or not
-            if (unvoiced_psola_flip) {
-              for (size_t k = 0; k < pulse.size(); k++)
-                pulse.swap_elements(k, pulse.size() - 1 - k);
-              unvoiced_psola_flip = false;
-            } else {
-              unvoiced_psola_flip = true;
-            }
-            // RandomizePhase(&pulse);
-            ApplyWindowingFunction(params.psola_windowing_function, &pulse);
-          } else {
-            pulse = noise;
-            pulse *= params.noise_gain_unvoiced * energy / getEnergy(noise);
-            pulse /= 0.5 * (double)noise.size() /
-                     (double)params.frame_shift;  // Compensate OLA gain
+        }
+        break;
+      case EXTERNAL_EXCITATION:
+        // this is never reached
+        break;
+    }
 
-            ApplyWindowingFunction(HANN, &pulse);
-          }
-          break;
-        case EXTERNAL_EXCITATION:
-          // this is never reached
-          break;
-      }
+    if (params_.use_paf_unvoiced_synthesis && params_.use_velvet_unvoiced_paf) {
+      /* Randomization inspired by velvet noise
+       * Thanks for the idea, Junichi!
+       */
+      // uniform random int from [0, params_.frame_shift], shift randomly up to
+      // half frame hop size Extreme case: unvoiced frames are placed on top
+      // of each other
+      int offset;
+      offset = round(0.5 * ((double)UniformNoiseInt(params_.random_seed,
+                                                    NOISE_STREAM_JITTER, sample_index_,
+                                                    2, params_.frame_shift) -
+                            (double)params_.frame_shift / 2));  // uniform
+      // offset = round(1.0*params_.frame_shift *
+      // GSL_MAX(gauss_gen.get(), 1.0)); // Gaussian
+      double sign = -1.0 + 2.0 * UniformNoiseInt(params_.random_seed, NOISE_STREAM_JITTER,
+                                                 sample_index_, 3, 2);
+      pulse *= sign;
+      OverlapAdd(pulse, sample_index_ + offset, buffer_offset, params_.signal_length, excitation);
+    } else {
+      // Default behaviour
+      OverlapAdd(pulse, sample_index_, buffer_offset, params_.signal_length, excitation);
+    }
 
-      if (params.use_paf_unvoiced_synthesis && params.use_velvet_unvoiced_paf) {
-        /* Randomization inspired by velvet noise
-         * Thanks for the idea, Junichi!
-         */
-        // uniform random int from [0, params.frame_shift], shift randomly up to
-        // half frame hop size Extreme case: unvoiced frames are placed on top
-        // of each other
-        int offset;
-        offset = round(0.5 * ((double)rand_gen.uniform_int(params.frame_shift) -
-                              (double)params.frame_shift / 2));  // uniform
-        // offset = round(1.0*params.frame_shift *
-        // GSL_MAX(gauss_gen.get(), 1.0)); // Gaussian
-        double sign = -1.0 + 2.0 * rand_gen.uniform_int(2);
-        pulse *= sign;
-        OverlapAdd(pulse, sample_index + offset, excitation_signal);
-      } else {
-        // Default behaviour
-        OverlapAdd(pulse, sample_index, excitation_signal);
-      }
+    sample_index_ += params_.frame_shift;
+    pulse_prev_ = gsl::vector(
+        1, true);  // sets the previous pulse to undefined for WS-Psola
+  }
+}
 
-      sample_index += params.frame_shift;
-      pulse_prev = gsl::vector(
-          1, true);  // sets the previous pulse to undefined for WS-Psola
+int CreateExcitation(const Param &params, const SynthesisData &data,
+                     gsl::vector *excitation_signal) {
+  if (params.excitation_method == EXTERNAL_EXCITATION) {
+    if (ReadExternalExcitation(params.external_excitation_filename,
+                               excitation_signal) == EXIT_FAILURE) {
+      std::cerr << "Error: failed to read excitation signal from "
+                << params.external_excitation_filename << std::endl;
+      return EXIT_FAILURE;
     }
+    return EXIT_SUCCESS;
   }
+
+  ExcitationGenerator generator(params);
+  if (!generator.Ready())
+    return EXIT_FAILURE;
+  while (!generator.Finished())
+    generator.Step(data, 0, excitation_signal);
   CheckNanInf(*excitation_signal);
 
   return EXIT_SUCCESS;
@@ -561,8 +664,6 @@ void HarmonicModification(const Param &params, const SynthesisData &data,
   gsl::vector hnr_interp(fft_mag.size());
 
   /* Noise generation */
-  gsl::random_generator rand_gen;
-  gsl::gaussian_random random_gauss_gen(rand_gen);
   ComplexVector noise_vec_fft;
   noise_vec_fft.setAllReal(1.0);
   noise_vec_fft.setAllImag(0.0);
@@ -651,8 +752,8 @@ void HarmonicModification(const Param &params, const SynthesisData &data,
       }
 
       /* Generate random Gaussian noise*/
-      for (i = 0; i < (int)noise_vec.size(); i++)
-        noise_vec(i) = random_gauss_gen.get();
+      FillGaussianNoise(params.random_seed, NOISE_STREAM_HARMONIC, frame_index,
+                        &noise_vec);
 
       /* Noise FFT with analysis window */
       noise_vec *= kbd_window;
@@ -798,145 +899,164 @@ void SpectralMatchExcitation(const Param &params, const SynthesisData &data,
   std::cout << " done." << std::endl;
 }
 
-void GenerateUnvoicedSignal(const Param &params, const SynthesisData &data,
-                            gsl::vector *signal) {
+template <typename T>
+UnvoicedNoiseKernel<T>::UnvoicedNoiseKernel(const Param &params)
+    : params_(params),
+      A_(params.lpc_order_vt + 1, true),
+      A_tilt_(params.lpc_order_glot + 1, true),
+      noise_vec_fft_(4096),  // Long FFT
+      tilt_fft_(4096),
+      vt_fft_(4096),
+      impulse_(params.frame_length),
+      imp_response_(params.frame_length),
+      b_(1) {
+  b_(0) = 1.0;
+}
+
+template <typename T>
+bool UnvoicedNoiseKernel<T>::Enabled(const Param &params) {
   /* When using pulses-as-features for unvoiced, unvoiced part is filtered as
    * voiced */
-  /*
-  if ((params.use_paf_unvoiced_synthesis &&
-       params.excitation_method == PULSES_AS_FEATURES_EXCITATION) ||
-      params.use_external_excitation)
-  { return; }
-  */
-
-  if (params.use_paf_unvoiced_synthesis &&
-      params.excitation_method == PULSES_AS_FEATURES_EXCITATION) {
-    //std::cout << "skipping unvoiced excitation generation" << std::endl;
-    return;
-  }
-
-  //std::cout << "generating unvoiced" << std::endl;
-
-  gsl::vector uv_signal((*signal).size(), true);
-  gsl::vector noise_vec(params.frame_length_unvoiced);
-  gsl::random_generator rand_gen;
-  gsl::gaussian_random random_gauss_gen(rand_gen);
-
-  gsl::vector A(params.lpc_order_vt + 1, true);
-  gsl::vector A_tilt(params.lpc_order_glot + 1, true);
+  return !(params.use_paf_unvoiced_synthesis &&
+           params.excitation_method == PULSES_AS_FEATURES_EXCITATION);
+}
 
-  ComplexVector noise_vec_fft;
+template <typename T>
+bool UnvoicedNoiseKernel<T>::Generate(const SynthesisData &data,
+                                      const size_t &frame_index,
+                                      gsl::vector *noise_vec) {
+  if (data.fundf(frame_index) != 0)
+    return false;
 
-  ComplexVector tilt_fft;
-  size_t NFFT = 4096;  // Long FFT
-  ComplexVector vt_fft(NFFT / 2 + 1);
-  gsl::vector fft_mag(NFFT / 2 + 1);
   size_t i;
+  if (!noise_vec->is_set())
+    *noise_vec = gsl::vector(params_.frame_length_unvoiced);
 
-  // for de-warping filters
-  gsl::vector impulse(params.frame_length);
-  gsl::vector imp_response(params.frame_length);
-  // gsl::vector impulse(NFFT);
-  // gsl::vector imp_response(NFFT);
-  gsl::vector b(1);
-  b(0) = 1.0;
-
-  /* Define analysis and synthesis window */
-  //double kbd_alpha = 2.3;
-  //gsl::vector kbd_window =
-  //    getKaiserBesselDerivedWindow(noise_vec.size(), kbd_alpha);
+  if (params_.use_generic_envelope) {
+    for (i = 0; i < vt_fft_.getSize(); i++)
+      vt_fft_.setBin(i, (T)data.spectrum(i, frame_index), T(0));
+    // Spectrum2MinPhase(&vt_fft_);
+  } else {
+    Lsf2Poly(data.lsf_vocal_tract, frame_index, &A_);
+    if (params_.warping_lambda_vt == 0.0) {
+      vt_fft_.Transform(A_);
+    } else {
+      /* get warped filter linear frequency response via impulse response */
+      imp_response_.set_zero();
+      impulse_.set_zero();
+      impulse_(0) = 1.0;
+      /* get inverse filter impulse response */
+      WFilter(A_, b_, impulse_, params_.warping_lambda_vt, &imp_response_);
+      vt_fft_.Transform(imp_response_);
+    }
+  }
 
-  size_t frame_index;
-  for (frame_index = 0; frame_index < params.number_of_frames; frame_index++) {
-    if (data.fundf(frame_index) == 0) {
+  if (params_.use_external_excitation) {
+    GetFrame(data.excitation_signal, frame_index,
+             rint(params_.frame_shift / params_.speed_scale), noise_vec, NULL);
+  } else {
+    FillGaussianNoise(params_.random_seed, NOISE_STREAM_UNVOICED, frame_index,
+                      noise_vec);
+  }
 
-      if (params.use_generic_envelope) {
-        for (i = 0; i < vt_fft.getSize(); i++) {
-          vt_fft.setReal(i, data.spectrum(i, frame_index));
-          vt_fft.setImag(i, 0.0);
-        }
-        // Spectrum2MinPhase(&vt_fft);
-      } else {
-        Lsf2Poly(data.lsf_vocal_tract.get_col_vec(frame_index), &A);
-        if (params.warping_lambda_vt == 0.0) {
-          FFTRadix2(A, NFFT, &vt_fft);
-        } else {
-          /* get warped filter linear frequency response via impulse response */
-          imp_response.set_zero();
-          impulse.set_zero();
-          impulse(0) = 1.0;
-          /* get inverse filter impulse response */
-          WFilter(A, b, impulse, params.warping_lambda_vt, &imp_response);
-          FFTRadix2(imp_response, NFFT, &vt_fft);
-        }
-      }
+  /* Cancel pre-emphasis if needed */
+  if (params_.unvoiced_pre_emphasis_coefficient > 0.0) {
+    gsl::vector noise_vec_copy(*noise_vec);
+    Filter(std::vector<double>{1.0},
+           std::vector<double>{
+               1.0, -1.0 * params_.unvoiced_pre_emphasis_coefficient},
+           noise_vec_copy, noise_vec);
+  }
 
-      if (params.use_external_excitation) {
-        GetFrame(data.excitation_signal, frame_index,
-                    rint(params.frame_shift / params.speed_scale), &noise_vec, NULL);
-      } else {
-        for (i = 0; i < noise_vec.size(); i++) {
-            noise_vec(i) = random_gauss_gen.get();
-        }
-      }
+  ApplyWindowingFunction(COSINE, noise_vec);
+
+  noise_vec_fft_.Transform(*noise_vec);
+  Lsf2Poly(data.lsf_glot, frame_index, &A_tilt_);
+  tilt_fft_.Transform(A_tilt_);
+
+  // Randomize phase
+  T mag;
+  T ang;
+  for (i = 0; i < noise_vec_fft_.getSize(); i++) {
+    if (params_.use_generic_envelope) {
+      mag = noise_vec_fft_.getAbs(i) * vt_fft_.getAbs(i);
+    } else if (!params_.use_spectral_matching) {
+      /* Only use vocal tract synthesis filter */
+      mag = noise_vec_fft_.getAbs(i) *
+            GSL_MIN(T(1.0) / (vt_fft_.getAbs(i)), T(10000));
+    } else {
+      /* Use both vocal tract and excitation LP envelope synthesis filters */
+      mag = noise_vec_fft_.getAbs(i) *
+            GSL_MIN(T(1.0) / (vt_fft_.getAbs(i)), T(10000)) *
+            GSL_MIN(T(1.0) / tilt_fft_.getAbs(i), T(10000));
+    }
+    ang = noise_vec_fft_.getAng(i);
 
+    noise_vec_fft_.setBin(i, mag * std::cos(ang), mag * std::sin(ang));
+  }
+  double e_target;
+  e_target = LogEnergy2FrameEnergy(data.frame_energy(frame_index),
+                                   noise_vec->size());
 
-      /* Cancel pre-emphasis if needed */
-      if (params.unvoiced_pre_emphasis_coefficient > 0.0) {
-        gsl::vector noise_vec_copy(noise_vec);
-        Filter(std::vector<double>{1.0},
-               std::vector<double>{
-                   1.0, -1.0 * params.unvoiced_pre_emphasis_coefficient},
-               noise_vec_copy, &noise_vec);
-      }
+  noise_vec_fft_.Inverse(noise_vec);
 
-      ApplyWindowingFunction(COSINE, &noise_vec);
+  ApplyWindowingFunction(COSINE, noise_vec);
+  (*noise_vec) *= params_.noise_gain_unvoiced * e_target /
+                  getEnergy(*noise_vec) / sqrt(2.0);
 
-      FFTRadix2(noise_vec, NFFT, &noise_vec_fft);
-      Lsf2Poly(data.lsf_glot.get_col_vec(frame_index), &A_tilt);
-      FFTRadix2(A_tilt, NFFT, &tilt_fft);
-
-      // Randomize phase
-      double mag;
-      double ang;
-      for (i = 0; i < noise_vec_fft.getSize(); i++) {
-        if (params.use_generic_envelope) {
-          mag = noise_vec_fft.getAbs(i) * vt_fft.getAbs(i);
-        } else if (!params.use_spectral_matching) {
-          /* Only use vocal tract synthesis filter */
-          mag = noise_vec_fft.getAbs(i) *
-                GSL_MIN(1.0 / (vt_fft.getAbs(i)), 10000);
-        } else {
-          /* Use both vocal tract and excitation LP envelope synthesis filters */
-          mag = noise_vec_fft.getAbs(i) *
-                GSL_MIN(1.0 / (vt_fft.getAbs(i)), 10000) *
-                GSL_MIN(1.0 / tilt_fft.getAbs(i), 10000);
-        }
-        ang = noise_vec_fft.getAng(i);
+  /* Normalize overlap-add window */
+  (*noise_vec) /= 0.5 * (double)noise_vec->size() / (double)params_.frame_shift;
+  return true;
+}
 
-        noise_vec_fft.setReal(i, mag * cos(double(ang)));
-        noise_vec_fft.setImag(i, mag * sin(double(ang)));
-      }
-      double e_target;
-      e_target = LogEnergy2FrameEnergy(data.frame_energy(frame_index),
-                                       noise_vec.size());
+template class UnvoicedNoiseKernel<float>;
+template class UnvoicedNoiseKernel<double>;
 
-      IFFTRadix2(noise_vec_fft, &noise_vec);
+template <typename T>
+static void GenerateUnvoicedSignalT(const Param &params,
+                                    const SynthesisData &data,
+                                    gsl::vector *signal) {
+  if (!UnvoicedNoiseKernel<T>::Enabled(params)) {
+    //std::cout << "skipping unvoiced excitation generation" << std::endl;
+    return;
+  }
 
-      ApplyWindowingFunction(COSINE, &noise_vec);
-      noise_vec *= params.noise_gain_unvoiced * e_target /
-                   getEnergy(noise_vec) / sqrt(2.0);
+  gsl::vector uv_signal((*signal).size(), true);
 
-      /* Normalize overlap-add window */
-      noise_vec /= 0.5 * (double)noise_vec.size() / (double)params.frame_shift;
-      OverlapAdd(noise_vec,
-                 frame_index * rint(params.frame_shift / params.speed_scale),
-                 &uv_signal);
+  /* Filtered noise frames of each chunk, overlap-added in frame order. The
+   * scratch of a slot is reused chunk after chunk (also when running serially),
+   * so it only ever holds one chunk. */
+  std::vector<std::vector<gsl::vector> > chunk_noise(GSL_MAX(params.num_threads, 1));
+
+  ParallelFramesOrdered(params.num_threads, params.number_of_frames,
+                        [&](size_t begin, size_t end, size_t slot) {
+    UnvoicedNoiseKernel<T> kernel(params);
+    std::vector<gsl::vector> &noise_frames = chunk_noise[slot];
+    noise_frames.clear();
+    noise_frames.resize(end - begin);
+    size_t frame_index;
+    for (frame_index = begin; frame_index < end; frame_index++)
+      kernel.Generate(data, frame_index, &noise_frames[frame_index - begin]);
+  }, [&](size_t begin, size_t end, size_t slot) {
+    size_t frame_index;
+    for (frame_index = begin; frame_index < end; frame_index++) {
+      if (data.fundf(frame_index) == 0)
+        OverlapAdd(chunk_noise[slot][frame_index - begin],
+                   frame_index * rint(params.frame_shift / params.speed_scale),
+                   &uv_signal);
     }
-  }
+  });
   (*signal) += uv_signal;
 }
 
+void GenerateUnvoicedSignal(const Param &params, const SynthesisData &data,
+                            gsl::vector *signal) {
+  if (params.compute_precision == COMPUTE_FLOAT)
+    GenerateUnvoicedSignalT<float>(params, data, signal);
+  else
+    GenerateUnvoicedSignalT<double>(params, data, signal);
+}
+
 void NoiseGating(const Param &params, gsl::vector *frame_energy) {
   size_t i;
   double max_gain = frame_energy->max();
@@ -947,173 +1067,202 @@ void NoiseGating(const Param &params, gsl::vector *frame_energy) {
   }
 }
 
-void FftFilterExcitation(const Param &params, const SynthesisData &data,
-                         gsl::vector *signal) {
-
-  /*
-  if (params.use_waveforms_directly) {
-    size_t i;
-     for (i=0; i<data.excitation_signal.size(); i++) {
-       (*signal)(i) += data.excitation_signal(i);
-     }
-    ///signal->copy(data.excitation_signal);
-    std::cout << "Using waveforms directly, no filtering" << std::endl;;
-    return;
-  }
-  */
-
-  gsl::vector frame(params.frame_length);
-  gsl::vector excitation_frame(params.frame_length);
-
-  gsl::vector A(params.lpc_order_vt + 1, true);
-  gsl::vector A_tilt(params.lpc_order_glot + 1, true);
-  gsl::vector A_tilt_exc(params.lpc_order_glot + 1, true);
-
-  ComplexVector frame_fft;
-  ComplexVector tilt_fft;
-  ComplexVector tilt_exc_fft;
-  // ComplexVector postfilter_fft;
-  size_t NFFT = 4096;  // Long FFT
-  ComplexVector vt_fft(NFFT / 2 + 1);
-  gsl::vector frame_copy;
+template <typename T>
+VoicedFilterKernel<T>::VoicedFilterKernel(const Param &params)
+    : params_(params),
+      A_(params.lpc_order_vt + 1, true),
+      A_tilt_(params.lpc_order_glot + 1, true),
+      A_tilt_exc_(params.lpc_order_glot + 1, true),
+      frame_fft_(4096),  // Long FFT
+      tilt_fft_(4096),
+      tilt_exc_fft_(4096),
+      vt_fft_(4096),
+      vt_fft_generic_(4096 / 2 + 1),
+      impulse_(params.frame_length / 2),
+      imp_response_(params.frame_length / 2),
+      b_(1) {
+  b_(0) = 1.0;
+}
 
-  /* for de-warping filters */
-  gsl::vector impulse(params.frame_length / 2);
-  gsl::vector imp_response(params.frame_length / 2);
-  gsl::vector b(1);
-  b(0) = 1.0;
+template <typename T>
+bool VoicedFilterKernel<T>::Filter(const SynthesisData &data,
+                                   const size_t &frame_index,
+                                   const gsl::vector &excitation,
+                                   const size_t &buffer_offset,
+                                   gsl::vector *frame) {
+  bool frame_is_voiced = data.fundf(frame_index) > 0;
+  //treat_frame_as_voiced = (frame_is_voiced
+  //      || params_.use_paf_unvoiced_synthesis
+  //      || params_.use_external_excitation);
+
+  bool treat_frame_as_voiced =
+      (frame_is_voiced ||
+       (params_.use_paf_unvoiced_synthesis &&
+        params_.excitation_method == PULSES_AS_FEATURES_EXCITATION));
+  if (!treat_frame_as_voiced)
+    return false;
 
   size_t i;
   double e_target;
 
-  /* Define analysis and synthesis window */
-  double kbd_alpha = 2.3;
-  gsl::vector kbd_window =
-      getKaiserBesselDerivedWindow(frame.size(), kbd_alpha);
-
-  bool frame_is_voiced;
-  bool treat_frame_as_voiced;
-  size_t frame_index;
-  for (frame_index = 0; frame_index < (size_t)params.number_of_frames;
-       frame_index++) {
-    frame_is_voiced = data.fundf(frame_index) > 0;
-    //treat_frame_as_voiced = (frame_is_voiced
-    //      || params.use_paf_unvoiced_synthesis
-    //      || params.use_external_excitation);
-
-    treat_frame_as_voiced =
-        (frame_is_voiced ||
-         (params.use_paf_unvoiced_synthesis &&
-          params.excitation_method == PULSES_AS_FEATURES_EXCITATION));
-
-    if (treat_frame_as_voiced) {
-      /* Get spectrum of excitation */
-      GetFrame(data.excitation_signal, frame_index,
-               rint(params.frame_shift / params.speed_scale), &frame, NULL);
-
-      if (treat_frame_as_voiced && params.use_waveforms_directly) {
-         /* Copy excitation to signal as it is */
-         ApplyWindowingFunction(HANN, &frame);
-         e_target = LogEnergy2FrameEnergy(data.frame_energy(frame_index), frame.size());
-         frame *= e_target / getEnergy(frame) / sqrt(2.0);
-         /* Normalize overlap-add window */
-         frame /= 0.5 * (double)frame.size() / (double)params.frame_shift;
-         OverlapAdd(frame,
-                    frame_index * rint(params.frame_shift / params.speed_scale),
-                    signal);
-         continue; // to next frame
-      }
-
-      frame_copy.copy(frame);
-      /* Estimate excitation LP spectrum */
-      ApplyWindowingFunction(HANN, &frame_copy);
-      LPC(frame_copy, params.lpc_order_glot, &A_tilt_exc);
-      FFTRadix2(A_tilt_exc, NFFT, &tilt_exc_fft);
+  /* Get spectrum of excitation */
+  if (frame->size() != (size_t)params_.frame_length)
+    *frame = gsl::vector(params_.frame_length);
+  GetFrame(excitation, buffer_offset, params_.signal_length, frame_index,
+           rint(params_.frame_shift / params_.speed_scale), frame);
+
+  if (params_.use_waveforms_directly) {
+     /* Copy excitation to signal as it is */
+     ApplyWindowingFunction(HANN, frame);
+     e_target = LogEnergy2FrameEnergy(data.frame_energy(frame_index), frame->size());
+     (*frame) *= e_target / getEnergy(*frame) / sqrt(2.0);
+     /* Normalize overlap-add window */
+     (*frame) /= 0.5 * (double)frame->size() / (double)params_.frame_shift;
+     return true;
+  }
 
-      /* Estimate excitation spectrum */
-      ApplyWindowingFunction(COSINE, &frame);
-      FFTRadix2(frame, NFFT, &frame_fft);
+  frame_copy_.copy(*frame);
+  /* Estimate excitation LP spectrum */
+  ApplyWindowingFunction(HANN, &frame_copy_);
+  LPC(frame_copy_, params_.lpc_order_glot, &A_tilt_exc_);
+  tilt_exc_fft_.Transform(A_tilt_exc_);
+
+  /* Estimate excitation spectrum */
+  ApplyWindowingFunction(COSINE, frame);
+  frame_fft_.Transform(*frame);
+
+  if (params_.use_generic_envelope) {
+    for (i = 0; i < vt_fft_generic_.getSize(); i++) {
+      vt_fft_generic_.setReal(
+          i, data.spectrum(i, frame_index) * tilt_exc_fft_.getAbs(i));
+      vt_fft_generic_.setImag(i, 0.0);
+    }
+    Spectrum2MinPhase(&vt_fft_generic_);
+    vt_fft_.Copy(vt_fft_generic_);
+  } else {
+    /* Get spectrum of vocal tract and glot filter */
+    Lsf2Poly(data.lsf_vocal_tract, frame_index, &A_);
+    if (params_.warping_lambda_vt == 0.0) {
+      vt_fft_.Transform(A_);
+    } else {
+      // get warped filter linear frequency response via impulse response
+      imp_response_.set_zero();
+      impulse_.set_zero();
+      impulse_(0) = 1.0;
+      // get inverse filter impulse response
+      WFilter(A_, b_, impulse_, params_.warping_lambda_vt, &imp_response_);
+      vt_fft_.Transform(imp_response_);
+    }
+  }
 
-      if (params.use_generic_envelope) {
-        for (i = 0; i < vt_fft.getSize(); i++) {
-          vt_fft.setReal(
-              i, data.spectrum(i, frame_index) * tilt_exc_fft.getAbs(i));
-          vt_fft.setImag(i, 0.0);
-        }
-        Spectrum2MinPhase(&vt_fft);
+  Lsf2Poly(data.lsf_glot, frame_index, &A_tilt_);
+  tilt_fft_.Transform(A_tilt_);
+
+  T mag_vt, mag_exc, ang_vt, ang_exc, mag_tilt, ang_tilt, mag_tilt_exc,
+      ang_tilt_exc, mag, ang;
+
+  for (i = 0; i < frame_fft_.getSize(); i++) {
+    mag_vt = GSL_MIN(T(1.0) / (vt_fft_.getAbs(i)), T(10000));
+    ang_vt = T(-1.0) * vt_fft_.getAng(i);
+    mag_tilt = GSL_MIN(T(1.0) / (tilt_fft_.getAbs(i)), T(10000));
+    ang_tilt = T(-1.0) * tilt_fft_.getAng(i);
+    mag_exc = frame_fft_.getAbs(i);
+    ang_exc = frame_fft_.getAng(i);
+    mag_tilt_exc = GSL_MIN(T(1.0) / tilt_exc_fft_.getAbs(i), T(10000));
+    ang_tilt_exc = T(-1.0) * tilt_exc_fft_.getAng(i);
+
+    if (params_.use_generic_envelope) {
+      // mag = mag_exc/mag_vt/mag_tilt_exc;
+      mag = mag_exc / mag_vt;
+      ang = ang_exc + ang_vt;  // - ang_tilt + ang_tilt_exc; // Maximum
+                               // phase filtering for glottal contribution
+    } else {
+      if (params_.use_spectral_matching && frame_is_voiced) {
+        mag = mag_exc * mag_vt * mag_tilt / mag_tilt_exc;
+        ang = ang_exc + ang_vt + ang_tilt -
+              ang_tilt_exc;  // Maximum phase filtering for glottal
+                             // contribution
       } else {
-        /* Get spectrum of vocal tract and glot filter */
-        Lsf2Poly(data.lsf_vocal_tract.get_col_vec(frame_index), &A);
-        if (params.warping_lambda_vt == 0.0) {
-          FFTRadix2(A, NFFT, &vt_fft);
+        mag = mag_exc * mag_vt;
+        // mag = mag_exc*mag_vt / mag_tilt_exc; // whiten excitation
+        if (data.fundf(frame_index) > 0) {
+          ang = ang_exc + ang_vt;
         } else {
-          // get warped filter linear frequency response via impulse response
-          imp_response.set_zero();
-          impulse.set_zero();
-          impulse(0) = 1.0;
-          // get inverse filter impulse response
-          WFilter(A, b, impulse, params.warping_lambda_vt, &imp_response);
-          FFTRadix2(imp_response, NFFT, &vt_fft);
+          ang = ang_exc;  // all-pole filter starts to ring for unvoiced
+                          // (ljuvela 2017-07-03)
         }
       }
+    }
+    // Set filtered FFT values
+    frame_fft_.setBin(i, mag * std::cos(ang), mag * std::sin(ang));
+  }
 
-      Lsf2Poly(data.lsf_glot.get_col_vec(frame_index), &A_tilt);
-      FFTRadix2(A_tilt, NFFT, &tilt_fft);
-
-      double mag_vt, mag_exc, ang_vt, ang_exc, mag_tilt, ang_tilt, mag_tilt_exc,
-          ang_tilt_exc, mag, ang;
-
-      for (i = 0; i < frame_fft.getSize(); i++) {
-        mag_vt = GSL_MIN(1.0 / (vt_fft.getAbs(i)), 10000);
-        ang_vt = -1.0 * vt_fft.getAng(i);
-        mag_tilt = GSL_MIN(1.0 / (tilt_fft.getAbs(i)), 10000);
-        ang_tilt = -1.0 * tilt_fft.getAng(i);
-        mag_exc = frame_fft.getAbs(i);
-        ang_exc = frame_fft.getAng(i);
-        mag_tilt_exc = GSL_MIN(1.0 / tilt_exc_fft.getAbs(i), 10000);
-        ang_tilt_exc = -1.0 * tilt_exc_fft.getAng(i);
-
-        if (params.use_generic_envelope) {
-          // mag = mag_exc/mag_vt/mag_tilt_exc;
-          mag = mag_exc / mag_vt;
-          ang = ang_exc + ang_vt;  // - ang_tilt + ang_tilt_exc; // Maximum
-                                   // phase filtering for glottal contribution
-        } else {
-          if (params.use_spectral_matching && frame_is_voiced) {
-            mag = mag_exc * mag_vt * mag_tilt / mag_tilt_exc;
-            ang = ang_exc + ang_vt + ang_tilt -
-                  ang_tilt_exc;  // Maximum phase filtering for glottal
-                                 // contribution
-          } else {
-            mag = mag_exc * mag_vt;
-            // mag = mag_exc*mag_vt / mag_tilt_exc; // whiten excitation
-            if (data.fundf(frame_index) > 0) {
-              ang = ang_exc + ang_vt;
-            } else {
-              ang = ang_exc;  // all-pole filter starts to ring for unvoiced
-                              // (ljuvela 2017-07-03)
-            }
-          }
-        }
-        // Set filtered FFT values
-        frame_fft.setReal(i, mag * cos(double(ang)));
-        frame_fft.setImag(i, mag * sin(double(ang)));
-      }
+  frame_fft_.Inverse(frame);
+  ApplyWindowingFunction(COSINE, frame);
 
-      IFFTRadix2(frame_fft, &frame);
-      ApplyWindowingFunction(COSINE, &frame);
+  e_target =
+      LogEnergy2FrameEnergy(data.frame_energy(frame_index), frame->size());
+  (*frame) *= e_target / getEnergy(*frame) / sqrt(2.0);
 
-      e_target =
-          LogEnergy2FrameEnergy(data.frame_energy(frame_index), frame.size());
-      frame *= e_target / getEnergy(frame) / sqrt(2.0);
+  /* Normalize overlap-add window */
+  (*frame) /= 0.5 * (double)frame->size() / (double)params_.frame_shift;
+  return true;
+}
 
-      /* Normalize overlap-add window */
-      frame /= 0.5 * (double)frame.size() / (double)params.frame_shift;
-      OverlapAdd(frame,
-                 frame_index * rint(params.frame_shift / params.speed_scale),
-                 signal);
-    }
+template class VoicedFilterKernel<float>;
+template class VoicedFilterKernel<double>;
+
+template <typename T>
+static void FftFilterExcitationT(const Param &params, const SynthesisData &data,
+                                 gsl::vector *signal) {
+
+  /*
+  if (params.use_waveforms_directly) {
+    size_t i;
+     for (i=0; i<data.excitation_signal.size(); i++) {
+       (*signal)(i) += data.excitation_signal(i);
+     }
+    ///signal->copy(data.excitation_signal);
+    std::cout << "Using waveforms directly, no filtering" << std::endl;;
+    return;
   }
+  */
+
+  /* Filtered frames of each chunk, overlap-added in frame order. Frames
+   * that produce no output are left unset; the scratch is cleared for every
+   * chunk since a slot is reused chunk after chunk. */
+  std::vector<std::vector<gsl::vector> > chunk_frames(GSL_MAX(params.num_threads, 1));
+
+  ParallelFramesOrdered(params.num_threads, params.number_of_frames,
+                        [&](size_t begin, size_t end, size_t slot) {
+    VoicedFilterKernel<T> kernel(params);
+    gsl::vector frame(params.frame_length);
+    std::vector<gsl::vector> &frames = chunk_frames[slot];
+    frames.clear();
+    frames.resize(end - begin);
+    size_t frame_index;
+    for (frame_index = begin; frame_index < end; frame_index++) {
+      if (kernel.Filter(data, frame_index, data.excitation_signal, 0, &frame))
+        frames[frame_index - begin].copy(frame);
+    }
+  }, [&](size_t begin, size_t end, size_t slot) {
+    size_t frame_index;
+    for (frame_index = begin; frame_index < end; frame_index++) {
+      const gsl::vector &frame = chunk_frames[slot][frame_index - begin];
+      if (frame.is_set())
+        OverlapAdd(frame,
+                   frame_index * rint(params.frame_shift / params.speed_scale),
+                   signal);
+    }
+  });
+}
+
+void FftFilterExcitation(const Param &params, const SynthesisData &data,
+                         gsl::vector *signal) {
+  if (params.compute_precision == COMPUTE_FLOAT)
+    FftFilterExcitationT<float>(params, data, signal);
+  else
+    FftFilterExcitationT<double>(params, data, signal);
 }
 
 void FilterExcitation(const Param &params, const SynthesisData &data,
@@ -1187,3 +1336,30 @@ void FilterExcitation(const Param &params, const SynthesisData &data,
   /* Replace nan and inf values with zeros */
   CheckNanInf(*signal);
 }
+
+/**
+ * Function PrepareSynthesisParameters
+ *
+ * Feature post-processing before excitation generation: noise gating,
+ * postfiltering, trajectory smoothing and LSF stabilisation.
+ */
+void PrepareSynthesisParameters(const Param &params, SynthesisData *data) {
+  if (params.noise_gated_synthesis)
+    NoiseGating(params, &(data->frame_energy));
+
+  if (params.use_postfiltering)
+    PostFilter(params.postfilter_coefficient, params.fs, data->fundf,
+               &(data->lsf_vocal_tract));
+
+  if (params.use_postfiltering || params.use_spectral_matching)
+    PostFilter(params.postfilter_coefficient_glot, params.fs, data->fundf,
+               &(data->lsf_glot));
+
+  if (params.use_trajectory_smoothing)
+    ParameterSmoothing(params, data);
+
+  /* Check LSF stability and fix if needed */
+  StabilizeLsf(&(data->lsf_vocal_tract));
+  if (params.use_spectral_matching)
+    StabilizeLsf(&(data->lsf_glot));
+}
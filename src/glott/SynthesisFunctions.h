@@ -17,6 +17,10 @@
 
 void ParameterSmoothing(const Param &params, SynthesisData *data);
 void PostFilter(const double &postfilter_coefficient, const int &fs, const gsl::vector &fundf, gsl::matrix *lsf);
+void PostFilter(const double &postfilter_coefficient, const int &fs, const gsl::vector &fundf,
+                const size_t &begin, const size_t &end, gsl::matrix *lsf);
+int LoadExcitationModels(const Param &params);
+int SynthesisFeatures(const Param &params, unsigned *features);
 int CreateExcitation(const Param &params, const SynthesisData &data, gsl::vector *excitation_signal);
 void HarmonicModification(const Param &params, const SynthesisData &data, gsl::vector *excitation_signal);
 void SpectralMatchExcitation(const Param &params,const SynthesisData &data, gsl::vector *excitation_signal);
@@ -24,4 +28,5 @@ void GenerateUnvoicedSignal(const Param &params, const SynthesisData &data, gsl:
 void FilterExcitation(const Param &params, const SynthesisData &data, gsl::vector *signal);
 void FftFilterExcitation(const Param &params, const SynthesisData &data, gsl::vector *signal);
 void NoiseGating(const Param &params, gsl::vector *frame_energy);
+void PrepareSynthesisParameters(const Param &params, SynthesisData *data);
 #endif /* SRC_GLOTT_SYNTHESISFUNCTIONS_H_ */
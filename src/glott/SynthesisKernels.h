@@ -0,0 +1,132 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_SYNTHESISKERNELS_H_
+#define SRC_GLOTT_SYNTHESISKERNELS_H_
+
+#include "ComplexVector.h"
+#include "PackedSpectrum.h"
+
+class Dnn;
+
+/* Per-pulse and per-frame steps of the synthesis, shared by the offline
+ * functions in SynthesisFunctions.cpp and by StreamingSynthesis. Signals
+ * are passed as windows of the full signal: the buffer holds samples
+ * buffer_offset ... of a signal of params.signal_length samples. The
+ * offline functions pass the whole signal with buffer_offset 0. */
+
+/**
+ * Class ExcitationGenerator
+ *
+ * Overlap-add excitation of CreateExcitation, one pulse (voiced) or one
+ * noise frame (unvoiced) per Step(). Not for EXTERNAL_EXCITATION.
+ */
+class ExcitationGenerator {
+ public:
+  explicit ExcitationGenerator(const Param &params);
+
+  /* False if the excitation DNN could not be read */
+  bool Ready() const {
+    return dnn_ != NULL || params_.excitation_method != DNN_GENERATED_EXCITATION;
+  }
+
+  bool Finished() const {return sample_index_ >= (size_t)params_.signal_length;}
+  /* Position of the next pulse and the frame it takes its features from */
+  size_t SampleIndex() const {return sample_index_;}
+  size_t FrameIndex() const;
+
+  /* Add the next pulse to excitation. Needs the features of FrameIndex()
+   * and, for WS-PSOLA, the excitation before SampleIndex(). */
+  void Step(const SynthesisData &data, const size_t &buffer_offset,
+            gsl::vector *excitation);
+
+ private:
+  const Param &params_;
+  Dnn *dnn_;
+  gsl::vector single_pulse_base_;
+  bool use_wsola_;
+  size_t sample_index_;
+  gsl::vector pulse_prev_;  // previous pulse for WSOLA similarity estimation
+  bool unvoiced_psola_flip_;  // alternatingly flip unvoiced frames in psola
+  gsl::vector noise_;
+};
+
+/**
+ * Class VoicedFilterKernel
+ *
+ * FFT filtering of one excitation frame (FftFilterExcitation). Holds the
+ * scratch buffers, one kernel per thread.
+ */
+template <typename T>
+class VoicedFilterKernel {
+ public:
+  explicit VoicedFilterKernel(const Param &params);
+
+  /* Filter frame frame_index of excitation into frame. Returns false for
+   * frames that are not filtered as voiced. */
+  bool Filter(const SynthesisData &data, const size_t &frame_index,
+              const gsl::vector &excitation, const size_t &buffer_offset,
+              gsl::vector *frame);
+
+ private:
+  const Param &params_;
+  gsl::vector frame_copy_;
+  gsl::vector A_;
+  gsl::vector A_tilt_;
+  gsl::vector A_tilt_exc_;
+  PackedSpectrum<T> frame_fft_;
+  PackedSpectrum<T> tilt_fft_;
+  PackedSpectrum<T> tilt_exc_fft_;
+  PackedSpectrum<T> vt_fft_;
+  /* Minimum phase conversion of the generic envelope stays in double */
+  ComplexVector vt_fft_generic_;
+  /* for de-warping filters */
+  gsl::vector impulse_;
+  gsl::vector imp_response_;
+  gsl::vector b_;
+};
+
+/**
+ * Class UnvoicedNoiseKernel
+ *
+ * Spectrally shaped noise of one unvoiced frame (GenerateUnvoicedSignal).
+ * One kernel per thread.
+ */
+template <typename T>
+class UnvoicedNoiseKernel {
+ public:
+  explicit UnvoicedNoiseKernel(const Param &params);
+
+  /* false when the configuration filters unvoiced frames as voiced */
+  static bool Enabled(const Param &params);
+
+  /* Noise frame of frame_index into noise_vec. Returns false for voiced
+   * frames. */
+  bool Generate(const SynthesisData &data, const size_t &frame_index,
+                gsl::vector *noise_vec);
+
+ private:
+  const Param &params_;
+  gsl::vector A_;
+  gsl::vector A_tilt_;
+  PackedSpectrum<T> noise_vec_fft_;
+  PackedSpectrum<T> tilt_fft_;
+  PackedSpectrum<T> vt_fft_;
+  /* for de-warping filters */
+  gsl::vector impulse_;
+  gsl::vector imp_response_;
+  gsl::vector b_;
+};
+
+#endif /* SRC_GLOTT_SYNTHESISKERNELS_H_ */
@@ -0,0 +1,67 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_SYNTHESISPROTOCOL_H_
+#define SRC_GLOTT_SYNTHESISPROTOCOL_H_
+
+#include <cstdint>
+
+/* Messages of SynthesisServer on its Unix-domain socket. The socket is
+ * local, so all fields are in host byte order. A connection carries any
+ * number of request/reply pairs. python/synthesis_client.py implements the
+ * client side. */
+
+#define SYNTHESIS_PROTOCOL_MAGIC 0x544F4C47u  /* "GLOT" */
+#define SYNTHESIS_PROTOCOL_VERSION 1
+
+/* Largest accepted request (about 8 minutes at 5 ms frame shift) */
+#define SYNTHESIS_MAX_FRAMES 100000
+
+enum SynthesisRequestType {
+   SYNTHESIS_REQUEST_SYNTHESIZE = 1,
+   SYNTHESIS_REQUEST_STATS = 2
+};
+
+enum SynthesisStatus {
+   SYNTHESIS_STATUS_OK = 0,
+   SYNTHESIS_STATUS_BAD_REQUEST = 1,
+   SYNTHESIS_STATUS_FAILED = 2,
+   SYNTHESIS_STATUS_BUSY = 3
+};
+
+/* Request header. A synthesis request is followed by float32 features in
+ * the order f0, gain, rd (number_of_frames values each), then lsf, slsf and
+ * hnr, frame by frame as in the FLOAT feature files. slsf_order and
+ * hnr_order may be 0 when the configuration does not use the feature. */
+struct SynthesisRequestHeader {
+   uint32_t magic;
+   uint16_t version;
+   uint16_t type;
+   uint32_t number_of_frames;
+   uint32_t lsf_order;
+   uint32_t slsf_order;
+   uint32_t hnr_order;
+};
+
+/* Reply header, followed by payload_bytes of payload: int16 PCM for a
+ * synthesis request, text for a stats request or an error message */
+struct SynthesisReplyHeader {
+   uint32_t magic;
+   uint16_t version;
+   uint16_t status;
+   uint32_t sample_rate;
+   uint32_t payload_bytes;
+};
+
+#endif /* SRC_GLOTT_SYNTHESISPROTOCOL_H_ */
@@ -0,0 +1,628 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/***********************************************/
+/*                 INCLUDE                     */
+/***********************************************/
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <gslwrap/vector_double.h>
+
+#include "definitions.h"
+#include "FeatureBuffers.h"
+#include "FileIo.h"
+#include "ReadConfig.h"
+#include "FixedOrderKernels.h"
+#include "SpFunctions.h"
+#include "SynthesisFunctions.h"
+#include "SynthesisProtocol.h"
+#include "Utils.h"
+
+/* Latencies kept for the percentiles */
+#define LATENCY_WINDOW 4096
+
+/* Poll interval for noticing a shutdown request (ms) */
+#define ACCEPT_POLL_MS 200
+
+static std::atomic<bool> server_stop(false);
+
+static void HandleStopSignal(int) {
+   server_stop = true;
+}
+
+/**
+ * Class LatencyStats
+ *
+ * Request counters and the latencies of the last LATENCY_WINDOW requests.
+ */
+class LatencyStats {
+ public:
+   LatencyStats() : num_ok_(0), num_failed_(0), num_rejected_(0), next_(0) {}
+
+   void Add(const double &seconds, const bool &ok) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (ok)
+         num_ok_++;
+      else
+         num_failed_++;
+      if (latencies_.size() < LATENCY_WINDOW) {
+         latencies_.push_back(seconds);
+      } else {
+         latencies_[next_] = seconds;
+         next_ = (next_ + 1) % LATENCY_WINDOW;
+      }
+   }
+
+   void AddRejected() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_rejected_++;
+   }
+
+   std::string Report() {
+      std::vector<double> sorted;
+      std::ostringstream report;
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         sorted = latencies_;
+         report << "requests_ok " << num_ok_ << "\n"
+                << "requests_failed " << num_failed_ << "\n"
+                << "requests_rejected " << num_rejected_ << "\n";
+      }
+      std::sort(sorted.begin(), sorted.end());
+      report << "latency_samples " << sorted.size() << "\n";
+      if (!sorted.empty()) {
+         report << "latency_p50_ms " << 1000.0*Percentile(sorted, 0.50) << "\n"
+                << "latency_p90_ms " << 1000.0*Percentile(sorted, 0.90) << "\n"
+                << "latency_p99_ms " << 1000.0*Percentile(sorted, 0.99) << "\n"
+                << "latency_max_ms " << 1000.0*sorted.back() << "\n";
+      }
+      return report.str();
+   }
+
+ private:
+   /* Nearest-rank percentile of sorted values */
+   static double Percentile(const std::vector<double> &sorted, const double &p) {
+      size_t rank = (size_t)ceil(p*(double)sorted.size());
+      return sorted[GSL_MIN(GSL_MAX(rank, 1), sorted.size()) - 1];
+   }
+
+   std::mutex mutex_;
+   size_t num_ok_;
+   size_t num_failed_;
+   size_t num_rejected_;
+   std::vector<double> latencies_;
+   size_t next_;
+};
+
+/**
+ * Class ConnectionQueue
+ *
+ * Bounded queue of connections with a request waiting for a worker.
+ */
+class ConnectionQueue {
+ public:
+   explicit ConnectionQueue(const size_t &capacity) : capacity_(capacity), closed_(false) {}
+
+   /* Returns false if the queue is full */
+   bool Push(const int &fd) {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         if (queue_.size() >= capacity_)
+            return false;
+         queue_.push_back(fd);
+      }
+      cv_.notify_one();
+      return true;
+   }
+
+   /* Returns -1 when the queue is closed and empty */
+   int Pop() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] {return closed_ || !queue_.empty();});
+      if (queue_.empty())
+         return -1;
+      int fd = queue_.front();
+      queue_.pop_front();
+      return fd;
+   }
+
+   void Close() {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         closed_ = true;
+      }
+      cv_.notify_all();
+   }
+
+ private:
+   std::mutex mutex_;
+   std::condition_variable cv_;
+   std::deque<int> queue_;
+   size_t capacity_;
+   bool closed_;
+};
+
+/**
+ * Class IdleConnections
+ *
+ * Connections between requests, watched by the accept loop: new
+ * connections and the ones that workers hand back after a reply. A
+ * connection is handed to a worker when it has data to read and closed
+ * after SERVER_IDLE_TIMEOUT without any. Only the accept loop calls Add()
+ * and Poll(); Return() wakes it up through a pipe.
+ */
+class IdleConnections {
+ public:
+   IdleConnections() {
+      wake_[0] = wake_[1] = -1;
+   }
+
+   ~IdleConnections() {
+      for (const IdleConnection &connection : idle_)
+         close(connection.fd);
+      for (const int &fd : returned_)
+         close(fd);
+      if (wake_[0] >= 0) {
+         close(wake_[0]);
+         close(wake_[1]);
+      }
+   }
+
+   int Open() {
+      if (pipe(wake_) != 0 || fcntl(wake_[0], F_SETFL, O_NONBLOCK) != 0 ||
+          fcntl(wake_[1], F_SETFL, O_NONBLOCK) != 0) {
+         std::cerr << "Error: could not create pipe: " << strerror(errno) << std::endl;
+         return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+   }
+
+   void Add(const int &fd) {
+      IdleConnection connection;
+      connection.fd = fd;
+      connection.since = std::chrono::steady_clock::now();
+      idle_.push_back(connection);
+   }
+
+   /* From a worker, after a reply */
+   void Return(const int &fd) {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         returned_.push_back(fd);
+      }
+      const char byte = 0;
+      if (write(wake_[1], &byte, 1) < 0) {
+         /* Pipe full: the accept loop is awake anyway */
+      }
+   }
+
+   /* Wait up to ACCEPT_POLL_MS. Connections with data to read (or closed
+    * by the client) are moved to ready, the ones idle for timeout_ms
+    * (<= 0: no limit) are closed. Returns true if listen_fd can accept. */
+   bool Poll(const int &listen_fd, const int &timeout_ms, std::vector<int> *ready) {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         for (const int &fd : returned_)
+            Add(fd);
+         returned_.clear();
+      }
+      std::vector<struct pollfd> pfds(idle_.size() + 2);
+      pfds[0].fd = listen_fd;
+      pfds[1].fd = wake_[0];
+      size_t i;
+      for (i = 0; i < idle_.size(); i++)
+         pfds[i+2].fd = idle_[i].fd;
+      for (i = 0; i < pfds.size(); i++) {
+         pfds[i].events = POLLIN;
+         pfds[i].revents = 0;
+      }
+      if (poll(pfds.data(), pfds.size(), ACCEPT_POLL_MS) < 0)
+         return false;
+
+      if (pfds[1].revents != 0) {
+         char buffer[64];
+         while (read(wake_[0], buffer, sizeof(buffer)) > 0) {}
+      }
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      size_t kept = 0;
+      for (i = 0; i < idle_.size(); i++) {
+         if (pfds[i+2].revents != 0) {
+            ready->push_back(idle_[i].fd);
+         } else if (timeout_ms > 0 &&
+                    now - idle_[i].since >= std::chrono::milliseconds(timeout_ms)) {
+            close(idle_[i].fd);
+         } else {
+            idle_[kept++] = idle_[i];
+         }
+      }
+      idle_.resize(kept);
+      return (pfds[0].revents & POLLIN) != 0;
+   }
+
+ private:
+   struct IdleConnection {
+      int fd;
+      std::chrono::steady_clock::time_point since;
+   };
+
+   std::vector<IdleConnection> idle_;
+   std::mutex mutex_;
+   std::vector<int> returned_;
+   int wake_[2];
+};
+
+/* Wait until fd is readable, false on shutdown, error or when
+ * timeout_ms (<= 0: no limit) passes first. Polls in ACCEPT_POLL_MS steps
+ * to notice a shutdown request. */
+static bool WaitReadable(const int &fd, const int &timeout_ms) {
+   struct pollfd pfd;
+   pfd.fd = fd;
+   pfd.events = POLLIN;
+   std::chrono::steady_clock::time_point deadline =
+         std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+   while (!server_stop) {
+      int r = poll(&pfd, 1, ACCEPT_POLL_MS);
+      if (r > 0)
+         return true;
+      if (r < 0 && errno != EINTR)
+         return false;
+      if (timeout_ms > 0 && std::chrono::steady_clock::now() >= deadline)
+         return false;
+   }
+   return false;
+}
+
+/* Read n bytes; fails when the client closes the connection or when
+ * timeout_ms (<= 0: no limit) after start the bytes have not all arrived */
+static bool ReadFull(const int &fd, void *buffer, const size_t &n,
+                     const std::chrono::steady_clock::time_point &start, const int &timeout_ms) {
+   char *ptr = static_cast<char *>(buffer);
+   size_t done = 0;
+   while (done < n) {
+      int wait_ms = 0;
+      if (timeout_ms > 0) {
+         std::chrono::milliseconds elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start);
+         wait_ms = timeout_ms - (int)elapsed.count();
+         if (wait_ms <= 0)
+            return false;
+      }
+      if (!WaitReadable(fd, wait_ms))
+         return false;
+      ssize_t r = read(fd, ptr + done, n - done);
+      if (r < 0 && errno == EINTR)
+         continue;
+      if (r <= 0)
+         return false;
+      done += (size_t)r;
+   }
+   return true;
+}
+
+static bool WriteFull(const int &fd, const void *buffer, const size_t &n) {
+   const char *ptr = static_cast<const char *>(buffer);
+   size_t done = 0;
+   while (done < n) {
+      ssize_t r = send(fd, ptr + done, n - done, MSG_NOSIGNAL);
+      if (r < 0 && errno == EINTR)
+         continue;
+      if (r <= 0)
+         return false;
+      done += (size_t)r;
+   }
+   return true;
+}
+
+static bool SendReply(const int &fd, const SynthesisStatus &status, const int &fs,
+                      const void *payload, const size_t &payload_bytes) {
+   SynthesisReplyHeader header;
+   header.magic = SYNTHESIS_PROTOCOL_MAGIC;
+   header.version = SYNTHESIS_PROTOCOL_VERSION;
+   header.status = (uint16_t)status;
+   header.sample_rate = (uint32_t)fs;
+   header.payload_bytes = (uint32_t)payload_bytes;
+   if (!WriteFull(fd, &header, sizeof(header)))
+      return false;
+   return payload_bytes == 0 || WriteFull(fd, payload, payload_bytes);
+}
+
+static bool SendError(const int &fd, const SynthesisStatus &status, const int &fs,
+                      const std::string &message) {
+   return SendReply(fd, status, fs, message.c_str(), message.size());
+}
+
+/* Features of a synthesis request, pointing into the payload (orders
+ * only when payload is NULL) */
+static FeatureBuffers GetRequestFeatures(const SynthesisRequestHeader &header,
+                                         const float *payload) {
+   FeatureBuffers features;
+   const size_t n = header.number_of_frames;
+   features.number_of_frames = n;
+   features.lsf_order = header.lsf_order;
+   features.slsf_order = header.slsf_order;
+   features.hnr_order = header.hnr_order;
+   if (payload == NULL)
+      return features;
+   features.f0 = payload;
+   features.gain = features.f0 + n;
+   features.rd = features.gain + n;
+   features.lsf = features.rd + n;
+   features.slsf = features.lsf + n*header.lsf_order;
+   features.hnr = features.slsf + n*header.slsf_order;
+   return features;
+}
+
+/* Check the request size and the feature orders against the configuration */
+static int CheckRequestHeader(const SynthesisRequestHeader &header, const Param &params,
+                              std::string *error) {
+   if (header.number_of_frames == 0 || header.number_of_frames > SYNTHESIS_MAX_FRAMES) {
+      std::ostringstream msg;
+      msg << "number of frames must be in 1 ... " << SYNTHESIS_MAX_FRAMES;
+      *error = msg.str();
+      return EXIT_FAILURE;
+   }
+   return CheckFeatureOrders(GetRequestFeatures(header, NULL), params, error);
+}
+
+/**
+ * Function ServeRequest
+ *
+ * Read and answer one request of a connection that has data to read. The
+ * whole request has to arrive within SERVER_IDLE_TIMEOUT. Returns false if
+ * the connection cannot be used for further requests (closed by the
+ * client, timed out, write error or invalid request).
+ */
+static bool ServeRequest(const int &fd, const Param &params, LatencyStats *stats) {
+   SynthesisRequestHeader header;
+   std::vector<float> features;
+   std::vector<int16_t> pcm;
+   std::string error;
+
+   const int timeout_ms = 1000*params.server_idle_timeout;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   if (!ReadFull(fd, &header, sizeof(header), start, timeout_ms))
+      return false;
+
+   if (header.magic != SYNTHESIS_PROTOCOL_MAGIC || header.version != SYNTHESIS_PROTOCOL_VERSION) {
+      SendError(fd, SYNTHESIS_STATUS_BAD_REQUEST, params.fs, "unknown protocol");
+      return false;
+   }
+   if (header.type == SYNTHESIS_REQUEST_STATS) {
+      std::string report = stats->Report();
+      return SendReply(fd, SYNTHESIS_STATUS_OK, params.fs, report.c_str(), report.size());
+   }
+   if (header.type != SYNTHESIS_REQUEST_SYNTHESIZE ||
+       CheckRequestHeader(header, params, &error) == EXIT_FAILURE) {
+      if (error.empty())
+         error = "unknown request type";
+      /* The payload size is unknown, the connection cannot be reused */
+      SendError(fd, SYNTHESIS_STATUS_BAD_REQUEST, params.fs, error);
+      stats->Add(0.0, false);
+      return false;
+   }
+
+   size_t n_values = (size_t)header.number_of_frames*
+         (3 + header.lsf_order + header.slsf_order + header.hnr_order);
+   features.resize(n_values);
+   if (!ReadFull(fd, features.data(), n_values*sizeof(float), start, timeout_ms))
+      return false;
+
+   Param request_params = params;
+   SynthesisData data;
+   bool ok = SetSynthesisData(GetRequestFeatures(header, features.data()), &request_params,
+                              &data, &error) == EXIT_SUCCESS;
+   bool sent;
+   if (!ok) {
+      sent = SendError(fd, SYNTHESIS_STATUS_BAD_REQUEST, params.fs, error);
+   } else if (SynthesizeFeatures(request_params, &data) == EXIT_FAILURE) {
+      ok = false;
+      sent = SendError(fd, SYNTHESIS_STATUS_FAILED, params.fs, "synthesis failed");
+   } else {
+      SignalToPcm16(data.signal, &pcm);
+      sent = SendReply(fd, SYNTHESIS_STATUS_OK, params.fs, pcm.data(), pcm.size()*sizeof(int16_t));
+   }
+   if (!sent)
+      return false;
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+   stats->Add(elapsed.count(), ok);
+   return true;
+}
+
+/* A worker takes one request at a time; between requests the connection
+ * goes back to the accept loop, so idle clients do not hold a worker */
+static void WorkerLoop(const Param &params, ConnectionQueue *queue, IdleConnections *idle,
+                       LatencyStats *stats) {
+   /* If the excitation DNN cannot be read, the worker still runs: its
+    * synthesis requests get a failure reply, and each one tries to read the
+    * network again */
+   if (LoadExcitationModels(params) == EXIT_FAILURE)
+      std::cerr << "Error: worker could not load the excitation DNN" << std::endl;
+   int fd;
+   while ((fd = queue->Pop()) >= 0) {
+      if (ServeRequest(fd, params, stats))
+         idle->Return(fd);
+      else
+         close(fd);
+   }
+}
+
+static int OpenServerSocket(const char *path, const int &backlog) {
+   struct sockaddr_un addr;
+   if (strlen(path) >= sizeof(addr.sun_path)) {
+      std::cerr << "Error: socket path too long: " << path << std::endl;
+      return -1;
+   }
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd < 0) {
+      std::cerr << "Error: could not create socket: " << strerror(errno) << std::endl;
+      return -1;
+   }
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+   unlink(path);
+   if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, backlog) < 0) {
+      std::cerr << "Error: could not listen on " << path << ": " << strerror(errno) << std::endl;
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+/* Configurations that need per-file inputs cannot be served */
+static int CheckServerConfig(const Param &params) {
+   if (params.excitation_method == PULSES_AS_FEATURES_EXCITATION ||
+       params.excitation_method == EXTERNAL_EXCITATION || params.use_generic_envelope) {
+      std::cerr << "Error: SynthesisServer does not support pulses as features, "
+                << "external excitation or generic envelopes" << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+static void PrintUsageSynthesisServer() {
+   std::cout << "<><><><><><><><><><><><><><><><><><><><><><><><><><><><><><><><>"  << std::endl;
+   std::cout << "            GlottDNN - Synthesis Server                         "  << std::endl;
+   std::cout << "<><><><><><><><><><><><><><><><><><><><><><><><><><><><><><><><>"  << std::endl;
+   std::cout << "Description:                                                    "  << std::endl;
+   std::cout << "    Resident synthesis process on a Unix-domain socket          "  << std::endl;
+   std::cout << "Usage:                                                          "  << std::endl;
+   std::cout << "    SynthesisServer socket config_default.cfg (config_user.cfg) "  << std::endl;
+   std::cout << " socket              - Path of the socket to create            "  << std::endl;
+   std::cout << " config_default.cfg  - Name of the default config file          "  << std::endl;
+   std::cout << " config_user.cfg     - Name of the user config file (OPTIONAL)  "  << std::endl;
+}
+
+/*******************************************************************/
+/*                          MAIN                                   */
+/*******************************************************************/
+
+int main(int argc, char *argv[]) {
+
+   if (argc < 3 || argc > 4) {
+      PrintUsageSynthesisServer();
+      return EXIT_FAILURE;
+   }
+
+   const char *socket_path = argv[1];
+   const char *default_config_filename = argv[2];
+   const char *user_config_filename = argv[3];
+
+   /* Read configuration file */
+   Param params;
+   if (ReadConfig(default_config_filename, true, &params) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+   if (argc > 3) {
+      if (ReadConfig(user_config_filename, false, &params) == EXIT_FAILURE)
+         return EXIT_FAILURE;
+   }
+   if (CheckServerConfig(params) == EXIT_FAILURE)
+      return EXIT_FAILURE;
+
+   /* Select fixed-order kernels for the configured LP orders */
+   ConfigureFixedOrderKernels(params);
+
+   /* Requests run in parallel, each on one thread */
+   const int num_workers = GSL_MAX(params.num_threads, 1);
+   params.num_threads = 1;
+
+   int listen_fd = OpenServerSocket(socket_path, GSL_MAX(params.server_queue_length, 1));
+   if (listen_fd < 0)
+      return EXIT_FAILURE;
+
+   signal(SIGINT, HandleStopSignal);
+   signal(SIGTERM, HandleStopSignal);
+   signal(SIGPIPE, SIG_IGN);
+
+   LatencyStats stats;
+   IdleConnections idle;
+   if (idle.Open() == EXIT_FAILURE) {
+      close(listen_fd);
+      return EXIT_FAILURE;
+   }
+   ConnectionQueue queue((size_t)GSL_MAX(params.server_queue_length, 1));
+   std::vector<std::thread> workers;
+   int i;
+   for (i = 0; i < num_workers; i++)
+      workers.push_back(std::thread(WorkerLoop, std::cref(params), &queue, &idle, &stats));
+
+   std::cout << "Listening on " << socket_path << " (" << num_workers << " workers)" << std::endl;
+
+   const int timeout_ms = 1000*params.server_idle_timeout;
+   std::vector<int> ready;
+   while (!server_stop) {
+      bool can_accept = idle.Poll(listen_fd, timeout_ms, &ready);
+      for (const int &fd : ready) {
+         if (!queue.Push(fd)) {
+            /* All workers busy and the queue is full */
+            SendError(fd, SYNTHESIS_STATUS_BUSY, params.fs, "server busy");
+            stats.AddRejected();
+            close(fd);
+         }
+      }
+      ready.clear();
+      if (!can_accept)
+         continue;
+      int fd = accept(listen_fd, NULL, NULL);
+      if (fd < 0)
+         continue;
+      /* Replies to a client that does not read fail after SERVER_IDLE_TIMEOUT */
+      if (timeout_ms > 0) {
+         struct timeval timeout;
+         timeout.tv_sec = params.server_idle_timeout;
+         timeout.tv_usec = 0;
+         setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      }
+      idle.Add(fd);
+   }
+
+   queue.Close();
+   for (i = 0; i < num_workers; i++)
+      workers[i].join();
+   close(listen_fd);
+   unlink(socket_path);
+
+   std::cout << stats.Report();
+
+   return EXIT_SUCCESS;
+}
+
+/***********/
+/*   EOF   */
+/***********/
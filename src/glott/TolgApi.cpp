@@ -0,0 +1,254 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/***********************************************/
+/*                 INCLUDE                     */
+/***********************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <exception>
+#include <string>
+#include <vector>
+
+#include <gslwrap/vector_double.h>
+
+#include "definitions.h"
+#include "ReadConfig.h"
+#include "FixedOrderKernels.h"
+#include "AnalysisPipeline.h"
+#include "FeatureBuffers.h"
+#include "PulseCodec.h"
+#include "tolg.h"
+
+struct TolgParams {
+   Param params;
+};
+
+static thread_local std::string last_error;
+
+static int Fail(const std::string &error) {
+   last_error = error;
+   return TOLG_ERROR;
+}
+
+/* Values of a vector, or a matrix frame by frame, in a new float32 buffer
+ * (NULL if out of memory) */
+static float *NewFloatBuffer(const gsl::vector &v) {
+   float *buffer = (float*)malloc(GSL_MAX(v.size(), (size_t)1)*sizeof(float));
+   if (buffer == NULL)
+      return NULL;
+   size_t i;
+   for (i = 0; i < v.size(); i++)
+      buffer[i] = (float)v(i);
+   return buffer;
+}
+
+static float *NewFloatBuffer(const gsl::matrix &mat) {
+   float *buffer = (float*)malloc(GSL_MAX(mat.size1()*mat.size2(), (size_t)1)*sizeof(float));
+   if (buffer == NULL)
+      return NULL;
+   size_t i, j;
+   for (j = 0; j < mat.size2(); j++)
+      for (i = 0; i < mat.size1(); i++)
+         buffer[j*mat.size1() + i] = (float)mat(i, j);
+   return buffer;
+}
+
+extern "C" {
+
+int tolg_api_version(void) {
+   return TOLG_API_VERSION;
+}
+
+TolgParams *tolg_params_load(const char *default_config, const char *user_config) {
+   if (default_config == NULL) {
+      Fail("no configuration file");
+      return NULL;
+   }
+   TolgParams *handle = new TolgParams;
+   if (ReadConfig(default_config, true, &(handle->params)) == EXIT_FAILURE ||
+       (user_config != NULL && ReadConfig(user_config, false, &(handle->params)) == EXIT_FAILURE)) {
+      delete handle;
+      Fail("could not read the configuration");
+      return NULL;
+   }
+   /* The first configuration loaded selects the fixed-order kernels for the
+    * process. The scheduler starts its threads when first used and, in a
+    * host process, never pins them (PIN_THREADS is left to the programs). */
+   ConfigureFixedOrderKernels(handle->params);
+   return handle;
+}
+
+void tolg_params_free(TolgParams *params) {
+   delete params;
+}
+
+int tolg_params_fs(const TolgParams *params) {
+   return params == NULL ? 0 : params->params.fs;
+}
+
+int tolg_analyze(const float *pcm, size_t n_samples, const TolgParams *params,
+                 TolgFeatures *features) {
+   if (features == NULL)
+      return Fail("no output features");
+   memset(features, 0, sizeof(TolgFeatures));
+   if (pcm == NULL || params == NULL || n_samples == 0)
+      return Fail("no input signal or configuration");
+
+   try {
+      Param p = params->params;
+      if (p.use_external_f0 || p.use_external_gci)
+         return Fail("external F0 and GCI files are not supported");
+      p.signal_length = (int)n_samples;
+      p.number_of_frames = (int)ceil((double)n_samples/(double)p.frame_shift);
+
+      AnalysisData data;
+      data.signal = gsl::vector(n_samples);
+      size_t i;
+      for (i = 0; i < n_samples; i++)
+         data.signal(i) = (double)pcm[i];
+      if (data.CheckMemoryBudget(p) == EXIT_FAILURE)
+         return Fail("estimated memory exceeds MEMORY_BUDGET_MB");
+
+      SignalOutput discard = [](const std::string &, const std::string &, const gsl::vector &) {
+         return EXIT_SUCCESS;
+      };
+      SignalPolarity polarity;
+      if (AnalyseSignal(p, discard, &data, &polarity) != EXIT_SUCCESS)
+         return Fail("analysis failed");
+
+      features->number_of_frames = data.fundf.size();
+      features->lsf_order = data.lsf_vocal_tract.size1();
+      features->slsf_order = data.lsf_glot.size1();
+      features->hnr_order = data.hnr_glot.size1();
+      features->f0 = NewFloatBuffer(data.fundf);
+      features->gain = NewFloatBuffer(data.frame_energy);
+      features->rd = NewFloatBuffer(data.Rd_opt);
+      features->lsf = NewFloatBuffer(data.lsf_vocal_tract);
+      features->slsf = NewFloatBuffer(data.lsf_glot);
+      features->hnr = NewFloatBuffer(data.hnr_glot);
+      if (p.extract_pulses_as_features) {
+         features->pls_length = data.excitation_pulses.size1();
+         features->pls = NewFloatBuffer(data.excitation_pulses);
+      }
+      if (features->f0 == NULL || features->gain == NULL || features->rd == NULL ||
+          features->lsf == NULL || features->slsf == NULL || features->hnr == NULL ||
+          (p.extract_pulses_as_features && features->pls == NULL)) {
+         tolg_features_free(features);
+         return Fail("out of memory");
+      }
+   } catch (const std::exception &e) {
+      tolg_features_free(features);
+      return Fail(e.what());
+   }
+   return TOLG_OK;
+}
+
+void tolg_features_free(TolgFeatures *features) {
+   if (features == NULL)
+      return;
+   free(features->f0);
+   free(features->gain);
+   free(features->rd);
+   free(features->lsf);
+   free(features->slsf);
+   free(features->hnr);
+   free(features->pls);
+   memset(features, 0, sizeof(TolgFeatures));
+}
+
+int tolg_synthesize(const TolgFeatures *features, const TolgParams *params, float **pcm,
+                    size_t *n_samples) {
+   if (pcm == NULL || n_samples == NULL)
+      return Fail("no output signal");
+   *pcm = NULL;
+   *n_samples = 0;
+   if (features == NULL || params == NULL || features->f0 == NULL || features->gain == NULL ||
+       features->rd == NULL || features->lsf == NULL)
+      return Fail("no input features or configuration");
+
+   try {
+      Param p = params->params;
+      if (p.excitation_method == EXTERNAL_EXCITATION || p.use_generic_envelope)
+         return Fail("external excitation and generic envelopes are not supported");
+
+      FeatureBuffers buffers;
+      buffers.number_of_frames = features->number_of_frames;
+      buffers.f0 = features->f0;
+      buffers.gain = features->gain;
+      buffers.rd = features->rd;
+      buffers.lsf = features->lsf;
+      buffers.lsf_order = features->lsf_order;
+      buffers.slsf = features->slsf;
+      buffers.slsf_order = (features->slsf == NULL) ? 0 : features->slsf_order;
+      buffers.hnr = features->hnr;
+      buffers.hnr_order = (features->hnr == NULL) ? 0 : features->hnr_order;
+      buffers.pls = features->pls;
+      buffers.pls_length = (features->pls == NULL) ? 0 : features->pls_length;
+
+      std::string error;
+      SynthesisData data;
+      if (CheckFeatureOrders(buffers, p, &error) == EXIT_FAILURE ||
+          SetSynthesisData(buffers, &p, &data, &error) == EXIT_FAILURE)
+         return Fail(error);
+      if (SynthesizeFeatures(p, &data) == EXIT_FAILURE)
+         return Fail("synthesis failed");
+
+      *pcm = NewFloatBuffer(data.signal);
+      if (*pcm == NULL)
+         return Fail("out of memory");
+      *n_samples = data.signal.size();
+   } catch (const std::exception &e) {
+      return Fail(e.what());
+   }
+   return TOLG_OK;
+}
+
+void tolg_pcm_free(float *pcm) {
+   free(pcm);
+}
+
+int tolg_decode_pulses(const void *data, size_t bytes, size_t pls_length, float **pulses,
+                       size_t *n_frames) {
+   if (pulses == NULL || n_frames == NULL)
+      return Fail("no output buffer");
+   *pulses = NULL;
+   *n_frames = 0;
+   if (data == NULL || pls_length == 0 || !IsEncodedPulses(data, bytes))
+      return Fail("not an encoded pulse file");
+
+   try {
+      std::vector<float> frames;
+      if (DecodePulses(data, bytes, pls_length, &frames) == EXIT_FAILURE)
+         return Fail("could not decode the pulses");
+      *pulses = (float*)malloc(GSL_MAX(frames.size(), (size_t)1)*sizeof(float));
+      if (*pulses == NULL)
+         return Fail("out of memory");
+      std::copy(frames.begin(), frames.end(), *pulses);
+      *n_frames = frames.size()/pls_length;
+   } catch (const std::exception &e) {
+      return Fail(e.what());
+   }
+   return TOLG_OK;
+}
+
+const char *tolg_last_error(void) {
+   return last_error.c_str();
+}
+
+}  // extern "C"
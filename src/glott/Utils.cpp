@@ -13,9 +13,12 @@
 // limitations under the License.
 
 #include <gslwrap/vector_double.h>
+#include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#include <sys/resource.h>
 #include "definitions.h"
 #include "Utils.h"
 
@@ -53,6 +56,63 @@ gsl::matrix ElementDivision(const gsl::matrix &A, const gsl::matrix &B) {
    return C;
 }
 
+/**
+ * Print the deviation of a signal from a reference signal: maximum
+ * absolute error, RMS error and signal-to-error ratio in dB.
+ * Used to compare the COMPUTE_PRECISION = "FLOAT" synthesis against the
+ * double precision path.
+ */
+void PrintPrecisionReport(const gsl::vector &reference, const gsl::vector &signal) {
+   assert(reference.size() == signal.size());
+   double max_err = 0.0;
+   double err_energy = 0.0;
+   double ref_energy = 0.0;
+   double err;
+
+   for (size_t i=0; i<reference.size(); i++) {
+      err = signal(i) - reference(i);
+      if (fabs(err) > max_err)
+         max_err = fabs(err);
+      err_energy += err*err;
+      ref_energy += reference(i)*reference(i);
+   }
+
+   std::cout << "Precision report (float vs. double):" << std::endl;
+   std::cout << "   max abs error: " << max_err << std::endl;
+   if (reference.size() > 0)
+      std::cout << "   rms error:     " << sqrt(err_energy/(double)reference.size()) << std::endl;
+   if (err_energy > 0.0)
+      std::cout << "   SNR:           " << 10.0*log10(ref_energy/err_energy) << " dB" << std::endl;
+   else
+      std::cout << "   SNR:           inf (bit-exact)" << std::endl;
+}
+
+/**
+ * Peak resident set size of the process so far, in megabytes
+ */
+double PeakMemoryMb() {
+   struct rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0.0;
+   /* ru_maxrss is in kilobytes on Linux */
+   return (double)usage.ru_maxrss/1024.0;
+}
+
+/**
+ * Print the wall-clock time of a processing stage and its real-time
+ * factor (processing time / signal duration, smaller is faster)
+ */
+void PrintTimingReport(const std::string &stage, const double &seconds,
+                       const size_t &num_samples, const int &fs, const int &num_threads) {
+   double duration = (double)num_samples/(double)fs;
+   std::cout << "Timing report (" << stage << "):" << std::endl;
+   std::cout << "   threads:          " << std::max(num_threads, 1) << std::endl;
+   std::cout << "   processing time:  " << seconds << " s" << std::endl;
+   std::cout << "   signal duration:  " << duration << " s" << std::endl;
+   if (duration > 0.0)
+      std::cout << "   real-time factor: " << seconds/duration << std::endl;
+}
+
 /**
  * Replace Nan and Inf values in vector
  * Prints a warning message if invalid values are found
@@ -98,8 +158,10 @@ int CheckCommandLineAnalysis(int argc) {
       std::cout << "    source parameters using glottal inverse filtering.\n"          << std::endl;
       std::cout << "Usage:  "                                                          << std::endl;
       std::cout << "    Analysis wav_file.wav config_default.cfg (config_user.cfg)  "  << std::endl;
+      std::cout << "    Analysis --scp wav.scp config_default.cfg (config_user.cfg) "  << std::endl;
       std::cout << " wav_file.wav        - Name of the audio file to be analysed"      << std::endl;
       std::cout << " config_default.cfg  - Name of the default config file"            << std::endl;
+      std::cout << " wav.scp             - List of audio files, one per line (batch)"  << std::endl;
       std::cout << " config_user.cfg     - Name of the user config file (OPTIONAL)"    << std::endl;
       return EXIT_FAILURE;
    } else {
@@ -124,8 +186,10 @@ int CheckCommandLineSynthesis(int argc) {
       std::cout << "    Synthesis of speech signal from glottal vocoder parameters  "  << std::endl;
       std::cout << "Usage:                                                          "  << std::endl;
       std::cout << "    Synthesis basename config_default.cfg (config_user.cfg)     "  << std::endl;
+      std::cout << "    Synthesis --scp list.scp config_default.cfg (config_user.cfg)"  << std::endl;
       std::cout << " basename            - Basename for synthesized audio           "  << std::endl;
       std::cout << " config_default.cfg  - Name of the default config file          "  << std::endl;
+      std::cout << " list.scp            - List of basenames, one per line (batch)  "  << std::endl;
       std::cout << " config_user.cfg     - Name of the user config file (OPTIONAL)  "  << std::endl;
       return EXIT_FAILURE;
    } else {
@@ -14,6 +14,7 @@
 
 #ifndef UTILS_H_
 #define UTILS_H_
+#include <string>
 #include <vector>
 
 gsl::vector StdVector2GslVector(const std::vector<double> &stdvec);
@@ -25,6 +26,10 @@ int CheckCommandLineAnalysis(int argc);
 int CheckCommandLineSynthesis(int argc);
 
 void CheckNanInf(gsl::vector &vec);
+void PrintPrecisionReport(const gsl::vector &reference, const gsl::vector &signal);
+double PeakMemoryMb();
+void PrintTimingReport(const std::string &stage, const double &seconds,
+                       const size_t &num_samples, const int &fs, const int &num_threads);
 
 /* Debug functions */
 void VPrint1(const gsl::vector &vector);
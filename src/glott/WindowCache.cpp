@@ -0,0 +1,184 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gsl/gsl_math.h>
+#include <gsl/gsl_sf_bessel.h>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include "definitions.h"
+#include "SpFunctions.h"
+#include "WindowCache.h"
+
+/* Tables kept before the cache is flushed. Pitch-synchronous windows
+ * come in many lengths, outstanding WindowTablePtrs stay valid. */
+#define WINDOW_CACHE_MAX_ENTRIES 1024
+
+/* Key type for the Kaiser-Bessel derived window, outside WindowingFunctionType */
+#define WINDOW_KEY_KBD -1
+
+typedef std::tuple<int, size_t, double> WindowKey;
+
+static std::map<WindowKey, WindowTablePtr> window_cache;
+static std::mutex window_cache_mutex;
+
+WindowTable::WindowTable(size_t n) : data_(NULL), size_(n) {
+   void *ptr = NULL;
+   if (posix_memalign(&ptr, 64, GSL_MAX(n, 1)*sizeof(double)) != 0)
+      throw std::bad_alloc();
+   data_ = static_cast<double *>(ptr);
+}
+
+WindowTable::~WindowTable() {
+   free(data_);
+}
+
+static void FillWindow(const WindowingFunctionType &window_function, double *w, const size_t &len) {
+   size_t i;
+   double n = (double)len;
+   switch(window_function) {
+   case HANN :
+      for(i=0;i<len;i++)
+         w[i] = 0.5*(1.0-cos(2.0*M_PI*((double)i)/((n)-1.0)));
+      break;
+   case HAMMING :
+      for(i=0;i<len;i++)
+         w[i] = 0.53836 - 0.46164*(cos(2.0*M_PI*((double)i)/((n)-1.0)));
+      break;
+   case BLACKMAN :
+      for(i=0;i<len;i++)
+         w[i] = 0.42-0.5*cos(2.0*M_PI*((double)i)/((n)-1))+0.08*cos(4.0*M_PI*((double)i)/((n)-1.0));
+      break;
+   case COSINE :
+      for(i=0;i<len;i++)
+         w[i] = sqrt(0.5*(1.0-cos(2.0*M_PI*((double)i)/((n)-1.0))));
+      break;
+   case HANNING : // Hann window with non-zero edges
+      for(i=0;i<len;i++)
+         w[i] = 0.5*(1.0-cos(2.0*M_PI*((double)i+1.0)/((n+2.0)-1.0)));
+      break;
+   case RECT :
+      for(i=0;i<len;i++)
+         w[i] = 1.0;
+      break;
+   case NUTTALL :
+      double a0 = 0.3635819;
+      double a1 = 0.4891775;
+      double a2 = 0.1365995;
+      double a3 = 0.0106411;
+      for(i=0;i<len;i++)
+         w[i] = a0-a1*cos(2.0*M_PI*(i/((double)(n-1)))) + a2*cos(4.0*M_PI*(i/((double)(n-1)))) - a3*cos(6.0*M_PI*(i/((double)(n-1))));
+      break;
+   }
+}
+
+static void FillKbdWindow(const double &alpha, double *w, const size_t &N) {
+   double sum;
+   size_t k;
+   size_t M = N/2;
+
+   for (k=0; k<N; k++)
+      w[k] = 0.0;
+   for (k=0; k<M; k++) {
+      sum = 0.0;
+      size_t h;
+      for(h=0;h<k;h++)
+         sum += gsl_sf_bessel_I0(M_PI*alpha*sqrt(1.0-pow(2.0*(double)h/(double)(M-1)-1.0,2.0)));
+      w[k] = sqrt(sum);
+      w[N-k-1] = sqrt(sum);
+   }
+
+   /* Same scaling as gsl::vector::operator/= */
+   double max = 0.0;
+   for (k=0; k<N; k++)
+      max = GSL_MAX(max, w[k]);
+   double scale = 1/max;
+   for (k=0; k<N; k++)
+      w[k] *= scale;
+}
+
+static WindowTablePtr LookupTable(const WindowKey &key) {
+   std::lock_guard<std::mutex> lock(window_cache_mutex);
+   std::map<WindowKey, WindowTablePtr>::const_iterator it = window_cache.find(key);
+   if (it == window_cache.end())
+      return WindowTablePtr();
+   return it->second;
+}
+
+static WindowTablePtr InsertTable(const WindowKey &key, const WindowTablePtr &table) {
+   std::lock_guard<std::mutex> lock(window_cache_mutex);
+   if (window_cache.size() >= WINDOW_CACHE_MAX_ENTRIES)
+      window_cache.clear();
+   /* Another thread may have built the same table meanwhile, keep the first */
+   return window_cache.insert(std::make_pair(key, table)).first->second;
+}
+
+/**
+ * Function GetWindowTable
+ *
+ * Return the window of the given type and length, computing it on the
+ * first request. Safe to call from several threads.
+ *
+ * @param window_function
+ * @param length
+ * @return shared read-only table
+ */
+WindowTablePtr GetWindowTable(const WindowingFunctionType &window_function, const size_t &length) {
+   WindowKey key((int)window_function, length, 0.0);
+   WindowTablePtr table = LookupTable(key);
+   if (table)
+      return table;
+
+   /* Build outside the lock */
+   std::shared_ptr<WindowTable> new_table = std::make_shared<WindowTable>(length);
+   FillWindow(window_function, new_table->mutable_data(), length);
+   return InsertTable(key, new_table);
+}
+
+/**
+ * Function GetKbdWindowTable
+ *
+ * Cached Kaiser-Bessel derived window, see getKaiserBesselDerivedWindow.
+ *
+ * @param length
+ * @param alpha shape parameter
+ * @return shared read-only table
+ */
+WindowTablePtr GetKbdWindowTable(const size_t &length, const double &alpha) {
+   WindowKey key(WINDOW_KEY_KBD, length, alpha);
+   WindowTablePtr table = LookupTable(key);
+   if (table)
+      return table;
+
+   std::shared_ptr<WindowTable> new_table = std::make_shared<WindowTable>(length);
+   FillKbdWindow(alpha, new_table->mutable_data(), length);
+   return InsertTable(key, new_table);
+}
+
+void ApplyWindow(const WindowTable &window, double *x) {
+   const double *w = window.data();
+   const size_t n = window.size();
+   size_t i;
+   for(i=0;i<n;i++)
+      x[i] *= w[i];
+}
+
+void ApplyWindow(const WindowTable &window, gsl::vector *frame) {
+   assert(frame->size() >= window.size());
+   ApplyWindow(window, VectorData(frame));
+}
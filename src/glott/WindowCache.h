@@ -0,0 +1,58 @@
+// Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_GLOTT_WINDOWCACHE_H_
+#define SRC_GLOTT_WINDOWCACHE_H_
+
+#include <cstddef>
+#include <memory>
+#include <gslwrap/vector_double.h>
+#include "definitions.h"
+
+/**
+ * Class WindowTable
+ *
+ * Precomputed window of a given length, stored in a 64-byte aligned
+ * buffer. Tables are created by the window cache and shared read-only.
+ *
+ * author: @ljuvela
+ */
+class WindowTable {
+ public:
+   explicit WindowTable(size_t n);
+   ~WindowTable();
+   size_t size() const {return size_;}
+   const double *data() const {return data_;}
+   double operator[](size_t i) const {return data_[i];}
+   double *mutable_data() {return data_;}
+ private:
+   WindowTable(const WindowTable &);
+   WindowTable &operator=(const WindowTable &);
+   double *data_;
+   size_t size_;
+};
+
+typedef std::shared_ptr<const WindowTable> WindowTablePtr;
+
+/* Thread-safe lookups, keyed by (window type, length, shape parameter).
+ * The values are identical to the per-sample formulas in
+ * ApplyWindowingFunction and getKaiserBesselDerivedWindow. */
+WindowTablePtr GetWindowTable(const WindowingFunctionType &window_function, const size_t &length);
+WindowTablePtr GetKbdWindowTable(const size_t &length, const double &alpha);
+
+/* Fused kernels: x[i] *= window[i] for the first window.size() samples */
+void ApplyWindow(const WindowTable &window, double *x);
+void ApplyWindow(const WindowTable &window, gsl::vector *frame);
+
+#endif /* SRC_GLOTT_WINDOWCACHE_H_ */
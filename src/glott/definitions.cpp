@@ -14,7 +14,11 @@
 
 #include <iostream>
 #include "FileIo.h"
+#include "FeatureContainer.h"
+#include "OutputWriter.h"
+#include "PulseCodec.h"
 #include "definitions.h"
+#include "Utils.h"
 
 Param::Param() {
    /* String parameters */
@@ -106,6 +110,34 @@ Param::Param() {
    use_pitch_synchronous_analysis = false;
    save_to_datadir_root = true;
    use_generic_envelope = false;
+   use_fixed_order_kernels = true;
+   compute_precision = COMPUTE_DOUBLE;
+   precision_report = false;
+   memory_budget_mb = 0;
+   memory_report = false;
+   num_threads = 1;
+   pin_threads = false;
+   timing_report = false;
+   random_seed = 0;
+   server_queue_length = 16;
+   server_idle_timeout = 30;
+   streaming_synthesis = false;
+   stream_block_frames = 1;
+   streaming_report = false;
+   analysis_chunk_seconds = 0.0;
+   analysis_chunk_overlap_seconds = 1.0;
+   analysis_chunk_report = false;
+   feature_container = false;
+   pulse_encoding = PULSES_RAW;
+   dataset_directory = "";
+   dataset_shard_frames = 500000;
+   dataset_remove_unvoiced = true;
+   async_output = false;
+   output_queue_mb = 256;
+   output_fsync = false;
+   analysis_cache_directory = "";
+   analysis_cache_stages = false;
+   wav_format = WAV_PCM16;
    extension_gain = ".gain";
    extension_lsf = ".lsf";
    extension_lsfg = ".slsf";
@@ -117,6 +149,7 @@ Param::Param() {
    extension_syn = ".syn.wav";
    extension_wav = ".proc.wav";
    extension_rd = ".rd";
+   extension_container = ".feat";
 
 
 }
@@ -144,7 +177,6 @@ int AnalysisData::AllocateData(const Param &params) {
 	fundf = gsl::vector(params.number_of_frames,true);
 	frame_energy = gsl::vector(params.number_of_frames,true);
 	source_signal = gsl::vector(params.signal_length, true);
-    source_dev_signal = gsl::vector(params.signal_length, true);
 
 	poly_vocal_tract = gsl::matrix(params.lpc_order_vt+1,params.number_of_frames,true);
 	lsf_vocal_tract = gsl::matrix(params.lpc_order_vt,params.number_of_frames,true);
@@ -163,51 +195,169 @@ int AnalysisData::AllocateData(const Param &params) {
 	return EXIT_SUCCESS;
 }
 
+template <class V>
+static size_t VectorBytes(const V &v) {
+   return v.is_set() ? v.size()*sizeof(typename V::value_type) : 0;
+}
+
+static size_t MatrixBytes(const gsl::matrix &m) {
+   return m.is_set() ? m.size1()*m.size2()*sizeof(double) : 0;
+}
+
+/**
+ * Bytes currently held by the analysis buffers
+ */
+size_t AnalysisData::BufferBytes() const {
+   size_t bytes = 0;
+   bytes += VectorBytes(signal) + VectorBytes(fundf) + VectorBytes(frame_energy);
+   bytes += signal_pcm16.size()*sizeof(int16_t);
+   bytes += VectorBytes(gci_inds) + VectorBytes(source_signal) + VectorBytes(source_signal_iaif);
+   bytes += MatrixBytes(poly_vocal_tract) + MatrixBytes(lsf_vocal_tract);
+   bytes += MatrixBytes(poly_glot) + MatrixBytes(lsf_glot);
+   bytes += MatrixBytes(excitation_pulses) + MatrixBytes(hnr_glot) + MatrixBytes(spectrum);
+   bytes += VectorBytes(Rd_opt) + VectorBytes(Rd_opt_temp) + VectorBytes(Rd_opt_tuned);
+   bytes += VectorBytes(GCI_Reaper_gsl) + VectorBytes(F0_Reaper_gsl);
+   bytes += VectorBytes(EE) + VectorBytes(EE_tuned) + VectorBytes(EE_aligned);
+   bytes += VectorBytes(Ra) + VectorBytes(Ra_tuned) + VectorBytes(Rk) + VectorBytes(Rk_tuned);
+   bytes += VectorBytes(Rg) + VectorBytes(Rg_tuned);
+   bytes += VectorBytes(LF_excitation_pulses) + VectorBytes(LF_excitation_pulses_tuned);
+   bytes += VectorBytes(excitation_signal);
+   return bytes;
+}
+
+/**
+ * Check the estimated peak buffer memory of the analysis against
+ * MEMORY_BUDGET_MB. The estimate counts the full-length signals alive at
+ * the same time (speech, glottal source, IAIF residual or LF pulses, the
+ * filtering output and its unvoiced part, the tuned LF pulses), the 16-bit
+ * REAPER input and the per-frame feature matrices.
+ */
+int AnalysisData::CheckMemoryBudget(const Param &params) const {
+   if (params.memory_budget_mb <= 0)
+      return EXIT_SUCCESS;
+
+   const size_t signal_bytes = (size_t)params.signal_length*sizeof(double);
+   const size_t frame_values = (size_t)(2*(params.lpc_order_vt+1) + 2*(params.lpc_order_glot+1)
+         + params.hnr_order + params.paf_pulse_length + 8);
+   const size_t estimate = 5*signal_bytes + (size_t)params.signal_length*sizeof(int16_t)
+         + (size_t)params.number_of_frames*frame_values*sizeof(double);
+   const double estimate_mb = (double)estimate/(1024.0*1024.0);
+
+   if (estimate_mb > (double)params.memory_budget_mb) {
+      std::cerr << "Error: estimated analysis memory " << estimate_mb << " MB exceeds "
+                << "MEMORY_BUDGET_MB = " << params.memory_budget_mb << std::endl;
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Print the buffer memory held after a pipeline stage and the process
+ * peak RSS (MEMORY_REPORT = true). Warns when the buffers exceed
+ * MEMORY_BUDGET_MB.
+ */
+void AnalysisData::ReportMemory(const Param &params, const char *stage) const {
+   const double buffer_mb = (double)BufferBytes()/(1024.0*1024.0);
+   if (params.memory_report) {
+      std::cout << "Memory after " << stage << ": buffers " << buffer_mb
+                << " MB, peak RSS " << PeakMemoryMb() << " MB" << std::endl;
+   }
+   if (params.memory_budget_mb > 0 && buffer_mb > (double)params.memory_budget_mb) {
+      std::cerr << "Warning: analysis buffers (" << buffer_mb << " MB) exceed "
+                << "MEMORY_BUDGET_MB = " << params.memory_budget_mb << " after "
+                << stage << std::endl;
+   }
+}
+
 int AnalysisData::SaveData(const Param &params) {
+   return SaveData(params, false);
+}
+
+/**
+ * With append set, add the features to the end of the existing files
+ * (chunked analysis writes the blocks of a recording in order).
+ */
+int AnalysisData::SaveData(const Param &params, const bool &append) {
+   return SaveData(params, append, NULL);
+}
+
+/**
+ * With a writer (ASYNC_OUTPUT), the features and signals are moved to one
+ * batch of the writer thread and the function returns without waiting for
+ * the files; the saved members are left empty. Write errors are then
+ * reported by the writer.
+ */
+int AnalysisData::SaveData(const Param &params, const bool &append, OutputWriter *writer) {
 
    std::string basedir(params.data_directory) ;
    if (basedir.back() != '/')
       basedir += "/";
 
+   std::unique_ptr<OutputBatch> batch;
+   if (writer != NULL)
+      batch.reset(new OutputBatch);
+
    std::string filename;
-   if (params.extract_gain) {
-      filename = GetParamPath("gain", params.extension_gain, params.dir_gain, params);
-      WriteGslVector(filename, params.data_type, frame_energy);
-   }
-   if (params.extract_lsf_vt) {
-      filename = GetParamPath("lsf", params.extension_lsf, params.dir_lsf, params);
-      WriteGslMatrix(filename, params.data_type, lsf_vocal_tract);
-   }
-   if (params.extract_lsf_glot) {
-      filename = GetParamPath("slsf", params.extension_lsfg, params.dir_lsfg, params);
-      WriteGslMatrix(filename, params.data_type, lsf_glot);
-   }
-   if (params.extract_hnr) {
-      filename = GetParamPath("hnr", params.extension_hnr, params.dir_hnr, params);
-      WriteGslMatrix(filename, params.data_type, hnr_glot);
-   }
+   /* Chunked analysis cannot re-scale the whole signal: its blocks are
+    * clipped, the first one included */
+   auto SaveWav = [&](const std::string &fname, gsl::vector *wav_signal) {
+      const bool clip = append || params.analysis_chunk_seconds > 0.0;
+      if (batch && clip)
+         batch->AddAppendWav(fname, wav_signal, params.fs, params.wav_format, !append);
+      else if (batch)
+         batch->AddWav(fname, wav_signal, params.fs, params.wav_format);
+      else if (clip)
+         return AppendWavFile(fname, *wav_signal, params.fs, params.wav_format, !append, false);
+      else
+         return WriteWavFile(fname, *wav_signal, params.fs, params.wav_format, false);
+      return EXIT_SUCCESS;
+   };
+   /* Features go to their own files, or all to one container */
+   FeatureContainerWriter container;
+   auto SaveVector = [&](const std::string &name, const std::string &extension,
+                         const std::string &dir, gsl::vector *vector) {
+      if (params.feature_container)
+         container.AddVector(name, batch ? batch->Take(vector) : *vector);
+      else if (batch)
+         batch->AddVector(GetParamPath(name, extension, dir, params), params.data_type, vector, append);
+      else
+         WriteGslVector(GetParamPath(name, extension, dir, params), params.data_type, *vector, append);
+   };
+   auto SaveMatrix = [&](const std::string &name, const std::string &extension,
+                         const std::string &dir, gsl::matrix *matrix) {
+      if (params.feature_container)
+         container.AddMatrix(name, batch ? batch->Take(matrix) : *matrix);
+      else if (batch)
+         batch->AddMatrix(GetParamPath(name, extension, dir, params), params.data_type, matrix, append);
+      else
+         WriteGslMatrix(GetParamPath(name, extension, dir, params), params.data_type, *matrix, append);
+   };
+   if (params.extract_gain)
+      SaveVector("gain", params.extension_gain, params.dir_gain, &frame_energy);
+   if (params.extract_lsf_vt)
+      SaveMatrix("lsf", params.extension_lsf, params.dir_lsf, &lsf_vocal_tract);
+   if (params.extract_lsf_glot)
+      SaveMatrix("slsf", params.extension_lsfg, params.dir_lsfg, &lsf_glot);
+   if (params.extract_hnr)
+      SaveMatrix("hnr", params.extension_hnr, params.dir_hnr, &hnr_glot);
    if (params.extract_pulses_as_features) {
       filename = GetParamPath("pls", params.extension_paf, params.dir_paf, params);
-      //std::cout << filename << std::endl; 
-      WriteGslMatrix(filename, params.data_type, excitation_pulses);
-   }
-   if (params.extract_f0) {
-      filename = GetParamPath("f0", params.extension_f0, params.dir_f0, params);
-      WriteGslVector(filename, params.data_type, fundf);
+      if (params.feature_container)
+         container.AddPulses("pls", batch ? batch->Take(&excitation_pulses) : excitation_pulses,
+                             params.pulse_encoding);
+      else if (batch)
+         batch->AddPulses(filename, params.data_type, params.pulse_encoding, &excitation_pulses, append);
+      else
+         WritePulseFile(filename, params.data_type, params.pulse_encoding, excitation_pulses, append);
    }
+   if (params.extract_f0)
+      SaveVector("f0", params.extension_f0, params.dir_f0, &fundf);
    if (params.extract_glottal_excitation) {
       filename = GetParamPath("src", params.extension_src, params.dir_exc, params);
-      if(WriteWavFile(filename, source_signal, params.fs) == EXIT_FAILURE)
+      if(SaveWav(filename, &source_signal) == EXIT_FAILURE)
          return EXIT_FAILURE;
    }
 
-    // Calculate derivative of source_signal
-    gsl::vector source_dev_signal(source_signal.size() - 1);
-    for (size_t i = 0; i < source_signal.size() - 1; i++) {
-        double derivative = source_signal[i+1] - source_signal[i];
-        source_dev_signal[i] = derivative;
-    }
-
 
 //    if (params.extract_rd) {
 //        filename = GetParamPath("exc", params.extension_dev_src, params.dir_exc, params);
@@ -217,41 +367,41 @@ int AnalysisData::SaveData(const Param &params) {
 // Save source_dev_signal to file
     if (params.extract_rd) {
         // Write derivative of source signal to file with extension ".dev_src"
-        filename = GetParamPath("rd", params.extension_rd, params.dir_exc, params);
-        WriteGslVector(filename, params.data_type, Rd_opt);
-        filename = GetParamPath("ee", params.extension_ee, params.dir_ee, params);
-        WriteGslVector(filename, params.data_type, EE);
-
-        filename = GetParamPath("ra", params.extension_ra, params.dir_ra, params);
-        WriteGslVector(filename, params.data_type, Ra);
-
-        filename = GetParamPath("rk", params.extension_rk, params.dir_rk, params);
-        WriteGslVector(filename, params.data_type, Rk);
-
-        filename = GetParamPath("rg", params.extension_rg, params.dir_rg, params);
-        WriteGslVector(filename, params.data_type, Rg);
-
-        filename = GetParamPath("reaper_gci", params.extension_reaper_gci, params.dir_reaper_gci, params);
-        WriteGslVector(filename, params.data_type, GCI_Reaper_gsl);
-
-
-        filename = GetParamPath("reaper_f0", params.extension_reaper_f0, params.dir_reaper_f0, params);
-        WriteGslVector(filename, params.data_type, F0_Reaper_gsl);
+        SaveVector("rd", params.extension_rd, params.dir_exc, &Rd_opt);
+        SaveVector("ee", params.extension_ee, params.dir_ee, &EE);
+        SaveVector("ra", params.extension_ra, params.dir_ra, &Ra);
+        SaveVector("rk", params.extension_rk, params.dir_rk, &Rk);
+        SaveVector("rg", params.extension_rg, params.dir_rg, &Rg);
+        SaveVector("reaper_gci", params.extension_reaper_gci, params.dir_reaper_gci, &GCI_Reaper_gsl);
+        SaveVector("reaper_f0", params.extension_reaper_f0, params.dir_reaper_f0, &F0_Reaper_gsl);
     }
 
 
    if (params.extract_original_signal) {
       filename = GetParamPath("exc", params.extension_wav, params.dir_exc, params);
-      if(WriteWavFile(filename, signal, params.fs) == EXIT_FAILURE)
+      if(SaveWav(filename, &signal) == EXIT_FAILURE)
          return EXIT_FAILURE;
    }
 
     if (params.extract_gci_signal) {
-        filename = GetParamPath("gci", params.extension_gci, params.dir_gci, params);
-        WriteGslVector(filename, params.data_type, gci_inds);
+        gsl::vector gci_values(gci_inds);
+        SaveVector("gci", params.extension_gci, params.dir_gci, &gci_values);
     }
 
+   if (params.feature_container) {
+      filename = GetParamPath("feat", params.extension_container, params.dir_container, params);
+      if (batch) {
+         const DataType format = params.data_type;
+         batch->Add([container, filename, format, append](const bool &sync) {
+            return container.Write(filename, format, append, sync);
+         });
+      } else if (container.Write(filename, params.data_type, append) == EXIT_FAILURE) {
+         return EXIT_FAILURE;
+      }
+   }
 
+   if (batch)
+      writer->Submit(std::move(batch));
 
     return EXIT_SUCCESS;
 }
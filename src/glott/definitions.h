@@ -15,6 +15,8 @@
 #ifndef DEFINITIONS_H_
 #define DEFINITIONS_H_
 
+#include <cstdint>
+#include <vector>
 #include <gslwrap/vector_int.h>
 #include <gslwrap/vector_double.h>
 #include <gslwrap/matrix_double.h>
@@ -26,6 +28,12 @@ enum LpWeightingFunction {NONE, AME, STE};
 enum WindowingFunctionType {HANN, HAMMING, BLACKMAN, COSINE, HANNING, RECT, NUTTALL};
 enum ExcitationMethod {SINGLE_PULSE_EXCITATION, DNN_GENERATED_EXCITATION,
    PULSES_AS_FEATURES_EXCITATION, EXTERNAL_EXCITATION, IMPULSE_EXCITATION};
+enum ComputePrecision {COMPUTE_DOUBLE, COMPUTE_FLOAT};
+enum PulseEncoding {PULSES_RAW, PULSES_FLOAT16, PULSES_RICE};
+enum WavFormat {WAV_PCM16, WAV_FLOAT};
+/* Feature streams read for synthesis (bit flags) */
+enum SynthesisFeature {SYNTHESIS_F0 = 1, SYNTHESIS_GAIN = 2, SYNTHESIS_RD = 4, SYNTHESIS_LSF = 8,
+   SYNTHESIS_SLSF = 16, SYNTHESIS_HNR = 32, SYNTHESIS_PULSES = 64, SYNTHESIS_SPECTRUM = 128};
 
 /* Structures */
 struct Param
@@ -124,6 +132,34 @@ struct Param
 	ExcitationMethod excitation_method;
 	bool use_pitch_synchronous_analysis;
 	bool use_generic_envelope;
+	bool use_fixed_order_kernels;
+	ComputePrecision compute_precision;
+	bool precision_report;
+	int memory_budget_mb;
+	bool memory_report;
+	int num_threads;
+	bool pin_threads;
+	bool timing_report;
+	int random_seed;
+	int server_queue_length;
+	int server_idle_timeout;
+	bool streaming_synthesis;
+	int stream_block_frames;
+	bool streaming_report;
+	double analysis_chunk_seconds;
+	double analysis_chunk_overlap_seconds;
+	bool analysis_chunk_report;
+	bool feature_container;
+	PulseEncoding pulse_encoding;
+	std::string dataset_directory;
+	int dataset_shard_frames;
+	bool dataset_remove_unvoiced;
+	bool async_output;
+	int output_queue_mb;
+	bool output_fsync;
+	std::string analysis_cache_directory;
+	bool analysis_cache_stages;
+	WavFormat wav_format;
 
 	/* directory paths for storing parameters */
 	std::string dir_gain;
@@ -142,6 +178,7 @@ struct Param
     std::string dir_rg;
     std::string dir_reaper_gci;
     std::string dir_reaper_f0;
+	std::string dir_container;
 
 
 
@@ -165,26 +202,33 @@ struct Param
     std::string extension_rg = ".rg";
     std::string extension_reaper_gci = ".reaper_gci";
     std::string extension_reaper_f0 = ".reaper_f0";
+	std::string extension_container;
 
     std::string wav_filename;
 	std::string default_config_filename;
 	std::string user_config_filename;
 };
 
+class OutputWriter;
+
 /* Define analysis data variable struct*/
 struct AnalysisData {
 	AnalysisData();
 	~AnalysisData();
 	int AllocateData(const Param &params);
 	int SaveData(const Param &params);
+	int SaveData(const Param &params, const bool &append);
+	int SaveData(const Param &params, const bool &append, OutputWriter *writer);
+	size_t BufferBytes() const;
+	int CheckMemoryBudget(const Param &params) const;
+	void ReportMemory(const Param &params, const char *stage) const;
 public:
 	gsl::vector signal;
-    gsl::vector signal_tuned;
+	std::vector<int16_t> signal_pcm16;  // signal as 16-bit samples (REAPER input)
     gsl::vector fundf;
 	gsl::vector frame_energy;
 	gsl::vector_int gci_inds;
 	gsl::vector source_signal;
-    gsl::vector source_dev_signal;
 
     gsl::vector source_signal_iaif;
 
@@ -199,6 +243,7 @@ public:
     gsl::vector Rd_opt_tuned;
     gsl::vector GCI_Reaper_gsl;
     gsl::vector F0_Reaper_gsl;
+    gsl::vector F0_Reaper_times;
     gsl::vector EE;
     gsl::vector EE_tuned;
     gsl::vector Ra;
@@ -209,10 +254,8 @@ public:
     gsl::vector Rg_tuned;
     gsl::vector LF_excitation_pulses;
     gsl::vector LF_excitation_pulses_tuned;
-    gsl::vector unvoiced;
     gsl::vector EE_aligned;
     gsl::vector excitation_signal;
-    gsl::vector excitation_signal_tuned;
     gsl::matrix spectrum;
 
 	/* QMF analysis specific */
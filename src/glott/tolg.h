@@ -0,0 +1,102 @@
+/* Copyright 2016-2018 Lauri Juvela and Manu Airaksinen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * C API of libtolg: analysis and synthesis in memory, without config
+ * file juggling or feature files.
+ *
+ * Features are float32, frame by frame (n_frames x order), in the same
+ * layout as the FLOAT feature files. Buffers returned by the library are
+ * owned by the caller and released with tolg_features_free() /
+ * tolg_pcm_free(). Functions return TOLG_OK or TOLG_ERROR; the reason of
+ * the last error on the calling thread is given by tolg_last_error().
+ * Calls with the same TolgParams may run concurrently.
+ */
+
+#ifndef SRC_GLOTT_TOLG_H_
+#define SRC_GLOTT_TOLG_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TOLG_API_VERSION 1
+
+#define TOLG_OK 0
+#define TOLG_ERROR 1
+
+#if defined(__GNUC__)
+#define TOLG_EXPORT __attribute__((visibility("default")))
+#else
+#define TOLG_EXPORT
+#endif
+
+/* Configuration (opaque) */
+typedef struct TolgParams TolgParams;
+
+/* Frame-wise features of one utterance. slsf, hnr and pls are NULL with
+ * order 0 when absent. */
+typedef struct TolgFeatures {
+  size_t number_of_frames;
+  size_t lsf_order;
+  size_t slsf_order;
+  size_t hnr_order;
+  size_t pls_length;
+  float *f0;    /* number_of_frames */
+  float *gain;  /* number_of_frames */
+  float *rd;    /* number_of_frames */
+  float *lsf;   /* number_of_frames x lsf_order */
+  float *slsf;  /* number_of_frames x slsf_order */
+  float *hnr;   /* number_of_frames x hnr_order */
+  float *pls;   /* number_of_frames x pls_length */
+} TolgFeatures;
+
+TOLG_EXPORT int tolg_api_version(void);
+
+/* Read the configuration as the programs do; user_config may be NULL.
+ * Returns NULL on failure. USE_FIXED_ORDER_KERNELS is taken from the first
+ * configuration loaded in the process; PIN_THREADS is not applied. */
+TOLG_EXPORT TolgParams *tolg_params_load(const char *default_config,
+                                         const char *user_config);
+TOLG_EXPORT void tolg_params_free(TolgParams *params);
+TOLG_EXPORT int tolg_params_fs(const TolgParams *params);
+
+/* Analyse n_samples of pcm (in [-1, 1], at the configured sample rate).
+ * Pulses (pls) are returned when EXTRACT_PULSES_AS_FEATURES is set. */
+TOLG_EXPORT int tolg_analyze(const float *pcm, size_t n_samples,
+                             const TolgParams *params, TolgFeatures *features);
+TOLG_EXPORT void tolg_features_free(TolgFeatures *features);
+
+/* Synthesise from features (e.g. from tolg_analyze, or filled by the
+ * caller with its own buffers). *pcm is not re-scaled or clipped. */
+TOLG_EXPORT int tolg_synthesize(const TolgFeatures *features,
+                                const TolgParams *params, float **pcm,
+                                size_t *n_samples);
+TOLG_EXPORT void tolg_pcm_free(float *pcm);
+
+/* Decode the contents of an encoded pulse file (PULSE_ENCODING) to
+ * *n_frames x pls_length floats, released with tolg_pcm_free(). */
+TOLG_EXPORT int tolg_decode_pulses(const void *data, size_t bytes, size_t pls_length,
+                                   float **pulses, size_t *n_frames);
+
+TOLG_EXPORT const char *tolg_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_GLOTT_TOLG_H_ */
@@ -103,6 +103,10 @@ public:
 	size_t size1() const {return m->size1;}
 	///
 	size_t size2() const {return m->size2;}
+	///
+	bool is_set() const {return m != NULL;}
+	/* exchange data with another matrix without copying */
+	void swap(matrix &other) {gsl_matrix *tmp = m; m = other.m; other.m = tmp;}
    
 
 	///
@@ -103,6 +103,8 @@ public:
 	size_t size1() const {return m->size1;}
 	///
 	size_t size2() const {return m->size2;}
+	///
+	bool is_set() const {return m != NULL;}
    
 
 	///
@@ -91,6 +91,10 @@ public:
 		}
 	void copy(const vector_float& other);
 	bool is_set() const{if (gsldata) return true; else return false;}
+	/* exchange data with another vector without copying */
+	void swap(vector_float &other){gsl_vector_float *tmp=gsldata;gsldata=other.gsldata;other.gsldata=tmp;}
+	/* free the data, is_set() is false afterwards */
+	void release(){free();}
 //	void clone(vector_float& other);
 	
 //	size_t size() const {if (!gsldata) {cout << "vector_float::size vector not initialized" << endl; exit(-1);}return gsldata->size;}
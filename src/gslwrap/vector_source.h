@@ -89,6 +89,10 @@ public:
 		}
 	void copy(const vector#typeext#& other);
 	bool is_set() const{if (gsldata) return true; else return false;}
+	/* exchange data with another vector without copying */
+	void swap(vector#typeext# &other){gsl_vector#typeext# *tmp=gsldata;gsldata=other.gsldata;other.gsldata=tmp;}
+	/* free the data, is_set() is false afterwards */
+	void release(){free();}
 //	void clone(vector#typeext#& other);
 	
 //	size_t size() const {if (!gsldata) {cout << "vector#typeext#::size vector not initialized" << endl; exit(-1);}return gsldata->size;}